@@ -0,0 +1,39 @@
+#include "alloc_count.h"
+
+#ifdef ALLOC_DEBUG
+
+#include <stddef.h>
+
+//glibc's own allocator, what the wrappers below hand the work to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+//per thread, the helpers and workers allocate as they please
+static __thread unsigned long allocations;
+
+void *malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  allocations++;
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+  allocations++;
+  return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+  __libc_free(p);
+}
+
+unsigned long alloc_count(void) {
+  return allocations;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+//heap allocations made by the calling thread, built with -DALLOC_DEBUG
+//malloc, calloc and realloc are wrapped to count them, otherwise this is
+//always 0 and costs nothing
+#ifdef ALLOC_DEBUG
+unsigned long alloc_count(void);
+#else
+static inline unsigned long alloc_count(void) {
+  return 0;
+}
+#endif
+
+#endif
@@ -10,11 +10,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "font_chain.h"
+#include "glyph_cache.h"
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
 #define FONT_SIZE 20
 #define MAX_OUTPUT_LINES 30
+#define FONT_PATH "/usr/share/fonts/truetype/jetbrains-mono/JetBrainsMono-Regular.ttf"
 
 // Function to execute shell commands and capture output
 void execute_shell_command(const char *command, char *output, size_t output_size) {
@@ -36,8 +39,14 @@ void execute_shell_command(const char *command, char *output, size_t output_size
 }
 
 // Function to handle text rendering and return SDL_Texture*
-SDL_Texture* render_text(SDL_Renderer *renderer, const char *text, TTF_Font *font, SDL_Color color, SDL_Rect *rect) {
-    SDL_Surface *surface = TTF_RenderText_Solid(font, text, color);
+// Glyphs come from the glyph cache, so characters missing from the main font
+// are drawn from the fallback fonts and newlines start a new line
+SDL_Texture* render_text(SDL_Renderer *renderer, const char *text, GlyphCache *cache, SDL_Color color, SDL_Rect *rect) {
+    if (text[0] == '\0') {
+        return NULL; // Nothing to draw
+    }
+
+    SDL_Surface *surface = glyph_cache_render_text(cache, text, color);
     if (surface == NULL) {
         printf("Error rendering text: %s\n", SDL_GetError());
         return NULL;
@@ -87,10 +96,13 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    // Load font for text rendering
-    TTF_Font *font = TTF_OpenFont("/usr/share/fonts/truetype/jetbrains-mono/JetBrainsMono-Regular.ttf", FONT_SIZE);
-    if (font == NULL) {
-        printf("Error loading font: %s\n", TTF_GetError());
+    // Load fonts on a background thread, draw with the built-in bitmap font until then
+    FontChain *font_chain = font_chain_create(FONT_PATH, FONT_SIZE);
+    GlyphCache *glyph_cache = glyph_cache_create_bitmap();
+    if (font_chain == NULL || glyph_cache == NULL || font_chain_start(font_chain) < 0) {
+        printf("Error starting font loader: %s\n", SDL_GetError());
+        glyph_cache_destroy(glyph_cache);
+        font_chain_destroy(font_chain);
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         TTF_Quit();
@@ -110,6 +122,15 @@ int main(int argc, char *argv[]) {
 
     // Main loop
     while (!quit) {
+        // Switch to the real font as soon as it has been loaded
+        GlyphCache *loaded_cache = font_chain_take_cache(font_chain);
+        if (loaded_cache != NULL) {
+            glyph_cache_destroy(glyph_cache);
+            glyph_cache = loaded_cache;
+        } else {
+            glyph_cache_refresh(glyph_cache); // Picks up fallback fonts, everything is redrawn anyway
+        }
+
         // Clear the screen
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Black background
         SDL_RenderClear(renderer);
@@ -134,7 +155,7 @@ int main(int argc, char *argv[]) {
         }
 
         // Render the input buffer (command)
-        SDL_Texture *inputTexture = render_text(renderer, inputBuffer, font, textColor, &textRect);
+        SDL_Texture *inputTexture = render_text(renderer, inputBuffer, glyph_cache, textColor, &textRect);
         if (inputTexture) {
             SDL_RenderCopy(renderer, inputTexture, NULL, &textRect);
             SDL_DestroyTexture(inputTexture); // Clean up texture after rendering
@@ -142,7 +163,7 @@ int main(int argc, char *argv[]) {
 
         // Render the command output
         SDL_Rect outputRect = {10, 40, 0, 0}; // Adjust y-position to avoid overlap with input
-        SDL_Texture *outputTexture = render_text(renderer, outputBuffer, font, textColor, &outputRect);
+        SDL_Texture *outputTexture = render_text(renderer, outputBuffer, glyph_cache, textColor, &outputRect);
         if (outputTexture) {
             SDL_RenderCopy(renderer, outputTexture, NULL, &outputRect);
             SDL_DestroyTexture(outputTexture); // Clean up texture after rendering
@@ -156,7 +177,8 @@ int main(int argc, char *argv[]) {
     }
 
     // Clean up and exit
-    TTF_CloseFont(font);
+    glyph_cache_destroy(glyph_cache);
+    font_chain_destroy(font_chain);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     TTF_Quit();
@@ -0,0 +1,114 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static inline size_t align_up(size_t n) {
+  return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static ArenaBlock *new_block(size_t size) {
+  ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + size);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->next = NULL;
+  block->size = size;
+  return block;
+}
+
+int arena_init(Arena *a, size_t size) {
+  *a = (Arena){0};
+  a->first = new_block(align_up(size));
+  if (a->first == NULL) {
+    return -1;
+  }
+  a->current = a->first;
+  return 0;
+}
+
+void arena_free(Arena *a) {
+  ArenaBlock *block = a->first;
+  while (block != NULL) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  *a = (Arena){0};
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+  size = align_up(size == 0 ? 1 : size);
+  if (a->used + size > a->current->size) {
+    ArenaBlock *block = a->current->next;
+    //left over when folding the blocks together ran out of memory
+    if (block == NULL || block->size < size) {
+      //at least double, so a growing command adds few blocks
+      size_t block_size = a->current->size * 2;
+      if (block_size < size) {
+        block_size = size;
+      }
+      block = new_block(block_size);
+      if (block == NULL) {
+        return NULL;
+      }
+      block->next = a->current->next;
+      a->current->next = block;
+      a->grown++;
+    }
+    a->current = block;
+    a->used = 0;
+  }
+  void *p = a->current->data + a->used;
+  a->used += size;
+  a->last = p;
+  return p;
+}
+
+void *arena_grow(Arena *a, void *p, size_t old_size, size_t new_size) {
+  if (p != NULL && p == a->last) {
+    size_t start = (size_t)((char *)p - a->current->data);
+    if (start + align_up(new_size) <= a->current->size) {
+      a->used = start + align_up(new_size);
+      return p;
+    }
+  }
+  void *grown = arena_alloc(a, new_size);
+  if (grown != NULL && p != NULL) {
+    memcpy(grown, p, old_size < new_size ? old_size : new_size);
+  }
+  return grown;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t len) {
+  char *copy = (char *)arena_alloc(a, len + 1);
+  if (copy != NULL) {
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+void arena_reset(Arena *a) {
+  if (a->first->next != NULL) {
+    //outgrown, one block that holds it all next time
+    size_t total = 0;
+    for (ArenaBlock *block = a->first; block != NULL; block = block->next) {
+      total += block->size;
+    }
+    ArenaBlock *merged = new_block(total);
+    if (merged != NULL) {
+      ArenaBlock *block = a->first;
+      while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+      }
+      a->first = merged;
+    }
+  }
+  a->current = a->first;
+  a->used = 0;
+  a->last = NULL;
+  a->grown = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t size;
+  _Alignas(ARENA_ALIGN) char data[];
+} ArenaBlock;
+
+//bump allocator for everything one command needs, from reading the line to
+//running it: allocating is a pointer bump, nothing is freed on its own and
+//arena_reset gives it all back at once
+//a command that outgrows the blocks gets another one, the next reset folds
+//them into a single block of the total size, so once the arena has seen
+//the biggest command it never asks the heap for memory again
+typedef struct {
+  ArenaBlock *first;
+  ArenaBlock *current;
+  size_t used;       //bytes used in current
+  void *last;        //newest allocation, the one arena_grow can extend in place
+  size_t grown;      //blocks added since the last reset
+} Arena;
+
+//-1 when out of memory
+int arena_init(Arena *a, size_t size);
+void arena_free(Arena *a);
+
+//NULL when out of memory, aligned to ARENA_ALIGN
+void *arena_alloc(Arena *a, size_t size);
+//resizes p (old_size bytes from arena_alloc), in place when it is the
+//newest allocation and fits, otherwise copied
+void *arena_grow(Arena *a, void *p, size_t old_size, size_t new_size);
+char *arena_strndup(Arena *a, const char *s, size_t len);
+
+//everything allocated since the last reset is gone
+void arena_reset(Arena *a);
+
+#endif
@@ -0,0 +1,181 @@
+//grep benchmark
+//writes a synthetic log file, checks that the grep builtin prints what GNU
+//grep prints for a table of patterns (the ones that make a character
+//optional are where the literal prefilter could drop a line it should
+//keep), then times a few searches against GNU grep
+//
+//gcc -O2 bench/grep_bench.c builtins/grep.c str_search.c thread_pool.c -o grep_bench -pthread
+//./grep_bench [MB]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../builtins/builtins.h"
+
+#define DEFAULT_MB 256
+#define REPEATS 3 //best of, after a warm up run
+
+static const char *levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+static const char *services[] = {"api", "worker", "scheduler", "auth", "db-proxy", "gateway"};
+static const char *messages[] = {"request handled", "cache miss for key", "retrying connection to",
+                                 "job finished in", "user logged in from", "slow query took",
+                                 "queue depth is", "config reloaded from"};
+
+//lines only the checks below care about, one of each every so often
+static const char *odd_lines[] = {"ac", "abc", "abbc", "qac", "qabc", "qabbc", "xyac", "xyxyac",
+                                  "time out", "timeout", "timed out", "colour", "color", "TIMEOUT"};
+
+//patterns checked against GNU grep, with and without -i
+static const char *checks[] = {
+    "ERROR", "request handled", "db-proxy.*took", "[0-9]\\{5\\}", "worker\\|auth", "missing entirely",
+    //a character made optional, alone and after a group
+    "ab\\?c", "ab\\{0,\\}c", "ab\\{0,1\\}c", "ab*c", "colou\\?r", "time\\? \\?out", "^qab\\?c$",
+    "\\(q\\)ab\\?c", "\\(q\\)ab\\{0,\\}c", "\\(xy\\)\\?ac", "\\(xy\\)*ac", "\\(xy\\)\\{0,\\}ac",
+};
+
+//patterns timed, a common literal, a rare one, one with a regex around it
+static const char *timed[] = {"ERROR", "slow query took", "db-proxy.*took [0-9]*9.(pid"};
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void write_log(const char *path, size_t size) {
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    perror("fopen");
+    exit(EXIT_FAILURE);
+  }
+  srand(42);
+  size_t written = 0;
+  for (long line = 0; written < size; line++) {
+    if (line % 997 == 0) {
+      written += (size_t)fprintf(out, "%s\n", odd_lines[(line / 997) % (sizeof(odd_lines) / sizeof(odd_lines[0]))]);
+      continue;
+    }
+    written += (size_t)fprintf(out, "2024-05-%02d %02d:%02d:%02d.%03d %-5s [%s] %s %d\t(pid %d)\n", 1 + rand() % 28,
+                               rand() % 24, rand() % 60, rand() % 60, rand() % 1000, levels[rand() % 6],
+                               services[rand() % 6], messages[rand() % 8], rand() % 100000, 1000 + rand() % 9000);
+  }
+  fclose(out);
+}
+
+//runs the builtin with stdout sent to a file
+static double run_builtin(char **argv, int argc, const char *out_path) {
+  int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int saved = dup(STDOUT_FILENO);
+  dup2(out, STDOUT_FILENO);
+  close(out);
+  double start = now_us();
+  builtin_grep(argc, argv);
+  double took = now_us() - start;
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  return took;
+}
+
+static double run_gnu(char **argv, const char *out_path) {
+  double start = now_us();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(out, STDOUT_FILENO);
+    execvp("grep", argv);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+    fprintf(stderr, "could not run GNU grep\n");
+    exit(EXIT_FAILURE);
+  }
+  return now_us() - start;
+}
+
+static int same_output(const char *a_path, const char *b_path) {
+  FILE *a = fopen(a_path, "r");
+  FILE *b = fopen(b_path, "r");
+  int same = a != NULL && b != NULL;
+  while (same) {
+    int ca = fgetc(a);
+    int cb = fgetc(b);
+    same = ca == cb;
+    if (ca == EOF) {
+      break;
+    }
+  }
+  if (a != NULL) {
+    fclose(a);
+  }
+  if (b != NULL) {
+    fclose(b);
+  }
+  return same;
+}
+
+int main(int argc, char **argv) {
+  size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MB;
+  size_t size = mb * 1024 * 1024;
+
+  char dir[] = "/tmp/terrabine_grep_XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  char log_path[sizeof(dir) + 16], ours_path[sizeof(dir) + 16], theirs_path[sizeof(dir) + 16];
+  snprintf(log_path, sizeof(log_path), "%s/app.log", dir);
+  snprintf(ours_path, sizeof(ours_path), "%s/ours", dir);
+  snprintf(theirs_path, sizeof(theirs_path), "%s/theirs", dir);
+  write_log(log_path, size);
+  printf("%zu MB of log\n\n", mb);
+
+  //grep -c [-i] PATTERN FILE
+  char *grep_argv[6] = {"grep", "-c", NULL, NULL, NULL, NULL};
+  int check_count = sizeof(checks) / sizeof(checks[0]);
+  int wrong = 0;
+  for (int i = 0; i < check_count * 2; i++) {
+    int icase = i >= check_count;
+    int n = 2;
+    if (icase) {
+      grep_argv[n++] = "-i";
+    }
+    grep_argv[n++] = (char *)checks[i % check_count];
+    grep_argv[n++] = log_path;
+    grep_argv[n] = NULL;
+    run_builtin(grep_argv, n, ours_path);
+    run_gnu(grep_argv, theirs_path);
+    if (!same_output(ours_path, theirs_path)) {
+      printf("MISMATCH for %s%s\n", icase ? "-i " : "", checks[i % check_count]);
+      wrong++;
+    }
+  }
+  if (wrong == 0) {
+    printf("%d patterns count the same lines as GNU grep\n\n", check_count * 2);
+  }
+
+  //the matching lines themselves, so the time includes printing them
+  for (size_t t = 0; t < sizeof(timed) / sizeof(timed[0]) && wrong == 0; t++) {
+    char *argv_timed[] = {"grep", (char *)timed[t], log_path, NULL};
+    double ours = 0, theirs = 0;
+    for (int r = 0; r <= REPEATS; r++) {
+      double took = run_builtin(argv_timed, 3, ours_path);
+      ours = r == 1 || (r > 1 && took < ours) ? took : ours;
+      took = run_gnu(argv_timed, theirs_path);
+      theirs = r == 1 || (r > 1 && took < theirs) ? took : theirs;
+    }
+    printf("%-28s builtin %8.1f ms  GNU grep %8.1f ms  %5.1fx%s\n", timed[t], ours / 1e3, theirs / 1e3,
+           theirs / ours, same_output(ours_path, theirs_path) ? "" : "  MISMATCH");
+  }
+
+  unlink(log_path);
+  unlink(ours_path);
+  unlink(theirs_path);
+  rmdir(dir);
+  return wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,202 @@
+//Ctrl-R search benchmark
+//builds a history of synthetic commands, then types queries one key at a
+//time and times every search with the trigram index against a linear scan
+//
+//gcc -O2 -D_GNU_SOURCE bench/history_search_bench.c history.c history_search.c str_search.c -o history_search_bench
+//./history_search_bench [entries]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../history.h"
+#include "../history_search.h"
+#include "../str_search.h"
+
+#define DEFAULT_ENTRIES 1000000
+#define REPEATS 5 //Ctrl-R presses after each query is typed
+
+static const char *commands[] = {"ls", "cd", "cat", "grep", "gcc", "mv", "touch", "delete", "make",
+                                 "git commit -m", "git checkout", "ssh", "tail -f", "./build.sh", "vim"};
+static const char *words[] = {"src", "include", "main.c", "build", "test", "notes.txt", "server",
+                              "deploy", "config.yaml", "release", "docs", "api", "worker", "log",
+                              "shell_cmds", "parser", "render", "fix", "bench", "tmp"};
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+//writes plain lines, history_open converts them to records and indexes them
+static void write_history(const char *path, size_t entries) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror("fopen");
+    exit(EXIT_FAILURE);
+  }
+
+  srand(42);
+  for (size_t i = 0; i < entries; i++) {
+    fputs(commands[rand() % (sizeof(commands) / sizeof(commands[0]))], f);
+    int args = 1 + rand() % 3;
+    for (int a = 0; a < args; a++) {
+      fprintf(f, " %s", words[rand() % (sizeof(words) / sizeof(words[0]))]);
+      if (rand() % 4 == 0) {
+        fprintf(f, "/%d", rand() % 1000);
+      }
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+}
+
+static long scan_memmem(History *h, const char *q, size_t len, size_t before) {
+  for (size_t id = before; id-- > 0;) {
+    size_t entry_len;
+    const char *entry = history_get(h, id, &entry_len);
+    if (memmem(entry, entry_len, q, len) != NULL) {
+      return (long)id;
+    }
+  }
+  return -1;
+}
+
+static long scan_simd(History *h, const char *q, size_t len, size_t before) {
+  for (size_t id = before; id-- > 0;) {
+    size_t entry_len;
+    const char *entry = history_get(h, id, &entry_len);
+    if (str_search(entry, entry_len, q, len) != NULL) {
+      return (long)id;
+    }
+  }
+  return -1;
+}
+
+typedef long (*FindFunc)(void *ctx, const char *q, size_t len, size_t before);
+
+static long find_index(void *ctx, const char *q, size_t len, size_t before) {
+  return history_search_find((HistorySearch *)ctx, q, len, before);
+}
+
+static History *bench_history;
+
+static long find_memmem(void *ctx, const char *q, size_t len, size_t before) {
+  (void)ctx;
+  return scan_memmem(bench_history, q, len, before);
+}
+
+static long find_simd(void *ctx, const char *q, size_t len, size_t before) {
+  (void)ctx;
+  return scan_simd(bench_history, q, len, before);
+}
+
+//types every query a key at a time and presses Ctrl-R a few times after
+static void run(const char *name, FindFunc find, void *ctx, const char **queries, int query_count,
+                long *results) {
+  double total = 0, worst = 0;
+  int searches = 0;
+
+  for (int q = 0; q < query_count; q++) {
+    size_t len = strlen(queries[q]);
+    long found = -1;
+    for (size_t typed = 1; typed <= len; typed++) {
+      double start = now_us();
+      found = find(ctx, queries[q], typed, history_count(bench_history));
+      double took = now_us() - start;
+      total += took;
+      worst = took > worst ? took : worst;
+      searches++;
+    }
+    for (int r = 0; r < REPEATS && found > 0; r++) {
+      double start = now_us();
+      found = find(ctx, queries[q], len, (size_t)found);
+      double took = now_us() - start;
+      total += took;
+      worst = took > worst ? took : worst;
+      searches++;
+    }
+    results[q] = found;
+  }
+  printf("%-16s %8d searches  avg %9.1f us  max %9.1f us\n", name, searches, total / searches, worst);
+}
+
+int main(int argc, char **argv) {
+  size_t entries = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ENTRIES;
+
+  char path[] = "/tmp/terrabine_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  write_history(path, entries);
+
+  double start = now_us();
+  History *h = history_open(path);
+  if (h == NULL) {
+    perror("history_open");
+    return EXIT_FAILURE;
+  }
+  bench_history = h;
+  printf("history: %zu entries, %.1f MB, first open + convert + index build %.1f ms\n", history_count(h),
+         h->log_size / 1e6, (now_us() - start) / 1e3);
+
+  HistorySearch *hs = history_search_create(h);
+  start = now_us();
+  history_search_update(hs);
+  size_t postings = 0;
+  for (size_t i = 0; i < hs->table_cap; i++) {
+    postings += hs->table[i].cap;
+  }
+  printf("trigram index: %zu trigrams, built in %.1f ms, %.1f MB\n", hs->table_used, (now_us() - start) / 1e3,
+         (postings * sizeof(uint32_t) + hs->table_cap * sizeof(TrigramPostings)) / 1e6);
+  printf("substring check: %s\n\n", str_search_name());
+
+  //common, rare, absent and out of order queries
+  const char *queries[] = {"git commit", "config.yaml/99", "deploy/123", "tail -f log", "main.c/7",
+                           "notes.txt/500", "make release/42", "src render", "kubectl", "ssh worker/1"};
+  int query_count = sizeof(queries) / sizeof(queries[0]);
+  long index_results[16], simd_results[16], memmem_results[16];
+
+  run("trigram index", find_index, hs, queries, query_count, index_results);
+  run("scan + simd", find_simd, NULL, queries, query_count, simd_results);
+  run("scan + memmem", find_memmem, NULL, queries, query_count, memmem_results);
+
+  for (int q = 0; q < query_count; q++) {
+    if (index_results[q] != simd_results[q] || index_results[q] != memmem_results[q]) {
+      printf("MISMATCH for \"%s\": %ld %ld %ld\n", queries[q], index_results[q], simd_results[q],
+             memmem_results[q]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  //random substrings of random entries searched below random points
+  srand(7);
+  for (int i = 0; i < 2000; i++) {
+    size_t id = rand() % history_count(h), len;
+    const char *entry = history_get(h, id, &len);
+    size_t from = rand() % len, qlen = 1 + rand() % 8;
+    if (from + qlen > len) {
+      qlen = len - from;
+    }
+    size_t before = rand() % (history_count(h) + 1);
+    long indexed = history_search_find(hs, entry + from, qlen, before);
+    long scanned = scan_simd(h, entry + from, qlen, before);
+    if (indexed != scanned) {
+      printf("MISMATCH for \"%.*s\" below %zu: %ld %ld\n", (int)qlen, entry + from, before, indexed, scanned);
+      return EXIT_FAILURE;
+    }
+  }
+  printf("\n2000 random queries agree with a linear scan\n");
+
+  history_search_destroy(hs);
+  history_close(h);
+  char index_path[sizeof(path) + sizeof(HISTORY_INDEX_SUFFIX)];
+  snprintf(index_path, sizeof(index_path), "%s%s", path, HISTORY_INDEX_SUFFIX);
+  unlink(path);
+  unlink(index_path);
+  return 0;
+}
@@ -0,0 +1,233 @@
+//command line splitting benchmark
+//times lex_words against the strtok splitter it replaced over a corpus of
+//everyday command lines and a few pathological ones, each line is copied
+//fresh before every split since both work in place, and the arena is reset
+//after every line the way the shell does after every command; a table of
+//lines is first checked against the words they must split into
+//
+//gcc -O2 bench/lexer_bench.c lexer.c arena.c -o lexer_bench
+//./lexer_bench [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lexer.h"
+
+#define DEFAULT_ROUNDS 200
+#define LONG_WORDS 20000 //words in the longest pathological line
+
+static const char *everyday[] = {
+    "ls",
+    "ls -la /usr/local/bin",
+    "cd ../src/render",
+    "cat notes.txt",
+    "gcc -O2 -Wall main.c line_editor.c gap_buffer.c -o terrabine -lncurses",
+    "mv build/output.log logs/2024-05-01.log",
+    "git commit -m \"fix the wrap at the last column\"",
+    "grep -rn 'TODO' src include",
+    "touch a.txt b.txt c.txt d.txt",
+    "echo $HOME/projects/$USER/build",
+    "delete -r tmp/cache",
+    "ls shell_cmds | cat > listing.txt",
+    "./build.sh --release && ./terrabine",
+    "cat 'My Documents/report final.txt'",
+    "mv file\\ with\\ spaces.txt renamed.txt # tidy up",
+};
+
+typedef struct {
+  const char *name;
+  char **lines;
+  size_t count;
+} Corpus;
+
+//lines and the words they must split into, checked before anything is timed
+//E is set to the empty string and UNSET is not set at all
+typedef struct {
+  const char *line;
+  const char *words[10];
+} LexCase;
+
+static const LexCase cases[] = {
+    {"ls -la", {"ls", "-la"}},
+    {"cat 'a b'\\ c\"d e\"", {"cat", "a b cd e"}},
+    {"a|b&&c;d>e", {"a", "|", "b", "&&", "c", ";", "d", ">", "e"}},
+    {"echo \">\" # comment", {"echo", ">"}},
+    {"echo $PROJECT/src", {"echo", "/home/me/projects/terrabine/src"}},
+    {"echo '$PROJECT'", {"echo", "$PROJECT"}},
+    //empty and unset variables at the start of a word and of the line
+    {"$E", {NULL}},
+    {"$UNSET", {NULL}},
+    {"$E.", {"."}},
+    {"$UNSET.", {"."}},
+    {"${E}x ${UNSET}y", {"x", "y"}},
+    {"\"$E\" ls", {"", "ls"}},
+    {"echo $E$PROJECT", {"echo", "/home/me/projects/terrabine"}},
+    {"echo $E $UNSET z", {"echo", "z"}},
+};
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//what split_line did before: strtok on single spaces, the array grown one
+//slot at a time past 64
+static char **strtok_split(char *cmd) {
+  int i = 0;
+  int bufsize = 64;
+  char **tokens = (char **)malloc(bufsize * sizeof(char *));
+  char *token = strtok(cmd, " ");
+  while (token != NULL) {
+    if (token[0] == '#') {
+      break;
+    }
+    tokens[i++] = token;
+    if (i >= bufsize) {
+      bufsize++;
+      tokens = realloc(tokens, bufsize * sizeof(char *));
+    }
+    token = strtok(NULL, " ");
+  }
+  tokens[i] = NULL;
+  return tokens;
+}
+
+static char *repeat(const char *piece, size_t times) {
+  size_t len = strlen(piece);
+  char *line = (char *)malloc(len * times + 1);
+  for (size_t i = 0; i < times; i++) {
+    memcpy(line + i * len, piece, len);
+  }
+  line[len * times] = '\0';
+  return line;
+}
+
+static void add(Corpus *c, char *line) {
+  c->lines = (char **)realloc(c->lines, (c->count + 1) * sizeof(char *));
+  c->lines[c->count++] = line;
+}
+
+//returns the number of lines that split differently than expected
+static int check(void) {
+  Arena arena;
+  arena_init(&arena, 4096);
+  LexWords words = {.arena = &arena};
+  int wrong = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    char *copy = strdup(cases[i].line);
+    size_t expected = 0;
+    while (cases[i].words[expected] != NULL) {
+      expected++;
+    }
+    int same = lex_words(copy, strlen(copy), &words) == 0 && words.argc == expected;
+    for (size_t w = 0; same && w < expected; w++) {
+      same = strcmp(words.argv[w], cases[i].words[w]) == 0;
+    }
+    if (!same) {
+      printf("MISMATCH for %s:", cases[i].line);
+      for (size_t w = 0; w < words.argc; w++) {
+        printf(" [%s]", words.argv[w]);
+      }
+      printf("\n");
+      wrong++;
+    }
+    free(copy);
+    arena_reset(&arena);
+  }
+  arena_free(&arena);
+  return wrong;
+}
+
+static void run(const Corpus *c, int rounds) {
+  size_t bytes = 0;
+  size_t longest = 0;
+  for (size_t i = 0; i < c->count; i++) {
+    size_t len = strlen(c->lines[i]);
+    bytes += len;
+    longest = len > longest ? len : longest;
+  }
+  char *copy = (char *)malloc(longest + 1);
+  Arena arena;
+  arena_init(&arena, 16 * 1024);
+  LexWords words = {.arena = &arena};
+  size_t args = 0;
+
+  //warm up so the arena has grown to the biggest line
+  for (size_t i = 0; i < c->count; i++) {
+    strcpy(copy, c->lines[i]);
+    lex_words(copy, strlen(copy), &words);
+    arena_reset(&arena);
+  }
+
+  double start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < c->count; i++) {
+      size_t len = strlen(c->lines[i]);
+      memcpy(copy, c->lines[i], len + 1);
+      lex_words(copy, len, &words);
+      args += words.argc;
+      arena_reset(&arena);
+    }
+  }
+  double lexed = now_ns() - start;
+
+  start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < c->count; i++) {
+      size_t len = strlen(c->lines[i]);
+      memcpy(copy, c->lines[i], len + 1);
+      char **tokens = strtok_split(copy);
+      args += tokens[0] != NULL;
+      free(tokens);
+    }
+  }
+  double split = now_ns() - start;
+
+  double n = (double)c->count * rounds;
+  printf("%-22s %6zu lines %9zu bytes   lex_words %10.0f ns/line %8.0f MB/s   strtok %10.0f ns/line %8.0f MB/s\n",
+         c->name, c->count, bytes, lexed / n, bytes * rounds / lexed * 1e3, split / n,
+         bytes * rounds / split * 1e3);
+  free(copy);
+  arena_free(&arena);
+  (void)args;
+}
+
+int main(int argc, char **argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+  setenv("PROJECT", "/home/me/projects/terrabine", 1);
+  setenv("E", "", 1);
+  unsetenv("UNSET");
+  if (check() > 0) {
+    return EXIT_FAILURE;
+  }
+  printf("%zu lines split as expected\n", sizeof(cases) / sizeof(cases[0]));
+
+  Corpus normal = {"everyday", NULL, 0};
+  for (int r = 0; r < 100; r++) {
+    for (size_t i = 0; i < sizeof(everyday) / sizeof(everyday[0]); i++) {
+      add(&normal, strdup(everyday[i]));
+    }
+  }
+
+  Corpus many = {"20k words", NULL, 0};
+  add(&many, repeat("arg ", LONG_WORDS));
+  Corpus spaces = {"blank runs", NULL, 0};
+  add(&spaces, repeat("a                                ", LONG_WORDS / 10));
+  Corpus quoted = {"quotes and escapes", NULL, 0};
+  add(&quoted, repeat("\"a b\"'c d'e\\ f ", LONG_WORDS / 4));
+  Corpus vars = {"$VAR expansion", NULL, 0};
+  add(&vars, repeat("$PROJECT/src ${PROJECT}/include ", LONG_WORDS / 4));
+  Corpus ops = {"operators", NULL, 0};
+  add(&ops, repeat("a|b&&c;d>e ", LONG_WORDS / 4));
+
+  printf("%d rounds, the strtok splitter knows no quotes, variables or operators so it does less\n", rounds);
+  run(&normal, rounds);
+  run(&many, rounds / 10 > 0 ? rounds / 10 : 1);
+  run(&spaces, rounds);
+  run(&quoted, rounds);
+  run(&vars, rounds);
+  run(&ops, rounds);
+  return 0;
+}
@@ -0,0 +1,183 @@
+//wc benchmark
+//writes a set of synthetic log files, warms the page cache and times the
+//counting loop on one core, the wc builtin over all files and coreutils wc,
+//checking that both print the same thing
+//
+//gcc -O2 bench/wc_bench.c word_count.c builtins/wc.c thread_pool.c -o wc_bench -pthread
+//./wc_bench [MB per file] [files]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../builtins/builtins.h"
+#include "../word_count.h"
+
+#define DEFAULT_MB 256
+#define DEFAULT_FILES 8
+#define REPEATS 3 //best of, after a warm up run
+#define BLOCK (1024 * 1024)
+
+static const char *levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+static const char *services[] = {"api", "worker", "scheduler", "auth", "db-proxy", "gateway"};
+static const char *messages[] = {"request handled", "cache miss for key", "retrying connection to",
+                                 "job finished in", "user logged in from", "slow query took",
+                                 "queue depth is", "config reloaded from"};
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+//a block of log lines written over and over, each file starts at another
+//line so they are not all alike
+static void write_logs(char **paths, int files, size_t size) {
+  char *block = (char *)malloc(BLOCK + 256);
+  size_t len = 0;
+  srand(42);
+  while (len < BLOCK) {
+    len += (size_t)sprintf(block + len, "2024-05-%02d %02d:%02d:%02d.%03d %-5s [%s] %s %d\t(pid %d)\n",
+                           1 + rand() % 28, rand() % 24, rand() % 60, rand() % 60, rand() % 1000,
+                           levels[rand() % 6], services[rand() % 6], messages[rand() % 8], rand() % 100000,
+                           1000 + rand() % 9000);
+  }
+  for (int f = 0; f < files; f++) {
+    FILE *out = fopen(paths[f], "w");
+    if (out == NULL) {
+      perror("fopen");
+      exit(EXIT_FAILURE);
+    }
+    size_t skip = (size_t)f * 97;
+    fwrite(block + skip, 1, len - skip, out);
+    for (size_t written = len - skip; written < size; written += len) {
+      fwrite(block, 1, written + len <= size ? len : size - written, out);
+    }
+    fclose(out);
+  }
+  free(block);
+}
+
+//runs the builtin with stdout sent to a file
+static double run_builtin(char **argv, int argc, const char *out_path) {
+  int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int saved = dup(STDOUT_FILENO);
+  dup2(out, STDOUT_FILENO);
+  close(out);
+  double start = now_us();
+  builtin_wc(argc, argv);
+  double took = now_us() - start;
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  return took;
+}
+
+static double run_coreutils(char **argv, const char *out_path) {
+  double start = now_us();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(out, STDOUT_FILENO);
+    execvp("wc", argv);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+    fprintf(stderr, "could not run coreutils wc\n");
+    exit(EXIT_FAILURE);
+  }
+  return now_us() - start;
+}
+
+static char *read_all(const char *path) {
+  FILE *f = fopen(path, "r");
+  char *text = (char *)calloc(1, 1 << 20);
+  if (f != NULL) {
+    fread(text, 1, (1 << 20) - 1, f);
+    fclose(f);
+  }
+  return text;
+}
+
+int main(int argc, char **argv) {
+  size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MB;
+  int files = argc > 2 ? atoi(argv[2]) : DEFAULT_FILES;
+  size_t size = mb * 1024 * 1024;
+
+  char dir[] = "/tmp/terrabine_wc_XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  //wc, a flag, the files
+  char **wc_argv = (char **)calloc((size_t)files + 3, sizeof(char *));
+  wc_argv[0] = "wc";
+  for (int f = 0; f < files; f++) {
+    wc_argv[f + 2] = (char *)malloc(sizeof(dir) + 32);
+    sprintf(wc_argv[f + 2], "%s/log%d.txt", dir, f);
+  }
+  write_logs(wc_argv + 2, files, size);
+  double gb = (double)size * files / 1e9;
+  printf("%d files of %zu MB, %.2f GB, counting with %s, %ld cpus\n\n", files, mb, gb, word_count_name(),
+         sysconf(_SC_NPROCESSORS_ONLN));
+
+  char ours_path[sizeof(dir) + 16], theirs_path[sizeof(dir) + 16];
+  snprintf(ours_path, sizeof(ours_path), "%s/ours", dir);
+  snprintf(theirs_path, sizeof(theirs_path), "%s/theirs", dir);
+
+  //the counting loop alone, one core over the first file
+  int fd = open(wc_argv[2], O_RDONLY);
+  char *map = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  double best = 0;
+  WordCount count;
+  for (int r = 0; r <= REPEATS; r++) {
+    double start = now_us();
+    word_count(map, size, &count);
+    double took = now_us() - start;
+    best = r == 1 || (r > 1 && took < best) ? took : best;
+  }
+  munmap(map, size);
+  printf("%-18s %8.1f ms  %6.2f GB/s\n", "kernel, one core", best / 1e3, size / best / 1e3);
+
+  //all three counts, then lines alone, which coreutils has its own
+  //vector loop for
+  int same = 1;
+  for (int mode = 0; mode < 2 && same; mode++) {
+    wc_argv[1] = mode == 0 ? "-lwc" : "-l";
+    double ours = 0, theirs = 0;
+    for (int r = 0; r <= REPEATS; r++) {
+      double took = run_builtin(wc_argv, files + 2, ours_path);
+      ours = r == 1 || (r > 1 && took < ours) ? took : ours;
+      took = run_coreutils(wc_argv, theirs_path);
+      theirs = r == 1 || (r > 1 && took < theirs) ? took : theirs;
+    }
+    printf("\nwc %s\n", wc_argv[1]);
+    printf("%-18s %8.1f ms  %6.2f GB/s\n", "builtin", ours / 1e3, gb * 1e6 / ours);
+    printf("%-18s %8.1f ms  %6.2f GB/s\n", "coreutils", theirs / 1e3, gb * 1e6 / theirs);
+    printf("%-18s %8.1fx\n", "speedup", theirs / ours);
+
+    char *ours_text = read_all(ours_path);
+    char *theirs_text = read_all(theirs_path);
+    same = strcmp(ours_text, theirs_text) == 0;
+    if (!same) {
+      printf("MISMATCH\n--- builtin\n%s--- coreutils\n%s", ours_text, theirs_text);
+    }
+    free(ours_text);
+    free(theirs_text);
+  }
+
+  for (int f = 0; f < files; f++) {
+    unlink(wc_argv[f + 2]);
+  }
+  unlink(ours_path);
+  unlink(theirs_path);
+  rmdir(dir);
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,16 @@
+#ifndef BITMAP_FONT_H
+#define BITMAP_FONT_H
+
+#include <SDL2/SDL_stdinc.h>
+
+//built-in 8x16 bitmap font for printable ascii
+//used to draw the first frames before any TrueType font has been loaded,
+//and as the last resort when none of the configured fonts can be opened
+#define BITMAP_FONT_WIDTH 8
+#define BITMAP_FONT_HEIGHT 16
+
+//returns BITMAP_FONT_HEIGHT row bytes, the leftmost pixel is the high bit
+//codepoints outside printable ascii get the '?' glyph
+const Uint8 *bitmap_font_glyph(Uint32 codepoint);
+
+#endif
@@ -0,0 +1,671 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../thread_pool.h"
+#include "compile_cache.h"
+
+#define BUILD_DIR ".build"
+#define GRAPH_PATH BUILD_DIR "/graph"
+#define GRAPH_VERSION "terrabine-build 1"
+
+//a file of the dependency graph, a source or a header it includes
+typedef struct {
+  char *path;
+  long long mtime_ns;
+  long long size;
+  CacheKey hash;   //of the contents
+  size_t *includes; //files it includes with "", by number
+  size_t include_count;
+  int scanned;   //hash and includes are checked against the file this run
+  int missing;
+  unsigned walk; //the last walk that reached it
+} DepFile;
+
+typedef struct Build Build;
+
+//a source and the object it is compiled into
+typedef struct {
+  Build *build;
+  size_t file;
+  char *object;
+  CacheKey key;   //of the flags and every file the object is made of
+  CacheKey built; //the key it was made with last time, 0 when never
+  int state;
+} Unit;
+
+enum { UNIT_UP_TO_DATE, UNIT_CACHED, UNIT_COMPILED, UNIT_FAILED };
+
+struct Build {
+  DepFile *files;
+  size_t file_count;
+  size_t file_cap;
+  size_t *index; //open addressing on the path, file number + 1, 0 is free
+  size_t index_cap;
+  unsigned walk;
+  Unit *units;
+  size_t unit_count;
+  CacheKey exe_built;
+
+  CompileCache cache;
+  char **compile_flags;
+  size_t compile_count;
+  char **link_flags;
+  size_t link_count;
+  char **include_dirs; //-I, where a "" include is looked for after its own directory
+  size_t include_dir_count;
+  const char *out;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//one line in one write, lines of compiles running at once never mix
+static void say(const char *format, const char *what) {
+  char line[PATH_MAX + 128];
+  int len = snprintf(line, sizeof(line), format, what);
+  if (len > (int)sizeof(line) - 2) {
+    len = (int)sizeof(line) - 2;
+  }
+  line[len] = '\n';
+  write(STDOUT_FILENO, line, (size_t)len + 1);
+}
+
+static size_t path_hash(const char *path) {
+  size_t h = 1469598103934665603ull;
+  for (; *path != '\0'; path++) {
+    h = (h ^ (unsigned char)*path) * 1099511628211ull;
+  }
+  return h;
+}
+
+static int index_insert(Build *b, size_t file) {
+  if ((b->file_count + 1) * 2 > b->index_cap) {
+    size_t cap = b->index_cap == 0 ? 256 : b->index_cap * 2;
+    size_t *index = (size_t *)calloc(cap, sizeof(size_t));
+    if (index == NULL) {
+      return -1;
+    }
+    free(b->index);
+    b->index = index;
+    b->index_cap = cap;
+    for (size_t i = 0; i < b->file_count; i++) {
+      if (i != file) {
+        index_insert(b, i);
+      }
+    }
+  }
+  size_t at = path_hash(b->files[file].path) & (b->index_cap - 1);
+  while (b->index[at] != 0) {
+    at = (at + 1) & (b->index_cap - 1);
+  }
+  b->index[at] = file + 1;
+  return 0;
+}
+
+//the number of path in the graph, added when it is not there, -1 when out
+//of memory
+static long find_file(Build *b, const char *path) {
+  if (b->index_cap > 0) {
+    size_t at = path_hash(path) & (b->index_cap - 1);
+    while (b->index[at] != 0) {
+      if (strcmp(b->files[b->index[at] - 1].path, path) == 0) {
+        return (long)(b->index[at] - 1);
+      }
+      at = (at + 1) & (b->index_cap - 1);
+    }
+  }
+  if (b->file_count == b->file_cap) {
+    size_t cap = b->file_cap == 0 ? 64 : b->file_cap * 2;
+    DepFile *files = (DepFile *)realloc(b->files, cap * sizeof(DepFile));
+    if (files == NULL) {
+      return -1;
+    }
+    b->files = files;
+    b->file_cap = cap;
+  }
+  DepFile *f = &b->files[b->file_count];
+  memset(f, 0, sizeof(*f));
+  f->path = strdup(path);
+  if (f->path == NULL) {
+    return -1;
+  }
+  b->file_count++;
+  if (index_insert(b, b->file_count - 1) < 0) {
+    return -1;
+  }
+  return (long)(b->file_count - 1);
+}
+
+static int add_include(Build *b, size_t file, size_t include) {
+  DepFile *f = &b->files[file];
+  size_t *includes = (size_t *)realloc(f->includes, (f->include_count + 1) * sizeof(size_t));
+  if (includes == NULL) {
+    return -1;
+  }
+  includes[f->include_count] = include;
+  f->includes = includes;
+  f->include_count++;
+  return 0;
+}
+
+static void hex_key(const CacheKey *key, char hex[33]) {
+  snprintf(hex, 33, "%016llx%016llx", (unsigned long long)(key->h >> 64), (unsigned long long)key->h);
+}
+
+static CacheKey parse_key(const char *hex) {
+  char half[17];
+  memcpy(half, hex, 16);
+  half[16] = '\0';
+  CacheKey key;
+  key.h = (unsigned __int128)strtoull(half, NULL, 16) << 64 | strtoull(hex + 16, NULL, 16);
+  return key;
+}
+
+//the graph the last build left, as lines of
+//  file MTIME SIZE HASH PATH, followed by an inc PATH for each include
+//  unit KEY PATH, the key its object was made with
+//  exe KEY
+static void load_graph(Build *b) {
+  FILE *graph = fopen(GRAPH_PATH, "r");
+  if (graph == NULL) {
+    return;
+  }
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  long file = -1;
+  int valid = getline(&line, &cap, graph) > 0 && strncmp(line, GRAPH_VERSION, strlen(GRAPH_VERSION)) == 0;
+  while (valid && (len = getline(&line, &cap, graph)) > 0) {
+    if (line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+    long long mtime, size;
+    int at = 0;
+    char hex[33];
+    if (sscanf(line, "file %lld %lld %32s %n", &mtime, &size, hex, &at) == 3 && at > 0) {
+      file = find_file(b, line + at);
+      if (file >= 0) {
+        b->files[file].mtime_ns = mtime;
+        b->files[file].size = size;
+        b->files[file].hash = parse_key(hex);
+      }
+    } else if (strncmp(line, "inc ", 4) == 0 && file >= 0) {
+      long include = find_file(b, line + 4);
+      if (include >= 0) {
+        add_include(b, (size_t)file, (size_t)include);
+      }
+    } else if (sscanf(line, "unit %32s %n", hex, &at) == 1 && at > 0) {
+      for (size_t i = 0; i < b->unit_count; i++) {
+        if (strcmp(b->files[b->units[i].file].path, line + at) == 0) {
+          b->units[i].built = parse_key(hex);
+        }
+      }
+    } else if (sscanf(line, "exe %32s", hex) == 1) {
+      b->exe_built = parse_key(hex);
+    }
+  }
+  free(line);
+  fclose(graph);
+}
+
+static void save_walk(Build *b, FILE *graph, size_t file) {
+  DepFile *f = &b->files[file];
+  if (f->walk == b->walk || f->missing) {
+    return;
+  }
+  f->walk = b->walk;
+  char hex[33];
+  hex_key(&f->hash, hex);
+  fprintf(graph, "file %lld %lld %s %s\n", f->mtime_ns, f->size, hex, f->path);
+  for (size_t i = 0; i < f->include_count; i++) {
+    fprintf(graph, "inc %s\n", b->files[f->includes[i]].path);
+  }
+  for (size_t i = 0; i < f->include_count; i++) {
+    save_walk(b, graph, f->includes[i]);
+  }
+}
+
+//only what this build reached is kept, a header nobody includes any more
+//drops out
+static int save_graph(Build *b, const CacheKey *exe) {
+  FILE *graph = fopen(GRAPH_PATH ".tmp", "w");
+  if (graph == NULL) {
+    return -1;
+  }
+  fprintf(graph, "%s\n", GRAPH_VERSION);
+  b->walk++;
+  char hex[33];
+  for (size_t i = 0; i < b->unit_count; i++) {
+    Unit *u = &b->units[i];
+    save_walk(b, graph, u->file);
+    if (u->state != UNIT_FAILED) {
+      hex_key(&u->key, hex);
+      fprintf(graph, "unit %s %s\n", hex, b->files[u->file].path);
+    }
+  }
+  if (exe != NULL) {
+    hex_key(exe, hex);
+    fprintf(graph, "exe %s\n", hex);
+  }
+  if (fclose(graph) != 0 || rename(GRAPH_PATH ".tmp", GRAPH_PATH) < 0) {
+    unlink(GRAPH_PATH ".tmp");
+    return -1;
+  }
+  return 0;
+}
+
+//where #include "name" in a file of dir points: dir itself, then the -I
+//directories, NULL when it is in none (a system header, or not made yet)
+static char *resolve_include(Build *b, const char *dir, const char *name, size_t len) {
+  struct stat st;
+  char path[PATH_MAX];
+  for (size_t i = 0; i <= b->include_dir_count; i++) {
+    const char *base = i == 0 ? dir : b->include_dirs[i - 1];
+    int n = base[0] == '\0' ? snprintf(path, sizeof(path), "%.*s", (int)len, name)
+                            : snprintf(path, sizeof(path), "%s/%.*s", base, (int)len, name);
+    if (n < (int)sizeof(path) && stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+      const char *clean = path;
+      while (strncmp(clean, "./", 2) == 0) {
+        clean += 2;
+      }
+      return strdup(clean);
+    }
+  }
+  return NULL;
+}
+
+//the #include "..." lines of a file's text
+static int scan_includes(Build *b, size_t file, const char *text, size_t len) {
+  char dir[PATH_MAX];
+  const char *slash = strrchr(b->files[file].path, '/');
+  snprintf(dir, sizeof(dir), "%.*s", slash == NULL ? 0 : (int)(slash - b->files[file].path), b->files[file].path);
+
+  const char *end = text + len;
+  for (const char *p = text; p < end;) {
+    const char *eol = (const char *)memchr(p, '\n', (size_t)(end - p));
+    if (eol == NULL) {
+      eol = end;
+    }
+    while (p < eol && (*p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if (p < eol && *p == '#') {
+      p++;
+      while (p < eol && (*p == ' ' || *p == '\t')) {
+        p++;
+      }
+      if (eol - p > 7 && strncmp(p, "include", 7) == 0) {
+        p += 7;
+        while (p < eol && (*p == ' ' || *p == '\t')) {
+          p++;
+        }
+        const char *close = p < eol && *p == '"' ? (const char *)memchr(p + 1, '"', (size_t)(eol - p - 1)) : NULL;
+        char *path = close != NULL ? resolve_include(b, dir, p + 1, (size_t)(close - p - 1)) : NULL;
+        if (path != NULL) {
+          long include = find_file(b, path);
+          free(path);
+          if (include < 0 || add_include(b, file, (size_t)include) < 0) {
+            return -1;
+          }
+        }
+      }
+    }
+    p = eol + 1;
+  }
+  return 0;
+}
+
+//brings a file and everything it includes up to date with the disk: a
+//file whose time and size are what the graph has is taken as it is, any
+//other is hashed and scanned again, so touching a file rebuilds nothing
+static int refresh(Build *b, size_t file) {
+  DepFile *f = &b->files[file];
+  if (f->scanned) {
+    return 0;
+  }
+  f->scanned = 1;
+  struct stat st;
+  if (stat(f->path, &st) < 0) {
+    f->missing = 1;
+    return 0;
+  }
+  long long mtime = (long long)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+  if (mtime != f->mtime_ns || (long long)st.st_size != f->size || f->hash.h == 0) {
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    char *text = (char *)malloc((size_t)st.st_size + 1);
+    ssize_t n = fd >= 0 && text != NULL ? read(fd, text, (size_t)st.st_size) : -1;
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (n < 0) {
+      free(text);
+      f->missing = 1;
+      return 0;
+    }
+    f->mtime_ns = mtime;
+    f->size = (long long)st.st_size;
+    f->hash.h = 0;
+    cache_key_add(&f->hash, text, (size_t)n);
+    f->include_count = 0;
+    int rc = scan_includes(b, file, text, (size_t)n);
+    free(text);
+    if (rc < 0) {
+      return -1;
+    }
+  }
+  //files may be added on the way, so by number and not by pointer
+  for (size_t i = 0; i < b->files[file].include_count; i++) {
+    if (refresh(b, b->files[file].includes[i]) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void key_walk(Build *b, CacheKey *key, size_t file) {
+  DepFile *f = &b->files[file];
+  if (f->walk == b->walk) {
+    return;
+  }
+  f->walk = b->walk;
+  cache_key_add_string(key, f->path);
+  cache_key_add(key, f->missing ? &(CacheKey){0} : &f->hash, sizeof(CacheKey));
+  for (size_t i = 0; i < f->include_count; i++) {
+    key_walk(b, key, f->includes[i]);
+  }
+}
+
+//a unit's key comes from the graph, without running the preprocessor:
+//the flags, the source and every header it reaches with ""
+static void unit_key(Build *b, Unit *u) {
+  cache_key_init(&u->key, &b->cache);
+  cache_key_add_string(&u->key, "build");
+  for (size_t i = 0; i < b->compile_count; i++) {
+    cache_key_add_string(&u->key, b->compile_flags[i]);
+  }
+  b->walk++;
+  key_walk(b, &u->key, u->file);
+}
+
+static void compile_unit(void *arg) {
+  Unit *u = (Unit *)arg;
+  Build *b = u->build;
+  const char *src = b->files[u->file].path;
+  char **args = (char **)calloc(b->compile_count + 6, sizeof(char *));
+  if (args == NULL) {
+    u->state = UNIT_FAILED;
+    return;
+  }
+  args[0] = "gcc";
+  memcpy(args + 1, b->compile_flags, b->compile_count * sizeof(char *));
+  size_t at = b->compile_count + 1;
+  args[at++] = "-c";
+  args[at++] = (char *)src;
+  args[at++] = "-o";
+  args[at] = u->object;
+
+  uint64_t cost = 0;
+  if (compile_cache_restore(&b->cache, &u->key, "o", u->object, 0666, STDOUT_FILENO, &cost)) {
+    say("  cached  %s", src);
+    u->state = UNIT_CACHED;
+  } else {
+    say("  CC      %s", src);
+    u->state = compile_cache_run(&b->cache, &u->key, "o", args, u->object, 0666, STDOUT_FILENO, &cost) == 0
+                   ? UNIT_COMPILED
+                   : UNIT_FAILED;
+  }
+  free(args);
+}
+
+//name.c becomes .build/name-HASH.o, the hash of the whole path keeps
+//a.c and dir/a.c apart
+static char *object_path(const char *src) {
+  const char *base = strrchr(src, '/');
+  base = base != NULL ? base + 1 : src;
+  size_t len = strlen(base);
+  char *path;
+  if (asprintf(&path, "%s/%.*s-%08zx.o", BUILD_DIR, (int)(len > 2 ? len - 2 : len), base,
+               path_hash(src) & 0xffffffff) < 0) {
+    return NULL;
+  }
+  return path;
+}
+
+static int by_name(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+//the .c files of the current directory, sorted
+static char **find_sources(size_t *count) {
+  DIR *dir = opendir(".");
+  if (dir == NULL) {
+    return NULL;
+  }
+  char **sources = NULL;
+  size_t cap = 0;
+  *count = 0;
+  struct dirent *d;
+  while ((d = readdir(dir)) != NULL) {
+    size_t len = strlen(d->d_name);
+    struct stat st;
+    if (len < 3 || d->d_name[0] == '.' || strcmp(d->d_name + len - 2, ".c") != 0 || stat(d->d_name, &st) < 0 ||
+        !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    if (*count == cap) {
+      cap = cap == 0 ? 32 : cap * 2;
+      char **grown = (char **)realloc(sources, cap * sizeof(char *));
+      if (grown == NULL) {
+        break;
+      }
+      sources = grown;
+    }
+    sources[(*count)++] = strdup(d->d_name);
+  }
+  closedir(dir);
+  if (*count > 0) {
+    qsort(sources, *count, sizeof(char *), by_name);
+  }
+  return sources;
+}
+
+//build [-o OUT] [-j N] [SOURCE.c...] [OPTION...]
+//compiles the .c files of the current directory (or the sources given)
+//into one executable, OUT or the directory's name: the #include "" lines
+//of every file make a dependency graph kept in .build/graph with each
+//file's time, size and hash, and only a source that reaches a changed
+//file is compiled again, through the gcc cache, on every core; the link
+//comes last
+int builtin_build(int argc, char **argv) {
+  Build b = {0};
+  uint64_t start = now_ns();
+  int threads = 0;
+  size_t source_count = 0;
+  char **sources = (char **)calloc((size_t)argc, sizeof(char *));
+  b.compile_flags = (char **)calloc((size_t)argc + 1, sizeof(char *));
+  b.link_flags = (char **)calloc((size_t)argc + 1, sizeof(char *));
+  b.include_dirs = (char **)calloc((size_t)argc, sizeof(char *));
+  if (sources == NULL || b.compile_flags == NULL || b.link_flags == NULL || b.include_dirs == NULL) {
+    return 1;
+  }
+  for (int i = 1; i < argc; i++) {
+    char *arg = argv[i];
+    if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+      b.out = argv[++i];
+    } else if (strcmp(arg, "-j") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (arg[0] != '-') {
+      sources[source_count++] = arg;
+    } else {
+      int link = gcc_link_only(arg);
+      char *value = gcc_takes_value(arg) && i + 1 < argc ? argv[++i] : NULL;
+      if (strncmp(arg, "-I", 2) == 0) {
+        b.include_dirs[b.include_dir_count++] = value != NULL ? value : arg + 2;
+      }
+      b.link_flags[b.link_count++] = arg;
+      if (value != NULL) {
+        b.link_flags[b.link_count++] = value;
+      }
+      if (!link) {
+        b.compile_flags[b.compile_count++] = arg;
+        if (value != NULL) {
+          b.compile_flags[b.compile_count++] = value;
+        }
+      }
+    }
+  }
+  if (source_count == 0) {
+    free(sources);
+    sources = find_sources(&source_count);
+  }
+  if (source_count == 0) {
+    say("build: no .c files in %s", ".");
+    return 1;
+  }
+  char cwd[PATH_MAX];
+  if (b.out == NULL) {
+    const char *name = getcwd(cwd, sizeof(cwd)) != NULL ? strrchr(cwd, '/') : NULL;
+    b.out = name != NULL && name[1] != '\0' ? name + 1 : "a.out";
+  }
+  if (compile_cache_open(&b.cache) < 0) {
+    say("build: %s", "gcc does not run");
+    return 1;
+  }
+  if (mkdir(BUILD_DIR, 0755) < 0 && errno != EEXIST) {
+    say("build: cannot make %s", BUILD_DIR);
+    return 1;
+  }
+
+  b.units = (Unit *)calloc(source_count, sizeof(Unit));
+  if (b.units == NULL) {
+    return 1;
+  }
+  for (size_t i = 0; i < source_count; i++) {
+    long file = find_file(&b, sources[i]);
+    if (file < 0) {
+      return 1;
+    }
+    Unit *u = &b.units[b.unit_count++];
+    u->build = &b;
+    u->file = (size_t)file;
+    u->object = object_path(sources[i]);
+    if (u->object == NULL) {
+      return 1;
+    }
+  }
+  load_graph(&b);
+
+  //what changed, and the units it reaches
+  size_t stale = 0;
+  for (size_t i = 0; i < b.unit_count; i++) {
+    Unit *u = &b.units[i];
+    if (refresh(&b, u->file) < 0) {
+      say("build: %s", "out of memory");
+      return 1;
+    }
+    if (b.files[u->file].missing) {
+      say("build: %s: No such file", b.files[u->file].path);
+      return 1;
+    }
+    unit_key(&b, u);
+    struct stat st;
+    if (u->key.h != u->built.h || stat(u->object, &st) < 0) {
+      stale++;
+    }
+  }
+
+  ThreadPool *pool = stale > 1 ? thread_pool_create(threads) : NULL;
+  if (stale > 0) {
+    char what[64];
+    snprintf(what, sizeof(what), "%zu of %zu", stale, b.unit_count);
+    say("build: %s sources to compile", what);
+  }
+  TaskGroup group;
+  task_group_init(&group);
+  for (size_t i = 0; i < b.unit_count; i++) {
+    Unit *u = &b.units[i];
+    struct stat st;
+    if (u->key.h == u->built.h && stat(u->object, &st) == 0) {
+      u->state = UNIT_UP_TO_DATE;
+    } else if (pool == NULL || thread_pool_submit(pool, &group, compile_unit, u) < 0) {
+      compile_unit(u);
+    }
+  }
+  if (pool != NULL) {
+    task_group_wait(pool, &group);
+    thread_pool_destroy(pool);
+  }
+  task_group_destroy(&group);
+
+  size_t counts[4] = {0};
+  for (size_t i = 0; i < b.unit_count; i++) {
+    counts[b.units[i].state]++;
+  }
+  int status = 0;
+  CacheKey exe;
+  if (counts[UNIT_FAILED] > 0) {
+    char what[64];
+    snprintf(what, sizeof(what), "%zu of %zu", counts[UNIT_FAILED], b.unit_count);
+    say("Build failed: %s sources did not compile.", what);
+    status = 1;
+  } else {
+    //everything compiled, the link goes last
+    cache_key_init(&exe, &b.cache);
+    cache_key_add_string(&exe, "build-exe");
+    for (size_t i = 0; i < b.link_count; i++) {
+      cache_key_add_string(&exe, b.link_flags[i]);
+    }
+    for (size_t i = 0; i < b.unit_count; i++) {
+      cache_key_add(&exe, &b.units[i].key, sizeof(CacheKey));
+    }
+    struct stat st;
+    if (exe.h != b.exe_built.h || stat(b.out, &st) < 0) {
+      char **args = (char **)calloc(b.unit_count + b.link_count + 4, sizeof(char *));
+      if (args == NULL) {
+        return 1;
+      }
+      size_t at = 0;
+      args[at++] = "gcc";
+      for (size_t i = 0; i < b.unit_count; i++) {
+        args[at++] = b.units[i].object;
+      }
+      memcpy(args + at, b.link_flags, b.link_count * sizeof(char *));
+      at += b.link_count;
+      args[at++] = "-o";
+      args[at] = (char *)b.out;
+      say("  LD      %s", b.out);
+      uint64_t cost = 0;
+      status = compile_cache_run(&b.cache, &exe, "exe", args, b.out, 0777, STDOUT_FILENO, &cost) != 0;
+      free(args);
+      if (status != 0) {
+        say("Build failed: %s did not link.", b.out);
+      }
+    }
+  }
+  save_graph(&b, status == 0 ? &exe : NULL);
+
+  CacheStats total;
+  compile_cache_close(&b.cache, &total);
+  if (status == 0) {
+    char what[PATH_MAX + 128];
+    snprintf(what, sizeof(what), "%s%s, %zu compiled, %zu from the cache, %zu up to date, %.2fs",
+             strchr(b.out, '/') != NULL ? "" : "./", b.out, counts[UNIT_COMPILED], counts[UNIT_CACHED],
+             counts[UNIT_UP_TO_DATE], (now_ns() - start) / 1e9);
+    say("Build successful: %s", what);
+  }
+  return status;
+}
@@ -0,0 +1,27 @@
+#include "builtins.h"
+
+#include <string.h>
+
+const Builtin builtins[] = {
+    {"ls", builtin_ls, NULL},
+    {"cat", builtin_cat, builtin_cat_shell},
+    {"mv", builtin_mv, NULL},
+    {"delete", NULL, builtin_delete_shell},
+    {"jobs", NULL, builtin_jobs_shell},
+    {"touch", builtin_touch, NULL},
+    {"gcc", builtin_gcc, NULL},
+    {"build", builtin_build, NULL},
+    {"grep", builtin_grep, NULL},
+    {"wc", builtin_wc, NULL},
+};
+
+const size_t builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+
+const Builtin *builtin_find(const char *name) {
+  for (size_t i = 0; i < builtin_count; i++) {
+    if (strcmp(builtins[i].name, name) == 0) {
+      return &builtins[i];
+    }
+  }
+  return NULL;
+}
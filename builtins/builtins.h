@@ -0,0 +1,57 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stddef.h>
+#include "../jobs.h"
+
+//a command compiled into the shell, argv[0] is its name and the return
+//value its exit status
+//the shell runs it in a forked child with stdout on the pipe it reads
+//output from, the same way it runs the scripts in shell_cmds, so output
+//streams to the screen as it is written and a crash only takes the child
+typedef int (*BuiltinMain)(int argc, char **argv);
+
+//takes one line of output, without its newline
+typedef void (*BuiltinShow)(const char *line, size_t len, void *ctx);
+
+//what a builtin running inside the shell gets to use
+typedef struct {
+  BuiltinShow show;  //the screen, or the file the output is redirected to
+  void *ctx;
+  ThreadPool *pool;  //NULL when the shell has none
+  Jobs *jobs;        //for work that outlives the command, NULL without a pool
+} BuiltinShell;
+
+//optional, for a builtin that is better off in the shell's own process:
+//when the output is not redirected (or there is no main) the shell calls
+//this instead of forking main, so nothing crosses a pipe and the builtin
+//can leave work running in the background
+//it must not allocate, it runs inside the shell's per-command budget
+typedef int (*BuiltinInShell)(int argc, char **argv, BuiltinShell *shell);
+
+typedef struct {
+  const char *name;
+  BuiltinMain main;       //NULL when it only runs in the shell
+  BuiltinInShell in_shell; //NULL when it only runs in a child
+} Builtin;
+
+//the registry, in no particular order
+extern const Builtin builtins[];
+extern const size_t builtin_count;
+
+//NULL when name is not a native command
+const Builtin *builtin_find(const char *name);
+
+int builtin_ls(int argc, char **argv);
+int builtin_cat(int argc, char **argv);
+int builtin_cat_shell(int argc, char **argv, BuiltinShell *shell);
+int builtin_mv(int argc, char **argv);
+int builtin_delete_shell(int argc, char **argv, BuiltinShell *shell);
+int builtin_jobs_shell(int argc, char **argv, BuiltinShell *shell);
+int builtin_touch(int argc, char **argv);
+int builtin_gcc(int argc, char **argv);
+int builtin_build(int argc, char **argv);
+int builtin_grep(int argc, char **argv);
+int builtin_wc(int argc, char **argv);
+
+#endif
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHUNK (1 << 30) //bytes asked of the kernel per call, it moves what it can
+
+//opens a regular file to read, -1 (with the old message written) otherwise
+static int open_file(const char *path, struct stat *st, void (*say)(const char *msg, size_t len, void *ctx),
+                     void *ctx) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd >= 0 && fstat(fd, st) == 0 && S_ISREG(st->st_mode)) {
+    return fd;
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  char msg[4200];
+  int len = snprintf(msg, sizeof(msg), "cat: %s: No such file", path);
+  say(msg, len < (int)sizeof(msg) ? (size_t)len : sizeof(msg) - 1, ctx);
+  return -1;
+}
+
+//write(2) everything, 0 or -1
+static int write_all(int out, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(out, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static void say_stdout(const char *msg, size_t len, void *ctx) {
+  (void)ctx;
+  write_all(STDOUT_FILENO, msg, len);
+  write_all(STDOUT_FILENO, "\n", 1);
+}
+
+//the last resort, through user space
+static int copy_read_write(int in, int out) {
+  char buf[64 * 1024];
+  for (;;) {
+    ssize_t n = read(in, buf, sizeof(buf));
+    if (n == 0) {
+      return 0;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (write_all(out, buf, (size_t)n) < 0) {
+      return -1;
+    }
+  }
+}
+
+//moves in to out without the bytes entering user space when the kernel
+//can: copy_file_range into a file (a reflink on file systems that share
+//extents), splice into a pipe, sendfile into anything else
+//each falls through to the next when the kernel or file system says no,
+//before anything was moved
+static int copy_fd(int in, int out) {
+  struct stat st;
+  if (fstat(out, &st) < 0) {
+    return -1;
+  }
+  ssize_t n = -1;
+  int moved = 0;
+
+  if (S_ISREG(st.st_mode)) {
+    while ((n = copy_file_range(in, NULL, out, NULL, CHUNK, 0)) > 0) {
+      moved = 1;
+    }
+    if (n == 0) {
+      return 0;
+    }
+    //EXDEV before 5.3, EBADF when out is O_APPEND (>>)
+    if (moved || (errno != EXDEV && errno != EINVAL && errno != EBADF && errno != ENOSYS &&
+                  errno != EOPNOTSUPP)) {
+      return -1;
+    }
+  } else if (S_ISFIFO(st.st_mode)) {
+    while ((n = splice(in, NULL, out, NULL, CHUNK, SPLICE_F_MORE)) > 0) {
+      moved = 1;
+    }
+    if (n == 0) {
+      return 0;
+    }
+    if (moved || errno != EINVAL) {
+      return -1;
+    }
+  }
+
+  while ((n = sendfile(out, in, NULL, CHUNK)) > 0) {
+    moved = 1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  if (moved || (errno != EINVAL && errno != ENOSYS)) {
+    return -1;
+  }
+  return copy_read_write(in, out);
+}
+
+//cat FILE...
+//used when the output is redirected, stdout is a file or a pipe
+int builtin_cat(int argc, char **argv) {
+  if (argc < 2) {
+    say_stdout("cat: missing file operand", 25, NULL);
+    return 1;
+  }
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    struct stat st;
+    int fd = open_file(argv[i], &st, say_stdout, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    if (copy_fd(fd, STDOUT_FILENO) < 0) {
+      status = 1;
+    }
+    close(fd);
+  }
+  return status;
+}
+
+//cat FILE... to the screen, in the shell itself: each file is mapped and
+//its lines handed to show straight from the mapping, no pipe in between
+int builtin_cat_shell(int argc, char **argv, BuiltinShell *shell) {
+  BuiltinShow show = shell->show;
+  void *ctx = shell->ctx;
+  if (argc < 2) {
+    show("cat: missing file operand", 25, ctx);
+    return 1;
+  }
+  for (int i = 1; i < argc; i++) {
+    struct stat st;
+    int fd = open_file(argv[i], &st, show, ctx);
+    if (fd < 0) {
+      continue;
+    }
+    if (st.st_size == 0) {
+      close(fd);
+      continue;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      show("cat: cannot map file", 20, ctx);
+      continue;
+    }
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    const char *line = data;
+    const char *end = data + size;
+    while (line < end) {
+      const char *newline = (const char *)memchr(line, '\n', (size_t)(end - line));
+      const char *stop = newline != NULL ? newline : end;
+      show(line, (size_t)(stop - line), ctx);
+      line = stop + 1;
+    }
+    munmap((void *)data, size);
+  }
+  return 0;
+}
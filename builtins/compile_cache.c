@@ -0,0 +1,560 @@
+#define _GNU_SOURCE
+#include "compile_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FNV_OFFSET (((unsigned __int128)0x6c62272e07bb0142ull << 64) | 0x62b821756295c58dull)
+#define FNV_PRIME (((unsigned __int128)0x0000000001000000ull << 64) | 0x000000000000013bull)
+#define READ_BUFFER (64 * 1024)
+#define MESSAGES_MAX (1024 * 1024) //of what gcc prints, kept with an entry
+#define CACHE_MAX (1024ull * 1024 * 1024) //bytes, past it the least recently used go down to 3/4 of it
+
+extern char **environ;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void cache_key_add(CacheKey *key, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  unsigned __int128 h = key->h;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= FNV_PRIME;
+  }
+  key->h = h;
+}
+
+//with its terminator, so "ab","c" and "a","bc" differ
+void cache_key_add_string(CacheKey *key, const char *s) {
+  cache_key_add(key, s, strlen(s) + 1);
+}
+
+void cache_key_init(CacheKey *key, const CompileCache *cache) {
+  *key = cache->compiler;
+}
+
+static void key_hex(const CacheKey *key, char hex[33]) {
+  snprintf(hex, 33, "%016llx%016llx", (unsigned long long)(key->h >> 64), (unsigned long long)key->h);
+}
+
+//starts args with stdin from /dev/null and stdout and stderr on out and err
+static int spawn(char *const *args, int out, int err, pid_t *pid) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, err, STDERR_FILENO);
+  int rc = posix_spawnp(pid, args[0], &actions, NULL, args, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  return rc == 0 ? 0 : -1;
+}
+
+static int wait_for(pid_t pid) {
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+//write(2) everything, 0 or -1
+static int write_all(int out, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(out, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+//the contents of a memfd gcc printed into (or a meta file), from the start
+static char *read_messages(int fd, size_t *len) {
+  off_t size = lseek(fd, 0, SEEK_END);
+  *len = size > 0 ? (size_t)(size < MESSAGES_MAX ? size : MESSAGES_MAX) : 0;
+  char *text = (char *)malloc(*len + 1);
+  if (text == NULL || pread(fd, text, *len, 0) != (ssize_t)*len) {
+    free(text);
+    *len = 0;
+    return NULL;
+  }
+  return text;
+}
+
+//everything of in into a new file at path with mode: copy_file_range,
+//which shares the extents on file systems that can, or reads and writes
+//written next to path and renamed over it, so nobody sees half of it
+static int copy_file(CompileCache *cache, int in, const char *path, mode_t mode) {
+  char tmp[PATH_MAX];
+  if (snprintf(tmp, sizeof(tmp), "%s.%d.%u.tmp", path, (int)getpid(), atomic_fetch_add(&cache->sequence, 1)) >=
+      (int)sizeof(tmp)) {
+    return -1;
+  }
+  int out = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+  if (out < 0) {
+    return -1;
+  }
+  ssize_t n;
+  off_t at = 0;
+  while ((n = copy_file_range(in, &at, out, NULL, 1 << 30, 0)) > 0) {
+  }
+  if (n < 0) {
+    char buf[READ_BUFFER];
+    while ((n = pread(in, buf, sizeof(buf), at)) > 0 && write_all(out, buf, (size_t)n) == 0) {
+      at += n;
+    }
+  }
+  if (close(out) < 0 || n < 0 || rename(tmp, path) < 0) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+static int entry_path(CompileCache *cache, const CacheKey *key, const char *kind, const char *suffix, char *path,
+                      size_t size) {
+  char hex[33];
+  key_hex(key, hex);
+  return snprintf(path, size, "%s/%s.%s%s", cache->dir, hex, kind, suffix) < (int)size ? 0 : -1;
+}
+
+//mkdir -p
+static int make_dirs(char *path) {
+  for (char *p = path + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      int rc = mkdir(path, 0755);
+      *p = '/';
+      if (rc < 0 && errno != EEXIST) {
+        return -1;
+      }
+    }
+  }
+  return mkdir(path, 0755) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+int compile_cache_open(CompileCache *cache) {
+  memset(cache, 0, sizeof(*cache));
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int len;
+  if (xdg != NULL && xdg[0] == '/') {
+    len = snprintf(cache->dir, sizeof(cache->dir), "%s/terrabine/gcc", xdg);
+  } else if (home != NULL && home[0] == '/') {
+    len = snprintf(cache->dir, sizeof(cache->dir), "%s/.cache/terrabine/gcc", home);
+  } else {
+    return -1;
+  }
+  if (len >= (int)sizeof(cache->dir) || make_dirs(cache->dir) < 0) {
+    return -1;
+  }
+
+  //the compiler is known by what it says it is, a new gcc is a new cache
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+    return -1;
+  }
+  char *args[] = {"gcc", "-dumpfullversion", "-dumpmachine", NULL};
+  pid_t pid;
+  int started = spawn(args, pipe_fds[1], pipe_fds[1], &pid);
+  close(pipe_fds[1]);
+  cache->compiler.h = FNV_OFFSET;
+  char buf[256];
+  ssize_t n;
+  while (started == 0 && (n = read(pipe_fds[0], buf, sizeof(buf))) > 0) {
+    cache_key_add(&cache->compiler, buf, (size_t)n);
+  }
+  close(pipe_fds[0]);
+  return started == 0 && wait_for(pid) == 0 ? 0 : -1;
+}
+
+int cache_key_add_source(CacheKey *key, char *const *flags, const char *src, int out) {
+  size_t flag_count = 0;
+  while (flags[flag_count] != NULL) {
+    flag_count++;
+  }
+  char **args = (char **)malloc((flag_count + 4) * sizeof(char *));
+  char *buf = (char *)malloc(READ_BUFFER);
+  int messages = memfd_create("gcc-messages", MFD_CLOEXEC);
+  int pipe_fds[2] = {-1, -1};
+  int status = -1;
+  pid_t pid;
+  if (args != NULL && buf != NULL && messages >= 0 && pipe2(pipe_fds, O_CLOEXEC) == 0) {
+    args[0] = "gcc";
+    memcpy(args + 1, flags, flag_count * sizeof(char *));
+    args[flag_count + 1] = "-E";
+    args[flag_count + 2] = (char *)src;
+    args[flag_count + 3] = NULL;
+    if (spawn(args, pipe_fds[1], messages, &pid) == 0) {
+      close(pipe_fds[1]);
+      pipe_fds[1] = -1;
+      ssize_t n;
+      while ((n = read(pipe_fds[0], buf, READ_BUFFER)) > 0) {
+        cache_key_add(key, buf, (size_t)n);
+      }
+      status = wait_for(pid);
+    }
+  }
+  //what it warned about is shown again by the compile, so only errors
+  if (status != 0 && messages >= 0) {
+    size_t len;
+    char *text = read_messages(messages, &len);
+    if (text != NULL) {
+      write_all(out, text, len);
+    }
+    free(text);
+  }
+  for (int i = 0; i < 2; i++) {
+    if (pipe_fds[i] >= 0) {
+      close(pipe_fds[i]);
+    }
+  }
+  if (messages >= 0) {
+    close(messages);
+  }
+  free(buf);
+  free(args);
+  return status == 0 ? 0 : -1;
+}
+
+int cache_key_add_file(CacheKey *key, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  char buf[READ_BUFFER];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    cache_key_add(key, buf, (size_t)n);
+  }
+  close(fd);
+  return n < 0 ? -1 : 0;
+}
+
+uint64_t compile_cache_show(CompileCache *cache, const CacheKey *key, const char *kind, int out) {
+  char path[PATH_MAX];
+  int fd;
+  if (entry_path(cache, key, kind, ".meta", path, sizeof(path)) < 0 || (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return 0;
+  }
+  size_t len;
+  char *meta = read_messages(fd, &len);
+  close(fd);
+  if (meta == NULL) {
+    return 0;
+  }
+  meta[len] = '\0';
+  uint64_t cost = strtoull(meta, NULL, 10);
+  char *text = strchr(meta, '\n');
+  if (text != NULL && text + 1 < meta + len) {
+    write_all(out, text + 1, (size_t)(meta + len - text - 1));
+  }
+  free(meta);
+  return cost;
+}
+
+int compile_cache_restore(CompileCache *cache, const CacheKey *key, const char *kind, const char *product,
+                          mode_t mode, int out, uint64_t *cost) {
+  char path[PATH_MAX];
+  if (entry_path(cache, key, kind, "", path, sizeof(path)) < 0) {
+    return 0;
+  }
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  int copied = copy_file(cache, fd, product, mode);
+  //the entry's time is when it was last used, what eviction goes by
+  if (copied == 0) {
+    futimens(fd, NULL);
+  }
+  close(fd);
+  if (copied < 0) {
+    return 0;
+  }
+
+  uint64_t saved = compile_cache_show(cache, key, kind, out);
+  atomic_fetch_add(&cache->hits, 1);
+  atomic_fetch_add(&cache->saved_ns, saved);
+  *cost = saved;
+  return 1;
+}
+
+//keeps product under key and kind, the meta file first
+static void store(CompileCache *cache, const CacheKey *key, const char *kind, const char *product,
+                  const char *messages, size_t len, uint64_t cost) {
+  char path[PATH_MAX];
+  char tmp[PATH_MAX];
+  if (entry_path(cache, key, kind, ".meta", path, sizeof(path)) < 0 ||
+      snprintf(tmp, sizeof(tmp), "%s.%d.%u.tmp", path, (int)getpid(), atomic_fetch_add(&cache->sequence, 1)) >=
+          (int)sizeof(tmp)) {
+    return;
+  }
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return;
+  }
+  int ok = dprintf(fd, "%llu\n", (unsigned long long)cost) > 0 && write_all(fd, messages, len) == 0;
+  if (close(fd) < 0 || !ok || rename(tmp, path) < 0) {
+    unlink(tmp);
+    return;
+  }
+  if (entry_path(cache, key, kind, "", path, sizeof(path)) < 0 ||
+      (fd = open(product, O_RDONLY | O_CLOEXEC)) < 0) {
+    return;
+  }
+  copy_file(cache, fd, path, 0644);
+  close(fd);
+}
+
+int compile_cache_run(CompileCache *cache, const CacheKey *key, const char *kind, char *const *args,
+                      const char *product, mode_t mode, int out, uint64_t *cost) {
+  if (compile_cache_restore(cache, key, kind, product, mode, out, cost)) {
+    return 0;
+  }
+
+  int messages = memfd_create("gcc-messages", MFD_CLOEXEC);
+  if (messages < 0) {
+    return -1;
+  }
+  uint64_t start = now_ns();
+  pid_t pid;
+  int status = spawn(args, messages, messages, &pid) == 0 ? wait_for(pid) : -1;
+  uint64_t took = now_ns() - start;
+  size_t len = 0;
+  char *text = read_messages(messages, &len);
+  close(messages);
+  if (text != NULL && len > 0) {
+    write_all(out, text, len);
+  }
+  atomic_fetch_add(&cache->misses, 1);
+  if (status == 0) {
+    store(cache, key, kind, product, text != NULL ? text : "", len, *cost + took);
+  }
+  *cost += took;
+  free(text);
+  return status;
+}
+
+//the counts kept over all runs, "hits misses saved_ns"
+static void read_counts(int fd, CacheStats *stats) {
+  char buf[128];
+  ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+  buf[n > 0 ? n : 0] = '\0';
+  if (sscanf(buf, "%llu %llu %llu", &stats->hits, &stats->misses, &stats->saved_ns) != 3) {
+    stats->hits = stats->misses = stats->saved_ns = 0;
+  }
+}
+
+static int open_counts(CompileCache *cache, int flags) {
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/stats", cache->dir) >= (int)sizeof(path)) {
+    return -1;
+  }
+  return open(path, flags | O_CLOEXEC, 0644);
+}
+
+static void evict(CompileCache *cache, unsigned long long bytes);
+
+void compile_cache_close(CompileCache *cache, CacheStats *total) {
+  memset(total, 0, sizeof(*total));
+  int fd = open_counts(cache, O_RDWR | O_CREAT);
+  if (fd < 0) {
+    return;
+  }
+  //other shells and builds add to it as well
+  flock(fd, LOCK_EX);
+  read_counts(fd, total);
+  total->hits += atomic_load(&cache->hits);
+  total->misses += atomic_load(&cache->misses);
+  total->saved_ns += atomic_load(&cache->saved_ns);
+  char buf[128];
+  int len = snprintf(buf, sizeof(buf), "%llu %llu %llu\n", total->hits, total->misses, total->saved_ns);
+  if (pwrite(fd, buf, (size_t)len, 0) == len) {
+    ftruncate(fd, len);
+  }
+  //under the lock, so one run at a time cuts the cache back
+  CacheStats stats;
+  if (compile_cache_stats(cache, &stats) == 0 && stats.bytes > CACHE_MAX) {
+    evict(cache, stats.bytes);
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+//calls entry for each product in the cache and each file being written
+static int for_each_entry(CompileCache *cache, void (*entry)(int dir, const char *name, void *ctx), void *ctx) {
+  DIR *dir = opendir(cache->dir);
+  if (dir == NULL) {
+    return -1;
+  }
+  struct dirent *d;
+  while ((d = readdir(dir)) != NULL) {
+    if (d->d_name[0] != '.' && strcmp(d->d_name, "stats") != 0) {
+      entry(dirfd(dir), d->d_name, ctx);
+    }
+  }
+  closedir(dir);
+  return 0;
+}
+
+static void count_entry(int dir, const char *name, void *ctx) {
+  CacheStats *stats = (CacheStats *)ctx;
+  struct stat st;
+  if (fstatat(dir, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+    stats->bytes += (unsigned long long)st.st_size;
+    size_t len = strlen(name);
+    if (len < 5 || strcmp(name + len - 5, ".meta") != 0) {
+      stats->entries++;
+    }
+  }
+}
+
+int compile_cache_stats(CompileCache *cache, CacheStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  int fd = open_counts(cache, O_RDONLY);
+  if (fd >= 0) {
+    read_counts(fd, stats);
+    close(fd);
+  }
+  return for_each_entry(cache, count_entry, stats);
+}
+
+//a product and its meta file, for eviction
+typedef struct {
+  struct timespec used;
+  unsigned long long bytes;
+  char name[NAME_MAX + 1];
+} Entry;
+
+typedef struct {
+  Entry *entries;
+  size_t count;
+  size_t cap;
+} Entries;
+
+static int is_suffix(const char *name, const char *suffix) {
+  size_t len = strlen(name);
+  size_t suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+//the meta files and the files still being written are not entries
+static void list_entry(int dir, const char *name, void *ctx) {
+  Entries *list = (Entries *)ctx;
+  struct stat st;
+  if (is_suffix(name, ".meta") || is_suffix(name, ".tmp") || fstatat(dir, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+    return;
+  }
+  if (list->count == list->cap) {
+    size_t cap = list->cap == 0 ? 256 : list->cap * 2;
+    Entry *grown = (Entry *)realloc(list->entries, cap * sizeof(Entry));
+    if (grown == NULL) {
+      return;
+    }
+    list->entries = grown;
+    list->cap = cap;
+  }
+  Entry *entry = &list->entries[list->count++];
+  char meta_name[NAME_MAX + 6];
+  snprintf(meta_name, sizeof(meta_name), "%s.meta", name);
+  struct stat meta;
+  entry->bytes = (unsigned long long)st.st_size +
+                 (fstatat(dir, meta_name, &meta, AT_SYMLINK_NOFOLLOW) == 0 ? (unsigned long long)meta.st_size : 0);
+  entry->used = st.st_mtim;
+  snprintf(entry->name, sizeof(entry->name), "%s", name);
+}
+
+static int least_recent_first(const void *a, const void *b) {
+  const struct timespec *x = &((const Entry *)a)->used;
+  const struct timespec *y = &((const Entry *)b)->used;
+  if (x->tv_sec != y->tv_sec) {
+    return x->tv_sec < y->tv_sec ? -1 : 1;
+  }
+  return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+//removes the least recently used entries until the cache holds 3/4 of
+//CACHE_MAX, so it is not cut back again on every run; the product goes
+//first, an entry without one is a miss
+static void evict(CompileCache *cache, unsigned long long bytes) {
+  Entries list = {0};
+  int dir = open(cache->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir < 0 || for_each_entry(cache, list_entry, &list) < 0) {
+    if (dir >= 0) {
+      close(dir);
+    }
+    free(list.entries);
+    return;
+  }
+  qsort(list.entries, list.count, sizeof(Entry), least_recent_first);
+  for (size_t i = 0; i < list.count && bytes > CACHE_MAX / 4 * 3; i++) {
+    Entry *entry = &list.entries[i];
+    if (unlinkat(dir, entry->name, 0) < 0) {
+      continue;
+    }
+    char meta_name[NAME_MAX + 6];
+    snprintf(meta_name, sizeof(meta_name), "%s.meta", entry->name);
+    unlinkat(dir, meta_name, 0);
+    bytes = bytes > entry->bytes ? bytes - entry->bytes : 0;
+  }
+  close(dir);
+  free(list.entries);
+}
+
+static void remove_entry(int dir, const char *name, void *ctx) {
+  (void)ctx;
+  unlinkat(dir, name, 0);
+}
+
+int compile_cache_clear(CompileCache *cache) {
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/stats", cache->dir) < (int)sizeof(path)) {
+    unlink(path);
+  }
+  return for_each_entry(cache, remove_entry, NULL);
+}
+
+int gcc_takes_value(const char *arg) {
+  static const char *const options[] = {"-I", "-D", "-U", "-include", "-imacros", "-isystem", "-iquote",
+                                        "-idirafter", "-L", "-l", "-Xlinker", "-T", NULL};
+  for (size_t i = 0; options[i] != NULL; i++) {
+    if (strcmp(arg, options[i]) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int gcc_link_only(const char *arg) {
+  static const char *const prefixes[] = {"-l", "-L", "-Wl,", "-Xlinker", "-static", "-shared", "-pie", "-no-pie",
+                                         "-rdynamic", "-nostdlib", "-nostartfiles", "-T", NULL};
+  for (size_t i = 0; prefixes[i] != NULL; i++) {
+    if (strncmp(arg, prefixes[i], strlen(prefixes[i])) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
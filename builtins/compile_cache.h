@@ -0,0 +1,91 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+//128 bit FNV-1a over everything that decides what gcc makes of a source
+typedef struct {
+  unsigned __int128 h;
+} CacheKey;
+
+//a directory of what gcc made before, one file per product named after
+//its key (KEY.o, KEY.exe) next to a KEY.o.meta holding how long it took to
+//make and what gcc printed meanwhile, so a hit shows the same warnings
+//the key starts from gcc's version and target and takes the flags and the
+//preprocessed source, every header included is part of it that way
+//safe to use from several threads at once, the counts are this run's
+typedef struct {
+  char dir[PATH_MAX];
+  CacheKey compiler;
+  atomic_uint hits;
+  atomic_uint misses;
+  atomic_ullong saved_ns; //compile time the hits did not spend
+  atomic_uint sequence;   //names of files being written
+} CompileCache;
+
+//what the cache holds over all runs
+typedef struct {
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long saved_ns;
+  unsigned long long entries;
+  unsigned long long bytes;
+} CacheStats;
+
+//the cache in $XDG_CACHE_HOME/terrabine/gcc (~/.cache when unset), -1
+//when it cannot be made or gcc does not run
+int compile_cache_open(CompileCache *cache);
+
+//adds this run's counts to the ones kept in the cache, and gets the sums
+//a cache grown past 1 GB loses its least recently used entries here
+void compile_cache_close(CompileCache *cache, CacheStats *total);
+
+int compile_cache_stats(CompileCache *cache, CacheStats *stats);
+
+//removes every entry and the counts
+int compile_cache_clear(CompileCache *cache);
+
+//a key starting from the compiler's
+void cache_key_init(CacheKey *key, const CompileCache *cache);
+void cache_key_add(CacheKey *key, const void *data, size_t len);
+void cache_key_add_string(CacheKey *key, const char *s);
+
+//adds src as gcc -E flags makes it, -1 when the preprocessor fails, what
+//it said is written to out then
+int cache_key_add_source(CacheKey *key, char *const *flags, const char *src, int out);
+
+//adds the contents of a file given to the linker as it is
+int cache_key_add_file(CacheKey *key, const char *path);
+
+//shows what gcc printed when the entry under key and kind was made, in one
+//write, and returns how long making it took (the meta file is written
+//before the entry, so it is complete once the entry is there)
+uint64_t compile_cache_show(CompileCache *cache, const CacheKey *key, const char *kind, int out);
+
+//copies the entry under key and kind to product and shows what gcc printed
+//when it was made, 1 on a hit and 0 when there is no such entry
+//cost becomes the compile time the hit saved
+int compile_cache_restore(CompileCache *cache, const CacheKey *key, const char *kind, const char *product,
+                          mode_t mode, int out, uint64_t *cost);
+
+//makes product with mode: copied out of the cache under key and kind, or
+//made by running args (a gcc command line) and kept there when it succeeds
+//what gcc prints goes to out in one write, so runs in parallel never mix
+//their lines
+//cost is what the inputs of this step took, it is kept with the entry, and
+//becomes what the step took, or saved when it was a hit
+//returns gcc's exit status, 0 on a hit and -1 when gcc could not run
+int compile_cache_run(CompileCache *cache, const CacheKey *key, const char *kind, char *const *args,
+                      const char *product, mode_t mode, int out, uint64_t *cost);
+
+//an option of gcc whose value is the next argument (-I dir, -l m, ...)
+int gcc_takes_value(const char *arg);
+
+//an option only the linker needs, left out of compiles
+int gcc_link_only(const char *arg);
+
+#endif
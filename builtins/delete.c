@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dirents.h"
+
+#define TRASH_NAME ".terrabine-trash"
+#define PURGE_BUFFER (64 * 1024) //bytes of entries per getdents64 call in a purge task
+#define TREE_BUFFER 2048         //the same in remove_tree, one per level of the tree
+
+static unsigned trash_sequence; //the middle of <pid>.<sequence>.<name> in a trash
+
+//a directory of a tree being purged, one task each
+typedef struct {
+  Job *job;
+  char path[];
+} PurgeDir;
+
+static void say(BuiltinShell *shell, const char *format, const char *path, int number) {
+  char line[PATH_MAX + 128];
+  int len = snprintf(line, sizeof(line), format, path, number);
+  shell->show(line, len < (int)sizeof(line) ? (size_t)len : sizeof(line) - 1, shell->ctx);
+}
+
+static void count_done(Job *job) {
+  if (job != NULL) {
+    atomic_fetch_add(&job->done, 1);
+  }
+}
+
+//removes name (in dirfd) and everything under it depth first, without the
+//heap: the directories a parallel purge leaves, or all of a tree when
+//there is no pool to purge it on
+static int remove_tree(int dirfd, const char *name, Job *job) {
+  int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno != ENOTDIR && errno != ELOOP) {
+      return errno == ENOENT ? 0 : -1;
+    }
+    if (unlinkat(dirfd, name, 0) < 0) {
+      return errno == ENOENT ? 0 : -1;
+    }
+    count_done(job);
+    return 0;
+  }
+
+  int status = 0;
+  char buf[TREE_BUFFER];
+  //entries removed while reading can hide others on some file systems, so
+  //go over the directory again until it is empty
+  for (int pass = 0; pass < 2; pass++) {
+    long n;
+    while ((n = read_dirents(fd, buf, sizeof(buf))) > 0) {
+      for (long at = 0; at < n;) {
+        struct linux_dirent64 *entry = (struct linux_dirent64 *)(buf + at);
+        at += entry->d_reclen;
+        if (is_dot_or_dotdot(entry->d_name)) {
+          continue;
+        }
+        if (entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN) {
+          if (remove_tree(fd, entry->d_name, job) < 0) {
+            status = -1;
+          }
+        } else if (unlinkat(fd, entry->d_name, 0) == 0) {
+          count_done(job);
+        } else if (errno != ENOENT) {
+          status = -1;
+        }
+      }
+    }
+    if (unlinkat(dirfd, name, AT_REMOVEDIR) == 0) {
+      count_done(job);
+      close(fd);
+      return status;
+    }
+    if (errno != ENOTEMPTY || lseek(fd, 0, SEEK_SET) < 0) {
+      break;
+    }
+  }
+  close(fd);
+  return -1;
+}
+
+static void purge_dir(void *arg);
+
+static void purge_later(Job *job, const char *parent, const char *name) {
+  size_t parent_len = strlen(parent);
+  size_t name_len = strlen(name);
+  PurgeDir *dir = (PurgeDir *)malloc(sizeof(PurgeDir) + parent_len + name_len + 2);
+  //left for the final pass over the tree when this fails
+  if (dir == NULL) {
+    return;
+  }
+  dir->job = job;
+  memcpy(dir->path, parent, parent_len);
+  dir->path[parent_len] = '/';
+  memcpy(dir->path + parent_len + 1, name, name_len + 1);
+  if (thread_pool_submit(job->pool, &job->group, purge_dir, dir) < 0) {
+    free(dir);
+  }
+}
+
+//unlinks every file of a directory and hands each directory in it to
+//another task, so a wide or deep tree keeps every worker busy
+//directories themselves are left for remove_tree once it is all done
+static void purge_dir(void *arg) {
+  PurgeDir *dir = (PurgeDir *)arg;
+  Job *job = dir->job;
+  int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    free(dir);
+    return;
+  }
+  char *buf = (char *)malloc(PURGE_BUFFER);
+  long n;
+  while (buf != NULL && (n = read_dirents(fd, buf, PURGE_BUFFER)) > 0) {
+    for (long at = 0; at < n;) {
+      struct linux_dirent64 *entry = (struct linux_dirent64 *)(buf + at);
+      at += entry->d_reclen;
+      if (is_dot_or_dotdot(entry->d_name)) {
+        continue;
+      }
+      atomic_fetch_add(&job->total, 1);
+      unsigned char type = entry->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        type = fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+      }
+      if (type == DT_DIR) {
+        purge_later(job, dir->path, entry->d_name);
+      } else if (unlinkat(fd, entry->d_name, 0) == 0) {
+        atomic_fetch_add(&job->done, 1);
+      }
+    }
+  }
+  free(buf);
+  close(fd);
+  free(dir);
+}
+
+//the background job of one delete -r: the files go in parallel, then the
+//empty directories in one pass
+static void purge(void *arg) {
+  Job *job = (Job *)arg;
+  atomic_store(&job->total, 1); //the top directory itself
+  size_t len = strlen(job->path);
+  PurgeDir *top = (PurgeDir *)malloc(sizeof(PurgeDir) + len + 1);
+  if (top != NULL) {
+    top->job = job;
+    memcpy(top->path, job->path, len + 1);
+    if (thread_pool_submit(job->pool, &job->group, purge_dir, top) < 0) {
+      free(top);
+    }
+  }
+  task_group_wait(job->pool, &job->group);
+  jobs_finish(job, remove_tree(AT_FDCWD, job->path, job) < 0);
+}
+
+//last path component, trailing slashes left out, "/" for the root
+static const char *last_name(const char *path, size_t *len) {
+  size_t end = strlen(path);
+  while (end > 1 && path[end - 1] == '/') {
+    end--;
+  }
+  size_t start = end;
+  while (start > 0 && path[start - 1] != '/') {
+    start--;
+  }
+  if (start == end && end > 0) {
+    start--; //only slashes
+  }
+  *len = end - start;
+  return path + start;
+}
+
+//renames path into the trash of its file system, which is the same
+//rename wherever the path is: the trash at the root of the mount if it can
+//be made there, else one in the directory holding path
+//trashed gets the new name, -1 when neither works (a mount point, or no
+//write access)
+static int move_to_trash(const char *path, char *trashed, size_t size) {
+  struct stat st;
+  if (lstat(path, &st) < 0) {
+    return -1;
+  }
+
+  //the directory holding path, and the last component
+  char parent[PATH_MAX];
+  size_t len;
+  const char *name = last_name(path, &len);
+  int name_len = (int)len;
+  size_t slash = (size_t)(name - path);
+  if (slash == 0) {
+    snprintf(parent, sizeof(parent), ".");
+  } else {
+    snprintf(parent, sizeof(parent), "%.*s", (int)(slash > 1 ? slash - 1 : 1), path);
+  }
+  char real_parent[PATH_MAX];
+  if (realpath(parent, real_parent) == NULL) {
+    return -1;
+  }
+
+  //walk up while the directory above is on the same file system
+  char mount[PATH_MAX];
+  snprintf(mount, sizeof(mount), "%s", real_parent);
+  while (strcmp(mount, "/") != 0) {
+    char up[PATH_MAX];
+    char *last = strrchr(mount, '/');
+    size_t up_len = last == mount ? 1 : (size_t)(last - mount);
+    memcpy(up, mount, up_len);
+    up[up_len] = '\0';
+    struct stat up_st;
+    if (stat(up, &up_st) < 0 || up_st.st_dev != st.st_dev) {
+      break;
+    }
+    memcpy(mount, up, up_len + 1);
+  }
+
+  const char *places[] = {mount, real_parent};
+  for (int i = 0; i < 2; i++) {
+    char trash[PATH_MAX];
+    if (snprintf(trash, sizeof(trash), "%s/%s", strcmp(places[i], "/") == 0 ? "" : places[i], TRASH_NAME) >=
+        (int)sizeof(trash)) {
+      continue;
+    }
+    mkdir(trash, 0700);
+    struct stat ts;
+    if (lstat(trash, &ts) < 0 || !S_ISDIR(ts.st_mode) || ts.st_uid != getuid() || ts.st_dev != st.st_dev) {
+      continue;
+    }
+    if (snprintf(trashed, size, "%s/%d.%u.%.*s", trash, (int)getpid(), trash_sequence++, name_len, name) >= (int)size) {
+      continue;
+    }
+    if (rename(path, trashed) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+//a tree stays in the trash when the shell that put it there exits before
+//the purge is done: every entry of the trash whose pid is not running any
+//more is renamed to this shell's pid, so two shells never take the same
+//one, and purged as a job of its own
+static void sweep_trash(BuiltinShell *shell, const char *trashed) {
+  const char *slash = strrchr(trashed, '/');
+  char trash[PATH_MAX];
+  snprintf(trash, sizeof(trash), "%.*s", (int)(slash - trashed), trashed);
+  int fd = open(trash, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  char buf[TREE_BUFFER];
+  long n;
+  while ((n = read_dirents(fd, buf, sizeof(buf))) > 0) {
+    for (long at = 0; at < n;) {
+      struct linux_dirent64 *entry = (struct linux_dirent64 *)(buf + at);
+      at += entry->d_reclen;
+      char *end;
+      long pid = strtol(entry->d_name, &end, 10);
+      if (pid <= 0 || *end != '.' || pid == getpid() || kill((pid_t)pid, 0) == 0 || errno != ESRCH) {
+        continue;
+      }
+      const char *name = strchr(end + 1, '.'); //past the sequence
+      char path[PATH_MAX];
+      if (name == NULL || snprintf(path, sizeof(path), "%s/%d.%u%s", trash, (int)getpid(), trash_sequence++, name) >=
+                              (int)sizeof(path) ||
+          renameat(fd, entry->d_name, AT_FDCWD, path) < 0) {
+        continue;
+      }
+      char what[PATH_MAX + 32];
+      snprintf(what, sizeof(what), "delete leftover %s", name + 1);
+      Job *job = jobs_start(shell->jobs, what, "removed", path, purge);
+      //out of job slots, the rest waits for the next delete -r
+      if (job == NULL) {
+        close(fd);
+        return;
+      }
+      say(shell, "Purging %s, left in the trash by an earlier shell, as job %d.", name + 1, job->id);
+    }
+  }
+  close(fd);
+}
+
+//delete [-r] PATH...
+//removes files, -r also removes directories: each is renamed into a trash
+//directory on its own file system, which takes no time whatever its size,
+//and purged there on the thread pool in the background, jobs shows how far
+//it got; what an earlier shell left in that trash is purged along with it
+int builtin_delete_shell(int argc, char **argv, BuiltinShell *shell) {
+  int recursive = 0;
+  int first = 1;
+  if (first < argc && strcmp(argv[first], "-r") == 0) {
+    recursive = 1;
+    first++;
+  }
+  if (first == argc) {
+    say(shell, "delete: missing operand", "", 0);
+    return 1;
+  }
+
+  int status = 0;
+  for (int i = first; i < argc; i++) {
+    const char *path = argv[i];
+    struct stat st;
+    if (lstat(path, &st) < 0) {
+      say(shell, "delete: %s: No such file", path, 0);
+      status = 1;
+      continue;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+      if (unlink(path) < 0) {
+        say(shell, "delete: %s: cannot delete", path, 0);
+        status = 1;
+      } else {
+        say(shell, "File '%s' deleted.", path, 0);
+      }
+      continue;
+    }
+    size_t name_len;
+    const char *name = last_name(path, &name_len);
+    if (name_len == 0 || (name[0] == '.' && (name_len == 1 || (name_len == 2 && name[1] == '.'))) ||
+        name[0] == '/') {
+      say(shell, "delete: refusing to delete %s", path, 0);
+      status = 1;
+      continue;
+    }
+    if (!recursive) {
+      say(shell, "delete: %s: is a directory, use delete -r", path, 0);
+      status = 1;
+      continue;
+    }
+
+    char trashed[PATH_MAX];
+    Job *job = NULL;
+    if (shell->jobs != NULL && move_to_trash(path, trashed, sizeof(trashed)) == 0) {
+      char what[PATH_MAX + 16];
+      snprintf(what, sizeof(what), "delete %s", path);
+      job = jobs_start(shell->jobs, what, "removed", trashed, purge);
+      //out of job slots, it is gone from view already so finish it here
+      if (job == NULL && remove_tree(AT_FDCWD, trashed, NULL) < 0) {
+        say(shell, "delete: %s: could not remove all of it", trashed, 0);
+        status = 1;
+        continue;
+      }
+    } else if (remove_tree(AT_FDCWD, path, NULL) < 0) {
+      say(shell, "delete: %s: could not remove all of it", path, 0);
+      status = 1;
+      continue;
+    }
+    if (job != NULL) {
+      say(shell, "Directory '%s' deleted, purging in the background as job %d.", path, job->id);
+      sweep_trash(shell, trashed);
+    } else {
+      say(shell, "Directory '%s' deleted.", path, 0);
+    }
+  }
+  return status;
+}
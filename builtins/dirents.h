@@ -0,0 +1,29 @@
+#ifndef DIRENTS_H
+#define DIRENTS_H
+
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//what the kernel fills a getdents64 buffer with, entries one after the
+//other, each d_reclen bytes long
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+//reads as many entries of dir as fit into buf, bytes filled, 0 at the end
+//and -1 on an error
+static inline long read_dirents(int dir, void *buf, size_t size) {
+  return syscall(SYS_getdents64, dir, buf, size);
+}
+
+static inline int is_dot_or_dotdot(const char *name) {
+  return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+#endif
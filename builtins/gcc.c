@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "compile_cache.h"
+
+//a gcc command line taken apart
+typedef struct {
+  char **compile_flags; //what the preprocessor and compiler get
+  size_t compile_count;
+  char **link_flags; //what the linker gets
+  size_t link_count;
+  char **sources;
+  size_t source_count;
+  char **inputs; //objects and libraries named on the line, for the linker
+  size_t input_count;
+  const char *out;
+  int compile_only; //-c
+  int debug;        //-g, the objects depend on the directory they are made in
+  int cacheable;
+} GccLine;
+
+static int starts_with(const char *s, const char *prefix) {
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+static int one_of(const char *s, const char *const *list) {
+  for (size_t i = 0; list[i] != NULL; i++) {
+    if (strcmp(s, list[i]) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int is_source(const char *arg) {
+  static const char *const extensions[] = {".c", ".cc", ".cpp", ".cxx", ".c++", ".C", ".i", ".ii", NULL};
+  const char *dot = strrchr(arg, '.');
+  return dot != NULL && strchr(dot, '/') == NULL && one_of(dot, extensions);
+}
+
+//sorts every argument into the lists, anything the cache cannot be sure
+//about (only preprocessing, dependency files, a forced language, ...) makes
+//the line uncacheable and it goes to gcc as it is
+static int parse(GccLine *line, int argc, char **argv) {
+  static const char *const uncacheable[] = {"-E", "-S", "-M", "-x", "-save-temps", "-v", "-###", "--", "-fprofile",
+                                            "-fauto-profile", "@", NULL};
+
+  size_t size = (size_t)argc + 1;
+  line->compile_flags = (char **)calloc(size, sizeof(char *));
+  line->link_flags = (char **)calloc(size, sizeof(char *));
+  line->sources = (char **)calloc(size, sizeof(char *));
+  line->inputs = (char **)calloc(size, sizeof(char *));
+  if (line->compile_flags == NULL || line->link_flags == NULL || line->sources == NULL || line->inputs == NULL) {
+    return -1;
+  }
+  line->cacheable = 1;
+
+  for (int i = 1; i < argc; i++) {
+    char *arg = argv[i];
+    if (arg[0] != '-' || arg[1] == '\0') {
+      if (strcmp(arg, "-") == 0) {
+        line->cacheable = 0;
+      } else if (is_source(arg)) {
+        line->sources[line->source_count++] = arg;
+      } else {
+        line->inputs[line->input_count++] = arg;
+      }
+      continue;
+    }
+    if (strcmp(arg, "-o") == 0) {
+      if (i + 1 == argc) {
+        line->cacheable = 0;
+      } else {
+        line->out = argv[++i];
+      }
+      continue;
+    }
+    if (strcmp(arg, "-c") == 0) {
+      line->compile_only = 1;
+      continue;
+    }
+    for (size_t u = 0; uncacheable[u] != NULL; u++) {
+      if (starts_with(arg, uncacheable[u])) {
+        line->cacheable = 0;
+      }
+    }
+    if (starts_with(arg, "-g") && strcmp(arg, "-g0") != 0) {
+      line->debug = 1;
+    }
+    int link = gcc_link_only(arg);
+    if (!link) {
+      line->compile_flags[line->compile_count++] = arg;
+    }
+    line->link_flags[line->link_count++] = arg;
+    //the value of an option written apart from it goes with it
+    if (gcc_takes_value(arg) && i + 1 < argc) {
+      if (!link) {
+        line->compile_flags[line->compile_count++] = argv[i + 1];
+      }
+      line->link_flags[line->link_count++] = argv[++i];
+    }
+  }
+  if (line->source_count == 0 && (line->compile_only || line->input_count == 0)) {
+    line->cacheable = 0;
+  }
+  if (line->compile_only && line->out != NULL && line->source_count > 1) {
+    line->cacheable = 0; //gcc says no to it
+  }
+  return 0;
+}
+
+//gcc with the line as it is, its messages on stdout
+static int run_plain(char **argv) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    return -1;
+  }
+  if (pid == 0) {
+    dup2(STDOUT_FILENO, STDERR_FILENO);
+    execvp("gcc", argv);
+    _exit(127);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) < 0) {
+    return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+//x.c is compiled into x.o in the current directory
+static char *object_name(const char *src) {
+  const char *base = strrchr(src, '/');
+  base = base != NULL ? base + 1 : src;
+  const char *dot = strrchr(base, '.');
+  char *name = (char *)malloc((size_t)(dot - base) + 3);
+  if (name != NULL) {
+    sprintf(name, "%.*s.o", (int)(dot - base), base);
+  }
+  return name;
+}
+
+//the key of the object src makes with these flags
+static int object_key(CompileCache *cache, GccLine *line, const char *src, CacheKey *key) {
+  cache_key_init(key, cache);
+  cache_key_add_string(key, "o");
+  for (size_t i = 0; i < line->compile_count; i++) {
+    cache_key_add_string(key, line->compile_flags[i]);
+  }
+  char cwd[PATH_MAX];
+  if (line->debug && getcwd(cwd, sizeof(cwd)) != NULL) {
+    cache_key_add_string(key, cwd);
+  }
+  return cache_key_add_source(key, line->compile_flags, src, STDOUT_FILENO);
+}
+
+//compiles every source into objects[i], from the cache when it can
+static int compile_objects(CompileCache *cache, GccLine *line, char **objects, CacheKey *keys, uint64_t *cost) {
+  char **args = (char **)calloc(line->compile_count + 6, sizeof(char *));
+  if (args == NULL) {
+    return -1;
+  }
+  args[0] = "gcc";
+  memcpy(args + 1, line->compile_flags, line->compile_count * sizeof(char *));
+  size_t at = line->compile_count + 1;
+  args[at] = "-c";
+  args[at + 2] = "-o";
+  int status = 0;
+  for (size_t i = 0; i < line->source_count && status == 0; i++) {
+    args[at + 1] = line->sources[i];
+    args[at + 3] = objects[i];
+    uint64_t took = 0;
+    status = compile_cache_run(cache, &keys[i], "o", args, objects[i], 0666, STDOUT_FILENO, &took);
+    *cost += took;
+  }
+  free(args);
+  return status;
+}
+
+//compiles the objects into the cache directory and links them with the
+//rest of the line into out, keeping out under exe
+static int link_executable(CompileCache *cache, GccLine *line, const CacheKey *exe, char **objects, CacheKey *keys,
+                           const char *out) {
+  char **args = (char **)calloc(line->source_count + line->input_count + line->link_count + 4, sizeof(char *));
+  int status = args == NULL ? -1 : 0;
+  for (size_t i = 0; i < line->source_count && status == 0; i++) {
+    if (asprintf(&objects[i], "%s/link.%d.%zu.o", cache->dir, (int)getpid(), i) < 0) {
+      objects[i] = NULL;
+      status = -1;
+    }
+  }
+  uint64_t cost = 0;
+  if (status == 0) {
+    status = compile_objects(cache, line, objects, keys, &cost);
+  }
+  if (status == 0) {
+    size_t at = 0;
+    args[at++] = "gcc";
+    memcpy(args + at, objects, line->source_count * sizeof(char *));
+    at += line->source_count;
+    memcpy(args + at, line->inputs, line->input_count * sizeof(char *));
+    at += line->input_count;
+    memcpy(args + at, line->link_flags, line->link_count * sizeof(char *));
+    at += line->link_count;
+    args[at++] = "-o";
+    args[at] = (char *)out;
+    status = compile_cache_run(cache, exe, "exe", args, out, 0777, STDOUT_FILENO, &cost);
+  }
+  for (size_t i = 0; i < line->source_count; i++) {
+    if (objects[i] != NULL) {
+      unlink(objects[i]);
+    }
+  }
+  free(args);
+  return status;
+}
+
+static void show_cache(CompileCache *cache) {
+  CacheStats total;
+  unsigned hits = atomic_load(&cache->hits);
+  unsigned misses = atomic_load(&cache->misses);
+  double saved = atomic_load(&cache->saved_ns) / 1e9;
+  compile_cache_close(cache, &total);
+  dprintf(STDOUT_FILENO, "gcc cache: %u hit%s, %u miss%s, %.2fs saved (all runs: %llu hits, %llu misses, %.2fs saved)\n",
+          hits, hits == 1 ? "" : "s", misses, misses == 1 ? "" : "es", saved, total.hits, total.misses,
+          total.saved_ns / 1e9);
+}
+
+static int cache_command(const char *what) {
+  CompileCache cache;
+  if (compile_cache_open(&cache) < 0) {
+    dprintf(STDOUT_FILENO, "gcc: no compile cache\n");
+    return 1;
+  }
+  if (strcmp(what, "--cache-clear") == 0) {
+    int rc = compile_cache_clear(&cache);
+    dprintf(STDOUT_FILENO, rc == 0 ? "gcc cache cleared\n" : "gcc: cannot clear %s\n", cache.dir);
+    return rc < 0;
+  }
+  CacheStats stats;
+  compile_cache_stats(&cache, &stats);
+  unsigned long long runs = stats.hits + stats.misses;
+  dprintf(STDOUT_FILENO, "gcc cache %s: %llu entries, %.1f MB\n", cache.dir, stats.entries, stats.bytes / 1048576.0);
+  dprintf(STDOUT_FILENO, "%llu hits, %llu misses (%.0f%% hit), %.2fs of compiling saved\n", stats.hits, stats.misses,
+          runs > 0 ? 100.0 * stats.hits / runs : 0.0, stats.saved_ns / 1e9);
+  return 0;
+}
+
+//gcc [OPTION...] SOURCE... [-o OUT]
+//gcc --cache-stats | --cache-clear
+//gcc through a cache keyed on the preprocessed source, the compiler and
+//the flags: a hit copies the object or the executable out of the cache
+//with the warnings it had instead of compiling, a line the cache cannot
+//judge goes to gcc untouched
+int builtin_gcc(int argc, char **argv) {
+  if (argc < 2) {
+    dprintf(STDOUT_FILENO, "Usage: gcc <source_file.c> [-o output]\n");
+    return 1;
+  }
+  if (argc == 2 && (strcmp(argv[1], "--cache-stats") == 0 || strcmp(argv[1], "--cache-clear") == 0)) {
+    return cache_command(argv[1]);
+  }
+
+  GccLine line = {0};
+  CompileCache cache;
+  int status;
+  if (parse(&line, argc, argv) < 0 || !line.cacheable || compile_cache_open(&cache) < 0) {
+    status = run_plain(argv);
+    dprintf(STDOUT_FILENO, status == 0 ? "Compilation successful.\n" : "Compilation failed.\n");
+    return status != 0;
+  }
+
+  const char *out = line.out != NULL ? line.out : "a.out";
+  char **objects = (char **)calloc(line.source_count + 1, sizeof(char *));
+  CacheKey *keys = (CacheKey *)calloc(line.source_count + 1, sizeof(CacheKey));
+  status = objects == NULL || keys == NULL ? -1 : 0;
+  for (size_t i = 0; i < line.source_count && status == 0; i++) {
+    status = object_key(&cache, &line, line.sources[i], &keys[i]);
+  }
+
+  uint64_t cost = 0;
+  if (status == 0 && line.compile_only) {
+    for (size_t i = 0; i < line.source_count && status == 0; i++) {
+      objects[i] = line.out != NULL ? strdup(line.out) : object_name(line.sources[i]);
+      status = objects[i] == NULL ? -1 : 0;
+    }
+    if (status == 0) {
+      status = compile_objects(&cache, &line, objects, keys, &cost);
+    }
+  } else if (status == 0) {
+    CacheKey exe;
+    cache_key_init(&exe, &cache);
+    cache_key_add_string(&exe, "exe");
+    for (size_t i = 0; i < line.link_count; i++) {
+      cache_key_add_string(&exe, line.link_flags[i]);
+    }
+    cache_key_add(&exe, keys, line.source_count * sizeof(CacheKey));
+    for (size_t i = 0; i < line.input_count && status == 0; i++) {
+      cache_key_add_string(&exe, line.inputs[i]);
+      if (cache_key_add_file(&exe, line.inputs[i]) < 0) {
+        dprintf(STDOUT_FILENO, "gcc: %s: No such file\n", line.inputs[i]);
+        status = 1;
+      }
+    }
+
+    //the executable's key is made of its objects' keys, so a hit needs no
+    //object at all
+    if (status == 0 && compile_cache_restore(&cache, &exe, "exe", out, 0777, STDOUT_FILENO, &cost) == 0) {
+      status = link_executable(&cache, &line, &exe, objects, keys, out);
+    } else if (status == 0) {
+      //what the compiles said comes along too
+      for (size_t i = 0; i < line.source_count; i++) {
+        compile_cache_show(&cache, &keys[i], "o", STDOUT_FILENO);
+      }
+    }
+  }
+
+  if (status == 0) {
+    dprintf(STDOUT_FILENO, "Compilation successful. %s created: %s%s\n", line.compile_only ? "Object" : "Executable",
+            strchr(line.compile_only ? objects[0] : out, '/') != NULL ? "" : "./",
+            line.compile_only ? objects[0] : out);
+  } else {
+    dprintf(STDOUT_FILENO, "Compilation failed.\n");
+  }
+  show_cache(&cache);
+  for (size_t i = 0; objects != NULL && i < line.source_count; i++) {
+    free(objects[i]);
+  }
+  free(objects);
+  free(keys);
+  return status != 0;
+}
@@ -0,0 +1,510 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../str_search.h"
+#include "../thread_pool.h"
+#include "dirents.h"
+
+#define BINARY_PROBE (32 * 1024) //a NUL in the first bytes makes a file binary
+#define WALK_BUFFER (64 * 1024)
+#define OUT_FLUSH (64 * 1024) //the file due on stdout writes once it holds this much
+
+//one grep over all its files
+typedef struct {
+  unsigned long id; //tells one call's search from the next at the same address
+  const char *pattern;
+  char *literal; //what every match has to contain, found with a rare byte scan
+  size_t literal_len;
+  StrFinder finder;
+  int use_regex; //the literal only finds candidate lines, the regex decides
+  int icase;
+  int line_numbers;
+  int count_only;
+  int show_names;
+  atomic_size_t due; //the file whose output can go to stdout now
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+} Search;
+
+//one file and what grep prints for it, printed in the order the files
+//were named whatever order the workers finish them in: the file that is
+//due writes straight to stdout, one that finishes ahead of its turn is
+//held until the ones before it are out
+typedef struct {
+  Search *search;
+  size_t index;
+  char *path;
+  char *out;
+  size_t len;
+  size_t cap;
+  long matches;
+  int error;
+  int lost; //out of memory holding the output, the rest of it is dropped
+  int done;
+} GrepFile;
+
+static void write_all(const char *data, size_t len) {
+  for (size_t at = 0; at < len;) {
+    ssize_t n = write(STDOUT_FILENO, data + at, len - at);
+    if (n <= 0) {
+      return;
+    }
+    at += (size_t)n;
+  }
+}
+
+static void put(GrepFile *file, const char *data, size_t len) {
+  if (file->lost) {
+    return;
+  }
+  if (file->len + len > OUT_FLUSH && atomic_load(&file->search->due) == file->index) {
+    write_all(file->out, file->len);
+    file->len = 0;
+    if (len > OUT_FLUSH) {
+      write_all(data, len);
+      return;
+    }
+  }
+  if (file->len + len > file->cap) {
+    size_t cap = file->cap == 0 ? 4096 : file->cap;
+    while (cap < file->len + len) {
+      cap *= 2;
+    }
+    char *grown = (char *)realloc(file->out, cap);
+    if (grown == NULL) {
+      file->lost = 1;
+      return;
+    }
+    file->out = grown;
+    file->cap = cap;
+  }
+  memcpy(file->out + file->len, data, len);
+  file->len += len;
+}
+
+static void put_string(GrepFile *file, const char *s) {
+  put(file, s, strlen(s));
+}
+
+static void fail(GrepFile *file, const char *what) {
+  char line[PATH_MAX + 64];
+  snprintf(line, sizeof(line), "grep: %s: %s\n", file->path, what);
+  put_string(file, line);
+  file->error = 1;
+}
+
+//regexec takes a lock inside its compiled pattern, so every worker gets a
+//copy of its own to keep them from queueing on it; the calling thread
+//helps too and keeps its copy from one call to the next, so the copy is
+//tied to the call's id rather than the Search, which lives on its stack
+static atomic_ulong search_ids;
+static __thread regex_t thread_regex;
+static __thread unsigned long thread_regex_for; //0 when none is compiled
+
+static regex_t *regex_of(Search *s) {
+  if (thread_regex_for != s->id) {
+    if (thread_regex_for != 0) {
+      regfree(&thread_regex);
+    }
+    if (regcomp(&thread_regex, s->pattern, REG_NEWLINE | (s->icase ? REG_ICASE : 0)) != 0) {
+      thread_regex_for = 0;
+      return NULL;
+    }
+    thread_regex_for = s->id;
+  }
+  return &thread_regex;
+}
+
+//the regex somewhere in [from, to), without copying the text out
+static const char *regex_find(regex_t *re, const char *from, const char *to) {
+  regmatch_t match;
+  match.rm_so = 0;
+  match.rm_eo = to - from;
+  if (regexec(re, from, 1, &match, REG_STARTEND) != 0) {
+    return NULL;
+  }
+  return from + match.rm_so;
+}
+
+static long count_newlines(const char *from, const char *to) {
+  long n = 0;
+  while (from < to && (from = (const char *)memchr(from, '\n', (size_t)(to - from))) != NULL) {
+    n++;
+    from++;
+  }
+  return n;
+}
+
+//every matching line of one mapped file into its output
+static void grep_text(GrepFile *file, const char *data, size_t size) {
+  Search *s = file->search;
+  regex_t *re = s->use_regex ? regex_of(s) : NULL;
+  if (s->use_regex && re == NULL) {
+    fail(file, "bad pattern");
+    return;
+  }
+  int binary = memchr(data, '\0', size < BINARY_PROBE ? size : BINARY_PROBE) != NULL;
+  const char *end = data + size;
+  const char *pos = data; //always at the start of a line
+  const char *counted = data;
+  long line_number = 1;
+
+  while (pos < end && !file->lost) {
+    const char *hit;
+    if (s->literal_len > 0) {
+      hit = str_finder_find(&s->finder, pos, (size_t)(end - pos));
+    } else {
+      hit = regex_find(re, pos, end);
+    }
+    if (hit == NULL) {
+      break;
+    }
+    const char *line = (const char *)memrchr(pos, '\n', (size_t)(hit - pos));
+    line = line != NULL ? line + 1 : pos;
+    const char *line_end = (const char *)memchr(hit, '\n', (size_t)(end - hit));
+    if (line_end == NULL) {
+      line_end = end;
+    }
+    //a candidate the literal found, the whole pattern has to match as well
+    if (s->literal_len > 0 && re != NULL && regex_find(re, line, line_end) == NULL) {
+      pos = line_end + 1;
+      continue;
+    }
+
+    file->matches++;
+    if (binary && !s->count_only) {
+      char msg[PATH_MAX + 32];
+      snprintf(msg, sizeof(msg), "Binary file %s matches\n", file->path);
+      put_string(file, msg);
+      return;
+    }
+    if (!s->count_only) {
+      if (s->show_names) {
+        put_string(file, file->path);
+        put(file, ":", 1);
+      }
+      if (s->line_numbers) {
+        line_number += count_newlines(counted, line);
+        counted = line;
+        char number[32];
+        put(file, number, (size_t)snprintf(number, sizeof(number), "%ld:", line_number));
+      }
+      put(file, line, (size_t)(line_end - line));
+      put(file, "\n", 1);
+    }
+    pos = line_end + 1;
+  }
+}
+
+static void grep_file(void *arg) {
+  GrepFile *file = (GrepFile *)arg;
+  Search *s = file->search;
+  int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fail(file, errno == ENOENT ? "No such file or directory" : strerror(errno));
+  } else if (S_ISDIR(st.st_mode)) {
+    fail(file, "Is a directory");
+  } else if (st.st_size > 0) {
+    size_t size = (size_t)st.st_size;
+    const char *data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      fail(file, "cannot map file");
+    } else {
+      madvise((void *)data, size, MADV_SEQUENTIAL);
+      grep_text(file, data, size);
+      munmap((void *)data, size);
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (s->count_only && !file->error) {
+    char line[PATH_MAX + 32];
+    if (s->show_names) {
+      snprintf(line, sizeof(line), "%s:%ld\n", file->path, file->matches);
+    } else {
+      snprintf(line, sizeof(line), "%ld\n", file->matches);
+    }
+    put_string(file, line);
+  }
+
+  pthread_mutex_lock(&s->lock);
+  file->done = 1;
+  pthread_cond_broadcast(&s->finished);
+  pthread_mutex_unlock(&s->lock);
+}
+
+//the files grep goes through, in order
+typedef struct {
+  Search *search;
+  ThreadPool *pool;
+  TaskGroup group;
+  GrepFile **files;
+  size_t count;
+  size_t cap;
+} FileList;
+
+static void add_file(FileList *list, const char *path) {
+  if (list->count == list->cap) {
+    size_t cap = list->cap == 0 ? 64 : list->cap * 2;
+    GrepFile **grown = (GrepFile **)realloc(list->files, cap * sizeof(GrepFile *));
+    if (grown == NULL) {
+      return;
+    }
+    list->files = grown;
+    list->cap = cap;
+  }
+  GrepFile *file = (GrepFile *)calloc(1, sizeof(GrepFile));
+  if (file == NULL || (file->path = strdup(path)) == NULL) {
+    free(file);
+    return;
+  }
+  file->search = list->search;
+  file->index = list->count;
+  list->files[list->count++] = file;
+  if (list->pool == NULL || thread_pool_submit(list->pool, &list->group, grep_file, file) < 0) {
+    grep_file(file);
+  }
+}
+
+//-r: the regular files under dir in directory order, symlinks are not
+//followed
+static void walk(FileList *list, const char *dir, int top) {
+  int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    add_file(list, dir);
+    return;
+  }
+  char *buf = (char *)malloc(WALK_BUFFER);
+  char path[PATH_MAX];
+  long n;
+  while (buf != NULL && (n = read_dirents(fd, buf, WALK_BUFFER)) > 0) {
+    for (long at = 0; at < n;) {
+      struct linux_dirent64 *entry = (struct linux_dirent64 *)(buf + at);
+      at += entry->d_reclen;
+      if (is_dot_or_dotdot(entry->d_name)) {
+        continue;
+      }
+      //grep -r with no file names the files without the "./"
+      if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path)) {
+        continue;
+      }
+      const char *shown = top && strcmp(dir, ".") == 0 ? path + 2 : path;
+      unsigned char type = entry->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        type = fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 ? DT_UNKNOWN
+               : S_ISDIR(st.st_mode)                                  ? DT_DIR
+               : S_ISREG(st.st_mode)                                  ? DT_REG
+                                                                      : DT_UNKNOWN;
+      }
+      if (type == DT_DIR) {
+        walk(list, shown, 0);
+      } else if (type == DT_REG) {
+        add_file(list, shown);
+      }
+    }
+  }
+  free(buf);
+  close(fd);
+}
+
+//the longest run of plain characters a basic regular expression cannot
+//match without, empty when there is none to rely on (alternation, or only
+//classes and wildcards); a run inside \( \) or the char a *, \? or \{
+//makes optional does not count
+static size_t required_literal(const char *pattern, char *literal, int *plain) {
+  *plain = 1;
+  if (strstr(pattern, "\\|") != NULL) {
+    *plain = 0;
+    return 0;
+  }
+  size_t best = 0;
+  size_t run = 0;
+  char *current = literal + strlen(pattern) + 1; //scratch after the best run
+  int depth = 0;
+  for (const char *p = pattern; *p != '\0'; p++) {
+    int literal_char = -1;
+    if (*p == '\\' && p[1] != '\0') {
+      p++;
+      if (strchr(".[]*^$\\", *p) != NULL) {
+        literal_char = (unsigned char)*p;
+      } else if (*p == '(') {
+        depth++;
+      } else if (*p == ')') {
+        depth--;
+      } else if (*p == '?') {
+        run = run > 0 ? run - 1 : 0; //the char before may not be there
+      } else if (*p == '{') {
+        run = run > 0 ? run - 1 : 0;
+        const char *close = strstr(p, "\\}");
+        p = close != NULL ? close + 1 : p + strlen(p) - 1;
+      }
+      *plain = 0;
+    } else if (*p == '*' && p != pattern) {
+      run = run > 0 ? run - 1 : 0;
+      *plain = 0;
+    } else if (*p == '[') {
+      //to the end of the bracket expression, a ] right after [ or [^ is in it
+      const char *q = p + 1;
+      q += *q == '^';
+      q += *q == ']';
+      q = strchr(q, ']');
+      p = q != NULL ? q : p + strlen(p) - 1;
+      *plain = 0;
+    } else if (*p == '.' || (*p == '^' && p == pattern) || (*p == '$' && p[1] == '\0')) {
+      *plain = 0;
+    } else {
+      literal_char = (unsigned char)*p;
+    }
+
+    if (literal_char >= 0 && depth == 0) {
+      current[run++] = (char)literal_char;
+      continue;
+    }
+    if (run > best) {
+      memcpy(literal, current, run);
+      best = run;
+    }
+    run = 0;
+  }
+  if (run > best) {
+    memcpy(literal, current, run);
+    best = run;
+  }
+  return best;
+}
+
+//grep [-rinc] [-F] PATTERN [FILE...]
+//prints the lines of the files that match PATTERN, a basic regular
+//expression or with -F a fixed string: each file is mapped and scanned
+//with a vector compare of two rare bytes of the literal every match
+//contains, only candidate lines go to the full match, and the files are
+//spread over a thread pool while the output stays in file order
+//-r searches directories (the current one without a FILE), -i ignores
+//case, -n numbers lines and -c counts the matching lines instead
+int builtin_grep(int argc, char **argv) {
+  Search s = {.id = atomic_fetch_add(&search_ids, 1) + 1};
+  int recursive = 0;
+  int fixed = 0;
+  int first = 1;
+  for (; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+    if (strcmp(argv[first], "--") == 0) {
+      first++;
+      break;
+    }
+    for (const char *o = argv[first] + 1; *o != '\0'; o++) {
+      switch (*o) {
+        case 'r': recursive = 1; break;
+        case 'i': s.icase = 1; break;
+        case 'n': s.line_numbers = 1; break;
+        case 'c': s.count_only = 1; break;
+        case 'F': fixed = 1; break;
+        default:
+          dprintf(STDOUT_FILENO, "grep: unknown option -%c\n", *o);
+          return 2;
+      }
+    }
+  }
+  if (first == argc) {
+    dprintf(STDOUT_FILENO, "Usage: grep [-rinc] [-F] PATTERN [FILE...]\n");
+    return 2;
+  }
+  s.pattern = argv[first++];
+
+  size_t pattern_len = strlen(s.pattern);
+  s.literal = (char *)malloc(2 * pattern_len + 2);
+  if (s.literal == NULL) {
+    return 2;
+  }
+  if (fixed) {
+    memcpy(s.literal, s.pattern, pattern_len);
+    s.literal_len = pattern_len;
+  } else {
+    int plain;
+    s.literal_len = required_literal(s.pattern, s.literal, &plain);
+    s.use_regex = !plain;
+    regex_t check;
+    if (s.use_regex && regcomp(&check, s.pattern, REG_NEWLINE) != 0) {
+      dprintf(STDOUT_FILENO, "grep: bad pattern %s\n", s.pattern);
+      return 2;
+    }
+    if (s.use_regex) {
+      regfree(&check);
+    }
+  }
+  //an empty fixed string matches every line, the regex path does that
+  if (s.literal_len == 0 && !s.use_regex) {
+    s.use_regex = 1;
+    s.pattern = "^";
+  }
+  str_finder_init(&s.finder, s.literal, s.literal_len, s.icase);
+  s.show_names = recursive || argc - first > 1;
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.finished, NULL);
+
+  if (first == argc && !recursive) {
+    dprintf(STDOUT_FILENO, "grep: no file to search\n");
+    return 2;
+  }
+  FileList list = {.search = &s};
+  if (recursive || argc - first > 1) {
+    list.pool = thread_pool_create(0);
+  }
+  task_group_init(&list.group);
+  if (first == argc) {
+    walk(&list, ".", 1);
+  }
+  for (int i = first; i < argc; i++) {
+    struct stat st;
+    if (recursive && stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+      walk(&list, argv[i], 1);
+    } else {
+      add_file(&list, argv[i]);
+    }
+  }
+
+  //in order, each as soon as it and the ones before it are done
+  long matches = 0;
+  int errors = 0;
+  for (size_t i = 0; i < list.count; i++) {
+    GrepFile *file = list.files[i];
+    pthread_mutex_lock(&s.lock);
+    while (!file->done) {
+      pthread_cond_wait(&s.finished, &s.lock);
+    }
+    pthread_mutex_unlock(&s.lock);
+    write_all(file->out, file->len);
+    if (file->lost) {
+      dprintf(STDOUT_FILENO, "grep: %s: out of memory, the rest of its output is lost\n", file->path);
+    }
+    atomic_store(&s.due, i + 1);
+    matches += file->matches;
+    errors |= file->error | file->lost;
+    free(file->out);
+    free(file->path);
+    free(file);
+  }
+  if (list.pool != NULL) {
+    task_group_wait(list.pool, &list.group);
+    thread_pool_destroy(list.pool);
+  }
+  task_group_destroy(&list.group);
+  free(list.files);
+  free(s.literal);
+  return errors ? 2 : matches > 0 ? 0 : 1;
+}
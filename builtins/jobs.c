@@ -0,0 +1,13 @@
+#include "builtins.h"
+
+//jobs
+//lists the background jobs and how far each got, a finished job is shown
+//once more and then forgotten
+int builtin_jobs_shell(int argc, char **argv, BuiltinShell *shell) {
+  (void)argc;
+  (void)argv;
+  if (shell->jobs != NULL) {
+    jobs_list(shell->jobs, shell->show, shell->ctx);
+  }
+  return 0;
+}
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dirents.h"
+
+#define DIRENT_BUFFER (256 * 1024) //bytes of entries per getdents64 call
+#define OUTPUT_BUFFER (64 * 1024)
+
+typedef enum { ENTRY_DIR, ENTRY_FILE, ENTRY_OTHER } EntryKind;
+
+typedef struct {
+  char buf[OUTPUT_BUFFER];
+  size_t len;
+  int failed;
+} Output;
+
+static void flush(Output *out) {
+  size_t done = 0;
+  while (done < out->len && !out->failed) {
+    ssize_t n = write(STDOUT_FILENO, out->buf + done, out->len - done);
+    if (n < 0) {
+      out->failed = 1; //the shell went away, nothing left to do
+    } else {
+      done += (size_t)n;
+    }
+  }
+  out->len = 0;
+}
+
+static void put(Output *out, const char *s, size_t len) {
+  if (out->len + len > sizeof(out->buf)) {
+    flush(out);
+  }
+  if (len > sizeof(out->buf)) {
+    return; //a name is at most 255 bytes, never happens
+  }
+  memcpy(out->buf + out->len, s, len);
+  out->len += len;
+}
+
+//d_type answers for almost every entry, only symlinks (followed, as the
+//old [ -d ] and [ -f ] tests did) and file systems that leave it unknown
+//cost a statx
+static EntryKind classify(int dir, const struct linux_dirent64 *entry) {
+  unsigned char type = entry->d_type;
+  if (type == DT_LNK || type == DT_UNKNOWN) {
+    struct statx stx;
+    if (statx(dir, entry->d_name, AT_NO_AUTOMOUNT, STATX_TYPE, &stx) < 0) {
+      return ENTRY_OTHER; //dangling link
+    }
+    type = S_ISDIR(stx.stx_mode) ? DT_DIR : S_ISREG(stx.stx_mode) ? DT_REG : DT_UNKNOWN;
+  }
+  return type == DT_DIR ? ENTRY_DIR : type == DT_REG ? ENTRY_FILE : ENTRY_OTHER;
+}
+
+//lists one directory into out, under a "path:" line when headed, with a
+//blank line before it when something was listed already
+//returns 1 when it could not be read
+static int list_dir(Output *out, const char *path, int compat, int headed, int after) {
+  int dir = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir < 0) {
+    flush(out);
+    dprintf(STDOUT_FILENO, "ls: %s: No such directory\n", path);
+    return 1;
+  }
+  if (headed) {
+    put(out, "\n", after);
+    put(out, path, strlen(path));
+    put(out, ":\n", 2);
+  }
+
+  static char entries[DIRENT_BUFFER];
+  static const char *const tags[] = {"[DIR] ", "[FILE] ", "[OTHER] "};
+  int status = 0;
+  for (;;) {
+    long n = read_dirents(dir, entries, sizeof(entries));
+    if (n <= 0) {
+      status = n < 0;
+      break;
+    }
+    for (long at = 0; at < n;) {
+      const struct linux_dirent64 *entry = (const struct linux_dirent64 *)(entries + at);
+      at += entry->d_reclen;
+      if (entry->d_name[0] == '.') {
+        continue;
+      }
+      size_t len = strlen(entry->d_name);
+      if (compat) {
+        const char *tag = tags[classify(dir, entry)];
+        put(out, tag, strlen(tag));
+        put(out, entry->d_name, len);
+      } else {
+        put(out, entry->d_name, len);
+        //only a symlink can hide a directory from d_type
+        if (entry->d_type == DT_DIR ||
+            ((entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) && classify(dir, entry) == ENTRY_DIR)) {
+          put(out, "/", 1);
+        }
+      }
+      put(out, "\n", 1);
+    }
+    flush(out);
+    if (out->failed) {
+      break;
+    }
+  }
+  close(dir);
+  return status;
+}
+
+//ls [--compat] [DIRECTORY...]
+//lists the entries of each DIRECTORY (default .) in directory order,
+//hidden ones left out, directories with a trailing /; with more than one
+//each listing starts with a "DIRECTORY:" line, as GNU ls does
+//--compat prints the "[DIR] name", "[FILE] name", "[OTHER] name" lines of
+//the old ls.sh for anything that reads them
+//entries are read in large getdents64 batches and written out after each
+//batch, so a huge directory starts showing at once
+int builtin_ls(int argc, char **argv) {
+  int compat = 0;
+  int dirs = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--compat") == 0) {
+      compat = 1;
+    } else {
+      dirs++;
+    }
+  }
+  static Output out;
+  if (dirs == 0) {
+    return list_dir(&out, ".", compat, 0, 0);
+  }
+  int status = 0;
+  int listed = 0;
+  for (int i = 1; i < argc && !out.failed; i++) {
+    if (strcmp(argv[i], "--compat") == 0) {
+      continue;
+    }
+    int failed = list_dir(&out, argv[i], compat, dirs > 1, listed > 0);
+    listed += !failed;
+    status |= failed;
+  }
+  return status;
+}
@@ -0,0 +1,526 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../thread_pool.h"
+
+#define COPY_CHUNK (64ll * 1024 * 1024) //bytes one task copies, big files are split
+#define PROGRESS_MS 100                 //progress line updates
+#define MB (1024.0 * 1024.0)
+
+//a byte range of one file, copied by one task
+typedef struct {
+  char *src;
+  char *dst;
+  off_t offset;
+  off_t len;
+} CopyChunk;
+
+//mode and times put on a copy once everything in it is written
+typedef struct {
+  char *path;
+  mode_t mode;
+  struct timespec times[2];
+  int is_link;
+} Stamp;
+
+//one source being copied across file systems
+typedef struct {
+  ThreadPool *pool;
+  CopyChunk *chunks;
+  size_t chunk_count;
+  size_t chunk_cap;
+  Stamp *stamps;
+  size_t stamp_count;
+  size_t stamp_cap;
+  uint64_t total;
+  int no_clobber;  //-n: everything is created exclusively, what exists is skipped
+  int skipped;     //something in the tree turned up at the target meanwhile
+  atomic_ullong copied;
+  atomic_int failed;
+} Copy;
+
+static void report(const char *what, const char *path) {
+  dprintf(STDOUT_FILENO, "mv: %s: %s\n", path, what);
+}
+
+static int add_chunk(Copy *c, const char *src, const char *dst, off_t offset, off_t len) {
+  if (c->chunk_count == c->chunk_cap) {
+    size_t cap = c->chunk_cap == 0 ? 64 : c->chunk_cap * 2;
+    CopyChunk *grown = (CopyChunk *)realloc(c->chunks, cap * sizeof(CopyChunk));
+    if (grown == NULL) {
+      return -1;
+    }
+    c->chunks = grown;
+    c->chunk_cap = cap;
+  }
+  //the first chunk of a file owns the paths, the rest share them
+  int first = offset == 0;
+  CopyChunk *chunk = &c->chunks[c->chunk_count];
+  chunk->src = first ? strdup(src) : c->chunks[c->chunk_count - 1].src;
+  chunk->dst = first ? strdup(dst) : c->chunks[c->chunk_count - 1].dst;
+  chunk->offset = offset;
+  chunk->len = len;
+  if (chunk->src == NULL || chunk->dst == NULL) {
+    return -1;
+  }
+  c->chunk_count++;
+  return 0;
+}
+
+static int add_stamp(Copy *c, const char *path, const struct stat *st) {
+  if (c->stamp_count == c->stamp_cap) {
+    size_t cap = c->stamp_cap == 0 ? 64 : c->stamp_cap * 2;
+    Stamp *grown = (Stamp *)realloc(c->stamps, cap * sizeof(Stamp));
+    if (grown == NULL) {
+      return -1;
+    }
+    c->stamps = grown;
+    c->stamp_cap = cap;
+  }
+  Stamp *stamp = &c->stamps[c->stamp_count];
+  stamp->path = strdup(path);
+  if (stamp->path == NULL) {
+    return -1;
+  }
+  stamp->mode = st->st_mode & 07777;
+  stamp->times[0] = st->st_atim;
+  stamp->times[1] = st->st_mtim;
+  stamp->is_link = S_ISLNK(st->st_mode);
+  c->stamp_count++;
+  return 0;
+}
+
+//with -n a target that exists by the time it is created is left alone,
+//and the source is kept since part of it did not move
+static int skip_existing(Copy *c, const char *dst) {
+  if (errno == EEXIST && c->no_clobber) {
+    c->skipped = 1;
+    return 0;
+  }
+  report(strerror(errno), dst);
+  return -1;
+}
+
+//creates dst for src, directories and everything but file contents right
+//away, file contents become chunks for the pool
+//a directory's stamp comes after everything in it, so setting the stamps
+//in order leaves its mtime alone
+//top is the source named on the command line, whose target may be an
+//empty directory already (checked before, as rename would)
+static int plan(Copy *c, const char *src, const char *dst, int top) {
+  struct stat st;
+  if (lstat(src, &st) < 0) {
+    report(strerror(errno), src);
+    return -1;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    if (mkdir(dst, 0700) < 0 && !(errno == EEXIST && top && !c->no_clobber)) {
+      return skip_existing(c, dst);
+    }
+    DIR *dir = opendir(src);
+    if (dir == NULL) {
+      report(strerror(errno), src);
+      return -1;
+    }
+    int status = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        continue;
+      }
+      char child_src[PATH_MAX];
+      char child_dst[PATH_MAX];
+      if (snprintf(child_src, sizeof(child_src), "%s/%s", src, entry->d_name) >= (int)sizeof(child_src) ||
+          snprintf(child_dst, sizeof(child_dst), "%s/%s", dst, entry->d_name) >= (int)sizeof(child_dst)) {
+        report("path too long", src);
+        status = -1;
+        continue;
+      }
+      if (plan(c, child_src, child_dst, 0) < 0) {
+        status = -1;
+      }
+    }
+    closedir(dir);
+    return add_stamp(c, dst, &st) < 0 ? -1 : status;
+  }
+
+  if (S_ISLNK(st.st_mode)) {
+    char target[PATH_MAX];
+    ssize_t len = readlink(src, target, sizeof(target) - 1);
+    if (len < 0) {
+      report(strerror(errno), src);
+      return -1;
+    }
+    target[len] = '\0';
+    if (!c->no_clobber) {
+      unlink(dst);
+    }
+    if (symlink(target, dst) < 0) {
+      return skip_existing(c, dst);
+    }
+    return add_stamp(c, dst, &st);
+  }
+
+  if (!S_ISREG(st.st_mode)) {
+    //fifos, sockets and devices are made again, devices need root
+    if (!c->no_clobber) {
+      unlink(dst);
+    }
+    if (mknod(dst, st.st_mode, st.st_rdev) < 0) {
+      return skip_existing(c, dst);
+    }
+    return add_stamp(c, dst, &st);
+  }
+
+  //sized up front so every chunk writes into its own part
+  int fd = open(dst, O_WRONLY | O_CREAT | (c->no_clobber ? O_EXCL : O_TRUNC) | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return skip_existing(c, dst);
+  }
+  if (ftruncate(fd, st.st_size) < 0) {
+    report(strerror(errno), dst);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  c->total += (uint64_t)st.st_size;
+  for (off_t offset = 0; offset < st.st_size; offset += COPY_CHUNK) {
+    off_t len = st.st_size - offset < COPY_CHUNK ? st.st_size - offset : COPY_CHUNK;
+    if (add_chunk(c, src, dst, offset, len) < 0) {
+      report("out of memory", src);
+      return -1;
+    }
+  }
+  return add_stamp(c, dst, &st);
+}
+
+//copies one chunk at its offsets: copy_file_range where the kernel can do
+//it between the two file systems, sendfile from the page cache otherwise,
+//and plain reads and writes as the last resort
+//returns NULL or why the chunk could not be copied
+static const char *copy_range(Copy *c, int in, int out, off_t offset, off_t len) {
+  off_t in_off = offset;
+  off_t out_off = offset;
+  off_t end = offset + len;
+  while (in_off < end) {
+    ssize_t n = copy_file_range(in, &in_off, out, &out_off, (size_t)(end - in_off), 0);
+    if (n <= 0) {
+      break;
+    }
+    atomic_fetch_add(&c->copied, (unsigned long long)n);
+  }
+  if (in_off == end) {
+    return NULL;
+  }
+
+  if (lseek(out, in_off, SEEK_SET) < 0) {
+    return strerror(errno);
+  }
+  while (in_off < end) {
+    ssize_t n = sendfile(out, in, &in_off, (size_t)(end - in_off));
+    if (n <= 0) {
+      break;
+    }
+    atomic_fetch_add(&c->copied, (unsigned long long)n);
+  }
+  if (in_off == end) {
+    return NULL;
+  }
+
+  char buf[64 * 1024];
+  while (in_off < end) {
+    size_t want = end - in_off < (off_t)sizeof(buf) ? (size_t)(end - in_off) : sizeof(buf);
+    ssize_t n = pread(in, buf, want, in_off);
+    if (n < 0) {
+      return strerror(errno);
+    }
+    if (n == 0) {
+      return "source shrank during the copy";
+    }
+    for (ssize_t done = 0; done < n;) {
+      ssize_t wrote = pwrite(out, buf + done, (size_t)(n - done), in_off + done);
+      if (wrote < 0) {
+        return strerror(errno);
+      }
+      done += wrote;
+    }
+    in_off += n;
+    atomic_fetch_add(&c->copied, (unsigned long long)n);
+  }
+  return NULL;
+}
+
+typedef struct {
+  Copy *copy;
+  CopyChunk *chunk;
+} ChunkTask;
+
+//each task opens the files itself, so no descriptor is shared and none
+//stays open while its chunk waits in the queue
+static void copy_chunk(void *arg) {
+  ChunkTask *task = (ChunkTask *)arg;
+  CopyChunk *chunk = task->chunk;
+  const char *error = NULL;
+  const char *path = chunk->src;
+  int in = open(chunk->src, O_RDONLY | O_CLOEXEC);
+  int out = -1;
+  if (in < 0) {
+    error = strerror(errno);
+  } else if ((out = open(chunk->dst, O_WRONLY | O_CLOEXEC)) < 0) {
+    error = strerror(errno);
+    path = chunk->dst;
+  } else {
+    error = copy_range(task->copy, in, out, chunk->offset, chunk->len);
+  }
+  if (error != NULL) {
+    report(error, path);
+    atomic_store(&task->copy->failed, 1);
+  }
+  if (in >= 0) {
+    close(in);
+  }
+  if (out >= 0) {
+    close(out);
+  }
+}
+
+static void show_progress(Copy *c, const char *src, int done) {
+  double copied = (double)atomic_load(&c->copied);
+  double percent = c->total > 0 ? copied * 100.0 / (double)c->total : 100.0;
+  dprintf(STDOUT_FILENO, "mv: %s: %.1f of %.1f MB (%.0f%%)%s", src, copied / MB, c->total / MB, percent,
+          done ? "\n" : "\r");
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+  (void)st;
+  (void)ftw;
+  return flag == FTW_DP ? rmdir(path) : unlink(path);
+}
+
+//what rename would say about putting src over an existing dst, 0 when it
+//would go ahead: a directory only replaces an empty directory, anything
+//else only something that is not a directory
+static int replace_error(const char *src, const char *dst) {
+  struct stat from;
+  struct stat to;
+  if (lstat(dst, &to) < 0 || lstat(src, &from) < 0) {
+    return 0;
+  }
+  if (!S_ISDIR(from.st_mode)) {
+    return S_ISDIR(to.st_mode) ? EISDIR : 0;
+  }
+  if (!S_ISDIR(to.st_mode)) {
+    return ENOTDIR;
+  }
+  DIR *dir = opendir(dst);
+  if (dir == NULL) {
+    return errno;
+  }
+  int error = 0;
+  struct dirent *entry;
+  while (error == 0 && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      error = ENOTEMPTY;
+    }
+  }
+  closedir(dir);
+  return error;
+}
+
+//moves src to dst on another file system: the tree is made again at dst,
+//file contents are copied on every core and src is only removed once all
+//of it arrived
+static int move_across(ThreadPool **pool, const char *src, const char *dst, int no_clobber) {
+  if (!no_clobber) {
+    int error = replace_error(src, dst);
+    if (error != 0) {
+      dprintf(STDOUT_FILENO, "mv: cannot move %s to %s: %s\n", src, dst, strerror(error));
+      return -1;
+    }
+  }
+  if (*pool == NULL) {
+    *pool = thread_pool_create(0);
+    if (*pool == NULL) {
+      report("out of memory", src);
+      return -1;
+    }
+  }
+  Copy c = {.pool = *pool, .no_clobber = no_clobber};
+  atomic_init(&c.copied, 0);
+  atomic_init(&c.failed, 0);
+  int status = plan(&c, src, dst, 1);
+  //-n and the target is there: nothing was made, nothing to say
+  if (status == 0 && c.skipped && c.stamp_count == 0) {
+    return 0;
+  }
+
+  ChunkTask *tasks = (ChunkTask *)malloc((c.chunk_count > 0 ? c.chunk_count : 1) * sizeof(ChunkTask));
+  if (tasks == NULL) {
+    report("out of memory", src);
+    status = -1;
+    c.chunk_count = 0;
+  }
+  TaskGroup group;
+  task_group_init(&group);
+  for (size_t i = 0; i < c.chunk_count; i++) {
+    tasks[i] = (ChunkTask){&c, &c.chunks[i]};
+    if (thread_pool_submit(c.pool, &group, copy_chunk, &tasks[i]) < 0) {
+      copy_chunk(&tasks[i]);
+    }
+  }
+
+  //the progress line is only drawn for a copy that takes a while
+  int shown = 0;
+  struct timespec tick = {0, PROGRESS_MS * 1000000L};
+  while (!task_group_done(&group)) {
+    nanosleep(&tick, NULL);
+    if (!task_group_done(&group)) {
+      show_progress(&c, src, 0);
+      shown = 1;
+    }
+  }
+  task_group_wait(c.pool, &group);
+  task_group_destroy(&group);
+  if (shown) {
+    show_progress(&c, src, 1);
+  }
+
+  for (size_t i = 0; i < c.stamp_count; i++) {
+    Stamp *stamp = &c.stamps[i];
+    if (!stamp->is_link) {
+      chmod(stamp->path, stamp->mode);
+    }
+    utimensat(AT_FDCWD, stamp->path, stamp->times, AT_SYMLINK_NOFOLLOW);
+    free(stamp->path);
+  }
+  for (size_t i = 0; i < c.chunk_count; i++) {
+    if (c.chunks[i].offset == 0) {
+      free(c.chunks[i].src);
+      free(c.chunks[i].dst);
+    }
+  }
+  free(c.stamps);
+  free(c.chunks);
+  free(tasks);
+
+  if (status < 0 || atomic_load(&c.failed)) {
+    report("copy incomplete, source kept", src);
+    return -1;
+  }
+  if (c.skipped) {
+    report("a target appeared during the copy and was kept, source kept", src);
+    return -1;
+  }
+  if (nftw(src, remove_entry, 64, FTW_DEPTH | FTW_PHYS) < 0) {
+    report(strerror(errno), src);
+    return -1;
+  }
+  return 0;
+}
+
+//last path component, trailing slashes left out
+static const char *base_name(const char *path, size_t *len) {
+  size_t end = strlen(path);
+  while (end > 1 && path[end - 1] == '/') {
+    end--;
+  }
+  size_t start = end;
+  while (start > 0 && path[start - 1] != '/') {
+    start--;
+  }
+  *len = end - start;
+  return path + start;
+}
+
+//mv [-n] SOURCE DEST
+//mv [-n] SOURCE... DIRECTORY
+//renames with renameat2, -n never replaces an existing target (and says
+//nothing about it), a source on another file system is copied over on
+//every core with a progress line and then removed
+int builtin_mv(int argc, char **argv) {
+  int no_clobber = 0;
+  int first = 1;
+  if (first < argc && strcmp(argv[first], "-n") == 0) {
+    no_clobber = 1;
+    first++;
+  }
+  if (argc - first < 2) {
+    dprintf(STDOUT_FILENO, "Usage: mv [-n] <source>... <destination>\n");
+    return 1;
+  }
+
+  const char *dest = argv[argc - 1];
+  struct stat st;
+  int into_dir = stat(dest, &st) == 0 && S_ISDIR(st.st_mode);
+  if (argc - first > 2 && !into_dir) {
+    report("not a directory", dest);
+    return 1;
+  }
+
+  ThreadPool *pool = NULL;
+  int status = 0;
+  for (int i = first; i < argc - 1; i++) {
+    const char *src = argv[i];
+    if (lstat(src, &st) < 0) {
+      report("No such file or directory", src);
+      status = 1;
+      continue;
+    }
+
+    char target[PATH_MAX];
+    if (into_dir) {
+      size_t len;
+      const char *name = base_name(src, &len);
+      if (snprintf(target, sizeof(target), "%s/%.*s", dest, (int)len, name) >= (int)sizeof(target)) {
+        report("path too long", src);
+        status = 1;
+        continue;
+      }
+    } else {
+      snprintf(target, sizeof(target), "%s", dest);
+    }
+
+    if (renameat2(AT_FDCWD, src, AT_FDCWD, target, no_clobber ? RENAME_NOREPLACE : 0) == 0) {
+      continue;
+    }
+    if (errno == EEXIST && no_clobber) {
+      continue;
+    }
+    if (errno != EXDEV) {
+      dprintf(STDOUT_FILENO, "mv: cannot move %s to %s: %s\n", src, target, strerror(errno));
+      status = 1;
+      continue;
+    }
+
+    //another file system: -n skips a target that is there now, and one
+    //that turns up during the copy is never replaced either since every
+    //target is created exclusively
+    struct stat existing;
+    if (no_clobber && lstat(target, &existing) == 0) {
+      continue;
+    }
+    if (move_across(&pool, src, target, no_clobber) < 0) {
+      status = 1;
+    }
+  }
+  if (pool != NULL) {
+    thread_pool_destroy(pool);
+  }
+  return status;
+}
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+  char dir_path[PATH_MAX]; //directory of the last file, dir_fd is open on it
+  int dir_fd;
+  long created;
+  long updated;
+  long failed;
+  char first_touched[PATH_MAX]; //what a glob matched, for the one file message
+  char first_error[PATH_MAX + 64];
+} Touch;
+
+//the directory part of path is opened once and kept while the following
+//paths are in the same directory, as a glob hands them out
+static int dir_of(Touch *t, const char *path, const char **name) {
+  const char *slash = strrchr(path, '/');
+  if (slash == NULL) {
+    *name = path;
+    return AT_FDCWD;
+  }
+  *name = slash + 1;
+  size_t len = slash == path ? 1 : (size_t)(slash - path);
+  if (len >= sizeof(t->dir_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  if (t->dir_fd >= 0 && strlen(t->dir_path) == len && memcmp(t->dir_path, path, len) == 0) {
+    return t->dir_fd;
+  }
+  if (t->dir_fd >= 0) {
+    close(t->dir_fd);
+  }
+  memcpy(t->dir_path, path, len);
+  t->dir_path[len] = '\0';
+  t->dir_fd = open(t->dir_path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+  return t->dir_fd;
+}
+
+static void touched(Touch *t, const char *path, long *count) {
+  if (t->created + t->updated == 0) {
+    snprintf(t->first_touched, sizeof(t->first_touched), "%s", path);
+  }
+  (*count)++;
+}
+
+static void touch_one(Touch *t, const char *path) {
+  const char *name;
+  int dir = dir_of(t, path, &name);
+  if (dir != -1 && *name != '\0') {
+    //a new file already has the current times, only an old one needs them set
+    int fd = openat(dir, name, O_WRONLY | O_CREAT | O_EXCL | O_NONBLOCK | O_NOCTTY | O_CLOEXEC, 0666);
+    if (fd >= 0) {
+      close(fd);
+      touched(t, path, &t->created);
+      return;
+    }
+    if (errno == EEXIST && utimensat(dir, name, NULL, 0) == 0) {
+      touched(t, path, &t->updated);
+      return;
+    }
+  } else if (dir != -1) {
+    errno = *path == '\0' ? ENOENT : EISDIR; //nothing at all, or a path ending in /
+  }
+  if (t->failed++ == 0) {
+    snprintf(t->first_error, sizeof(t->first_error), "%s: %s", path, strerror(errno));
+  }
+}
+
+//touch PATH...
+//creates every path that does not exist and sets the times of the ones
+//that do, a path with * ? or [ in it is a glob (left as it is when nothing
+//matches), and prints one summary line for all of them
+int builtin_touch(int argc, char **argv) {
+  if (argc < 2) {
+    dprintf(STDOUT_FILENO, "Usage: touch <file>...\n");
+    return 1;
+  }
+
+  Touch t = {.dir_fd = -1};
+  for (int i = 1; i < argc; i++) {
+    if (strpbrk(argv[i], "*?[") == NULL) {
+      touch_one(&t, argv[i]);
+      continue;
+    }
+    glob_t matches;
+    if (glob(argv[i], GLOB_NOCHECK, NULL, &matches) != 0) {
+      touch_one(&t, argv[i]);
+      continue;
+    }
+    for (size_t j = 0; j < matches.gl_pathc; j++) {
+      touch_one(&t, matches.gl_pathv[j]);
+    }
+    globfree(&matches);
+  }
+  if (t.dir_fd >= 0) {
+    close(t.dir_fd);
+  }
+
+  long total = t.created + t.updated + t.failed;
+  if (total == 1 && t.failed == 0) {
+    dprintf(STDOUT_FILENO, "File '%s' has been %s successfully.\n", t.first_touched, t.created ? "created" : "updated");
+  } else if (total == 1) {
+    dprintf(STDOUT_FILENO, "touch: %s\n", t.first_error);
+  } else {
+    dprintf(STDOUT_FILENO, "touch: %ld files, %ld created, %ld updated", total, t.created, t.updated);
+    if (t.failed > 0) {
+      dprintf(STDOUT_FILENO, ", %ld failed (%s)", t.failed, t.first_error);
+    }
+    dprintf(STDOUT_FILENO, "\n");
+  }
+  return t.failed > 0;
+}
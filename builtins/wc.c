@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../thread_pool.h"
+#include "../word_count.h"
+
+#define PIECE (16 * 1024 * 1024) //bytes one task counts, bigger files are split
+#define BATCH 4096               //files mapped at once, well under the kernel's map count
+#define READ_BUFFER (64 * 1024)
+
+//a range of a mapped file, one task each
+typedef struct {
+  const char *text;
+  size_t len;
+  int lines_only; //words not asked for, a cheaper loop does
+  WordCount count;
+} WcPiece;
+
+typedef struct {
+  const char *path;
+  char *map;
+  size_t size;
+  WcPiece *pieces;
+  size_t piece_count;
+  int error;
+  int opened; //a read that fails after the open still prints its counts
+} WcFile;
+
+static void count_piece(void *arg) {
+  WcPiece *piece = (WcPiece *)arg;
+  if (piece->lines_only) {
+    word_count_lines(piece->text, piece->len, &piece->count);
+  } else {
+    word_count(piece->text, piece->len, &piece->count);
+  }
+}
+
+//a file that cannot be mapped (a pipe, a device) is read instead
+static int count_read(int fd, WordCount *total) {
+  char buf[READ_BUFFER];
+  ssize_t n;
+  memset(total, 0, sizeof(*total));
+  while ((n = read(fd, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    WordCount part;
+    word_count(buf, (size_t)n, &part);
+    word_count_add(total, &part);
+  }
+  return 0;
+}
+
+//maps a regular file and queues its pieces, the rest is counted here
+static void start_file(WcFile *file, int lines_only, ThreadPool *pool, TaskGroup *group, WordCount *now) {
+  int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    file->error = errno;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  file->opened = 1;
+  if (S_ISDIR(st.st_mode)) {
+    file->error = EISDIR;
+  } else if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+    //an empty regular file may still be a /proc one with something to read
+    if (count_read(fd, now) < 0) {
+      file->error = errno;
+    }
+  } else {
+    file->size = (size_t)st.st_size;
+    file->map = (char *)mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    file->piece_count = (file->size + PIECE - 1) / PIECE;
+    file->pieces = file->map == MAP_FAILED ? NULL : (WcPiece *)calloc(file->piece_count, sizeof(WcPiece));
+    if (file->pieces == NULL) {
+      file->error = file->map == MAP_FAILED ? errno : ENOMEM;
+    } else {
+      madvise(file->map, file->size, MADV_SEQUENTIAL);
+      for (size_t i = 0; i < file->piece_count; i++) {
+        WcPiece *piece = &file->pieces[i];
+        piece->text = file->map + i * PIECE;
+        piece->len = i + 1 < file->piece_count ? PIECE : file->size - i * PIECE;
+        piece->lines_only = lines_only;
+        if (pool == NULL || thread_pool_submit(pool, group, count_piece, piece) < 0) {
+          count_piece(piece);
+        }
+      }
+    }
+  }
+  close(fd);
+}
+
+//the pieces of a file back in order, and the mapping gone
+static void finish_file(WcFile *file, WordCount *total) {
+  for (size_t i = 0; i < file->piece_count && file->pieces != NULL; i++) {
+    word_count_add(total, &file->pieces[i].count);
+  }
+  free(file->pieces);
+  if (file->map != NULL && file->map != MAP_FAILED) {
+    munmap(file->map, file->size);
+  }
+}
+
+static void print_counts(const WordCount *c, int show[3], int width, const char *name) {
+  char line[4200];
+  int len = 0;
+  uint64_t values[3] = {c->lines, c->words, c->bytes};
+  for (int i = 0; i < 3; i++) {
+    if (show[i]) {
+      len += snprintf(line + len, sizeof(line) - (size_t)len, "%s%*llu", len > 0 ? " " : "", width,
+                      (unsigned long long)values[i]);
+    }
+  }
+  snprintf(line + len, sizeof(line) - (size_t)len, " %s\n", name);
+  write(STDOUT_FILENO, line, strlen(line));
+}
+
+//wc [-lwc] FILE...
+//lines, words and bytes of each file and their total, laid out as
+//coreutils does: every file is mapped and counted 64 bytes at a time with
+//vector compares and popcounts, and files and 16 MB pieces of big files
+//are counted on a thread pool
+int builtin_wc(int argc, char **argv) {
+  int show[3] = {0, 0, 0};
+  int first = 1;
+  for (; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+    for (const char *o = argv[first] + 1; *o != '\0'; o++) {
+      if (*o == 'l') {
+        show[0] = 1;
+      } else if (*o == 'w') {
+        show[1] = 1;
+      } else if (*o == 'c') {
+        show[2] = 1;
+      } else {
+        dprintf(STDOUT_FILENO, "wc: unknown option -%c\n", *o);
+        return 1;
+      }
+    }
+  }
+  if (!show[0] && !show[1] && !show[2]) {
+    show[0] = show[1] = show[2] = 1;
+  }
+  int file_count = argc - first;
+  if (file_count == 0) {
+    dprintf(STDOUT_FILENO, "Usage: wc [-lwc] FILE...\n");
+    return 1;
+  }
+
+  //the columns are as wide as the total size of the regular files, at
+  //least 7 with anything else among them, as coreutils lays them out; one
+  //number for one file is not padded
+  int width = 1;
+  struct stat st;
+  if (show[0] + show[1] + show[2] > 1 || file_count > 1) {
+    unsigned long long regular_total = 0;
+    int minimum = 1;
+    for (int i = first; i < argc; i++) {
+      if (stat(argv[i], &st) < 0) {
+        continue;
+      }
+      if (S_ISREG(st.st_mode)) {
+        regular_total += (unsigned long long)st.st_size;
+      } else {
+        minimum = 7;
+      }
+    }
+    for (; regular_total >= 10; regular_total /= 10) {
+      width++;
+    }
+    width = width < minimum ? minimum : width;
+  }
+
+  word_count_name(); //picked here, before the workers need it
+  ThreadPool *pool = thread_pool_create(0);
+  WcFile *files = (WcFile *)calloc(file_count < BATCH ? (size_t)file_count : BATCH, sizeof(WcFile));
+  WordCount *counts = (WordCount *)calloc(file_count < BATCH ? (size_t)file_count : BATCH, sizeof(WordCount));
+  if (files == NULL || counts == NULL) {
+    return 1;
+  }
+  WordCount total = {0};
+  int status = 0;
+  for (int at = 0; at < file_count; at += BATCH) {
+    int batch = file_count - at < BATCH ? file_count - at : BATCH;
+    TaskGroup group;
+    task_group_init(&group);
+    for (int i = 0; i < batch; i++) {
+      memset(&files[i], 0, sizeof(WcFile));
+      memset(&counts[i], 0, sizeof(WordCount));
+      files[i].path = argv[first + at + i];
+      start_file(&files[i], !show[1], pool, &group, &counts[i]);
+    }
+    if (pool != NULL) {
+      task_group_wait(pool, &group);
+    }
+    task_group_destroy(&group);
+
+    for (int i = 0; i < batch; i++) {
+      finish_file(&files[i], &counts[i]);
+      if (files[i].error != 0) {
+        dprintf(STDOUT_FILENO, "wc: %s: %s\n", files[i].path, strerror(files[i].error));
+        status = 1;
+        if (!files[i].opened) {
+          continue;
+        }
+      }
+      print_counts(&counts[i], show, width, files[i].path);
+      total.lines += counts[i].lines;
+      total.words += counts[i].words;
+      total.bytes += counts[i].bytes;
+    }
+  }
+  if (file_count > 1) {
+    print_counts(&total, show, width, "total");
+  }
+  if (pool != NULL) {
+    thread_pool_destroy(pool);
+  }
+  free(files);
+  free(counts);
+  return status;
+}
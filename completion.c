@@ -0,0 +1,479 @@
+#include "completion.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TRIE_INITIAL_SIZE 1024
+#define NAMES_INITIAL_SIZE 4096
+#define SCRIPT_SUFFIX ".sh"
+#define MTIME_SETTLE_NS 100000000LL
+
+Completer *completer_create(const char *scripts_dir, const char *const *builtins, int builtin_count) {
+  Completer *c = (Completer *)calloc(1, sizeof(Completer));
+  if (c == NULL) {
+    return NULL;
+  }
+  //room for every shown name, so handing them out never moves the buffer
+  c->scratch_cap = COMPLETION_SHOW * (NAME_MAX + 2);
+  c->scratch = (char *)malloc(c->scratch_cap);
+  if (c->scratch == NULL) {
+    free(c);
+    return NULL;
+  }
+
+  strncpy(c->scripts_dir, scripts_dir, sizeof(c->scripts_dir) - 1);
+  c->builtins = builtins;
+  c->builtin_count = builtin_count;
+  return c;
+}
+
+static void free_listing(DirListing *d) {
+  free(d->names);
+  free(d->sorted);
+  memset(d, 0, sizeof(*d));
+}
+
+void completer_destroy(Completer *c) {
+  if (c == NULL) {
+    return;
+  }
+  for (int i = 0; i < COMPLETION_DIR_CACHE; i++) {
+    free_listing(&c->dirs[i]);
+  }
+  free(c->commands.nodes);
+  free(c->scratch);
+  free(c);
+}
+
+//trie
+
+static uint32_t trie_node(Trie *t, unsigned char byte) {
+  if (t->len == t->cap) {
+    uint32_t cap = t->cap == 0 ? TRIE_INITIAL_SIZE : t->cap * 2;
+    TrieNode *nodes = (TrieNode *)realloc(t->nodes, cap * sizeof(TrieNode));
+    if (nodes == NULL) {
+      return 0;
+    }
+    t->nodes = nodes;
+    t->cap = cap;
+  }
+  t->nodes[t->len] = (TrieNode){0, 0, 0, byte, 0};
+  return t->len++;
+}
+
+static uint32_t trie_child(const Trie *t, uint32_t node, unsigned char byte) {
+  for (uint32_t n = t->nodes[node].child; n != 0; n = t->nodes[n].sibling) {
+    if (t->nodes[n].byte == byte) {
+      return n;
+    }
+    if (t->nodes[n].byte > byte) {
+      break;
+    }
+  }
+  return 0;
+}
+
+//child for byte, added in byte order when missing, 0 when out of memory
+static uint32_t trie_add_child(Trie *t, uint32_t node, unsigned char byte) {
+  uint32_t prev = 0, n = t->nodes[node].child;
+  while (n != 0 && t->nodes[n].byte < byte) {
+    prev = n;
+    n = t->nodes[n].sibling;
+  }
+  if (n != 0 && t->nodes[n].byte == byte) {
+    return n;
+  }
+
+  uint32_t added = trie_node(t, byte);
+  if (added == 0) {
+    return 0;
+  }
+  t->nodes[added].sibling = n;
+  if (prev == 0) {
+    t->nodes[node].child = added;
+  } else {
+    t->nodes[prev].sibling = added;
+  }
+  return added;
+}
+
+static void trie_clear(Trie *t) {
+  t->len = 0;
+  trie_node(t, 0);
+}
+
+static void trie_insert(Trie *t, const char *name, size_t len) {
+  if (len == 0 || len > NAME_MAX) {
+    return;
+  }
+  uint32_t node = 0;
+  for (size_t i = 0; i < len; i++) {
+    node = trie_add_child(t, node, (unsigned char)name[i]);
+    if (node == 0) {
+      return;
+    }
+  }
+  if (t->nodes[node].word) {
+    return;
+  }
+  t->nodes[node].word = 1;
+
+  //one more name on the whole path
+  node = 0;
+  t->nodes[0].count++;
+  for (size_t i = 0; i < len; i++) {
+    node = trie_child(t, node, (unsigned char)name[i]);
+    t->nodes[node].count++;
+  }
+}
+
+//node reached by prefix, 0 with *found unset when no name starts with it
+static uint32_t trie_find(const Trie *t, const char *prefix, size_t len, int *found) {
+  uint32_t node = 0;
+  *found = 0;
+  if (t->len == 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < len; i++) {
+    node = trie_child(t, node, (unsigned char)prefix[i]);
+    if (node == 0) {
+      return 0;
+    }
+  }
+  *found = 1;
+  return node;
+}
+
+//names below node in order, name holds the depth bytes above them
+static void trie_collect(Completer *c, uint32_t node, char *name, size_t depth, size_t *used, Completion *out) {
+  const Trie *t = &c->commands;
+  if (out->shown_count == COMPLETION_SHOW) {
+    return;
+  }
+  if (t->nodes[node].word) {
+    char *copy = c->scratch + *used;
+    memcpy(copy, name, depth);
+    copy[depth] = '\0';
+    *used += depth + 1;
+    out->shown[out->shown_count++] = copy;
+  }
+  for (uint32_t n = t->nodes[node].child; n != 0 && depth < NAME_MAX; n = t->nodes[n].sibling) {
+    name[depth] = (char)t->nodes[n].byte;
+    trie_collect(c, n, name, depth + 1, used, out);
+  }
+}
+
+//directory listings
+
+static int add_name(DirListing *d, size_t *size, size_t *cap, uint32_t **offsets, size_t *offsets_cap,
+                    const char *name, int is_dir) {
+  size_t len = strlen(name);
+  if (*size + len + 2 > *cap) {
+    size_t new_cap = *cap * 2 + len + 2;
+    char *names = (char *)realloc(d->names, new_cap);
+    if (names == NULL) {
+      return -1;
+    }
+    d->names = names;
+    *cap = new_cap;
+  }
+  if (d->count == *offsets_cap) {
+    size_t new_cap = *offsets_cap * 2 + 64;
+    uint32_t *grown = (uint32_t *)realloc(*offsets, new_cap * sizeof(uint32_t));
+    if (grown == NULL) {
+      return -1;
+    }
+    *offsets = grown;
+    *offsets_cap = new_cap;
+  }
+
+  (*offsets)[d->count++] = (uint32_t)*size;
+  memcpy(d->names + *size, name, len);
+  *size += len;
+  if (is_dir) {
+    d->names[(*size)++] = '/';
+  }
+  d->names[(*size)++] = '\0';
+  return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+//first sorted name not below key in its first len bytes, or above it
+//when past is set
+static size_t bound(const DirListing *d, const char *key, size_t len, int past) {
+  size_t lo = 0, hi = d->count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int cmp = strncmp(d->sorted[mid], key, len);
+    if (cmp < 0 || (past && cmp == 0)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int read_listing(DirListing *d, const char *path, const struct stat *st) {
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    return -1;
+  }
+
+  size_t size = 0, cap = NAMES_INITIAL_SIZE, offsets_cap = 0;
+  uint32_t *offsets = NULL;
+  d->names = (char *)malloc(cap);
+  int result = d->names == NULL ? -1 : 0;
+
+  struct dirent *entry;
+  while (result == 0 && (entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    //links and file systems without d_type need a stat
+    int is_dir = entry->d_type == DT_DIR;
+    if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+      struct stat target;
+      is_dir = fstatat(dirfd(dir), name, &target, 0) == 0 && S_ISDIR(target.st_mode);
+    }
+    result = add_name(d, &size, &cap, &offsets, &offsets_cap, name, is_dir);
+  }
+  closedir(dir);
+
+  if (result == 0 && d->count > 0) {
+    d->sorted = (const char **)malloc(d->count * sizeof(char *));
+    if (d->sorted == NULL) {
+      result = -1;
+    }
+  }
+  if (result < 0) {
+    free(offsets);
+    free_listing(d);
+    return -1;
+  }
+
+  for (size_t i = 0; i < d->count; i++) {
+    d->sorted[i] = d->names + offsets[i];
+  }
+  free(offsets);
+  qsort(d->sorted, d->count, sizeof(char *), compare_names);
+  d->dot_start = bound(d, ".", 1, 0);
+  d->dot_end = bound(d, ".", 1, 1);
+
+  //file system clocks are coarse, a change in the same tick as the read
+  //may not move the mtime, so a fresh mtime means reading it again
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  long long age_ns = (long long)(now.tv_sec - st->st_mtim.tv_sec) * 1000000000LL + (now.tv_nsec - st->st_mtim.tv_nsec);
+  strncpy(d->path, path, sizeof(d->path) - 1);
+  d->dev = st->st_dev;
+  d->ino = st->st_ino;
+  d->mtime = st->st_mtim;
+  d->trusted = age_ns > MTIME_SETTLE_NS;
+  return 0;
+}
+
+//listing of path, read again only when the directory changed
+static DirListing *get_listing(Completer *c, const char *path) {
+  struct stat st;
+  if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+    return NULL;
+  }
+
+  DirListing *slot = &c->dirs[0];
+  for (int i = 0; i < COMPLETION_DIR_CACHE; i++) {
+    DirListing *d = &c->dirs[i];
+    if (d->names != NULL && strcmp(d->path, path) == 0) {
+      if (d->trusted && d->dev == st.st_dev && d->ino == st.st_ino && d->mtime.tv_sec == st.st_mtim.tv_sec && d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        d->last_used = ++c->clock;
+        return d;
+      }
+      slot = d;
+      break;
+    }
+    //otherwise the least recently used one goes
+    if (d->names == NULL || d->last_used < slot->last_used) {
+      slot = d;
+    }
+  }
+
+  free_listing(slot);
+  if (read_listing(slot, path, &st) < 0) {
+    return NULL;
+  }
+  slot->last_used = ++c->clock;
+  slot->generation = ++c->generation;
+  return slot;
+}
+
+static size_t common_prefix(const char *a, const char *b) {
+  size_t n = 0;
+  while (a[n] != '\0' && a[n] == b[n]) {
+    n++;
+  }
+  return n;
+}
+
+//commands
+
+//builtins, registry scripts and $PATH, the trie is built again when one
+//of the directories changed
+static void update_commands(Completer *c) {
+  uint64_t generation = 0;
+  DirListing *scripts = get_listing(c, c->scripts_dir);
+  generation += scripts == NULL ? 0 : scripts->generation;
+
+  char path[PATH_MAX];
+  const char *env = getenv("PATH");
+  strncpy(path, env == NULL ? "" : env, sizeof(path) - 1);
+  path[sizeof(path) - 1] = '\0';
+  for (char *dir = strtok(path, ":"); dir != NULL; dir = strtok(NULL, ":")) {
+    DirListing *d = get_listing(c, dir);
+    generation += d == NULL ? 0 : d->generation;
+  }
+
+  if (c->commands.len > 0 && generation == c->commands_generation) {
+    return;
+  }
+  c->commands_generation = generation;
+
+  Trie *t = &c->commands;
+  trie_clear(t);
+  for (int i = 0; i < c->builtin_count; i++) {
+    trie_insert(t, c->builtins[i], strlen(c->builtins[i]));
+  }
+  //listings may have been evicted by the ones after them, so they are
+  //looked up again, all of them are cached by now
+  if ((scripts = get_listing(c, c->scripts_dir)) != NULL) {
+    size_t suffix = strlen(SCRIPT_SUFFIX);
+    for (size_t i = 0; i < scripts->count; i++) {
+      size_t len = strlen(scripts->sorted[i]);
+      if (len > suffix && strcmp(scripts->sorted[i] + len - suffix, SCRIPT_SUFFIX) == 0) {
+        trie_insert(t, scripts->sorted[i], len - suffix);
+      }
+    }
+  }
+  strncpy(path, env == NULL ? "" : env, sizeof(path) - 1);
+  for (char *dir = strtok(path, ":"); dir != NULL; dir = strtok(NULL, ":")) {
+    DirListing *d = get_listing(c, dir);
+    for (size_t i = 0; d != NULL && i < d->count; i++) {
+      size_t len = strlen(d->sorted[i]);
+      if (d->sorted[i][len - 1] != '/') {
+        trie_insert(t, d->sorted[i], len);
+      }
+    }
+  }
+}
+
+static void complete_command(Completer *c, const char *word, size_t len, Completion *out) {
+  update_commands(c);
+
+  int found;
+  uint32_t node = trie_find(&c->commands, word, len, &found);
+  if (!found) {
+    return;
+  }
+  const TrieNode *nodes = c->commands.nodes;
+  out->total = nodes[node].count;
+
+  //follow the only way down for as long as there is one
+  uint32_t n = node;
+  while (!nodes[n].word && nodes[n].child != 0 && nodes[nodes[n].child].sibling == 0 &&
+         out->insert_len < NAME_MAX) {
+    n = nodes[n].child;
+    out->insert[out->insert_len++] = (char)nodes[n].byte;
+  }
+  if (out->total == 1) {
+    out->insert[out->insert_len++] = ' ';
+  }
+
+  char name[NAME_MAX + 1];
+  size_t used = 0;
+  memcpy(name, word, len);
+  trie_collect(c, node, name, len, &used, out);
+}
+
+//paths
+
+static void complete_path(Completer *c, const char *word, size_t len, Completion *out) {
+  //directory part up to the last '/', the name being completed after it
+  size_t name_start = len;
+  while (name_start > 0 && word[name_start - 1] != '/') {
+    name_start--;
+  }
+  char dir[PATH_MAX];
+  if (name_start == 0) {
+    strcpy(dir, ".");
+  } else if (name_start >= sizeof(dir)) {
+    return;
+  } else {
+    memcpy(dir, word, name_start);
+    //keep "/" for the root
+    dir[name_start > 1 ? name_start - 1 : 1] = '\0';
+  }
+
+  DirListing *d = get_listing(c, dir);
+  if (d == NULL) {
+    return;
+  }
+  const char *prefix = word + name_start;
+  size_t prefix_len = len - name_start;
+
+  //hidden names only when asked for
+  size_t first = bound(d, prefix, prefix_len, 0);
+  size_t last = bound(d, prefix, prefix_len, 1);
+  size_t skip_start = last, skip_end = last;
+  if (prefix_len == 0) {
+    skip_start = d->dot_start;
+    skip_end = d->dot_end;
+  }
+  out->total = (last - first) - (skip_end - skip_start);
+  if (out->total == 0) {
+    return;
+  }
+
+  //sorted, so what the first and last have in common all of them have
+  const char *low = skip_start == first ? d->sorted[skip_end] : d->sorted[first];
+  const char *high = skip_end == last ? d->sorted[skip_start - 1] : d->sorted[last - 1];
+  size_t common = common_prefix(low, high);
+  if (common > prefix_len && common - prefix_len <= NAME_MAX) {
+    out->insert_len = common - prefix_len;
+    memcpy(out->insert, low + prefix_len, out->insert_len);
+  }
+  if (out->total == 1 && low[common - 1] != '/') {
+    out->insert[out->insert_len++] = ' ';
+  }
+
+  for (size_t i = first; i < last && out->shown_count < COMPLETION_SHOW; i++) {
+    if (i == skip_start) {
+      i = skip_end;
+      if (i == last) {
+        break;
+      }
+    }
+    out->shown[out->shown_count++] = d->sorted[i];
+  }
+}
+
+void completer_complete(Completer *c, const char *word, size_t len, int is_command, Completion *out) {
+  out->insert_len = 0;
+  out->total = 0;
+  out->shown_count = 0;
+  if (len > PATH_MAX - 1) {
+    return;
+  }
+
+  if (is_command && memchr(word, '/', len) == NULL) {
+    complete_command(c, word, len, out);
+  } else {
+    complete_path(c, word, len, out);
+  }
+}
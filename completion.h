@@ -0,0 +1,86 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define COMPLETION_SHOW 512      //candidates handed back for display
+#define COMPLETION_DIR_CACHE 32  //directory listings kept, $PATH included
+
+//byte trie over command names
+//children of a node are a sibling list kept in byte order, so walking it
+//gives the names sorted, and every node counts the names below it
+typedef struct {
+  uint32_t child;    //first child, 0 for none (node 0 is the root)
+  uint32_t sibling;  //next node with the same parent
+  uint32_t count;    //names ending at or below this node
+  unsigned char byte;
+  unsigned char word; //a name ends here
+} TrieNode;
+
+typedef struct {
+  TrieNode *nodes;
+  uint32_t len;
+  uint32_t cap;
+} Trie;
+
+//sorted names of one directory, directories end in '/'
+//kept until the directory's mtime changes
+typedef struct {
+  char path[PATH_MAX];
+  dev_t dev;          //"." is another directory after a cd
+  ino_t ino;
+  struct timespec mtime;
+  int trusted;        //mtime was old enough when read to catch every change
+  char *names;        //every name nul terminated
+  const char **sorted; //the names in strcmp order
+  size_t count;
+  size_t dot_start;   //sorted[dot_start, dot_end) start with '.'
+  size_t dot_end;
+  uint64_t last_used;
+  uint64_t generation; //bumped on every read
+} DirListing;
+
+typedef struct {
+  char scripts_dir[PATH_MAX];
+  const char *const *builtins;
+  int builtin_count;
+
+  //commands, rebuilt when one of the listings it came from changes
+  Trie commands;
+  uint64_t commands_generation;
+
+  DirListing dirs[COMPLETION_DIR_CACHE];
+  uint64_t clock;
+  uint64_t generation;
+
+  //names handed out for display when they are not in a listing
+  char *scratch;
+  size_t scratch_cap;
+} Completer;
+
+//result of a completion
+typedef struct {
+  char insert[NAME_MAX + 2];  //text to add at the cursor
+  size_t insert_len;
+  size_t total;               //candidates in all
+  const char *shown[COMPLETION_SHOW]; //the first of them, sorted
+  size_t shown_count;
+} Completion;
+
+//builtins are names handled by the shell itself, scripts_dir holds the
+//registry scripts (name.sh) and $PATH is read for the rest
+Completer *completer_create(const char *scripts_dir, const char *const *builtins, int builtin_count);
+void completer_destroy(Completer *c);
+
+//completes the word before the cursor, a command name when is_command is
+//set and it has no '/', a path otherwise
+//a single candidate is inserted whole with a '/' or ' ' after it, more
+//insert what they have in common
+//the shown names stay valid until the next call
+void completer_complete(Completer *c, const char *word, size_t len, int is_command, Completion *out);
+
+#endif
@@ -0,0 +1,198 @@
+#include "exist_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+  ExistCache *cache;
+  uint64_t hash;
+  char key[];
+} Check;
+
+static uint64_t hash_key(const char *key, size_t len) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)key[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static long ms_since(const struct timespec *then) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - then->tv_sec) * 1000 + (now.tv_nsec - then->tv_nsec) / 1000000;
+}
+
+//slot holding key, or the free slot it would go in, called with the lock held
+static ExistEntry *find(ExistCache *c, const char *key, uint64_t hash) {
+  size_t i = hash & (EXIST_CACHE_SIZE - 1);
+  while (c->table[i].key != NULL) {
+    if (c->table[i].hash == hash && strcmp(c->table[i].key, key) == 0) {
+      break;
+    }
+    i = (i + 1) & (EXIST_CACHE_SIZE - 1);
+  }
+  return &c->table[i];
+}
+
+static void clear(ExistCache *c) {
+  for (size_t i = 0; i < EXIST_CACHE_SIZE; i++) {
+    free(c->table[i].key);
+    c->table[i].key = NULL;
+  }
+  c->used = 0;
+}
+
+static int is_command(ExistCache *c, const char *name) {
+  char path[PATH_MAX];
+  if (strchr(name, '/') != NULL) {
+    struct stat st;
+    return stat(name, &st) == 0 && S_ISREG(st.st_mode) && access(name, X_OK) == 0;
+  }
+  if ((size_t)snprintf(path, sizeof(path), "%s/%s.sh", c->scripts_dir, name) >= sizeof(path)) {
+    return 0;
+  }
+  return access(path, F_OK) == 0;
+}
+
+//runs on the pool, the only place the file system is looked at
+static void run_check(void *arg) {
+  Check *check = (Check *)arg;
+  ExistCache *c = check->cache;
+  const char *name = check->key + 1;
+  int exists;
+  if (check->key[0] == 'c') {
+    exists = is_command(c, name);
+  } else {
+    exists = access(name, F_OK) == 0;
+  }
+
+  pthread_mutex_lock(&c->lock);
+  //the table may have been emptied meanwhile, then the answer has nowhere to go
+  ExistEntry *entry = find(c, check->key, check->hash);
+  if (entry->key != NULL) {
+    ExistState state = exists ? EXIST_YES : EXIST_NO;
+    entry->checking = 0;
+    clock_gettime(CLOCK_MONOTONIC, &entry->checked);
+    if (entry->state != state) {
+      entry->state = state;
+      atomic_fetch_add(&c->generation, 1);
+    }
+  }
+  pthread_mutex_unlock(&c->lock);
+  free(check);
+}
+
+static ExistState lookup(ExistCache *c, const char *key, size_t len) {
+  uint64_t hash = hash_key(key, len);
+  pthread_mutex_lock(&c->lock);
+  ExistEntry *entry = find(c, key, hash);
+  if (entry->key == NULL) {
+    if (c->used >= EXIST_CACHE_SIZE / 2) {
+      clear(c);
+      entry = find(c, key, hash);
+    }
+    entry->key = strndup(key, len);
+    if (entry->key == NULL) {
+      pthread_mutex_unlock(&c->lock);
+      return EXIST_PENDING;
+    }
+    entry->hash = hash;
+    entry->state = EXIST_PENDING;
+    entry->checking = 0;
+    c->used++;
+  }
+
+  ExistState state = entry->state;
+  if (!entry->checking && (state == EXIST_PENDING || ms_since(&entry->checked) > EXIST_TTL_MS)) {
+    Check *check = (Check *)malloc(sizeof(Check) + len + 1);
+    if (check != NULL) {
+      check->cache = c;
+      check->hash = hash;
+      memcpy(check->key, key, len + 1);
+      if (thread_pool_submit(c->pool, &c->checks, run_check, check) == 0) {
+        entry->checking = 1;
+      } else {
+        free(check);
+      }
+    }
+  }
+  pthread_mutex_unlock(&c->lock);
+  return state;
+}
+
+//kind + name, relative names made absolute from cwd, 0 if it does not fit
+static size_t make_key(char *key, char kind, const char *name, size_t len, const char *cwd) {
+  size_t prefix = 0;
+  if (cwd != NULL && name[0] != '/') {
+    prefix = strlen(cwd) + 1;
+  }
+  if (1 + prefix + len >= PATH_MAX) {
+    return 0;
+  }
+  key[0] = kind;
+  if (prefix != 0) {
+    memcpy(key + 1, cwd, prefix - 1);
+    key[prefix] = '/';
+  }
+  memcpy(key + 1 + prefix, name, len);
+  key[1 + prefix + len] = '\0';
+  return 1 + prefix + len;
+}
+
+ExistCache *exist_cache_create(ThreadPool *pool, const char *scripts_dir, const char *const *builtins,
+                               int builtin_count) {
+  ExistCache *c = (ExistCache *)calloc(1, sizeof(ExistCache));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->pool = pool;
+  pthread_mutex_init(&c->lock, NULL);
+  task_group_init(&c->checks);
+  strncpy(c->scripts_dir, scripts_dir, sizeof(c->scripts_dir) - 1);
+  c->builtins = builtins;
+  c->builtin_count = builtin_count;
+  return c;
+}
+
+void exist_cache_destroy(ExistCache *c) {
+  if (c == NULL) {
+    return;
+  }
+  task_group_wait(c->pool, &c->checks);
+  task_group_destroy(&c->checks);
+  clear(c);
+  pthread_mutex_destroy(&c->lock);
+  free(c);
+}
+
+ExistState exist_cache_command(ExistCache *c, const char *name, size_t len, const char *cwd) {
+  if (len == 0) {
+    return EXIST_NO;
+  }
+  for (int i = 0; i < c->builtin_count; i++) {
+    if (strlen(c->builtins[i]) == len && memcmp(c->builtins[i], name, len) == 0) {
+      return EXIST_YES;
+    }
+  }
+  //only ./path runs a file, and only it depends on where the shell is
+  int local = len > 2 && name[0] == '.' && name[1] == '/';
+  if (!local && memchr(name, '/', len) != NULL) {
+    return EXIST_NO;
+  }
+  char key[PATH_MAX];
+  size_t key_len = make_key(key, 'c', name, len, local ? cwd : NULL);
+  return key_len == 0 ? EXIST_NO : lookup(c, key, key_len);
+}
+
+ExistState exist_cache_path(ExistCache *c, const char *path, size_t len, const char *cwd) {
+  if (len == 0) {
+    return EXIST_NO;
+  }
+  char key[PATH_MAX];
+  size_t key_len = make_key(key, 'p', path, len, cwd);
+  return key_len == 0 ? EXIST_NO : lookup(c, key, key_len);
+}
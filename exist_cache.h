@@ -0,0 +1,57 @@
+#ifndef EXIST_CACHE_H
+#define EXIST_CACHE_H
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "thread_pool.h"
+
+#define EXIST_CACHE_SIZE 4096  //slots, the table is emptied when half full
+#define EXIST_TTL_MS 2000      //checked again after this, the old answer is used meanwhile
+
+typedef enum { EXIST_PENDING, EXIST_YES, EXIST_NO } ExistState;
+
+typedef struct {
+  char *key;         //'c' + command name or 'p' + absolute path, NULL for a free slot
+  uint64_t hash;
+  ExistState state;
+  int checking;      //a check is queued on the pool
+  struct timespec checked;
+} ExistEntry;
+
+//answers "does this command / path exist" without touching the file system
+//on the caller's thread: a miss queues a check on the thread pool and says
+//EXIST_PENDING, generation goes up when an answer lands so the caller
+//knows to look again
+typedef struct {
+  ThreadPool *pool;
+  pthread_mutex_t lock;
+  ExistEntry table[EXIST_CACHE_SIZE];
+  size_t used;
+  atomic_uint generation;
+  TaskGroup checks;  //waited on before the cache goes away
+
+  //what counts as a command: builtins, scripts_dir/name.sh, or an
+  //executable ./path, the same as the shell runs
+  char scripts_dir[PATH_MAX];
+  const char *const *builtins;
+  int builtin_count;
+} ExistCache;
+
+ExistCache *exist_cache_create(ThreadPool *pool, const char *scripts_dir, const char *const *builtins,
+                               int builtin_count);
+//waits for checks still running
+void exist_cache_destroy(ExistCache *c);
+
+//relative names are taken from cwd
+ExistState exist_cache_command(ExistCache *c, const char *name, size_t len, const char *cwd);
+ExistState exist_cache_path(ExistCache *c, const char *path, size_t len, const char *cwd);
+
+static inline unsigned exist_cache_generation(ExistCache *c) {
+  return atomic_load(&c->generation);
+}
+
+#endif
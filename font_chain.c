@@ -0,0 +1,146 @@
+#include "font_chain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glyph_cache.h"
+
+//guards TTF_OpenFont and TTF_CloseFont, see font_chain_open
+static SDL_SpinLock font_lock = 0;
+
+TTF_Font *font_chain_open(FontChain *chain, int face, int ptsize) {
+  SDL_AtomicLock(&font_lock);
+  TTF_Font *font = TTF_OpenFont(chain->faces[face].path, ptsize);
+  SDL_AtomicUnlock(&font_lock);
+  return font;
+}
+
+void font_chain_close(TTF_Font *font) {
+  if (font == NULL) {
+    return;
+  }
+  SDL_AtomicLock(&font_lock);
+  TTF_CloseFont(font);
+  SDL_AtomicUnlock(&font_lock);
+}
+
+FontChain *font_chain_create(const char *primary_path, int ptsize) {
+  FontChain *chain = (FontChain *)calloc(1, sizeof(FontChain));
+  if (chain == NULL) {
+    return NULL;
+  }
+
+  chain->ptsize = ptsize;
+  SDL_AtomicSet(&chain->primary, -1);
+
+  //TERRABINE_FONTS replaces the chain, otherwise primary then fallbacks
+  char paths[FONT_PATH_MAX * 2];
+  const char *configured = getenv("TERRABINE_FONTS");
+  if (configured != NULL && configured[0] != '\0') {
+    snprintf(paths, sizeof(paths), "%s", configured);
+  } else {
+    snprintf(paths, sizeof(paths), "%s:%s", primary_path, FONT_FALLBACKS);
+  }
+
+  char *saveptr = NULL;
+  for (char *path = strtok_r(paths, ":", &saveptr); path != NULL && chain->face_count < FONT_CHAIN_MAX;
+       path = strtok_r(NULL, ":", &saveptr)) {
+    snprintf(chain->faces[chain->face_count++].path, FONT_PATH_MAX, "%s", path);
+  }
+  return chain;
+}
+
+//background thread: opens every face, records which codepoints it has and
+//builds the glyph cache as soon as the primary font is known
+static int load_fonts(void *data) {
+  FontChain *chain = (FontChain *)data;
+
+  for (int i = 0; i < chain->face_count; i++) {
+    FontFace *face = &chain->faces[i];
+    TTF_Font *font = font_chain_open(chain, i, chain->ptsize);
+
+    if (font != NULL) {
+      face->coverage = (Uint8 *)calloc(FONT_COVERAGE_LIMIT / 8, 1);
+      if (face->coverage != NULL) {
+        for (Uint32 cp = 0; cp < FONT_COVERAGE_LIMIT; cp++) {
+          if (TTF_GlyphIsProvided32(font, cp)) {
+            face->coverage[cp >> 3] |= 1 << (cp & 7);
+          }
+        }
+        face->usable = 1;
+      }
+      font_chain_close(font);
+    }
+
+    //publishes the face, font_chain_find only reads faces below loaded
+    SDL_AtomicSet(&chain->loaded, i + 1);
+
+    if (face->usable && SDL_AtomicGet(&chain->primary) < 0) {
+      SDL_AtomicSet(&chain->primary, i);
+      chain->ready_cache = glyph_cache_create(chain, chain->ptsize);
+      SDL_AtomicSet(&chain->cache_ready, 1);
+    }
+  }
+
+  if (SDL_AtomicGet(&chain->primary) < 0) {
+    fprintf(stderr, "TerraBine: no usable font, using the built-in bitmap font \n");
+  }
+  SDL_AtomicSet(&chain->done, 1);
+  return 0;
+}
+
+int font_chain_start(FontChain *chain) {
+  chain->thread = SDL_CreateThread(load_fonts, "font loader", chain);
+  return chain->thread != NULL ? 0 : -1;
+}
+
+GlyphCache *font_chain_take_cache(FontChain *chain) {
+  //1 -> 2 so the cache is only handed out once
+  if (SDL_AtomicCAS(&chain->cache_ready, 1, 2)) {
+    return chain->ready_cache;
+  }
+  return NULL;
+}
+
+GlyphCache *font_chain_wait_cache(FontChain *chain) {
+  while (!SDL_AtomicGet(&chain->done) && !SDL_AtomicGet(&chain->cache_ready)) {
+    SDL_Delay(1);
+  }
+  return font_chain_take_cache(chain);
+}
+
+int font_chain_find(FontChain *chain, Uint32 codepoint) {
+  int primary = SDL_AtomicGet(&chain->primary);
+  if (codepoint >= FONT_COVERAGE_LIMIT) {
+    return primary;
+  }
+
+  //one bit test per face, no trial rendering
+  int loaded = SDL_AtomicGet(&chain->loaded);
+  for (int i = 0; i < loaded; i++) {
+    const FontFace *face = &chain->faces[i];
+    if (face->usable && (face->coverage[codepoint >> 3] & (1 << (codepoint & 7)))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void font_chain_destroy(FontChain *chain) {
+  if (chain == NULL) {
+    return;
+  }
+  if (chain->thread != NULL) {
+    SDL_WaitThread(chain->thread, NULL);
+  }
+
+  //the cache was built but nobody took it
+  if (SDL_AtomicGet(&chain->cache_ready) == 1) {
+    glyph_cache_destroy(chain->ready_cache);
+  }
+  for (int i = 0; i < chain->face_count; i++) {
+    free(chain->faces[i].coverage);
+  }
+  free(chain);
+}
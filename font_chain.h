@@ -0,0 +1,71 @@
+#ifndef FONT_CHAIN_H
+#define FONT_CHAIN_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#define FONT_CHAIN_MAX 8
+#define FONT_PATH_MAX 4096
+
+//coverage is tracked for planes 0-3, above that only tags and private use
+//are assigned and those always go to the primary font
+#define FONT_COVERAGE_LIMIT 0x40000
+
+//fonts tried after the primary one, TERRABINE_FONTS (a colon separated list
+//of paths) replaces the whole chain including the primary font
+#define FONT_FALLBACKS \
+  "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf:" \
+  "/usr/share/fonts/truetype/liberation/LiberationMono-Regular.ttf:" \
+  "/usr/share/fonts/truetype/noto/NotoSansMono-Regular.ttf:" \
+  "/usr/share/fonts/truetype/noto/NotoSansSymbols2-Regular.ttf"
+
+struct GlyphCache;
+
+typedef struct {
+  char path[FONT_PATH_MAX];
+  int usable;       //0 when the file could not be opened
+  Uint8 *coverage;  //one bit per codepoint below FONT_COVERAGE_LIMIT
+} FontFace;
+
+//ordered list of fonts used to find a glyph for every codepoint
+//a background thread opens the fonts and builds their coverage bitmaps, a
+//face may only be looked at once its index is below loaded
+typedef struct FontChain {
+  FontFace faces[FONT_CHAIN_MAX];
+  int face_count;
+  int ptsize;
+
+  SDL_atomic_t loaded;  //faces whose coverage is final
+  SDL_atomic_t primary; //first usable face, -1 while unknown
+  SDL_atomic_t done;    //loader thread finished
+
+  struct GlyphCache *ready_cache; //built by the loader, handed out once
+  SDL_atomic_t cache_ready;
+  SDL_Thread *thread;
+} FontChain;
+
+FontChain *font_chain_create(const char *primary_path, int ptsize);
+
+//starts loading the fonts on a background thread
+int font_chain_start(FontChain *chain);
+
+//returns the glyph cache for the primary font once it is ready, NULL before
+//that and on every call after the first successful one
+struct GlyphCache *font_chain_take_cache(FontChain *chain);
+
+//blocks until the loader is done, returns NULL when no font could be opened
+struct GlyphCache *font_chain_wait_cache(FontChain *chain);
+
+//index of the first loaded face that has a glyph for the codepoint, -1 when
+//no loaded face has it (codepoints past the coverage limit get the primary)
+int font_chain_find(FontChain *chain, Uint32 codepoint);
+
+//waits for the loader thread and frees the coverage bitmaps
+void font_chain_destroy(FontChain *chain);
+
+//FreeType only allows one thread at a time to create or destroy faces, so
+//all opening and closing goes through these
+TTF_Font *font_chain_open(FontChain *chain, int face, int ptsize);
+void font_chain_close(TTF_Font *font);
+
+#endif
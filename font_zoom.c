@@ -0,0 +1,169 @@
+#include "font_zoom.h"
+
+#include <stdlib.h>
+
+FontZoom *font_zoom_create(FontChain *chain, SDL_Renderer *renderer) {
+  FontZoom *zoom = (FontZoom *)calloc(1, sizeof(FontZoom));
+  if (zoom == NULL) {
+    return NULL;
+  }
+  zoom->chain = chain;
+  zoom->renderer = renderer;
+  zoom->current = -1;
+  return zoom;
+}
+
+static void free_entry(ZoomEntry *entry) {
+  glyph_atlas_destroy(entry->atlas);
+  glyph_cache_destroy(entry->cache);
+  entry->ptsize = 0;
+  entry->cache = NULL;
+  entry->atlas = NULL;
+}
+
+void font_zoom_destroy(FontZoom *zoom) {
+  if (zoom == NULL) {
+    return;
+  }
+  if (zoom->worker != NULL) {
+    SDL_WaitThread(zoom->worker, NULL);
+    glyph_cache_destroy(zoom->built);
+  }
+  for (int i = 0; i < ZOOM_CACHED_SIZES; i++) {
+    free_entry(&zoom->entries[i]);
+  }
+  free(zoom);
+}
+
+static int find_entry(FontZoom *zoom, int ptsize) {
+  for (int i = 0; i < ZOOM_CACHED_SIZES; i++) {
+    if (zoom->entries[i].ptsize == ptsize) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//makes an entry the one being drawn
+static ZoomEntry *use_entry(FontZoom *zoom, int index) {
+  zoom->current = index;
+  zoom->entries[index].last_used = ++zoom->clock;
+  return &zoom->entries[index];
+}
+
+//stores a cache in a free entry or the least recently used one, returns
+//the entry index or -1 when its atlas could not be created
+//the current entry is never evicted, it is still on screen
+static int store_entry(FontZoom *zoom, GlyphCache *cache) {
+  int index = -1;
+  for (int i = 0; i < ZOOM_CACHED_SIZES; i++) {
+    if (i == zoom->current) {
+      continue;
+    }
+    if (zoom->entries[i].ptsize == 0) {
+      index = i;
+      break;
+    }
+    if (index < 0 || zoom->entries[i].last_used < zoom->entries[index].last_used) {
+      index = i;
+    }
+  }
+
+  ZoomEntry *entry = &zoom->entries[index];
+  free_entry(entry);
+
+  //atlases are textures, so they are uploaded here on the main thread
+  GlyphAtlas *atlas = NULL;
+  if (zoom->renderer != NULL) {
+    atlas = glyph_atlas_create(zoom->renderer, cache);
+    if (atlas == NULL) {
+      glyph_cache_destroy(cache);
+      return -1;
+    }
+  }
+
+  entry->ptsize = cache->ptsize;
+  entry->cache = cache;
+  entry->atlas = atlas;
+  entry->last_used = ++zoom->clock;
+  return index;
+}
+
+ZoomEntry *font_zoom_adopt(FontZoom *zoom, GlyphCache *cache) {
+  zoom->wanted = cache->ptsize;
+  int index = store_entry(zoom, cache);
+  return index < 0 ? NULL : use_entry(zoom, index);
+}
+
+static int build_cache(void *data) {
+  FontZoom *zoom = (FontZoom *)data;
+  zoom->built = glyph_cache_create(zoom->chain, zoom->building);
+  SDL_AtomicSet(&zoom->done, 1);
+  return 0;
+}
+
+static void start_build(FontZoom *zoom, int ptsize) {
+  zoom->building = ptsize;
+  zoom->built = NULL;
+  SDL_AtomicSet(&zoom->done, 0);
+  zoom->worker = SDL_CreateThread(build_cache, "font zoom", zoom);
+  if (zoom->worker == NULL) {
+    //no thread, give up on this size rather than stall the ui
+    zoom->building = 0;
+    zoom->wanted = zoom->entries[zoom->current].ptsize;
+  }
+}
+
+ZoomEntry *font_zoom_request(FontZoom *zoom, int ptsize) {
+  if (ptsize < ZOOM_MIN_SIZE) {
+    ptsize = ZOOM_MIN_SIZE;
+  } else if (ptsize > ZOOM_MAX_SIZE) {
+    ptsize = ZOOM_MAX_SIZE;
+  }
+  zoom->wanted = ptsize;
+
+  int index = find_entry(zoom, ptsize);
+  if (index >= 0) {
+    return use_entry(zoom, index);
+  }
+
+  //a build already running is finished first, font_zoom_poll starts the
+  //next one for whatever size is wanted by then
+  if (zoom->worker == NULL) {
+    start_build(zoom, ptsize);
+  }
+  return NULL;
+}
+
+ZoomEntry *font_zoom_poll(FontZoom *zoom) {
+  if (zoom->worker == NULL || !SDL_AtomicGet(&zoom->done)) {
+    return NULL;
+  }
+
+  SDL_WaitThread(zoom->worker, NULL);
+  zoom->worker = NULL;
+  GlyphCache *built = zoom->built;
+  zoom->built = NULL;
+  zoom->building = 0;
+
+  //keep what was built even when the user zoomed on, they tend to come back
+  if (built != NULL) {
+    store_entry(zoom, built);
+  }
+
+  int current_size = zoom->entries[zoom->current].ptsize;
+  if (zoom->wanted == current_size) {
+    return NULL;
+  }
+  int index = find_entry(zoom, zoom->wanted);
+  if (index >= 0) {
+    return use_entry(zoom, index);
+  }
+  if (built == NULL) {
+    //the font did not open at this size, stay where we are
+    zoom->wanted = current_size;
+    return NULL;
+  }
+  start_build(zoom, zoom->wanted);
+  return NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef FONT_ZOOM_H
+#define FONT_ZOOM_H
+
+#include <SDL2/SDL.h>
+#include "font_chain.h"
+#include "glyph_cache.h"
+#include "grid_render.h"
+
+#define ZOOM_CACHED_SIZES 4
+#define ZOOM_MIN_SIZE 6
+#define ZOOM_MAX_SIZE 72
+
+//one font size that was rasterized, atlas is NULL without a renderer
+typedef struct {
+  int ptsize; //0 when the entry is unused
+  GlyphCache *cache;
+  GlyphAtlas *atlas;
+  Uint32 last_used;
+} ZoomEntry;
+
+//font sizes for zooming
+//the glyph cache for a new size is built on a worker thread while the old
+//size keeps being drawn, and the last ZOOM_CACHED_SIZES sizes are kept with
+//their atlases so going back to one of them is instant
+typedef struct {
+  FontChain *chain;
+  SDL_Renderer *renderer; //NULL for the software backend
+  ZoomEntry entries[ZOOM_CACHED_SIZES];
+  Uint32 clock;
+  int current;            //entry being drawn, -1 before the first adopt
+  int wanted;             //size asked for last
+
+  SDL_Thread *worker;
+  int building;           //size the worker is rasterizing, 0 when idle
+  GlyphCache *built;
+  SDL_atomic_t done;
+} FontZoom;
+
+FontZoom *font_zoom_create(FontChain *chain, SDL_Renderer *renderer);
+//waits for the worker and frees every cached size
+void font_zoom_destroy(FontZoom *zoom);
+
+//takes ownership of a cache (e.g. the one the font chain built) and makes
+//its size the current one, returns its entry or NULL when out of memory
+ZoomEntry *font_zoom_adopt(FontZoom *zoom, GlyphCache *cache);
+
+//asks for another size, returns the entry right away when that size is
+//cached, otherwise starts building it and returns NULL
+ZoomEntry *font_zoom_request(FontZoom *zoom, int ptsize);
+
+//returns the entry for the size asked for once the worker has built it,
+//NULL while there is nothing new
+ZoomEntry *font_zoom_poll(FontZoom *zoom);
+
+#endif
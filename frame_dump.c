@@ -0,0 +1,151 @@
+#include "frame_dump.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFLATE_MAX_STORED 65535
+
+Uint64 frame_checksum(const Uint32 *pixels, int width, int height) {
+  const Uint8 *bytes = (const Uint8 *)pixels;
+  size_t len = (size_t)width * height * sizeof(Uint32);
+  Uint64 hash = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static Uint32 crc_table[256];
+
+static void init_crc_table(void) {
+  if (crc_table[1] != 0) {
+    return;
+  }
+  for (Uint32 n = 0; n < 256; n++) {
+    Uint32 c = n;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    }
+    crc_table[n] = c;
+  }
+}
+
+static Uint32 crc32_update(Uint32 crc, const Uint8 *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static void put_be32(Uint8 *out, Uint32 value) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+//writes one png chunk: length, type, data, crc over type and data
+static int write_chunk(FILE *fp, const char *type, const Uint8 *data, Uint32 len) {
+  Uint8 header[8];
+  put_be32(header, len);
+  memcpy(header + 4, type, 4);
+
+  Uint32 crc = crc32_update(0xFFFFFFFFu, header + 4, 4);
+  crc = crc32_update(crc, data, len) ^ 0xFFFFFFFFu;
+  Uint8 trailer[4];
+  put_be32(trailer, crc);
+
+  if (fwrite(header, 1, 8, fp) != 8 || (len > 0 && fwrite(data, 1, len, fp) != len) ||
+      fwrite(trailer, 1, 4, fp) != 4) {
+    return -1;
+  }
+  return 0;
+}
+
+int frame_write_png(const char *path, const Uint32 *pixels, int width, int height) {
+  init_crc_table();
+
+  //raw scanlines: filter byte 0 followed by RGB triples
+  size_t row_len = (size_t)width * 3 + 1;
+  size_t raw_len = row_len * height;
+  size_t blocks = raw_len / DEFLATE_MAX_STORED + 1;
+  size_t idat_len = 2 + raw_len + blocks * 5 + 4;
+
+  Uint8 *idat = (Uint8 *)malloc(idat_len);
+  Uint8 *raw = (Uint8 *)malloc(raw_len);
+  if (idat == NULL || raw == NULL) {
+    free(idat);
+    free(raw);
+    return -1;
+  }
+
+  for (int y = 0; y < height; y++) {
+    Uint8 *out = raw + y * row_len;
+    const Uint32 *in = pixels + (size_t)y * width;
+    *out++ = 0;
+    for (int x = 0; x < width; x++) {
+      *out++ = in[x] >> 16;
+      *out++ = in[x] >> 8;
+      *out++ = in[x];
+    }
+  }
+
+  //zlib header, stored blocks, adler32 of the raw data
+  Uint8 *p = idat;
+  *p++ = 0x78;
+  *p++ = 0x01;
+  Uint32 a = 1, b = 0;
+  size_t offset = 0;
+  do {
+    size_t len = raw_len - offset;
+    if (len > DEFLATE_MAX_STORED) {
+      len = DEFLATE_MAX_STORED;
+    }
+    *p++ = offset + len == raw_len; //BFINAL on the last block
+    *p++ = len & 0xFF;
+    *p++ = len >> 8;
+    *p++ = ~len & 0xFF;
+    *p++ = (~len >> 8) & 0xFF;
+    memcpy(p, raw + offset, len);
+    p += len;
+
+    for (size_t i = offset; i < offset + len; i++) {
+      a = (a + raw[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+    offset += len;
+  } while (offset < raw_len);
+  put_be32(p, (b << 16) | a);
+  p += 4;
+
+  Uint8 ihdr[13];
+  put_be32(ihdr, width);
+  put_be32(ihdr + 4, height);
+  ihdr[8] = 8;  //bit depth
+  ihdr[9] = 2;  //truecolor
+  ihdr[10] = 0; //deflate
+  ihdr[11] = 0; //adaptive filtering
+  ihdr[12] = 0; //no interlace
+
+  int result = -1;
+  FILE *fp = fopen(path, "wb");
+  if (fp != NULL) {
+    static const Uint8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (fwrite(signature, 1, 8, fp) == 8 &&
+        write_chunk(fp, "IHDR", ihdr, sizeof(ihdr)) == 0 &&
+        write_chunk(fp, "IDAT", idat, (Uint32)(p - idat)) == 0 &&
+        write_chunk(fp, "IEND", NULL, 0) == 0) {
+      result = 0;
+    }
+    if (fclose(fp) != 0) {
+      result = -1;
+    }
+  }
+
+  free(idat);
+  free(raw);
+  return result;
+}
@@ -0,0 +1,14 @@
+#ifndef FRAME_DUMP_H
+#define FRAME_DUMP_H
+
+#include <SDL2/SDL.h>
+
+//64-bit FNV-1a over the framebuffer, identical frames give identical sums
+Uint64 frame_checksum(const Uint32 *pixels, int width, int height);
+
+//writes an ARGB8888 framebuffer as an RGB png
+//uses stored (uncompressed) deflate blocks so no zlib is needed
+//returns 0 on success, -1 on error
+int frame_write_png(const char *path, const Uint32 *pixels, int width, int height);
+
+#endif
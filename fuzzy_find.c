@@ -0,0 +1,426 @@
+#include "fuzzy_find.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NO_MATCH INT_MIN
+#define SCORE_MATCH 16
+#define SCORE_CONSECUTIVE 8
+#define SCORE_BOUNDARY 10
+#define SCORE_BASENAME 12
+#define SCORE_GAP 1
+#define LENGTH_PENALTY_SHIFT 3  //one point less per 8 bytes of path
+
+//walking
+
+typedef struct {
+  FuzzyFinder *finder;
+  char *dir;  //relative to the root, "" for the root itself
+} WalkTask;
+
+static void walk_dir(void *arg);
+
+static int walk_submit(FuzzyFinder *f, const char *dir, size_t len) {
+  WalkTask *task = (WalkTask *)malloc(sizeof(WalkTask));
+  char *copy = (char *)malloc(len + 1);
+  if (task == NULL || copy == NULL) {
+    free(task);
+    free(copy);
+    return -1;
+  }
+  memcpy(copy, dir, len);
+  copy[len] = '\0';
+  *task = (WalkTask){f, copy};
+  if (thread_pool_submit(f->pool, &f->walk, walk_dir, task) < 0) {
+    free(copy);
+    free(task);
+    return -1;
+  }
+  return 0;
+}
+
+//adds the paths of one directory, buffer is kept until the finder goes
+static void publish(FuzzyFinder *f, char *buffer, const uint32_t *offsets, size_t n) {
+  pthread_mutex_lock(&f->lock);
+  if (f->buffers_len == f->buffers_cap) {
+    size_t cap = f->buffers_cap == 0 ? 256 : f->buffers_cap * 2;
+    char **buffers = (char **)realloc(f->buffers, cap * sizeof(char *));
+    if (buffers == NULL) {
+      pthread_mutex_unlock(&f->lock);
+      free(buffer);
+      return;
+    }
+    f->buffers = buffers;
+    f->buffers_cap = cap;
+  }
+  f->buffers[f->buffers_len++] = buffer;
+
+  size_t count = atomic_load(&f->count);
+  for (size_t i = 0; i < n; i++, count++) {
+    size_t block = count / FINDER_BLOCK;
+    if (block == FINDER_MAX_BLOCKS) {
+      break;
+    }
+    if (f->blocks[block] == NULL) {
+      f->blocks[block] = (const char **)malloc(FINDER_BLOCK * sizeof(char *));
+      if (f->blocks[block] == NULL) {
+        break;
+      }
+    }
+    f->blocks[block][count % FINDER_BLOCK] = buffer + offsets[i];
+  }
+  atomic_store(&f->count, count);
+  pthread_mutex_unlock(&f->lock);
+}
+
+static void walk_dir(void *arg) {
+  WalkTask *task = (WalkTask *)arg;
+  FuzzyFinder *f = task->finder;
+  size_t dir_len = strlen(task->dir);
+
+  int fd = atomic_load(&f->stop) ? -1
+           : openat(f->root_fd, dir_len == 0 ? "." : task->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  DIR *dir = fd == -1 ? NULL : fdopendir(fd);
+  if (dir == NULL) {
+    if (fd != -1) {
+      close(fd);
+    }
+    free(task->dir);
+    free(task);
+    return;
+  }
+
+  //every path of the directory goes in one buffer
+  char *buffer = NULL;
+  uint32_t *offsets = NULL;
+  size_t size = 0, cap = 0, n = 0, offsets_cap = 0;
+  char path[PATH_MAX];
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL && !atomic_load(&f->stop)) {
+    //hidden files and directories are left out, like .git
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    size_t name_len = strlen(entry->d_name);
+    size_t len = dir_len == 0 ? name_len : dir_len + 1 + name_len;
+    if (len >= sizeof(path)) {
+      continue;
+    }
+    if (dir_len == 0) {
+      memcpy(path, entry->d_name, name_len + 1);
+    } else {
+      memcpy(path, task->dir, dir_len);
+      path[dir_len] = '/';
+      memcpy(path + dir_len + 1, entry->d_name, name_len + 1);
+    }
+
+    //symlinks are listed, not followed, so there are no loops
+    int is_dir = entry->d_type == DT_DIR;
+    if (entry->d_type == DT_UNKNOWN) {
+      struct stat st;
+      is_dir = fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+    }
+    if (is_dir) {
+      walk_submit(f, path, len);
+      continue;
+    }
+
+    if (size + len + 1 > cap) {
+      size_t new_cap = cap == 0 ? 4096 : cap * 2;
+      while (new_cap < size + len + 1) {
+        new_cap *= 2;
+      }
+      char *grown = (char *)realloc(buffer, new_cap);
+      if (grown == NULL) {
+        break;
+      }
+      buffer = grown;
+      cap = new_cap;
+    }
+    if (n == offsets_cap) {
+      size_t new_cap = offsets_cap == 0 ? 64 : offsets_cap * 2;
+      uint32_t *grown = (uint32_t *)realloc(offsets, new_cap * sizeof(uint32_t));
+      if (grown == NULL) {
+        break;
+      }
+      offsets = grown;
+      offsets_cap = new_cap;
+    }
+    offsets[n++] = (uint32_t)size;
+    memcpy(buffer + size, path, len + 1);
+    size += len + 1;
+  }
+  closedir(dir);
+
+  if (n > 0) {
+    publish(f, buffer, offsets, n);
+  } else {
+    free(buffer);
+  }
+  free(offsets);
+  free(task->dir);
+  free(task);
+}
+
+FuzzyFinder *fuzzy_finder_create(ThreadPool *pool, const char *root) {
+  FuzzyFinder *f = (FuzzyFinder *)calloc(1, sizeof(FuzzyFinder));
+  if (f == NULL) {
+    return NULL;
+  }
+  f->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (f->root_fd == -1) {
+    free(f);
+    return NULL;
+  }
+  f->pool = pool;
+  pthread_mutex_init(&f->lock, NULL);
+  task_group_init(&f->walk);
+  atomic_init(&f->count, 0);
+  atomic_init(&f->stop, 0);
+
+  walk_submit(f, "", 0);
+  return f;
+}
+
+void fuzzy_finder_destroy(FuzzyFinder *f) {
+  if (f == NULL) {
+    return;
+  }
+  atomic_store(&f->stop, 1);
+  task_group_wait(f->pool, &f->walk);
+  task_group_destroy(&f->walk);
+  pthread_mutex_destroy(&f->lock);
+  close(f->root_fd);
+
+  for (size_t i = 0; i < f->buffers_len; i++) {
+    free(f->buffers[i]);
+  }
+  for (size_t i = 0; i < FINDER_MAX_BLOCKS && f->blocks[i] != NULL; i++) {
+    free(f->blocks[i]);
+  }
+  for (size_t i = 0; i < f->chunks_cap; i++) {
+    free(f->chunks[i].matches);
+  }
+  free(f->buffers);
+  free(f->chunks);
+  free(f);
+}
+
+//matching
+
+//ascii only, tolower() goes through the locale for every byte
+static inline int same_char(char a, char b, int fold) {
+  return (fold && a >= 'A' && a <= 'Z' ? a + ('a' - 'A') : a) == b;
+}
+
+static inline int is_boundary(const char *text, size_t i) {
+  if (i == 0) {
+    return 1;
+  }
+  char prev = text[i - 1];
+  return prev == '/' || prev == '_' || prev == '-' || prev == '.' || prev == ' ' ||
+         (islower((unsigned char)prev) && isupper((unsigned char)text[i]));
+}
+
+//NO_MATCH unless query is a subsequence of text, higher is better
+//the shortest window that ends at the first complete match is scored,
+//rewarding runs, word starts and matches in the file name
+static int fuzzy_score(const char *text, const char *query, size_t query_len, int fold) {
+  size_t q = 0, end = 0;
+  for (size_t i = 0; text[i] != '\0' && q < query_len; i++) {
+    if (same_char(text[i], query[q], fold)) {
+      q++;
+      end = i + 1;
+    }
+  }
+  if (q < query_len) {
+    return NO_MATCH;
+  }
+  size_t len = end + strlen(text + end);
+
+  //back from the end to the latest start
+  size_t start = end;
+  for (q = query_len; q > 0;) {
+    start--;
+    if (same_char(text[start], query[q - 1], fold)) {
+      q--;
+    }
+  }
+
+  int score = 0;
+  size_t prev = (size_t)-2;
+  q = 0;
+  for (size_t i = start; i < end && q < query_len; i++) {
+    if (!same_char(text[i], query[q], fold)) {
+      score -= SCORE_GAP;
+      continue;
+    }
+    score += SCORE_MATCH;
+    if (i == prev + 1) {
+      score += SCORE_CONSECUTIVE;
+    }
+    if (is_boundary(text, i)) {
+      score += SCORE_BOUNDARY;
+    }
+    prev = i;
+    q++;
+  }
+
+  const char *slash = strrchr(text, '/');
+  if (slash == NULL || (size_t)(slash - text) < start) {
+    score += SCORE_BASENAME;
+  }
+  return score - (int)(len >> LENGTH_PENALTY_SHIFT);
+}
+
+//better first, ties go to the path found first
+static inline int better(FuzzyMatch a, FuzzyMatch b) {
+  return a.score > b.score || (a.score == b.score && a.id < b.id);
+}
+
+//keeps the FINDER_SHOW best in order
+static void keep_best(FuzzyMatch *best, int *count, FuzzyMatch m) {
+  if (*count == FINDER_SHOW && !better(m, best[FINDER_SHOW - 1])) {
+    return;
+  }
+  int i = *count < FINDER_SHOW ? (*count)++ : FINDER_SHOW - 1;
+  while (i > 0 && better(m, best[i - 1])) {
+    best[i] = best[i - 1];
+    i--;
+  }
+  best[i] = m;
+}
+
+typedef struct {
+  FuzzyFinder *finder;
+  MatchChunk *chunk;
+  uint32_t first;  //id of the chunk's first candidate
+  uint32_t end;    //candidates published when the update started
+  const char *query;
+  size_t query_len;
+  int refine;      //the chunk's matches are for a prefix of query
+  int fold;
+} ScoreTask;
+
+static int add_match(MatchChunk *chunk, FuzzyMatch m) {
+  if (chunk->len == chunk->cap) {
+    uint32_t cap = chunk->cap == 0 ? 256 : chunk->cap * 2;
+    FuzzyMatch *grown = (FuzzyMatch *)realloc(chunk->matches, cap * sizeof(FuzzyMatch));
+    if (grown == NULL) {
+      return -1;
+    }
+    chunk->matches = grown;
+    chunk->cap = cap;
+  }
+  chunk->matches[chunk->len++] = m;
+  return 0;
+}
+
+static void score_chunk(void *arg) {
+  ScoreTask *t = (ScoreTask *)arg;
+  MatchChunk *chunk = t->chunk;
+
+  //a longer query only matches paths the shorter one matched
+  if (t->refine) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < chunk->len; i++) {
+      FuzzyMatch m = chunk->matches[i];
+      m.score = fuzzy_score(fuzzy_finder_path(t->finder, m.id), t->query, t->query_len, t->fold);
+      if (m.score != NO_MATCH) {
+        chunk->matches[kept++] = m;
+      }
+    }
+    chunk->len = kept;
+  }
+
+  //paths found since the chunk was last scored
+  for (uint32_t id = t->first + chunk->covered; id < t->end; id++) {
+    int score = fuzzy_score(fuzzy_finder_path(t->finder, id), t->query, t->query_len, t->fold);
+    if (score != NO_MATCH && add_match(chunk, (FuzzyMatch){id, score}) < 0) {
+      break;
+    }
+  }
+  chunk->covered = t->end - t->first;
+
+  chunk->best_count = 0;
+  for (uint32_t i = 0; i < chunk->len; i++) {
+    keep_best(chunk->best, &chunk->best_count, chunk->matches[i]);
+  }
+}
+
+void fuzzy_finder_update(FuzzyFinder *f, const char *query, size_t len) {
+  if (len > FINDER_QUERY_MAX) {
+    len = FINDER_QUERY_MAX;
+  }
+  size_t count = fuzzy_finder_count(f);
+  size_t chunks = (count + FINDER_CHUNK - 1) / FINDER_CHUNK;
+  if (chunks > f->chunks_cap) {
+    size_t cap = chunks * 2;
+    MatchChunk *grown = (MatchChunk *)realloc(f->chunks, cap * sizeof(MatchChunk));
+    if (grown == NULL) {
+      return;
+    }
+    memset(grown + f->chunks_cap, 0, (cap - f->chunks_cap) * sizeof(MatchChunk));
+    f->chunks = grown;
+    f->chunks_cap = cap;
+  }
+
+  int same = len == f->scored_len && memcmp(query, f->scored, len) == 0;
+  int refine = len > f->scored_len && memcmp(query, f->scored, f->scored_len) == 0;
+  if (!same && !refine) {
+    //anything but typing on starts over
+    for (size_t i = 0; i < f->chunks_cap; i++) {
+      f->chunks[i].len = 0;
+      f->chunks[i].covered = 0;
+    }
+  }
+
+  //smart case, an upper case letter makes the query exact
+  int fold = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (isupper((unsigned char)query[i])) {
+      fold = 0;
+    }
+  }
+
+  ScoreTask *tasks = (ScoreTask *)malloc(chunks * sizeof(ScoreTask));
+  if (tasks == NULL) {
+    return;
+  }
+  TaskGroup group;
+  task_group_init(&group);
+  for (size_t i = 0; i < chunks; i++) {
+    uint32_t first = (uint32_t)(i * FINDER_CHUNK);
+    uint32_t end = (uint32_t)(count < first + FINDER_CHUNK ? count : first + FINDER_CHUNK);
+    MatchChunk *chunk = &f->chunks[i];
+    //nothing new for this chunk
+    if (same && chunk->covered == end - first) {
+      continue;
+    }
+    tasks[i] = (ScoreTask){f, chunk, first, end, query, len, refine, fold};
+    if (thread_pool_submit(f->pool, &group, score_chunk, &tasks[i]) < 0) {
+      score_chunk(&tasks[i]);
+    }
+  }
+  task_group_wait(f->pool, &group);
+  task_group_destroy(&group);
+  free(tasks);
+
+  memcpy(f->scored, query, len);
+  f->scored_len = len;
+  f->matched = 0;
+  f->best_count = 0;
+  for (size_t i = 0; i < chunks; i++) {
+    f->matched += f->chunks[i].len;
+    for (int j = 0; j < f->chunks[i].best_count; j++) {
+      keep_best(f->best, &f->best_count, f->chunks[i].best[j]);
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef FUZZY_FIND_H
+#define FUZZY_FIND_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_pool.h"
+
+#define FINDER_SHOW 10           //best matches kept for display
+#define FINDER_QUERY_MAX 256
+#define FINDER_BLOCK 4096        //paths per block of the candidate list
+#define FINDER_MAX_BLOCKS 4096   //at most 16M paths
+#define FINDER_CHUNK 16384       //candidates scored by one task
+
+typedef struct {
+  uint32_t id;
+  int score;
+} FuzzyMatch;
+
+//matches among one chunk of candidates for the query last scored
+typedef struct {
+  FuzzyMatch *matches;
+  uint32_t len;
+  uint32_t cap;
+  uint32_t covered;  //candidates of the chunk looked at so far
+  FuzzyMatch best[FINDER_SHOW];
+  int best_count;
+} MatchChunk;
+
+//fuzzy file finder over the tree under a directory
+//the tree is walked on the thread pool, a directory is one task and its
+//subdirectories are new tasks, so idle workers steal whole subtrees
+//paths are published in blocks as they are found, so matching starts
+//right away and picks up the rest on later updates
+//matches are kept per chunk of candidates: when the query only grew,
+//a chunk filters its last matches instead of looking at every path again
+typedef struct {
+  ThreadPool *pool;
+  TaskGroup walk;
+  atomic_int stop;
+  int root_fd;
+
+  //paths relative to the root, written by the walkers under lock,
+  //readable by anyone up to count
+  pthread_mutex_t lock;
+  const char **blocks[FINDER_MAX_BLOCKS];
+  atomic_size_t count;
+  char **buffers;  //one per directory, the paths point into them
+  size_t buffers_len;
+  size_t buffers_cap;
+
+  char scored[FINDER_QUERY_MAX];  //query the chunks hold matches for
+  size_t scored_len;
+  MatchChunk *chunks;
+  size_t chunks_cap;
+  size_t matched;
+  FuzzyMatch best[FINDER_SHOW];
+  int best_count;
+} FuzzyFinder;
+
+//starts walking root, NULL when it cannot be opened
+FuzzyFinder *fuzzy_finder_create(ThreadPool *pool, const char *root);
+//stops the walk and waits for it
+void fuzzy_finder_destroy(FuzzyFinder *f);
+
+static inline int fuzzy_finder_walking(FuzzyFinder *f) {
+  return !task_group_done(&f->walk);
+}
+
+static inline size_t fuzzy_finder_count(FuzzyFinder *f) {
+  return atomic_load(&f->count);
+}
+
+static inline const char *fuzzy_finder_path(FuzzyFinder *f, uint32_t id) {
+  return f->blocks[id / FINDER_BLOCK][id % FINDER_BLOCK];
+}
+
+//matches the paths found so far against query, best and matched are set
+//the query is a subsequence of the path, lowercase queries ignore case
+void fuzzy_finder_update(FuzzyFinder *f, const char *query, size_t len);
+
+#endif
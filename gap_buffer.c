@@ -0,0 +1,135 @@
+#include "gap_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int gap_buffer_init(GapBuffer *gb, size_t cap) {
+  if (cap == 0) {
+    cap = 1;
+  }
+  gb->buf = (char *)malloc(cap);
+  if (gb->buf == NULL) {
+    return -1;
+  }
+  gb->cap = cap;
+  gb->gap_start = 0;
+  gb->gap_end = cap;
+  return 0;
+}
+
+void gap_buffer_free(GapBuffer *gb) {
+  free(gb->buf);
+  gb->buf = NULL;
+  gb->cap = 0;
+  gb->gap_start = 0;
+  gb->gap_end = 0;
+}
+
+const char *gap_buffer_span(const GapBuffer *gb, size_t pos, size_t *len) {
+  if (pos < gb->gap_start) {
+    *len = gb->gap_start - pos;
+    return gb->buf + pos;
+  }
+  size_t raw = pos + gb->gap_end - gb->gap_start;
+  *len = gb->cap - raw;
+  return gb->buf + raw;
+}
+
+void gap_buffer_move_to(GapBuffer *gb, size_t pos) {
+  size_t length = gap_buffer_length(gb);
+  if (pos > length) {
+    pos = length;
+  }
+
+  if (pos < gb->gap_start) {
+    //bytes between pos and the cursor go to the end of the gap
+    size_t n = gb->gap_start - pos;
+    memmove(gb->buf + gb->gap_end - n, gb->buf + pos, n);
+    gb->gap_start -= n;
+    gb->gap_end -= n;
+  } else if (pos > gb->gap_start) {
+    size_t n = pos - gb->gap_start;
+    memmove(gb->buf + gb->gap_start, gb->buf + gb->gap_end, n);
+    gb->gap_start += n;
+    gb->gap_end += n;
+  }
+}
+
+//makes the gap at least need bytes wide
+static int grow(GapBuffer *gb, size_t need) {
+  size_t gap = gb->gap_end - gb->gap_start;
+  if (gap >= need) {
+    return 0;
+  }
+
+  size_t cap = gb->cap * 2;
+  while (cap - gap_buffer_length(gb) < need) {
+    cap *= 2;
+  }
+  char *buf = (char *)realloc(gb->buf, cap);
+  if (buf == NULL) {
+    return -1;
+  }
+
+  //the text after the gap moves to the new end
+  size_t tail = gb->cap - gb->gap_end;
+  memmove(buf + cap - tail, buf + gb->gap_end, tail);
+  gb->buf = buf;
+  gb->gap_end = cap - tail;
+  gb->cap = cap;
+  return 0;
+}
+
+int gap_buffer_insert(GapBuffer *gb, const char *text, size_t len) {
+  if (grow(gb, len) < 0) {
+    return -1;
+  }
+  memcpy(gb->buf + gb->gap_start, text, len);
+  gb->gap_start += len;
+  return 0;
+}
+
+size_t gap_buffer_delete_before(GapBuffer *gb, size_t n) {
+  if (n > gb->gap_start) {
+    n = gb->gap_start;
+  }
+  gb->gap_start -= n;
+  return n;
+}
+
+size_t gap_buffer_delete_after(GapBuffer *gb, size_t n) {
+  if (n > gb->cap - gb->gap_end) {
+    n = gb->cap - gb->gap_end;
+  }
+  gb->gap_end += n;
+  return n;
+}
+
+void gap_buffer_copy(const GapBuffer *gb, size_t from, size_t to, char *out) {
+  while (from < to) {
+    size_t len;
+    const char *span = gap_buffer_span(gb, from, &len);
+    if (len > to - from) {
+      len = to - from;
+    }
+    memcpy(out, span, len);
+    out += len;
+    from += len;
+  }
+}
+
+char *gap_buffer_string(const GapBuffer *gb) {
+  size_t length = gap_buffer_length(gb);
+  char *text = (char *)malloc(length + 1);
+  if (text == NULL) {
+    return NULL;
+  }
+  gap_buffer_copy(gb, 0, length, text);
+  text[length] = '\0';
+  return text;
+}
+
+void gap_buffer_clear(GapBuffer *gb) {
+  gb->gap_start = 0;
+  gb->gap_end = gb->cap;
+}
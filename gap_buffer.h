@@ -0,0 +1,58 @@
+#ifndef GAP_BUFFER_H
+#define GAP_BUFFER_H
+
+#include <stddef.h>
+
+//text with a hole at the cursor
+//inserting and deleting at the cursor only moves the edges of the gap, so
+//typing costs the same no matter how long the line is; moving the cursor
+//moves the bytes between the old and new position across the gap
+typedef struct {
+  char *buf;
+  size_t cap;
+  size_t gap_start; //also the cursor
+  size_t gap_end;   //first byte after the gap
+} GapBuffer;
+
+//returns -1 when out of memory
+int gap_buffer_init(GapBuffer *gb, size_t cap);
+void gap_buffer_free(GapBuffer *gb);
+
+static inline size_t gap_buffer_length(const GapBuffer *gb) {
+  return gb->cap - (gb->gap_end - gb->gap_start);
+}
+
+static inline size_t gap_buffer_cursor(const GapBuffer *gb) {
+  return gb->gap_start;
+}
+
+//byte at a position of the text (not of the buffer)
+static inline char gap_buffer_at(const GapBuffer *gb, size_t pos) {
+  return pos < gb->gap_start ? gb->buf[pos] : gb->buf[pos + gb->gap_end - gb->gap_start];
+}
+
+//pointer to the text at pos, *len is set to how many bytes follow it
+//before the gap or the end of the buffer
+const char *gap_buffer_span(const GapBuffer *gb, size_t pos, size_t *len);
+
+//moves the cursor, pos is clamped to the length
+void gap_buffer_move_to(GapBuffer *gb, size_t pos);
+
+//inserts at the cursor and leaves the cursor after it, the buffer doubles
+//when the gap is full, returns -1 when out of memory
+int gap_buffer_insert(GapBuffer *gb, const char *text, size_t len);
+
+//remove up to n bytes before / after the cursor, return how many were removed
+size_t gap_buffer_delete_before(GapBuffer *gb, size_t n);
+size_t gap_buffer_delete_after(GapBuffer *gb, size_t n);
+
+//copies the bytes in [from, to) to out, which is not terminated
+void gap_buffer_copy(const GapBuffer *gb, size_t from, size_t to, char *out);
+
+//returns the whole text as a new nul terminated string, NULL when out of memory
+char *gap_buffer_string(const GapBuffer *gb);
+
+//empties the buffer, the capacity is kept
+void gap_buffer_clear(GapBuffer *gb);
+
+#endif
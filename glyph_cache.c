@@ -0,0 +1,376 @@
+#include "glyph_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap_font.h"
+
+#define GLYPH_CACHE_INITIAL_SLOTS 128
+#define GLYPH_CACHE_INITIAL_TABLE 256 //must stay a power of two
+
+static Uint32 hash_codepoint(Uint32 codepoint) {
+  //multiplicative hash, codepoints are mostly small and sequential
+  return codepoint * 2654435761u;
+}
+
+//copies a glyph from the built-in bitmap font, set bits become full coverage
+static void rasterize_bitmap_glyph(GlyphCache *cache, Uint8 *mask, Uint32 codepoint) {
+  const Uint8 *rows = bitmap_font_glyph(codepoint);
+  for (int y = 0; y < BITMAP_FONT_HEIGHT; y++) {
+    for (int x = 0; x < BITMAP_FONT_WIDTH; x++) {
+      mask[y * cache->cell_w + x] = (rows[y] & (0x80 >> x)) ? 255 : 0;
+    }
+  }
+}
+
+//rasterizes a codepoint into the mask of the given slot
+static void rasterize_glyph(GlyphCache *cache, int slot, Uint32 codepoint) {
+  Uint8 *mask = cache->masks + (size_t)slot * cache->cell_w * cache->cell_h;
+  memset(mask, 0, (size_t)cache->cell_w * cache->cell_h);
+
+  if (cache->chain == NULL) {
+    rasterize_bitmap_glyph(cache, mask, codepoint);
+    return;
+  }
+
+  //the coverage bitmaps say which font has the glyph, no trial rendering
+  int primary = SDL_AtomicGet(&cache->chain->primary);
+  int face = font_chain_find(cache->chain, codepoint);
+  if (face < 0) {
+    face = primary;
+    if (codepoint >= 0x20) {
+      cache->missing++; //a fallback font that is still loading may have it
+    }
+  }
+  if (cache->fonts[face] == NULL) {
+    cache->fonts[face] = font_chain_open(cache->chain, face, cache->ptsize);
+    if (cache->fonts[face] == NULL) {
+      face = primary;
+    }
+  }
+  TTF_Font *font = cache->fonts[face];
+
+  SDL_Color white = {255, 255, 255, 255};
+  SDL_Color black = {0, 0, 0, 255};
+
+  //shaded glyphs are 8-bit palettized surfaces where the pixel index is the
+  //coverage, so the pixels can be copied as they are
+  SDL_Surface *surface = TTF_RenderGlyph32_Shaded(font, codepoint, white, black);
+  if (surface == NULL) {
+    return; //blank cell, e.g. for a space
+  }
+
+  //fallback fonts have their own ascent, line them up on our baseline
+  int dy = cache->ascent - TTF_FontAscent(font);
+  int w = surface->w < cache->cell_w ? surface->w : cache->cell_w;
+  const Uint8 *pixels = (const Uint8 *)surface->pixels;
+  for (int y = 0; y < surface->h; y++) {
+    int cell_y = y + dy;
+    if (cell_y >= 0 && cell_y < cache->cell_h) {
+      memcpy(mask + cell_y * cache->cell_w, pixels + y * surface->pitch, w);
+    }
+  }
+
+  SDL_FreeSurface(surface);
+}
+
+static int grow_table(GlyphCache *cache) {
+  int new_cap = cache->table_cap * 2;
+  Uint32 *keys = (Uint32 *)malloc(new_cap * sizeof(Uint32));
+  Sint32 *slots = (Sint32 *)malloc(new_cap * sizeof(Sint32));
+  if (keys == NULL || slots == NULL) {
+    free(keys);
+    free(slots);
+    return -1;
+  }
+
+  for (int i = 0; i < new_cap; i++) {
+    slots[i] = -1;
+  }
+
+  //reinsert the old entries
+  for (int i = 0; i < cache->table_cap; i++) {
+    if (cache->slots[i] < 0) {
+      continue;
+    }
+    Uint32 pos = hash_codepoint(cache->keys[i]) & (new_cap - 1);
+    while (slots[pos] >= 0) {
+      pos = (pos + 1) & (new_cap - 1);
+    }
+    keys[pos] = cache->keys[i];
+    slots[pos] = cache->slots[i];
+  }
+
+  free(cache->keys);
+  free(cache->slots);
+  cache->keys = keys;
+  cache->slots = slots;
+  cache->table_cap = new_cap;
+  return 0;
+}
+
+static int new_slot(GlyphCache *cache) {
+  if (cache->slot_count == cache->slot_cap) {
+    int new_cap = cache->slot_cap * 2;
+    Uint8 *masks = (Uint8 *)realloc(cache->masks, (size_t)new_cap * cache->cell_w * cache->cell_h);
+    if (masks == NULL) {
+      return -1;
+    }
+    cache->masks = masks;
+    cache->slot_cap = new_cap;
+  }
+  return cache->slot_count++;
+}
+
+//forgets every glyph, the memory is kept
+static void reset_cache(GlyphCache *cache) {
+  cache->slot_count = 0;
+  cache->missing = 0;
+  for (int i = 0; i < cache->table_cap; i++) {
+    cache->slots[i] = -1;
+  }
+  for (int i = 0; i < 128; i++) {
+    cache->ascii_slots[i] = -1;
+  }
+}
+
+static GlyphCache *alloc_cache(int cell_w, int cell_h) {
+  GlyphCache *cache = (GlyphCache *)calloc(1, sizeof(GlyphCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  cache->cell_w = cell_w;
+  cache->cell_h = cell_h;
+  cache->slot_cap = GLYPH_CACHE_INITIAL_SLOTS;
+  cache->masks = (Uint8 *)malloc((size_t)cache->slot_cap * cache->cell_w * cache->cell_h);
+  cache->table_cap = GLYPH_CACHE_INITIAL_TABLE;
+  cache->keys = (Uint32 *)malloc(cache->table_cap * sizeof(Uint32));
+  cache->slots = (Sint32 *)malloc(cache->table_cap * sizeof(Sint32));
+  if (cache->masks == NULL || cache->keys == NULL || cache->slots == NULL) {
+    glyph_cache_destroy(cache);
+    return NULL;
+  }
+
+  reset_cache(cache);
+  return cache;
+}
+
+//rasterizes printable ascii up front, so whoever builds the cache pays for it
+static void warm_ascii(GlyphCache *cache) {
+  for (Uint32 cp = 0x20; cp < 0x7F; cp++) {
+    glyph_cache_get(cache, cp);
+  }
+}
+
+GlyphCache *glyph_cache_create(FontChain *chain, int ptsize) {
+  int primary = SDL_AtomicGet(&chain->primary);
+  if (primary < 0) {
+    return NULL;
+  }
+
+  TTF_Font *font = font_chain_open(chain, primary, ptsize);
+  if (font == NULL) {
+    return NULL;
+  }
+
+  //terminal text is monospaced, so the advance of 'M' is the cell width
+  int advance = 0;
+  if (TTF_GlyphMetrics32(font, 'M', NULL, NULL, NULL, NULL, &advance) < 0 || advance <= 0) {
+    advance = TTF_FontHeight(font) / 2;
+  }
+
+  GlyphCache *cache = alloc_cache(advance, TTF_FontHeight(font));
+  if (cache == NULL) {
+    font_chain_close(font);
+    return NULL;
+  }
+
+  cache->chain = chain;
+  cache->ptsize = ptsize;
+  cache->fonts[primary] = font;
+  cache->ascent = TTF_FontAscent(font);
+  cache->faces_seen = SDL_AtomicGet(&chain->loaded);
+  warm_ascii(cache);
+  return cache;
+}
+
+GlyphCache *glyph_cache_create_bitmap(void) {
+  GlyphCache *cache = alloc_cache(BITMAP_FONT_WIDTH, BITMAP_FONT_HEIGHT);
+  if (cache != NULL) {
+    warm_ascii(cache);
+  }
+  return cache;
+}
+
+void glyph_cache_destroy(GlyphCache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  for (int i = 0; i < FONT_CHAIN_MAX; i++) {
+    font_chain_close(cache->fonts[i]);
+  }
+  free(cache->masks);
+  free(cache->keys);
+  free(cache->slots);
+  free(cache);
+}
+
+int glyph_cache_refresh(GlyphCache *cache) {
+  if (cache->chain == NULL) {
+    return 0;
+  }
+
+  int loaded = SDL_AtomicGet(&cache->chain->loaded);
+  if (loaded == cache->faces_seen) {
+    return 0;
+  }
+  cache->faces_seen = loaded;
+
+  //glyphs that were found keep their font, faces only get added at the end
+  if (cache->missing == 0) {
+    return 0;
+  }
+  reset_cache(cache);
+  warm_ascii(cache);
+  return 1;
+}
+
+SDL_Surface *glyph_cache_render_text(GlyphCache *cache, const char *text, SDL_Color color) {
+  //measure first, one cell per codepoint
+  int lines = 1, columns = 0, max_columns = 0;
+  Uint32 cp;
+  int len;
+  for (const char *p = text; (len = utf8_decode(p, &cp)) > 0; p += len) {
+    if (cp == '\n') {
+      lines++;
+      columns = 0;
+    } else if (++columns > max_columns) {
+      max_columns = columns;
+    }
+  }
+  if (max_columns == 0) {
+    return NULL;
+  }
+
+  SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, max_columns * cache->cell_w,
+                                                        lines * cache->cell_h, 32,
+                                                        SDL_PIXELFORMAT_ARGB8888);
+  if (surface == NULL) {
+    return NULL;
+  }
+  SDL_FillRect(surface, NULL, 0);
+
+  //coverage goes into alpha, so the texture blends like TTF output does
+  Uint32 rgb = ((Uint32)color.r << 16) | ((Uint32)color.g << 8) | color.b;
+  int x = 0, y = 0;
+  for (const char *p = text; (len = utf8_decode(p, &cp)) > 0; p += len) {
+    if (cp == '\n') {
+      x = 0;
+      y += cache->cell_h;
+      continue;
+    }
+
+    const Uint8 *mask = glyph_cache_get(cache, cp);
+    if (mask != NULL) {
+      for (int row = 0; row < cache->cell_h; row++) {
+        Uint32 *dst = (Uint32 *)((Uint8 *)surface->pixels + (y + row) * surface->pitch) + x;
+        for (int col = 0; col < cache->cell_w; col++) {
+          dst[col] = ((Uint32)mask[row * cache->cell_w + col] << 24) | rgb;
+        }
+      }
+    }
+    x += cache->cell_w;
+  }
+
+  return surface;
+}
+
+int glyph_cache_slot(GlyphCache *cache, Uint32 codepoint) {
+  //fast path for ascii
+  if (codepoint < 128) {
+    Sint32 slot = cache->ascii_slots[codepoint];
+    if (slot < 0) {
+      slot = new_slot(cache);
+      if (slot < 0) {
+        return -1;
+      }
+      rasterize_glyph(cache, slot, codepoint);
+      cache->ascii_slots[codepoint] = slot;
+    }
+    return slot;
+  }
+
+  Uint32 pos = hash_codepoint(codepoint) & (cache->table_cap - 1);
+  while (cache->slots[pos] >= 0) {
+    if (cache->keys[pos] == codepoint) {
+      return cache->slots[pos];
+    }
+    pos = (pos + 1) & (cache->table_cap - 1);
+  }
+
+  //keep the load factor under one half
+  if (cache->slot_count * 2 >= cache->table_cap) {
+    if (grow_table(cache) < 0) {
+      return -1;
+    }
+    return glyph_cache_slot(cache, codepoint);
+  }
+
+  int slot = new_slot(cache);
+  if (slot < 0) {
+    return -1;
+  }
+  rasterize_glyph(cache, slot, codepoint);
+  cache->keys[pos] = codepoint;
+  cache->slots[pos] = slot;
+  return slot;
+}
+
+const Uint8 *glyph_cache_get(GlyphCache *cache, Uint32 codepoint) {
+  int slot = glyph_cache_slot(cache, codepoint);
+  if (slot < 0) {
+    return NULL;
+  }
+  return cache->masks + (size_t)slot * cache->cell_w * cache->cell_h;
+}
+
+int utf8_decode(const char *text, Uint32 *codepoint) {
+  const Uint8 *s = (const Uint8 *)text;
+  if (s[0] == 0) {
+    *codepoint = 0;
+    return 0;
+  }
+
+  if (s[0] < 0x80) {
+    *codepoint = s[0];
+    return 1;
+  }
+
+  int len;
+  Uint32 cp;
+  if ((s[0] & 0xE0) == 0xC0) {
+    len = 2;
+    cp = s[0] & 0x1F;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    len = 3;
+    cp = s[0] & 0x0F;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    len = 4;
+    cp = s[0] & 0x07;
+  } else {
+    *codepoint = 0xFFFD;
+    return 1;
+  }
+
+  for (int i = 1; i < len; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      *codepoint = 0xFFFD;
+      return i;
+    }
+    cp = (cp << 6) | (s[i] & 0x3F);
+  }
+
+  *codepoint = cp;
+  return len;
+}
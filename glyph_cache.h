@@ -0,0 +1,64 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "font_chain.h"
+
+//glyph cache
+//keeps one 8-bit coverage mask per codepoint, every mask is exactly one
+//cell (cell_w x cell_h) so the software backend can blend them without
+//having to look at glyph metrics again
+//glyphs come from the first font in the chain that has them, or from the
+//built-in bitmap font when the cache has no chain
+typedef struct GlyphCache {
+  FontChain *chain;
+  int ptsize;
+  TTF_Font *fonts[FONT_CHAIN_MAX]; //fallback faces are opened on first use
+  int ascent;
+  int faces_seen;  //faces loaded when the cache was last refreshed
+  int missing;     //glyphs no loaded face had
+  int cell_w;
+  int cell_h;
+
+  //masks are stored slot after slot, slot n starts at n * cell_w * cell_h
+  Uint8 *masks;
+  int slot_count;
+  int slot_cap;
+
+  //open addressing table codepoint -> slot, ascii skips the table
+  Uint32 *keys;
+  Sint32 *slots;
+  int table_cap;
+  Sint32 ascii_slots[128];
+} GlyphCache;
+
+//opens the primary font of the chain at ptsize and rasterizes ascii
+//returns NULL when the chain has no usable font
+GlyphCache *glyph_cache_create(FontChain *chain, int ptsize);
+//cache drawing from the built-in bitmap font, never fails except on oom
+GlyphCache *glyph_cache_create_bitmap(void);
+void glyph_cache_destroy(GlyphCache *cache);
+
+//drops glyphs that were drawn as missing when more fallback fonts have
+//finished loading since, returns 1 when that happened and text on screen
+//should be redrawn
+int glyph_cache_refresh(GlyphCache *cache);
+
+//renders text into a new ARGB surface with a transparent background,
+//'\n' starts a new line, returns NULL for empty text
+SDL_Surface *glyph_cache_render_text(GlyphCache *cache, const char *text, SDL_Color color);
+
+//returns the coverage mask for a codepoint, rasterizing it on first use
+//returns NULL only when out of memory
+const Uint8 *glyph_cache_get(GlyphCache *cache, Uint32 codepoint);
+
+//same as glyph_cache_get but returns the slot index, -1 when out of memory
+//slots are handed out in order, so slot_count tells what is new since
+int glyph_cache_slot(GlyphCache *cache, Uint32 codepoint);
+
+//decodes one utf-8 sequence, invalid bytes come back as U+FFFD
+//returns the number of bytes consumed (0 at the end of the string)
+int utf8_decode(const char *text, Uint32 *codepoint);
+
+#endif
@@ -0,0 +1,227 @@
+#include "grid_render.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ATLAS_COLS 64
+#define ATLAS_INITIAL_ROWS 16
+
+//(re)creates the atlas texture with room for rows x ATLAS_COLS glyphs
+static int create_texture(GlyphAtlas *atlas, SDL_Renderer *renderer, int rows) {
+  if (atlas->texture != NULL) {
+    SDL_DestroyTexture(atlas->texture);
+  }
+
+  atlas->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                     ATLAS_COLS * atlas->cache->cell_w, rows * atlas->cache->cell_h);
+  if (atlas->texture == NULL) {
+    return -1;
+  }
+  SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+  atlas->cols = ATLAS_COLS;
+  atlas->rows = rows;
+  atlas->slots = 0;
+  return 0;
+}
+
+GlyphAtlas *glyph_atlas_create(SDL_Renderer *renderer, GlyphCache *cache) {
+  GlyphAtlas *atlas = (GlyphAtlas *)calloc(1, sizeof(GlyphAtlas));
+  if (atlas == NULL) {
+    return NULL;
+  }
+
+  atlas->cache = cache;
+  if (create_texture(atlas, renderer, ATLAS_INITIAL_ROWS) < 0 || glyph_atlas_sync(atlas, renderer) < 0) {
+    glyph_atlas_destroy(atlas);
+    return NULL;
+  }
+  return atlas;
+}
+
+void glyph_atlas_destroy(GlyphAtlas *atlas) {
+  if (atlas == NULL) {
+    return;
+  }
+  if (atlas->texture != NULL) {
+    SDL_DestroyTexture(atlas->texture);
+  }
+  free(atlas);
+}
+
+int glyph_atlas_sync(GlyphAtlas *atlas, SDL_Renderer *renderer) {
+  GlyphCache *cache = atlas->cache;
+
+  //the cache forgot its glyphs (new fallback font), slots are reused
+  if (cache->slot_count < atlas->slots) {
+    atlas->slots = 0;
+  }
+
+  if (cache->slot_count > atlas->cols * atlas->rows) {
+    int rows = atlas->rows;
+    while (cache->slot_count > atlas->cols * rows) {
+      rows *= 2;
+    }
+    if (create_texture(atlas, renderer, rows) < 0) {
+      return -1;
+    }
+  }
+  if (atlas->slots == cache->slot_count) {
+    return 0;
+  }
+
+  int cell_pixels = cache->cell_w * cache->cell_h;
+  Uint32 *pixels = (Uint32 *)malloc(cell_pixels * sizeof(Uint32));
+  if (pixels == NULL) {
+    return -1;
+  }
+
+  for (int slot = atlas->slots; slot < cache->slot_count; slot++) {
+    const Uint8 *mask = cache->masks + (size_t)slot * cell_pixels;
+    for (int i = 0; i < cell_pixels; i++) {
+      pixels[i] = ((Uint32)mask[i] << 24) | 0x00FFFFFF;
+    }
+    SDL_Rect rect = {(slot % atlas->cols) * cache->cell_w, (slot / atlas->cols) * cache->cell_h,
+                     cache->cell_w, cache->cell_h};
+    SDL_UpdateTexture(atlas->texture, &rect, pixels, cache->cell_w * sizeof(Uint32));
+  }
+  atlas->slots = cache->slot_count;
+
+  free(pixels);
+  return 0;
+}
+
+GridRenderer *grid_render_create(SDL_Renderer *renderer, GlyphAtlas *atlas, int cell_w, int cell_h,
+                                 int cols, int rows) {
+  GridRenderer *gr = (GridRenderer *)calloc(1, sizeof(GridRenderer));
+  if (gr == NULL) {
+    return NULL;
+  }
+
+  gr->atlas = atlas;
+  gr->cell_w = cell_w;
+  gr->cell_h = cell_h;
+  gr->width = cols * cell_w;
+  gr->height = rows * cell_h;
+
+  //without render targets every frame is drawn from scratch
+  gr->use_targets = SDL_RenderTargetSupported(renderer);
+  for (int i = 0; gr->use_targets && i < 2; i++) {
+    gr->frames[i] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                      gr->width, gr->height);
+    if (gr->frames[i] == NULL) {
+      grid_render_destroy(gr);
+      return NULL;
+    }
+    //frames are copied as they are, shifting must not blend
+    SDL_SetTextureBlendMode(gr->frames[i], SDL_BLENDMODE_NONE);
+  }
+  return gr;
+}
+
+void grid_render_destroy(GridRenderer *gr) {
+  if (gr == NULL) {
+    return;
+  }
+  for (int i = 0; i < 2; i++) {
+    if (gr->frames[i] != NULL) {
+      SDL_DestroyTexture(gr->frames[i]);
+    }
+  }
+  free(gr);
+}
+
+void grid_render_invalidate(GridRenderer *gr) {
+  gr->primed = 0;
+}
+
+//draws one grid row with its top left corner at x,y on the current target
+static void draw_row(GridRenderer *gr, SDL_Renderer *renderer, TermGrid *grid, int row, int x, int y,
+                     SDL_Color bg) {
+  GlyphAtlas *atlas = gr->atlas;
+  GlyphCache *cache = atlas->cache;
+
+  SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, bg.a);
+  SDL_Rect band = {x, y, grid->cols * gr->cell_w, gr->cell_h};
+  SDL_RenderFillRect(renderer, &band);
+
+  const Uint32 *cells = term_grid_row(grid, row);
+  for (int col = 0; col < grid->cols; col++) {
+    if (cells[col] == ' ') {
+      continue;
+    }
+
+    int slot = glyph_cache_slot(cache, cells[col]);
+    if (slot < 0) {
+      continue;
+    }
+    if (slot >= atlas->slots && glyph_atlas_sync(atlas, renderer) < 0) {
+      continue;
+    }
+
+    SDL_Rect src = {(slot % atlas->cols) * cache->cell_w, (slot / atlas->cols) * cache->cell_h,
+                    cache->cell_w, cache->cell_h};
+    SDL_Rect dst = {x + col * gr->cell_w, y, gr->cell_w, gr->cell_h};
+    SDL_RenderCopy(renderer, atlas->texture, &src, &dst);
+  }
+}
+
+void grid_render_frame(GridRenderer *gr, SDL_Renderer *renderer, TermGrid *grid, int x, int y,
+                       SDL_Color fg, SDL_Color bg) {
+  int scrolled = grid->scrolled;
+  grid->scrolled = 0;
+  gr->rows_drawn = 0;
+  gr->rows_blitted = 0;
+
+  //glyphs drawn from a reset cache would come from reused slots
+  if (gr->atlas->cache->slot_count < gr->atlas->slots) {
+    gr->primed = 0;
+  }
+  glyph_atlas_sync(gr->atlas, renderer);
+  SDL_SetTextureColorMod(gr->atlas->texture, fg.r, fg.g, fg.b);
+
+  if (!gr->use_targets) {
+    SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, bg.a);
+    SDL_RenderClear(renderer);
+    for (int row = 0; row < grid->rows; row++) {
+      draw_row(gr, renderer, grid, row, x, y + row * gr->cell_h, bg);
+    }
+    memset(grid->dirty, 0, grid->rows);
+    gr->rows_drawn = grid->rows;
+    SDL_RenderPresent(renderer);
+    return;
+  }
+
+  if (!gr->primed || scrolled >= grid->rows) {
+    memset(grid->dirty, 1, grid->rows);
+    scrolled = 0;
+  }
+
+  if (scrolled > 0) {
+    //one copy moves everything that is still visible into the other target
+    int shift = scrolled * gr->cell_h;
+    SDL_Rect src = {0, shift, gr->width, gr->height - shift};
+    SDL_Rect dst = {0, 0, gr->width, gr->height - shift};
+    SDL_SetRenderTarget(renderer, gr->frames[!gr->front]);
+    SDL_RenderCopy(renderer, gr->frames[gr->front], &src, &dst);
+    gr->front = !gr->front;
+    gr->rows_blitted = grid->rows - scrolled;
+  } else {
+    SDL_SetRenderTarget(renderer, gr->frames[gr->front]);
+  }
+
+  for (int row = 0; row < grid->rows; row++) {
+    if (grid->dirty[row]) {
+      draw_row(gr, renderer, grid, row, 0, row * gr->cell_h, bg);
+      grid->dirty[row] = 0;
+      gr->rows_drawn++;
+    }
+  }
+  gr->primed = 1;
+
+  SDL_SetRenderTarget(renderer, NULL);
+  SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, bg.a);
+  SDL_RenderClear(renderer);
+  SDL_Rect frame = {x, y, gr->width, gr->height};
+  SDL_RenderCopy(renderer, gr->frames[gr->front], NULL, &frame);
+  SDL_RenderPresent(renderer);
+}
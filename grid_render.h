@@ -0,0 +1,60 @@
+#ifndef GRID_RENDER_H
+#define GRID_RENDER_H
+
+#include <SDL2/SDL.h>
+#include "glyph_cache.h"
+#include "term_grid.h"
+
+//glyphs of one cache uploaded into a texture, white with coverage in alpha
+//kept apart from the renderer so atlases for several font sizes can be
+//cached and switched between without uploading anything again
+typedef struct {
+  GlyphCache *cache;
+  SDL_Texture *texture;
+  int cols;  //in cells
+  int rows;
+  int slots; //cache slots uploaded so far
+} GlyphAtlas;
+
+//uploads every glyph the cache has so far
+GlyphAtlas *glyph_atlas_create(SDL_Renderer *renderer, GlyphCache *cache);
+void glyph_atlas_destroy(GlyphAtlas *atlas);
+
+//uploads glyphs rasterized since the last sync, starts over when the cache
+//was reset, returns -1 when the texture could not be grown
+int glyph_atlas_sync(GlyphAtlas *atlas, SDL_Renderer *renderer);
+
+//SDL renderer backend for a character grid
+//glyphs are copied out of an atlas texture, and the last frame is kept in a
+//render target: when the grid scrolled by n lines the old frame is shifted
+//with a single copy and only the exposed and dirty rows are drawn again
+typedef struct {
+  GlyphAtlas *atlas;    //not owned
+  int cell_w;           //glyphs are stretched when this differs from the atlas
+  int cell_h;
+
+  SDL_Texture *frames[2]; //render targets, frames[front] holds the last frame
+  int front;
+  int primed;           //0 until frames[front] has been drawn completely
+  int width;
+  int height;
+  int use_targets;      //0 when the renderer has no render targets
+
+  int rows_drawn;       //stats of the last frame
+  int rows_blitted;
+} GridRenderer;
+
+//sized for a cols x rows grid of cell_w x cell_h cells
+GridRenderer *grid_render_create(SDL_Renderer *renderer, GlyphAtlas *atlas, int cell_w, int cell_h,
+                                 int cols, int rows);
+void grid_render_destroy(GridRenderer *gr);
+
+//brings the kept frame up to date with the grid, clears the dirty flags,
+//copies the frame to x,y on a cleared window and presents it
+void grid_render_frame(GridRenderer *gr, SDL_Renderer *renderer, TermGrid *grid, int x, int y,
+                       SDL_Color fg, SDL_Color bg);
+
+//the kept frame was lost (SDL_RENDER_TARGETS_RESET), draw everything again
+void grid_render_invalidate(GridRenderer *gr);
+
+#endif
@@ -0,0 +1,193 @@
+#include "headless.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frame_dump.h"
+#include "glyph_cache.h"
+#include "latency.h"
+#include "soft_render.h"
+#include "term_grid.h"
+
+#define HEADLESS_DEFAULT_COLS 80
+#define HEADLESS_DEFAULT_ROWS 24
+#define HEADLESS_DEFAULT_CHUNK 4096
+
+//pipeline stages that get timed
+enum { STAGE_PARSE, STAGE_RENDER, STAGE_PRESENT, STAGE_DUMP, STAGE_COUNT };
+static const char *stage_names[STAGE_COUNT] = {"parse", "render", "present", "dump"};
+
+typedef struct {
+  Uint64 total;
+  Uint64 max;
+} StageTime;
+
+//reads the whole input up front so file io is not part of any stage
+static char *read_input(const char *path, size_t *len) {
+  FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (fp == NULL) {
+    perror(path);
+    return NULL;
+  }
+
+  size_t cap = 1 << 16, used = 0;
+  char *data = (char *)malloc(cap);
+  while (data != NULL) {
+    size_t n = fread(data + used, 1, cap - used, fp);
+    used += n;
+    if (used < cap) {
+      break;
+    }
+    cap *= 2;
+    char *grown = (char *)realloc(data, cap);
+    if (grown == NULL) {
+      free(data);
+    }
+    data = grown;
+  }
+
+  if (fp != stdin) {
+    fclose(fp);
+  }
+  *len = used;
+  return data;
+}
+
+static void add_time(StageTime *stage, Uint64 start) {
+  Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+  stage->total += elapsed;
+  if (elapsed > stage->max) {
+    stage->max = elapsed;
+  }
+}
+
+int headless_run(GlyphCache *cache, int argc, char **argv) {
+  const char *input_path = NULL;
+  const char *png_dir = NULL;
+  const char *latency_path = NULL;
+  int cols = HEADLESS_DEFAULT_COLS, rows = HEADLESS_DEFAULT_ROWS;
+  size_t chunk = HEADLESS_DEFAULT_CHUNK;
+  int print_checksums = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+      input_path = argv[++i];
+    } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &cols, &rows) != 2 || cols <= 0 || rows <= 0) {
+        fprintf(stderr, "headless: bad --size %s \n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+      chunk = strtoul(argv[++i], NULL, 10);
+      if (chunk == 0) {
+        chunk = HEADLESS_DEFAULT_CHUNK;
+      }
+    } else if (strcmp(argv[i], "--checksum") == 0) {
+      print_checksums = 1;
+    } else if (strcmp(argv[i], "--dump-png") == 0 && i + 1 < argc) {
+      png_dir = argv[++i];
+    } else if (strcmp(argv[i], "--latency-out") == 0 && i + 1 < argc) {
+      latency_path = argv[++i];
+    }
+  }
+
+  if (input_path == NULL) {
+    fprintf(stderr, "usage: %s --headless FILE [--size COLSxROWS] [--chunk BYTES] [--checksum] [--dump-png DIR] [--latency-out FILE] \n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  size_t input_len;
+  char *input = read_input(input_path, &input_len);
+  if (input == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  TermGrid *grid = term_grid_create(cols, rows);
+  SoftRenderer *sr = soft_render_create(NULL, cols * cache->cell_w, rows * cache->cell_h);
+  if (grid == NULL || sr == NULL) {
+    fprintf(stderr, "headless: out of memory \n");
+    soft_render_destroy(sr);
+    term_grid_destroy(grid);
+    free(input);
+    return EXIT_FAILURE;
+  }
+
+  SDL_Color fg = {255, 255, 255, 255};
+  SDL_Color bg = {0, 0, 0, 255};
+  StageTime stages[STAGE_COUNT] = {{0, 0}};
+  //from a chunk arriving to its frame being presented, what a key would see
+  static LatencyHistogram latency;
+  latency_reset(&latency);
+  long rows_drawn = 0, rows_uploaded = 0;
+  int frames = 0;
+  int status = EXIT_SUCCESS;
+
+  for (size_t offset = 0; offset < input_len; offset += chunk, frames++) {
+    size_t len = input_len - offset < chunk ? input_len - offset : chunk;
+
+    uint64_t arrived = latency_now();
+    Uint64 start = SDL_GetPerformanceCounter();
+    term_grid_feed(grid, input + offset, len);
+    add_time(&stages[STAGE_PARSE], start);
+
+    start = SDL_GetPerformanceCounter();
+    rows_drawn += soft_render_draw_grid(sr, cache, grid, 0, 0, fg, bg);
+    add_time(&stages[STAGE_RENDER], start);
+
+    start = SDL_GetPerformanceCounter();
+    soft_render_present(sr, NULL);
+    rows_uploaded += sr->uploaded_rows;
+    add_time(&stages[STAGE_PRESENT], start);
+    latency_record(&latency, latency_now() - arrived);
+
+    start = SDL_GetPerformanceCounter();
+    if (print_checksums) {
+      printf("frame %d checksum %016llx \n", frames,
+             (unsigned long long)frame_checksum(sr->pixels, sr->width, sr->height));
+    }
+    if (png_dir != NULL) {
+      char path[4096];
+      snprintf(path, sizeof(path), "%s/frame_%05d.png", png_dir, frames);
+      if (frame_write_png(path, sr->pixels, sr->width, sr->height) < 0) {
+        perror(path);
+        status = EXIT_FAILURE;
+        png_dir = NULL; //one error is enough
+      }
+    }
+    add_time(&stages[STAGE_DUMP], start);
+  }
+
+  //per stage summary, times in microseconds
+  double us = 1e6 / (double)SDL_GetPerformanceFrequency();
+  int per_frame = frames > 0 ? frames : 1;
+  printf("frames: %d  bytes: %zu  grid: %dx%d  cell: %dx%d  blend: %s \n", frames, input_len,
+         cols, rows, cache->cell_w, cache->cell_h, soft_render_blend_name());
+  printf("rows drawn: %ld  rows uploaded: %ld \n", rows_drawn, rows_uploaded);
+  printf("%-8s %12s %12s %12s \n", "stage", "total us", "avg us", "max us");
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    printf("%-8s %12.1f %12.2f %12.2f \n", stage_names[i], stages[i].total * us,
+           stages[i].total * us / per_frame, stages[i].max * us);
+  }
+  printf("latency us: p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f \n", latency_percentile(&latency, 0.5) / 1e3,
+         latency_percentile(&latency, 0.99) / 1e3, latency_percentile(&latency, 0.999) / 1e3,
+         latency.max / 1e3);
+
+  if (latency_path != NULL) {
+    int fd = open(latency_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || latency_export(&latency, fd) < 0) {
+      perror(latency_path);
+      status = EXIT_FAILURE;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  soft_render_destroy(sr);
+  term_grid_destroy(grid);
+  free(input);
+  return status;
+}
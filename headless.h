@@ -0,0 +1,21 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "glyph_cache.h"
+
+//headless benchmark mode
+//runs the parse -> grid -> render pipeline into an offscreen framebuffer
+//without creating a window and prints the time spent in every stage
+//
+//  --headless FILE     input to replay, - for stdin
+//  --size COLSxROWS    grid size (default 80x24)
+//  --chunk BYTES       bytes parsed per frame (default 4096)
+//  --checksum          print a checksum of every frame
+//  --dump-png DIR      write every frame to DIR/frame_NNNNN.png
+//  --latency-out FILE  write the input to present latency of every frame
+//                      to FILE as an HdrHistogram .hgrm percentile table
+//
+//returns the process exit code
+int headless_run(GlyphCache *cache, int argc, char **argv);
+
+#endif
@@ -0,0 +1,278 @@
+#include "highlight.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TOKENS_INITIAL_SIZE 64
+
+static int grow(void **array, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap) {
+    return 0;
+  }
+  size_t new_cap = *cap == 0 ? TOKENS_INITIAL_SIZE : *cap;
+  while (new_cap < need) {
+    new_cap *= 2;
+  }
+  void *grown = realloc(*array, new_cap * size);
+  if (grown == NULL) {
+    return -1;
+  }
+  *array = grown;
+  *cap = new_cap;
+  return 0;
+}
+
+//tokens and states share a capacity, states has one more
+static int grow_tokens(LexToken **tokens, LexState **states, size_t *cap, size_t need) {
+  size_t token_cap = *cap;
+  size_t state_cap = *cap;
+  if (grow((void **)tokens, &token_cap, need + 1, sizeof(LexToken)) < 0 ||
+      grow((void **)states, &state_cap, need + 1, sizeof(LexState)) < 0) {
+    return -1;
+  }
+  *cap = token_cap < state_cap ? token_cap : state_cap;
+  return 0;
+}
+
+static inline size_t token_end(const LexToken *tok) {
+  return tok->start + tok->len;
+}
+
+//first token ending at or after pos (inclusive) or after it
+static size_t first_token(Highlighter *hl, size_t pos, int inclusive) {
+  size_t lo = 0;
+  size_t hi = hl->count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    size_t end = token_end(&hl->tokens[mid]);
+    if (end < pos || (!inclusive && end == pos)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+Highlighter *highlighter_create(ExistCache *cache) {
+  Highlighter *hl = (Highlighter *)calloc(1, sizeof(Highlighter));
+  if (hl == NULL) {
+    return NULL;
+  }
+  hl->cache = cache;
+  if (grow_tokens(&hl->tokens, &hl->states, &hl->token_cap, 0) < 0) {
+    highlighter_destroy(hl);
+    return NULL;
+  }
+  highlighter_reset(hl);
+  return hl;
+}
+
+void highlighter_destroy(Highlighter *hl) {
+  if (hl == NULL) {
+    return;
+  }
+  free(hl->text);
+  free(hl->tokens);
+  free(hl->states);
+  free(hl->fresh);
+  free(hl->fresh_states);
+  free(hl);
+}
+
+void highlighter_reset(Highlighter *hl) {
+  if (getcwd(hl->cwd, sizeof(hl->cwd)) == NULL) {
+    hl->cwd[0] = '\0';
+  }
+  hl->len = 0;
+  hl->count = 0;
+  hl->states[0] = lex_start_state();
+  hl->pending = 0;
+}
+
+long highlighter_edit(Highlighter *hl, const GapBuffer *line, size_t pos, size_t removed, size_t inserted) {
+  if (hl->len != gap_buffer_length(line) + removed - inserted) {
+    //lost track after running out of memory, take the whole line again
+    hl->len = 0;
+    hl->count = 0;
+    hl->states[0] = lex_start_state();
+    pos = 0;
+    removed = 0;
+    inserted = gap_buffer_length(line);
+  }
+
+  //the copy gets the same edit
+  size_t new_len = hl->len - removed + inserted;
+  if (grow((void **)&hl->text, &hl->cap, new_len + 1, 1) < 0) {
+    hl->len = SIZE_MAX;
+    return -1;
+  }
+  memmove(hl->text + pos + inserted, hl->text + pos + removed, hl->len - pos - removed);
+  gap_buffer_copy(line, pos, pos + inserted, hl->text + pos);
+  hl->len = new_len;
+
+  //tokens ending before the edit keep their text and the byte after it
+  size_t first = first_token(hl, pos, 1);
+  size_t lex_pos = first > 0 ? token_end(&hl->tokens[first - 1]) : 0;
+  LexState state = hl->states[first];
+
+  size_t old_edit_end = pos + removed;
+  long delta = (long)inserted - (long)removed;
+  size_t old = first;
+  size_t fresh = 0;
+  int synced = 0;
+  LexToken tok;
+  while (1) {
+    LexState before = state;
+    if (!lex_token(hl->text, hl->len, &lex_pos, &state, &tok)) {
+      break;
+    }
+    //past the edit, a token where an old one started in the same state
+    //lexes the rest of the line the same way
+    if (tok.start >= pos + inserted) {
+      while (old < hl->count &&
+             (hl->tokens[old].start < old_edit_end || (long)hl->tokens[old].start + delta < (long)tok.start)) {
+        old++;
+      }
+      if (old < hl->count && (long)hl->tokens[old].start + delta == (long)tok.start &&
+          lex_same_state(hl->states[old], before)) {
+        synced = 1;
+        break;
+      }
+    }
+    if (grow_tokens(&hl->fresh, &hl->fresh_states, &hl->fresh_cap, fresh + 1) < 0) {
+      hl->len = SIZE_MAX;
+      return -1;
+    }
+    hl->fresh[fresh] = tok;
+    hl->fresh_states[fresh] = before;
+    fresh++;
+  }
+
+  size_t kept = synced ? hl->count - old : 0;
+  if (grow_tokens(&hl->tokens, &hl->states, &hl->token_cap, first + fresh + kept) < 0) {
+    hl->len = SIZE_MAX;
+    return -1;
+  }
+  if (synced) {
+    memmove(hl->tokens + first + fresh, hl->tokens + old, kept * sizeof(LexToken));
+    memmove(hl->states + first + fresh, hl->states + old, (kept + 1) * sizeof(LexState));
+    for (size_t i = first + fresh; i < first + fresh + kept; i++) {
+      hl->tokens[i].start = (uint32_t)((long)hl->tokens[i].start + delta);
+    }
+  } else {
+    hl->states[first + fresh] = state;
+  }
+  memcpy(hl->tokens + first, hl->fresh, fresh * sizeof(LexToken));
+  memcpy(hl->states + first, hl->fresh_states, fresh * sizeof(LexState));
+  hl->count = first + fresh + kept;
+
+  //a word's style depends on all of it
+  if (fresh > 0 && hl->fresh[0].start < pos) {
+    return hl->fresh[0].start;
+  }
+  return (long)pos;
+}
+
+static HighlightStyle word_style(Highlighter *hl, const LexToken *tok) {
+  char word[PATH_MAX];
+  if (tok->len >= sizeof(word)) {
+    return STYLE_PLAIN;
+  }
+  size_t len = lex_unquote(hl->text + tok->start, tok->len, word);
+
+  ExistState state;
+  if (tok->flags & LEX_COMMAND) {
+    state = exist_cache_command(hl->cache, word, len, hl->cwd);
+    if (state == EXIST_PENDING) {
+      hl->pending = 1;
+      return STYLE_PLAIN;
+    }
+    return state == EXIST_YES ? STYLE_COMMAND : STYLE_UNKNOWN;
+  }
+
+  //options are not looked up
+  if (len == 0 || word[0] == '-') {
+    return STYLE_PLAIN;
+  }
+  state = exist_cache_path(hl->cache, word, len, hl->cwd);
+  if (state == EXIST_PENDING) {
+    hl->pending = 1;
+  }
+  return state == EXIST_YES ? STYLE_PATH : STYLE_PLAIN;
+}
+
+//the part of [start, end) at or after from
+static void emit(Highlighter *hl, size_t from, size_t start, size_t end, HighlightStyle style,
+                 HighlightSpan span, void *ctx) {
+  if (start < from) {
+    start = from;
+  }
+  if (start < end) {
+    span(ctx, hl->text + start, end - start, style);
+  }
+}
+
+//quoted parts of a word are strings, the rest has the word's style
+static void emit_word(Highlighter *hl, size_t from, const LexToken *tok, HighlightStyle style,
+                      HighlightSpan span, void *ctx) {
+  size_t end = token_end(tok);
+  if (!(tok->flags & LEX_QUOTED)) {
+    emit(hl, from, tok->start, end, style, span, ctx);
+    return;
+  }
+
+  size_t run = tok->start;
+  char quote = 0;
+  for (size_t i = tok->start; i < end; i++) {
+    char c = hl->text[i];
+    if (quote != 0) {
+      if (c == quote) {
+        emit(hl, from, run, i + 1, STYLE_STRING, span, ctx);
+        run = i + 1;
+        quote = 0;
+      } else if (c == '\\' && quote == '"') {
+        i++;
+      }
+    } else if (c == '\'' || c == '"') {
+      emit(hl, from, run, i, style, span, ctx);
+      run = i;
+      quote = c;
+    } else if (c == '\\') {
+      i++;
+    }
+  }
+  emit(hl, from, run, end, quote != 0 ? STYLE_STRING : style, span, ctx);
+}
+
+void highlighter_draw(Highlighter *hl, size_t from, HighlightSpan span, void *ctx) {
+  if (hl->len == SIZE_MAX) {
+    return;
+  }
+  //a partial draw leaves words before from as they were, so the
+  //generation they were drawn at is kept and any answer still redraws
+  if (from == 0) {
+    hl->generation = exist_cache_generation(hl->cache);
+    hl->pending = 0;
+  }
+
+  size_t pos = from;
+  for (size_t i = first_token(hl, from, 0); i < hl->count; i++) {
+    const LexToken *tok = &hl->tokens[i];
+    emit(hl, from, pos, tok->start, STYLE_PLAIN, span, ctx);
+    switch (tok->kind) {
+      case LEX_COMMENT:
+        emit(hl, from, tok->start, token_end(tok), STYLE_COMMENT, span, ctx);
+        break;
+      case LEX_OPERATOR:
+        emit(hl, from, tok->start, token_end(tok), STYLE_OPERATOR, span, ctx);
+        break;
+      default:
+        emit_word(hl, from, tok, word_style(hl, tok), span, ctx);
+        break;
+    }
+    pos = token_end(tok);
+  }
+  emit(hl, from, pos, hl->len, STYLE_PLAIN, span, ctx);
+}
@@ -0,0 +1,77 @@
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include <linux/limits.h>
+#include <stddef.h>
+#include "exist_cache.h"
+#include "gap_buffer.h"
+#include "lexer.h"
+
+typedef enum {
+  STYLE_PLAIN,
+  STYLE_COMMAND,  //command that can be run
+  STYLE_UNKNOWN,  //command that cannot
+  STYLE_STRING,   //quoted text
+  STYLE_OPERATOR,
+  STYLE_COMMENT,
+  STYLE_PATH,     //argument naming something that exists
+  STYLE_COUNT
+} HighlightStyle;
+
+//called for each run of bytes drawn in one style
+typedef void (*HighlightSpan)(void *ctx, const char *text, size_t len, HighlightStyle style);
+
+//colors the line being edited
+//keeps the line's tokens and the lexer state before each one, an edit is
+//lexed again from the token it touches only until a token lines up with an
+//old one in the same state, the rest is shifted instead of lexed
+//whether commands and paths exist comes from an ExistCache, so drawing never
+//waits on the file system: an unanswered word is drawn plain and pending
+//is set, once the cache's generation moves the line is worth drawing again
+typedef struct {
+  ExistCache *cache;
+  char cwd[PATH_MAX];  //read at the start of each line
+
+  char *text;          //copy of the line
+  size_t len;
+  size_t cap;
+
+  LexToken *tokens;
+  LexState *states;    //state before each token, states[count] after the last
+  size_t count;
+  size_t token_cap;
+  LexToken *fresh;     //tokens of the region lexed again
+  LexState *fresh_states;
+  size_t fresh_cap;
+
+  unsigned generation; //cache generation when last drawn
+  int pending;         //a word was drawn without an answer
+} Highlighter;
+
+//NULL on error
+Highlighter *highlighter_create(ExistCache *cache);
+void highlighter_destroy(Highlighter *hl);
+
+//empties the line and takes the cwd again
+void highlighter_reset(Highlighter *hl);
+
+//removed bytes at pos were replaced by inserted bytes, now in line
+//returns the first byte whose style may have changed, -1 when out of memory
+//(the highlighter then starts over on the next edit)
+long highlighter_edit(Highlighter *hl, const GapBuffer *line, size_t pos, size_t removed, size_t inserted);
+
+//0 when the copy of the line is not the line editor's, after running out
+//of memory, the line is then best drawn without styles
+static inline int highlighter_in_sync(const Highlighter *hl, size_t len) {
+  return hl->len == len;
+}
+
+//calls span for the line from byte from to its end
+void highlighter_draw(Highlighter *hl, size_t from, HighlightSpan span, void *ctx);
+
+//1 when an answer for a word drawn plain has come in
+static inline int highlighter_stale(Highlighter *hl) {
+  return hl->pending && exist_cache_generation(hl->cache) != hl->generation;
+}
+
+#endif
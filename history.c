@@ -0,0 +1,396 @@
+#include "history.h"
+
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//extra address space mapped past the end of both files
+#define MAP_RESERVE (1 << 20)
+
+#define FRAME_MARK 0x1E
+#define FRAME_HEADER 9  //mark, length, checksum
+#define FRAME_TRAILER 1 //newline
+
+//offsets written to the index with one pwrite
+#define INDEX_BATCH 512
+
+//how far back open looks for an index entry it can trust before
+//building the index again
+#define INDEX_CHECK_BACK 64
+
+enum { FRAME_VALID, FRAME_PARTIAL, FRAME_BAD };
+
+//maps fd read only with room to grow, the part past the end of the file
+//becomes readable as appends extend it, so most appends need no new mapping
+static const void *map_file(int fd, const void *old, size_t *mapped, size_t size) {
+  if (old != NULL) {
+    munmap((void *)old, *mapped);
+  }
+  *mapped = size + size / 4 + MAP_RESERVE;
+
+  void *map = mmap(NULL, *mapped, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    *mapped = 0;
+    return NULL;
+  }
+  return map;
+}
+
+//picks up appends to both files, by us or by another shell
+static void refresh(History *h) {
+  struct stat log_st, index_st;
+  if (fstat(h->log_fd, &log_st) == -1 || fstat(h->index_fd, &index_st) == -1) {
+    return;
+  }
+
+  if (h->log == NULL || (size_t)log_st.st_size > h->log_mapped) {
+    h->log = (const char *)map_file(h->log_fd, h->log, &h->log_mapped, log_st.st_size);
+  }
+  if (h->index == NULL || (size_t)index_st.st_size > h->index_mapped) {
+    h->index = (const uint64_t *)map_file(h->index_fd, h->index, &h->index_mapped, index_st.st_size);
+  }
+  h->log_size = h->log == NULL ? 0 : log_st.st_size;
+  h->index_entries = h->index == NULL ? 0 : index_st.st_size / sizeof(uint64_t);
+}
+
+//fnv-1a over the length and the command
+static uint32_t frame_checksum(const char *data, uint32_t len) {
+  uint32_t hash = 2166136261u ^ len;
+  for (uint32_t i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+//checks the record at offset, its end goes to *end
+//FRAME_PARTIAL is a record that runs past the end of the file, either
+//still being written or torn
+static int frame_at(const History *h, size_t offset, size_t *end) {
+  if (offset >= h->log_size || h->log[offset] != FRAME_MARK) {
+    return FRAME_BAD;
+  }
+  if (offset + FRAME_HEADER > h->log_size) {
+    return FRAME_PARTIAL;
+  }
+
+  uint32_t len, checksum;
+  memcpy(&len, h->log + offset + 1, sizeof(len));
+  memcpy(&checksum, h->log + offset + 5, sizeof(checksum));
+  if (len > HISTORY_MAX_ENTRY) {
+    return FRAME_BAD;
+  }
+  if (offset + FRAME_HEADER + len + FRAME_TRAILER > h->log_size) {
+    return FRAME_PARTIAL;
+  }
+
+  const char *data = h->log + offset + FRAME_HEADER;
+  if (data[len] != '\n' || frame_checksum(data, len) != checksum) {
+    return FRAME_BAD;
+  }
+  *end = offset + FRAME_HEADER + len + FRAME_TRAILER;
+  return FRAME_VALID;
+}
+
+//first complete record at or after offset, log_size when there is none
+static size_t next_frame(const History *h, size_t offset) {
+  while (offset < h->log_size) {
+    const char *mark = (const char *)memchr(h->log + offset, FRAME_MARK, h->log_size - offset);
+    if (mark == NULL) {
+      break;
+    }
+    size_t end;
+    offset = mark - h->log;
+    if (frame_at(h, offset, &end) == FRAME_VALID) {
+      return offset;
+    }
+    offset++;
+  }
+  return h->log_size;
+}
+
+static int write_index(History *h, const uint64_t *offsets, size_t n, size_t first) {
+  size_t bytes = n * sizeof(uint64_t);
+  if (pwrite(h->index_fd, offsets, bytes, first * sizeof(uint64_t)) != (ssize_t)bytes) {
+    return -1;
+  }
+  return 0;
+}
+
+//reads the records after parsed_end and writes their offsets to the index
+//other shells may be writing the same slots, they write the same values
+static int catch_up(History *h) {
+  uint64_t batch[INDEX_BATCH];
+  size_t n = 0;
+  size_t offset = h->parsed_end;
+  size_t first = h->count;
+  int result = 0;
+
+  refresh(h);
+  while (offset < h->log_size) {
+    size_t end;
+    int state = frame_at(h, offset, &end);
+    if (state != FRAME_VALID) {
+      //garbage, or a torn record with complete ones after it
+      size_t next = next_frame(h, offset + 1);
+      if (state == FRAME_PARTIAL && next == h->log_size) {
+        //the last record is still being written
+        break;
+      }
+      offset = next;
+      continue;
+    }
+
+    batch[n++] = offset;
+    offset = end;
+    if (n == INDEX_BATCH) {
+      if (write_index(h, batch, n, first) < 0) {
+        result = -1;
+        break;
+      }
+      first += n;
+      h->parsed_end = offset;
+      n = 0;
+    }
+  }
+  if (n > 0 && result == 0) {
+    if (write_index(h, batch, n, first) < 0) {
+      result = -1;
+    } else {
+      first += n;
+      h->parsed_end = offset;
+    }
+  } else if (result == 0) {
+    //only garbage was skipped
+    h->parsed_end = offset;
+  }
+
+  refresh(h);
+  size_t added = first - h->count;
+  h->count = first < h->index_entries ? first : h->index_entries;
+  return result < 0 ? -1 : (int)added;
+}
+
+//trusts the index up to its last entry that points at a record, so a
+//clean index costs nothing to open, anything else is read again
+static void load_index(History *h) {
+  if (h->index_entries == 0 || h->index[0] != next_frame(h, 0)) {
+    return;
+  }
+
+  size_t stop = h->index_entries > INDEX_CHECK_BACK ? h->index_entries - INDEX_CHECK_BACK : 0;
+  for (size_t n = h->index_entries; n > stop; n--) {
+    size_t end;
+    uint64_t offset = h->index[n - 1];
+    if (frame_at(h, offset, &end) == FRAME_VALID && (n == 1 || h->index[n - 2] < offset)) {
+      h->count = n;
+      h->parsed_end = end;
+      return;
+    }
+  }
+}
+
+//rewrites a history of plain lines as records, only ever done once
+static int convert_lines(History *h, const char *path) {
+  char tmp_path[PATH_MAX];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >= (int)sizeof(tmp_path)) {
+    return -1;
+  }
+  int fd = mkstemp(tmp_path);
+  if (fd == -1) {
+    return -1;
+  }
+
+  FILE *out = fdopen(fd, "w");
+  if (out == NULL) {
+    close(fd);
+    unlink(tmp_path);
+    return -1;
+  }
+  size_t offset = 0;
+  while (offset < h->log_size) {
+    const char *line = h->log + offset;
+    const char *nl = (const char *)memchr(line, '\n', h->log_size - offset);
+    size_t len = nl == NULL ? h->log_size - offset : (size_t)(nl - line);
+    offset += len + 1;
+    if (len == 0 || len > HISTORY_MAX_ENTRY) {
+      continue;
+    }
+
+    uint32_t len32 = (uint32_t)len, checksum = frame_checksum(line, len32);
+    fputc(FRAME_MARK, out);
+    fwrite(&len32, sizeof(len32), 1, out);
+    fwrite(&checksum, sizeof(checksum), 1, out);
+    fwrite(line, 1, len, out);
+    fputc('\n', out);
+  }
+  if (fclose(out) != 0 || rename(tmp_path, path) == -1) {
+    unlink(tmp_path);
+    return -1;
+  }
+
+  //the old offsets mean nothing now
+  int log_fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+  if (log_fd == -1) {
+    return -1;
+  }
+  if (ftruncate(h->index_fd, 0) == -1) {
+    close(log_fd);
+    return -1;
+  }
+  close(h->log_fd);
+  h->log_fd = log_fd;
+  munmap((void *)h->log, h->log_mapped);
+  h->log = NULL;
+  refresh(h);
+  return 0;
+}
+
+History *history_open(const char *path) {
+  char index_path[PATH_MAX];
+  if (snprintf(index_path, sizeof(index_path), "%s%s", path, HISTORY_INDEX_SUFFIX) >= (int)sizeof(index_path)) {
+    return NULL;
+  }
+
+  History *h = (History *)calloc(1, sizeof(History));
+  if (h == NULL) {
+    return NULL;
+  }
+  h->watch_fd = -1;
+
+  //the index is written in place, not appended
+  h->log_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+  h->index_fd = open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (h->log_fd == -1 || h->index_fd == -1) {
+    history_close(h);
+    return NULL;
+  }
+
+  refresh(h);
+  if (h->log_size > 0 && h->log != NULL && h->log[0] != FRAME_MARK && convert_lines(h, path) < 0) {
+    history_close(h);
+    return NULL;
+  }
+
+  //watch before reading so no append falls in between
+  h->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (h->watch_fd != -1 && inotify_add_watch(h->watch_fd, path, IN_MODIFY) == -1) {
+    close(h->watch_fd);
+    h->watch_fd = -1;
+  }
+
+  load_index(h);
+  if (catch_up(h) < 0) {
+    history_close(h);
+    return NULL;
+  }
+  return h;
+}
+
+int history_default_path(char *path, size_t size) {
+  const char *home = getenv("HOME");
+  if (home == NULL) {
+    return -1;
+  }
+  if (snprintf(path, size, "%s/%s", home, HISTORY_FILE) >= (int)size) {
+    return -1;
+  }
+  return 0;
+}
+
+History *history_open_default(void) {
+  char path[PATH_MAX];
+  if (history_default_path(path, sizeof(path)) < 0) {
+    return NULL;
+  }
+  return history_open(path);
+}
+
+void history_close(History *h) {
+  if (h == NULL) {
+    return;
+  }
+  if (h->log != NULL) {
+    munmap((void *)h->log, h->log_mapped);
+  }
+  if (h->index != NULL) {
+    munmap((void *)h->index, h->index_mapped);
+  }
+  if (h->log_fd != -1) {
+    close(h->log_fd);
+  }
+  if (h->index_fd != -1) {
+    close(h->index_fd);
+  }
+  if (h->watch_fd != -1) {
+    close(h->watch_fd);
+  }
+  free(h);
+}
+
+int history_poll(History *h) {
+  //without inotify every poll looks at the file size
+  if (h->watch_fd != -1) {
+    char events[4096];
+    int changed = 0;
+    while (read(h->watch_fd, events, sizeof(events)) > 0) {
+      changed = 1;
+    }
+    if (!changed) {
+      return 0;
+    }
+  }
+  return catch_up(h);
+}
+
+const char *history_get(History *h, size_t i, size_t *len) {
+  uint32_t len32;
+  memcpy(&len32, h->log + h->index[i] + 1, sizeof(len32));
+  *len = len32;
+  return h->log + h->index[i] + FRAME_HEADER;
+}
+
+int history_add(History *h, const char *line) {
+  size_t len = strlen(line);
+  if (len == 0 || len > HISTORY_MAX_ENTRY) {
+    return 0;
+  }
+
+  //the last entry may have come from another shell
+  history_poll(h);
+  if (h->count > 0) {
+    size_t last_len;
+    const char *last = history_get(h, h->count - 1, &last_len);
+    if (last_len == len && memcmp(last, line, len) == 0) {
+      return 0;
+    }
+  }
+
+  //one write, O_APPEND puts the whole record after everything any shell
+  //wrote before it, the line goes straight from the caller's buffer
+  size_t size = FRAME_HEADER + len + FRAME_TRAILER;
+  char header[FRAME_HEADER];
+  uint32_t len32 = (uint32_t)len, checksum = frame_checksum(line, len32);
+  header[0] = FRAME_MARK;
+  memcpy(header + 1, &len32, sizeof(len32));
+  memcpy(header + 5, &checksum, sizeof(checksum));
+  struct iovec parts[3] = {
+      {header, FRAME_HEADER},
+      {(void *)line, len},
+      {(void *)"\n", FRAME_TRAILER},
+  };
+
+  ssize_t written = writev(h->log_fd, parts, 3);
+  if (written != (ssize_t)size) {
+    return -1;
+  }
+
+  //reads our record and anything another shell appended before it
+  return catch_up(h) < 0 ? -1 : 0;
+}
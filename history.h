@@ -0,0 +1,64 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_FILE ".terrabine_history"
+#define HISTORY_INDEX_SUFFIX ".idx"
+
+//entries longer than this are not kept
+#define HISTORY_MAX_ENTRY (1 << 20)
+
+//command history kept on disk and shared by every running shell
+//each entry is one framed record appended with a single O_APPEND write:
+//  0x1E, u32 length, u32 checksum, the command, '\n'
+//so records from several shells never interleave, and a record that is
+//still being written or was torn by a crash is recognised and skipped
+//next to it an index file holds the offset of record n at n * 8, every
+//shell computes the same offsets, so they all write it without locking
+//both files are mmap'd, so opening costs the same for ten entries or a
+//million and looking up entry n is one read of the index
+typedef struct {
+  int log_fd;
+  int index_fd;
+  int watch_fd;           //inotify on the history file, -1 without
+  const char *log;        //mapped history file
+  size_t log_size;
+  size_t log_mapped;      //length of the mapping, more than log_size
+  const uint64_t *index;  //mapped index file
+  size_t index_entries;   //offsets in the index file
+  size_t index_mapped;
+  size_t count;           //records read so far
+  size_t parsed_end;      //offset after the last record read
+} History;
+
+//opens (creating if needed) the history at path and its index at
+//path + HISTORY_INDEX_SUFFIX, returns NULL on error
+//a history file of plain lines from older versions is converted
+History *history_open(const char *path);
+void history_close(History *h);
+
+//opens ~/HISTORY_FILE
+History *history_open_default(void);
+
+//path of ~/HISTORY_FILE, returns -1 without $HOME or when it does not fit
+int history_default_path(char *path, size_t size);
+
+//appends a line, empty lines and repeats of the last entry are skipped
+//returns -1 on a write error
+int history_add(History *h, const char *line);
+
+//reads the records other shells appended since the last call
+//cheap when nothing changed, it only drains the inotify queue
+//returns the number of new entries, -1 on error
+int history_poll(History *h);
+
+//entry i (0 is the oldest), not nul terminated, its length goes to *len
+const char *history_get(History *h, size_t i, size_t *len);
+
+static inline size_t history_count(const History *h) {
+  return h->count;
+}
+
+#endif
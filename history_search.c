@@ -0,0 +1,279 @@
+#include "history_search.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "str_search.h"
+
+#define TRIGRAM_USED 0x80000000u
+#define TABLE_INITIAL_SIZE 4096
+#define POSTINGS_INITIAL_SIZE 4
+#define QUERY_MAX_TRIGRAMS 64
+
+//one and two byte queries first look at this many of the newest entries,
+//a common letter is nearly always in there
+#define SHORT_QUERY_WINDOW 4096
+
+HistorySearch *history_search_create(History *history) {
+  HistorySearch *hs = (HistorySearch *)calloc(1, sizeof(HistorySearch));
+  if (hs == NULL) {
+    return NULL;
+  }
+  hs->history = history;
+  return hs;
+}
+
+void history_search_destroy(HistorySearch *hs) {
+  if (hs == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < hs->table_cap; i++) {
+    free(hs->table[i].ids);
+  }
+  free(hs->table);
+  free(hs->short_ids);
+  free(hs);
+}
+
+static inline uint32_t trigram_at(const char *s) {
+  const unsigned char *u = (const unsigned char *)s;
+  return ((uint32_t)u[0] << 16) | ((uint32_t)u[1] << 8) | u[2];
+}
+
+static inline size_t hash_trigram(uint32_t trigram) {
+  return (size_t)(trigram * 2654435761u);
+}
+
+//slot for a trigram, either its postings or the empty slot it would go in
+static TrigramPostings *lookup(TrigramPostings *table, size_t cap, uint32_t trigram) {
+  uint32_t key = trigram | TRIGRAM_USED;
+  size_t pos = hash_trigram(trigram) & (cap - 1);
+  while (table[pos].key != 0 && table[pos].key != key) {
+    pos = (pos + 1) & (cap - 1);
+  }
+  return &table[pos];
+}
+
+static int grow_table(HistorySearch *hs) {
+  size_t cap = hs->table_cap == 0 ? TABLE_INITIAL_SIZE : hs->table_cap * 2;
+  TrigramPostings *table = (TrigramPostings *)calloc(cap, sizeof(TrigramPostings));
+  if (table == NULL) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < hs->table_cap; i++) {
+    if (hs->table[i].key != 0) {
+      *lookup(table, cap, hs->table[i].key & ~TRIGRAM_USED) = hs->table[i];
+    }
+  }
+  free(hs->table);
+  hs->table = table;
+  hs->table_cap = cap;
+  return 0;
+}
+
+//appends id unless it is already the last one, ids only ever grow
+static int append_id(uint32_t **ids, uint32_t *len, uint32_t *cap, uint32_t id) {
+  if (*len > 0 && (*ids)[*len - 1] == id) {
+    return 0;
+  }
+  if (*len == *cap) {
+    uint32_t new_cap = *cap == 0 ? POSTINGS_INITIAL_SIZE : *cap * 2;
+    uint32_t *grown = (uint32_t *)realloc(*ids, new_cap * sizeof(uint32_t));
+    if (grown == NULL) {
+      return -1;
+    }
+    *ids = grown;
+    *cap = new_cap;
+  }
+  (*ids)[(*len)++] = id;
+  return 0;
+}
+
+static int add_posting(HistorySearch *hs, uint32_t trigram, uint32_t block) {
+  if ((hs->table_used + 1) * 2 > hs->table_cap && grow_table(hs) < 0) {
+    return -1;
+  }
+
+  TrigramPostings *p = lookup(hs->table, hs->table_cap, trigram);
+  if (p->key == 0) {
+    p->key = trigram | TRIGRAM_USED;
+    hs->table_used++;
+  }
+  return append_id(&p->ids, &p->len, &p->cap, block);
+}
+
+int history_search_update(HistorySearch *hs) {
+  size_t count = history_count(hs->history);
+
+  while (hs->indexed < count) {
+    size_t len;
+    const char *entry = history_get(hs->history, hs->indexed, &len);
+    uint32_t block = (uint32_t)(hs->indexed / SEARCH_BLOCK);
+
+    if (len < 3) {
+      if (append_id(&hs->short_ids, &hs->short_len, &hs->short_cap, (uint32_t)hs->indexed) < 0) {
+        return -1;
+      }
+    }
+    for (size_t i = 0; i + 3 <= len; i++) {
+      if (add_posting(hs, trigram_at(entry + i), block) < 0) {
+        return -1;
+      }
+    }
+    hs->indexed++;
+  }
+  return 0;
+}
+
+//number of ids in the sorted list below limit
+static size_t count_below(const uint32_t *ids, size_t len, uint32_t limit) {
+  size_t lo = 0, hi = len;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (ids[mid] < limit) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int contains_id(const TrigramPostings *p, uint32_t id) {
+  size_t below = count_below(p->ids, p->len, id);
+  return below < p->len && p->ids[below] == id;
+}
+
+static int entry_matches(HistorySearch *hs, size_t id, const char *query, size_t query_len) {
+  size_t len;
+  const char *entry = history_get(hs->history, id, &len);
+  return str_search(entry, len, query, query_len) != NULL;
+}
+
+//newest entry of a block below before that matches, -1 when none does
+static long check_block(HistorySearch *hs, uint32_t block, const char *query, size_t query_len, size_t before) {
+  size_t end = (size_t)(block + 1) * SEARCH_BLOCK;
+  if (end > before) {
+    end = before;
+  }
+  for (size_t id = end; id-- > (size_t)block * SEARCH_BLOCK;) {
+    if (entry_matches(hs, id, query, query_len)) {
+      return (long)id;
+    }
+  }
+  return -1;
+}
+
+//checks the entries in [from, before) newest first
+static long scan_entries(HistorySearch *hs, const char *query, size_t query_len, size_t from, size_t before) {
+  for (size_t id = before; id-- > from;) {
+    if (entry_matches(hs, id, query, query_len)) {
+      return (long)id;
+    }
+  }
+  return -1;
+}
+
+//one or two byte queries have no trigram of their own, but every trigram
+//containing them does: the newest block in any of those lists has a match
+static long find_short(HistorySearch *hs, const char *query, size_t query_len, size_t before) {
+  size_t window = before > SHORT_QUERY_WINDOW ? before - SHORT_QUERY_WINDOW : 0;
+  long found = scan_entries(hs, query, query_len, window, before);
+  if (found >= 0 || window == 0) {
+    return found;
+  }
+  before = window;
+
+  //short entries are in no trigram list
+  size_t n = count_below(hs->short_ids, hs->short_len, (uint32_t)before);
+  while (n-- > 0) {
+    if (entry_matches(hs, hs->short_ids[n], query, query_len)) {
+      found = hs->short_ids[n];
+      break;
+    }
+  }
+
+  while (before > 0) {
+    //the block holding before - 1 may only match at or after before, so
+    //blocks are tried newest first until one has a match below before
+    uint32_t limit = (uint32_t)((before - 1) / SEARCH_BLOCK + 1);
+    long newest = -1;
+    for (size_t i = 0; i < hs->table_cap; i++) {
+      const TrigramPostings *p = &hs->table[i];
+      if (p->key == 0) {
+        continue;
+      }
+      char trigram[3] = {(char)(p->key >> 16), (char)(p->key >> 8), (char)p->key};
+      if (str_search(trigram, 3, query, query_len) == NULL) {
+        continue;
+      }
+      size_t below = count_below(p->ids, p->len, limit);
+      if (below > 0 && (long)p->ids[below - 1] > newest) {
+        newest = p->ids[below - 1];
+      }
+    }
+    if (newest < 0 || (found >= 0 && (size_t)found >= (size_t)(newest + 1) * SEARCH_BLOCK)) {
+      return found;
+    }
+
+    long match = check_block(hs, (uint32_t)newest, query, query_len, before);
+    if (match >= 0) {
+      return match > found ? match : found;
+    }
+    before = (size_t)newest * SEARCH_BLOCK;
+  }
+  return found;
+}
+
+long history_search_find(HistorySearch *hs, const char *query, size_t query_len, size_t before) {
+  //an index that fell behind (out of memory) cannot rule entries out
+  if (history_search_update(hs) < 0 || before > hs->indexed) {
+    return scan_entries(hs, query, query_len, 0, before);
+  }
+  if (query_len < 3) {
+    return find_short(hs, query, query_len, before);
+  }
+  if (hs->table_cap == 0) {
+    //no entry is three bytes long
+    return -1;
+  }
+
+  //postings of every trigram in the query, the shortest list drives
+  const TrigramPostings *lists[QUERY_MAX_TRIGRAMS];
+  int list_count = 0;
+  int shortest = 0;
+  for (size_t i = 0; i + 3 <= query_len && list_count < QUERY_MAX_TRIGRAMS; i++) {
+    const TrigramPostings *p = lookup(hs->table, hs->table_cap, trigram_at(query + i));
+    if (p->key == 0) {
+      //some trigram is in no entry at all
+      return -1;
+    }
+    lists[list_count] = p;
+    if (p->len < lists[shortest]->len) {
+      shortest = list_count;
+    }
+    list_count++;
+  }
+
+  const TrigramPostings *driver = lists[shortest];
+  uint32_t limit = before == 0 ? 0 : (uint32_t)((before - 1) / SEARCH_BLOCK + 1);
+  for (size_t n = count_below(driver->ids, driver->len, limit); n-- > 0;) {
+    uint32_t block = driver->ids[n];
+
+    int candidate = 1;
+    for (int i = 0; i < list_count && candidate; i++) {
+      if (i != shortest && !contains_id(lists[i], block)) {
+        candidate = 0;
+      }
+    }
+
+    //having every trigram does not mean one entry has them in order
+    if (candidate) {
+      long match = check_block(hs, block, query, query_len, before);
+      if (match >= 0) {
+        return match;
+      }
+    }
+  }
+  return -1;
+}
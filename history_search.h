@@ -0,0 +1,49 @@
+#ifndef HISTORY_SEARCH_H
+#define HISTORY_SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "history.h"
+
+//entries are indexed in blocks of this many, a posting names a block and
+//the entries of a candidate block are checked one by one
+//common trigrams are in most blocks, so this keeps the index small
+#define SEARCH_BLOCK 16
+
+//blocks containing one trigram (three consecutive bytes), oldest first
+typedef struct {
+  uint32_t key;  //trigram | TRIGRAM_USED, 0 for an empty table slot
+  uint32_t len;
+  uint32_t cap;
+  uint32_t *ids;
+} TrigramPostings;
+
+//substring search over the history for Ctrl-R
+//every trigram maps to the blocks that contain it, a query only looks at
+//blocks that have all of its trigrams and checks those with str_search
+//the index is built on the first search and extended as entries are added
+typedef struct {
+  History *history;
+  TrigramPostings *table;
+  size_t table_cap;
+  size_t table_used;
+  size_t indexed;  //entries indexed so far
+
+  //entries shorter than a trigram, only one or two byte queries match them
+  uint32_t *short_ids;
+  uint32_t short_len;
+  uint32_t short_cap;
+} HistorySearch;
+
+HistorySearch *history_search_create(History *history);
+void history_search_destroy(HistorySearch *hs);
+
+//indexes entries added to the history since the last call
+//returns -1 when out of memory, the index then covers fewer entries
+int history_search_update(HistorySearch *hs);
+
+//newest entry below before that contains query, -1 when there is none
+//pass history_count() as before to search the whole history
+long history_search_find(HistorySearch *hs, const char *query, size_t query_len, size_t before);
+
+#endif
@@ -0,0 +1,96 @@
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "latency.h"
+
+Jobs *jobs_create(ThreadPool *pool) {
+  Jobs *jobs = (Jobs *)calloc(1, sizeof(Jobs));
+  if (jobs == NULL) {
+    return NULL;
+  }
+  jobs->pool = pool;
+  jobs->next_id = 1;
+  task_group_init(&jobs->all);
+  //kept for the life of the list, a task finishing a job may still be
+  //signalling its group when the slot is taken again
+  for (int i = 0; i < JOBS_MAX; i++) {
+    task_group_init(&jobs->slots[i].group);
+  }
+  return jobs;
+}
+
+void jobs_destroy(Jobs *jobs) {
+  if (jobs == NULL) {
+    return;
+  }
+  task_group_wait(jobs->pool, &jobs->all);
+  task_group_destroy(&jobs->all);
+  for (int i = 0; i < JOBS_MAX; i++) {
+    task_group_destroy(&jobs->slots[i].group);
+  }
+  free(jobs);
+}
+
+Job *jobs_start(Jobs *jobs, const char *what, const char *unit, const char *path, TaskFunc func) {
+  Job *job = NULL;
+  for (int i = 0; i < JOBS_MAX && job == NULL; i++) {
+    if (jobs->slots[i].id == 0) {
+      job = &jobs->slots[i];
+    }
+  }
+  //no free slot, take the one of a finished job nobody looked at
+  for (int i = 0; i < JOBS_MAX && job == NULL; i++) {
+    if (atomic_load(&jobs->slots[i].finished)) {
+      job = &jobs->slots[i];
+    }
+  }
+  if (job == NULL) {
+    return NULL;
+  }
+
+  job->id = jobs->next_id++;
+  snprintf(job->what, sizeof(job->what), "%s", what);
+  job->unit = unit;
+  job->pool = jobs->pool;
+  snprintf(job->path, sizeof(job->path), "%s", path);
+  job->started = latency_now();
+  atomic_store(&job->done, 0);
+  atomic_store(&job->total, 0);
+  atomic_store(&job->finished, 0);
+  atomic_store(&job->failed, 0);
+  if (thread_pool_submit(jobs->pool, &jobs->all, func, job) < 0) {
+    job->id = 0;
+    return NULL;
+  }
+  return job;
+}
+
+void jobs_finish(Job *job, int failed) {
+  if (failed) {
+    atomic_store(&job->failed, 1);
+  }
+  job->ended = latency_now();
+  atomic_store(&job->finished, 1);
+}
+
+void jobs_list(Jobs *jobs, void (*show)(const char *line, size_t len, void *ctx), void *ctx) {
+  for (int i = 0; i < JOBS_MAX; i++) {
+    Job *job = &jobs->slots[i];
+    if (job->id == 0) {
+      continue;
+    }
+    int finished = atomic_load(&job->finished);
+    uint64_t end = finished ? job->ended : latency_now();
+    const char *state = !finished ? "Running" : atomic_load(&job->failed) ? "Failed" : "Done";
+    char line[512];
+    int len = snprintf(line, sizeof(line), "[%d] %-8s %s  %llu of %llu %s  %.1f s", job->id, state, job->what,
+                       (unsigned long long)atomic_load(&job->done),
+                       (unsigned long long)atomic_load(&job->total), job->unit, (end - job->started) / 1e9);
+    show(line, len < (int)sizeof(line) ? (size_t)len : sizeof(line) - 1, ctx);
+    if (finished) {
+      job->id = 0;
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <linux/limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "thread_pool.h"
+
+#define JOBS_MAX 16
+
+//work a command left running on the thread pool after it returned
+typedef struct {
+  int id;               //0 for a free slot
+  char what[256];       //shown by jobs
+  const char *unit;     //what done and total count
+  char path[PATH_MAX];  //what the job works on
+  uint64_t started;     //latency_now() when it was added
+  uint64_t ended;       //and when it finished
+  atomic_ullong done;
+  atomic_ullong total;  //grows while the job finds more to do
+  atomic_int finished;
+  atomic_int failed;
+  ThreadPool *pool;     //where it runs
+  TaskGroup group;      //the job's own tasks, for func to wait on
+} Job;
+
+//background jobs of the shell, listed by the jobs builtin
+//slots are fixed so starting a job never touches the heap on the shell
+//thread, a finished job keeps its slot until jobs has shown it once
+typedef struct {
+  ThreadPool *pool;
+  Job slots[JOBS_MAX];
+  int next_id;
+  TaskGroup all;  //one task per running job
+} Jobs;
+
+Jobs *jobs_create(ThreadPool *pool);
+//waits for the running jobs to finish
+void jobs_destroy(Jobs *jobs);
+
+//takes a slot and runs func(job) on the pool, NULL when every slot holds
+//a running job or the pool is out of memory
+//func calls jobs_finish as the last thing it does
+Job *jobs_start(Jobs *jobs, const char *what, const char *unit, const char *path, TaskFunc func);
+void jobs_finish(Job *job, int failed);
+
+//lines for the jobs builtin, the finished jobs shown are let go
+void jobs_list(Jobs *jobs, void (*show)(const char *line, size_t len, void *ctx), void *ctx);
+
+#endif
@@ -0,0 +1,173 @@
+#include "latency.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SUB_COUNT (1u << LATENCY_SUB_BITS)
+#define VALUE_MAX ((1ull << LATENCY_MAX_BITS) - 1)
+#define EXPORT_TICKS 5 //percentile steps per halving of the distance to 100%
+
+//bucket i < SUB_COUNT holds the value i, above that the bucket number is
+//(shift + 1) * SUB_COUNT + the SUB_BITS bits after the leading one
+static inline size_t bucket_of(uint64_t ns) {
+  if (ns < SUB_COUNT) {
+    return (size_t)ns;
+  }
+  int shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BITS;
+  return ((size_t)(shift + 1) << LATENCY_SUB_BITS) | (size_t)((ns >> shift) & (SUB_COUNT - 1));
+}
+
+//highest value that lands in bucket i
+static inline uint64_t bucket_top(size_t i) {
+  if (i < SUB_COUNT) {
+    return i;
+  }
+  int shift = (int)(i >> LATENCY_SUB_BITS) - 1;
+  uint64_t low = (uint64_t)(SUB_COUNT | (i & (SUB_COUNT - 1))) << shift;
+  return low + (1ull << shift) - 1;
+}
+
+//square root without libm, only ever used on the export path
+static double sqrt_newton(double x) {
+  if (x <= 0) {
+    return 0;
+  }
+  double r = x > 1 ? x : 1;
+  for (int i = 0; i < 100; i++) {
+    double next = (r + x / r) / 2;
+    if (next >= r) {
+      break;
+    }
+    r = next;
+  }
+  return r;
+}
+
+void latency_reset(LatencyHistogram *h) {
+  memset(h, 0, sizeof(*h));
+}
+
+void latency_record(LatencyHistogram *h, uint64_t ns) {
+  if (ns > VALUE_MAX) {
+    ns = VALUE_MAX;
+  }
+  h->counts[bucket_of(ns)]++;
+  if (h->total == 0 || ns < h->min) {
+    h->min = ns;
+  }
+  if (ns > h->max) {
+    h->max = ns;
+  }
+  h->total++;
+  h->sum += ns;
+}
+
+uint64_t latency_percentile(const LatencyHistogram *h, double p) {
+  if (h->total == 0) {
+    return 0;
+  }
+  //the smallest rank covering p of the values
+  double want = p * (double)h->total;
+  uint64_t rank = (uint64_t)want;
+  if (rank < want || rank == 0) {
+    rank++;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      //a bucket's top can be past the largest value actually seen
+      uint64_t top = bucket_top(i);
+      return top < h->max ? top : h->max;
+    }
+  }
+  return h->max;
+}
+
+//lines are gathered here and written out when it fills
+typedef struct {
+  int fd;
+  int failed;
+  size_t len;
+  char buf[4096];
+} Output;
+
+static void flush(Output *out) {
+  size_t done = 0;
+  while (done < out->len && !out->failed) {
+    ssize_t n = write(out->fd, out->buf + done, out->len - done);
+    if (n < 0) {
+      out->failed = 1;
+    } else {
+      done += (size_t)n;
+    }
+  }
+  out->len = 0;
+}
+
+__attribute__((format(printf, 2, 3)))
+static void put(Output *out, const char *format, ...) {
+  //no line comes near 256 bytes
+  if (sizeof(out->buf) - out->len < 256) {
+    flush(out);
+  }
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len, format, args);
+  va_end(args);
+  if (n > 0) {
+    out->len += (size_t)n;
+  }
+}
+
+int latency_export(const LatencyHistogram *h, int fd) {
+  Output output = {.fd = fd};
+  Output *out = &output;
+  put(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+  //steps get finer towards the tail: 0, 10%, ... 50%, 55%, ... 75%, 77.5%...
+  double p = 0;
+  double step = 0.5 / EXPORT_TICKS;
+  int ticks = 0;
+  while (h->total > 0) {
+    uint64_t value = latency_percentile(h, p);
+    uint64_t below = 0;
+    for (size_t i = 0; i <= bucket_of(value) && i < LATENCY_BUCKETS; i++) {
+      below += h->counts[i];
+    }
+    if (p < 1.0) {
+      put(out, "%12.3f %14.12f %10llu %14.2f\n", value / 1e3, p, (unsigned long long)below, 1.0 / (1.0 - p));
+    } else {
+      put(out, "%12.3f %14.12f %10llu\n", value / 1e3, 1.0, (unsigned long long)below);
+      break;
+    }
+    if (below == h->total) {
+      p = 1.0;
+      continue;
+    }
+    p += step;
+    if (++ticks == EXPORT_TICKS) {
+      ticks = 0;
+      step /= 2;
+    }
+  }
+
+  //the deviation is taken from the buckets, each value as its bucket's middle
+  double mean = h->total > 0 ? (double)h->sum / h->total : 0;
+  double squares = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    if (h->counts[i] != 0) {
+      double low = i == 0 ? 0 : (double)bucket_top(i - 1) + 1;
+      double d = (low + (double)bucket_top(i)) / 2 - mean;
+      squares += d * d * (double)h->counts[i];
+    }
+  }
+  double deviation = h->total > 0 ? sqrt_newton(squares / h->total) : 0;
+  put(out, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean / 1e3, deviation / 1e3);
+  put(out, "#[Max     = %12.3f, Total count    = %12llu]\n", h->max / 1e3, (unsigned long long)h->total);
+  put(out, "#[Buckets = %12d, SubBuckets     = %12d]\n", LATENCY_BUCKETS, SUB_COUNT);
+  flush(out);
+  return out->failed ? -1 : 0;
+}
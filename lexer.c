@@ -0,0 +1,408 @@
+#include "lexer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static inline int is_blank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static inline int is_operator(char c) {
+  return c == '|' || c == '&' || c == ';' || c == '<' || c == '>';
+}
+
+int lex_token(const char *text, size_t len, size_t *pos, LexState *state, LexToken *tok) {
+  size_t i = *pos;
+  while (i < len && is_blank(text[i])) {
+    i++;
+  }
+  if (i == len) {
+    *pos = i;
+    return 0;
+  }
+
+  tok->start = (uint32_t)i;
+  tok->flags = 0;
+
+  if (text[i] == '#') {
+    tok->kind = LEX_COMMENT;
+    tok->len = (uint32_t)(len - i);
+    *pos = len;
+    return 1;
+  }
+
+  if (is_operator(text[i])) {
+    char c = text[i++];
+    //&& || >>
+    if (i < len && text[i] == c && c != ';' && c != '<') {
+      i++;
+    }
+    tok->kind = LEX_OPERATOR;
+    tok->len = (uint32_t)(i - tok->start);
+    if (c == '<' || c == '>') {
+      state->expect_redirect = 1;
+    } else {
+      state->expect_command = 1;
+      state->expect_redirect = 0;
+    }
+    *pos = i;
+    return 1;
+  }
+
+  //a word runs to the first blank or operator outside quotes
+  char quote = 0;
+  while (i < len) {
+    char c = text[i];
+    if (quote != 0) {
+      if (c == quote) {
+        quote = 0;
+      } else if (c == '\\' && quote == '"' && i + 1 < len) {
+        i++;
+      }
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      tok->flags |= LEX_QUOTED;
+    } else if (c == '\\') {
+      tok->flags |= LEX_QUOTED;
+      if (i + 1 < len) {
+        i++;
+      }
+    } else if (is_blank(c) || is_operator(c)) {
+      break;
+    }
+    i++;
+  }
+  if (quote != 0) {
+    tok->flags |= LEX_OPEN_QUOTE;
+  }
+
+  tok->kind = LEX_WORD;
+  tok->len = (uint32_t)(i - tok->start);
+  if (state->expect_redirect) {
+    tok->flags |= LEX_REDIRECT;
+    state->expect_redirect = 0;
+  } else if (state->expect_command) {
+    tok->flags |= LEX_COMMAND;
+    state->expect_command = 0;
+  }
+  *pos = i;
+  return 1;
+}
+
+size_t lex_unquote(const char *word, size_t len, char *out) {
+  size_t n = 0;
+  char quote = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = word[i];
+    if (quote != 0) {
+      if (c == quote) {
+        quote = 0;
+        continue;
+      }
+      if (c == '\\' && quote == '"' && i + 1 < len && (word[i + 1] == '"' || word[i + 1] == '\\')) {
+        c = word[++i];
+      }
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      continue;
+    } else if (c == '\\' && i + 1 < len) {
+      c = word[++i];
+    }
+    out[n++] = c;
+  }
+  return n;
+}
+
+#define WORDS_INITIAL_SIZE 16
+#define EXTRA_INITIAL_SIZE 256
+#define VAR_NAME_MAX 255
+#define IN_EXTRA 0x80  //kinds bit of a word whose argv still holds its offset in extra
+
+static const char *const operators[] = {"|", "||", "&", "&&", ";", "<", ">", ">>"};
+
+static const char *operator_text(char c, int doubled) {
+  switch (c) {
+    case '|': return operators[doubled];
+    case '&': return operators[2 + doubled];
+    case ';': return operators[4];
+    case '<': return operators[5];
+    default: return operators[6 + doubled];
+  }
+}
+
+//doubles the capacity, there is always room for the NULL after the last word
+static int grow_words(LexWords *words) {
+  size_t cap = words->cap == 0 ? WORDS_INITIAL_SIZE : words->cap * 2;
+  char **argv = (char **)arena_grow(words->arena, words->argv, words->cap * sizeof(char *), cap * sizeof(char *));
+  if (argv == NULL) {
+    return -1;
+  }
+  words->argv = argv;
+  uint8_t *kinds = (uint8_t *)arena_grow(words->arena, words->kinds, words->cap, cap);
+  if (kinds == NULL) {
+    return -1;
+  }
+  words->kinds = kinds;
+  words->cap = cap;
+  return 0;
+}
+
+static int push(LexWords *words, char *word, uint8_t kind) {
+  if (words->argc + 2 > words->cap && grow_words(words) < 0) {
+    return -1;
+  }
+  words->argv[words->argc] = word;
+  words->kinds[words->argc] = kind;
+  words->argc++;
+  return 0;
+}
+
+static int extra_append(LexWords *words, const char *text, size_t len) {
+  //an empty or unset variable adds nothing, and extra may not exist yet
+  if (len == 0) {
+    return 0;
+  }
+  if (words->extra_len + len > words->extra_cap) {
+    size_t cap = words->extra_cap == 0 ? EXTRA_INITIAL_SIZE : words->extra_cap;
+    while (cap < words->extra_len + len) {
+      cap *= 2;
+    }
+    char *extra = (char *)arena_grow(words->arena, words->extra, words->extra_len, cap);
+    if (extra == NULL) {
+      return -1;
+    }
+    words->extra = extra;
+    words->extra_cap = cap;
+  }
+  memcpy(words->extra + words->extra_len, text, len);
+  words->extra_len += len;
+  return 0;
+}
+
+static inline int is_name_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static inline int is_name(char c) {
+  return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+//length of the $NAME or ${NAME} at line[i], 0 when it is a plain '$'
+static size_t var_at(const char *line, size_t len, size_t i, const char **name, size_t *name_len) {
+  size_t j = i + 1;
+  if (j < len && line[j] == '{') {
+    size_t end = j + 1;
+    while (end < len && is_name(line[end])) {
+      end++;
+    }
+    if (end == j + 1 || end == len || line[end] != '}' || !is_name_start(line[j + 1])) {
+      return 0;
+    }
+    *name = line + j + 1;
+    *name_len = end - j - 1;
+    return end + 1 - i;
+  }
+  if (j == len || !is_name_start(line[j])) {
+    return 0;
+  }
+  size_t end = j + 1;
+  while (end < len && is_name(line[end])) {
+    end++;
+  }
+  *name = line + j;
+  *name_len = end - j;
+  return end - i;
+}
+
+//bytes that end a run of plain text, outside quotes, in "" and in ''
+static const uint8_t word_stop[256] = {[' '] = 1, ['\t'] = 1, ['|'] = 1, ['&'] = 1, [';'] = 1, ['<'] = 1,
+                                       ['>'] = 1, ['\''] = 1, ['"'] = 1, ['\\'] = 1, ['$'] = 1};
+static const uint8_t double_stop[256] = {['"'] = 1, ['\\'] = 1, ['$'] = 1};
+static const uint8_t single_stop[256] = {['\''] = 1};
+
+//last variables looked up, a line tends to use the same ones again
+//names point into the line, which is never written over once a word has
+//moved to extra
+#define VAR_MEMO 4
+typedef struct {
+  const char *name;
+  size_t name_len;
+  const char *value;
+} VarMemo;
+
+static const char *lookup_var(VarMemo *memo, size_t *next, const char *name, size_t name_len) {
+  for (int k = 0; k < VAR_MEMO; k++) {
+    if (memo[k].name != NULL && memo[k].name_len == name_len && memcmp(memo[k].name, name, name_len) == 0) {
+      return memo[k].value;
+    }
+  }
+  char var[VAR_NAME_MAX + 1];
+  if (name_len > VAR_NAME_MAX) {
+    name_len = VAR_NAME_MAX;
+  }
+  memcpy(var, name, name_len);
+  var[name_len] = '\0';
+  VarMemo *slot = &memo[(*next)++ % VAR_MEMO];
+  *slot = (VarMemo){name, name_len, getenv(var)};
+  return slot->value;
+}
+
+int lex_words(char *line, size_t len, LexWords *words) {
+
+  words->argv = NULL;
+  words->kinds = NULL;
+  words->argc = 0;
+  words->cap = 0;
+  words->extra = NULL;
+  words->extra_len = 0;
+  words->extra_cap = 0;
+  VarMemo memo[VAR_MEMO] = {0};
+  size_t memo_next = 0;
+  size_t i = 0;
+
+  while (1) {
+    if (i + 1 < len && is_blank(line[i]) && is_blank(line[i + 1])) {
+      //a long run of blanks, libc skips it a vector at a time
+      i += strspn(line + i, " \t");
+    } else if (i < len && is_blank(line[i])) {
+      i++;
+    }
+    if (i >= len || line[i] == '#') {
+      break;
+    }
+
+    if (is_operator(line[i])) {
+      char c = line[i++];
+      int doubled = i < len && line[i] == c && c != ';' && c != '<';
+      i += doubled;
+      if (push(words, (char *)operator_text(c, doubled), LEX_OPERATOR) < 0) {
+        return -1;
+      }
+      continue;
+    }
+
+    //the word is written back over itself as it is read, w never passes i,
+    //until a $NAME moves it to extra
+    size_t start = i;
+    size_t w = i;
+    long in_extra = -1;  //offset of the word in extra
+    int quoted = 0;
+    char quote = 0;
+    while (i < len) {
+      //bytes that need nothing done go over as one run
+      size_t run = i;
+      const uint8_t *stops = quote == 0 ? word_stop : quote == '"' ? double_stop : single_stop;
+      while (i < len && !stops[(unsigned char)line[i]]) {
+        i++;
+      }
+      if (i > run) {
+        if (in_extra >= 0) {
+          if (extra_append(words, line + run, i - run) < 0) {
+            return -1;
+          }
+        } else {
+          if (w != run) {
+            memmove(line + w, line + run, i - run);
+          }
+          w += i - run;
+        }
+      }
+      if (i == len) {
+        break;
+      }
+
+      char c = line[i];
+      if (quote == 0 && (is_blank(c) || is_operator(c))) {
+        break;
+      }
+      i++;
+      if (quote != 0 && c == quote) {
+        quote = 0;
+        continue;
+      }
+      if (quote == 0 && (c == '\'' || c == '"')) {
+        quote = c;
+        quoted = 1;
+        continue;
+      }
+      if (c == '\\' && i < len && (quote == 0 || line[i] == '"' || line[i] == '\\')) {
+        c = line[i++];
+        quoted = 1;
+      } else if (c == '$') {
+        const char *name;
+        size_t name_len;
+        size_t var_len = var_at(line, len, i - 1, &name, &name_len);
+        if (var_len > 0) {
+          i += var_len - 1;
+          if (in_extra < 0) {
+            in_extra = (long)words->extra_len;
+            if (extra_append(words, line + start, w - start) < 0) {
+              return -1;
+            }
+          }
+          const char *value = lookup_var(memo, &memo_next, name, name_len);
+          if (value != NULL && extra_append(words, value, strlen(value)) < 0) {
+            return -1;
+          }
+          continue;
+        }
+      }
+      if (in_extra >= 0) {
+        if (extra_append(words, &c, 1) < 0) {
+          return -1;
+        }
+      } else {
+        line[w++] = c;
+      }
+    }
+
+    char *word;
+    size_t word_len;
+    if (in_extra >= 0) {
+      word_len = words->extra_len - (size_t)in_extra;
+      if (extra_append(words, "", 1) < 0) {
+        return -1;
+      }
+      //extra may still move, the offset is turned into a pointer at the end
+      word = (char *)(uintptr_t)in_extra;
+    } else {
+      word_len = w - start;
+      word = line + start;
+    }
+    if (word_len == 0 && !quoted) {
+      continue;
+    }
+    //the blank or operator after the word is read before the NUL can land on it
+    if (i < len && is_blank(line[i])) {
+      i++;
+    } else if (i < len && w == i) {
+      char c = line[i++];
+      int doubled = i < len && line[i] == c && c != ';' && c != '<';
+      i += doubled;
+      line[w] = '\0';
+      if (push(words, word, in_extra >= 0 ? LEX_WORD | IN_EXTRA : LEX_WORD) < 0 ||
+          push(words, (char *)operator_text(c, doubled), LEX_OPERATOR) < 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (in_extra < 0) {
+      line[w] = '\0';
+    }
+    if (push(words, word, in_extra >= 0 ? LEX_WORD | IN_EXTRA : LEX_WORD) < 0) {
+      return -1;
+    }
+  }
+
+  for (size_t k = 0; k < words->argc; k++) {
+    if (words->kinds[k] & IN_EXTRA) {
+      words->argv[k] = words->extra + (uintptr_t)words->argv[k];
+      words->kinds[k] = LEX_WORD;
+    }
+  }
+  if (words->cap == 0 && grow_words(words) < 0) {
+    return -1;
+  }
+  words->argv[words->argc] = NULL;
+  return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+typedef enum { LEX_WORD, LEX_OPERATOR, LEX_COMMENT } LexKind;
+
+//word flags
+#define LEX_COMMAND 1     //in command position
+#define LEX_QUOTED 2      //has quotes or backslashes in it
+#define LEX_OPEN_QUOTE 4  //a quote is still open at the end of the line
+#define LEX_REDIRECT 8    //target of < > or >>
+
+typedef struct {
+  uint32_t start;
+  uint32_t len;
+  uint8_t kind;
+  uint8_t flags;
+} LexToken;
+
+//what carries over from one token to the next, two positions with the
+//same state lex the rest of a line the same way
+typedef struct {
+  uint8_t expect_command;   //the next word is a command
+  uint8_t expect_redirect;  //the next word is a redirection target
+} LexState;
+
+static inline LexState lex_start_state(void) {
+  return (LexState){1, 0};
+}
+
+static inline int lex_same_state(LexState a, LexState b) {
+  return a.expect_command == b.expect_command && a.expect_redirect == b.expect_redirect;
+}
+
+//splits shell input into words, operators (| & ; && || < > >>) and
+//comments, quotes ('', "" and \) keep spaces and operators inside a word
+//lexes the token at or after *pos, moving *pos past it and updating state
+//returns 0 when only blanks are left
+int lex_token(const char *text, size_t len, size_t *pos, LexState *state, LexToken *tok);
+
+//words of a command line ready to run, argv[i] is a view into the line
+//unless $NAME expansion made the word longer, then it is in extra
+//argv, kinds and extra come from arena and last until it is reset
+typedef struct {
+  Arena *arena;    //set by the caller
+  char **argv;     //argc entries then NULL
+  uint8_t *kinds;  //LEX_WORD or LEX_OPERATOR for each, a quoted ">" is a word
+  size_t argc;
+  size_t cap;
+  char *extra;     //expanded words, NUL terminated one after the other
+  size_t extra_len;
+  size_t extra_cap;
+} LexWords;
+
+//splits line (len bytes, NUL terminated) into words in one pass, in place:
+//quotes and backslashes are taken out and each word gets a NUL where it
+//ends, $NAME and ${NAME} are expanded outside single quotes, an unquoted
+//word that expands to nothing is dropped, a comment ends the line
+//operators point at constant strings, returns -1 when out of memory
+int lex_words(char *line, size_t len, LexWords *words);
+
+//the text of a word with its quotes and backslashes taken out, out needs
+//len bytes, returns the length written
+size_t lex_unquote(const char *word, size_t len, char *out);
+
+#endif
@@ -0,0 +1,780 @@
+#include "line_editor.h"
+
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+#include "str_search.h"
+
+#define KEY_CTRL(c) ((c) & 0x1F)
+#define KEY_ESCAPE 27
+#define KEY_DEL 127
+#define LINE_INITIAL_SIZE 256
+#define SEARCH_QUERY_MAX 256
+#define MENU_MAX_ROWS 10
+#define MENU_GAP 2
+#define FINDER_TICK_MS 50 //redraws while the tree is still being walked
+#define POLL_MS 5 //checks for a suggestion or highlighting answer while no key comes
+#define HIGHLIGHT_PAIR 2  //first color pair of the highlighting styles
+
+//how each highlighting style is drawn, pair 0 keeps the line's pair
+static int style_attr[STYLE_COUNT];
+static short style_pair[STYLE_COUNT];
+
+void line_editor_colors(short background) {
+  static const struct {
+    HighlightStyle style;
+    short color;
+    int attr;
+  } colors[] = {
+      {STYLE_COMMAND, COLOR_GREEN, A_BOLD},
+      {STYLE_UNKNOWN, COLOR_RED, A_BOLD},
+      {STYLE_STRING, COLOR_YELLOW, A_BOLD},
+      {STYLE_OPERATOR, COLOR_CYAN, A_BOLD},
+      {STYLE_COMMENT, COLOR_WHITE, A_DIM},
+  };
+  for (size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); i++) {
+    short pair = (short)(HIGHLIGHT_PAIR + i);
+    init_pair(pair, colors[i].color, background);
+    style_pair[colors[i].style] = pair;
+    style_attr[colors[i].style] = colors[i].attr;
+  }
+  style_attr[STYLE_PATH] = A_UNDERLINE;
+}
+
+LineEditor *line_editor_create(void) {
+  LineEditor *ed = (LineEditor *)calloc(1, sizeof(LineEditor));
+  if (ed == NULL) {
+    return NULL;
+  }
+  if (gap_buffer_init(&ed->text, LINE_INITIAL_SIZE) < 0) {
+    free(ed);
+    return NULL;
+  }
+  return ed;
+}
+
+void line_editor_destroy(LineEditor *ed) {
+  if (ed == NULL) {
+    return;
+  }
+  gap_buffer_free(&ed->text);
+  free(ed->yank);
+  free(ed->draft);
+  free(ed->result);
+  history_search_destroy(ed->search);
+  free(ed);
+}
+
+//getch, noting when a key came for the latency histogram
+static int read_key(LineEditor *ed) {
+  int c = getch();
+  if (c != ERR && ed->latency != NULL && ed->key_time == 0) {
+    ed->key_time = latency_now();
+  }
+  return c;
+}
+
+//refresh, after which the keys read before it are on screen
+static void show(LineEditor *ed) {
+  refresh();
+  if (ed->key_time != 0) {
+    latency_record(ed->latency, latency_now() - ed->key_time);
+    ed->key_time = 0;
+  }
+}
+
+//moves the screen cursor onto a byte of the line, long lines wrap
+static void place(LineEditor *ed, size_t pos) {
+  size_t cell = (size_t)ed->start_y * COLS + ed->start_x + pos;
+  move(cell / COLS, cell % COLS);
+}
+
+static void draw_span(void *ctx, const char *text, size_t len, HighlightStyle style) {
+  (void)ctx;
+  if (style == STYLE_PLAIN) {
+    addnstr(text, len);
+    return;
+  }
+  attr_t attrs;
+  short pair;
+  attr_get(&attrs, &pair, NULL);
+  attr_set(attrs | style_attr[style], style_pair[style] != 0 ? style_pair[style] : pair, NULL);
+  addnstr(text, len);
+  attr_set(attrs, pair, NULL);
+}
+
+//draws the line from pos to the end, blanks what is left of a longer
+//previous line and puts the cursor back
+static void redraw_from(LineEditor *ed, size_t pos) {
+  size_t length = gap_buffer_length(&ed->text);
+
+  place(ed, pos);
+  if (ed->highlighter != NULL && highlighter_in_sync(ed->highlighter, length)) {
+    highlighter_draw(ed->highlighter, pos, draw_span, NULL);
+    pos = length;
+  }
+  while (pos < length) {
+    size_t len;
+    const char *span = gap_buffer_span(&ed->text, pos, &len);
+    if (len > length - pos) {
+      len = length - pos;
+    }
+    addnstr(span, len);
+    pos += len;
+  }
+  for (size_t i = length; i < ed->drawn; i++) {
+    addch(' ');
+  }
+
+  ed->drawn = length;
+  place(ed, gap_buffer_cursor(&ed->text));
+}
+
+//removed bytes at pos were replaced by inserted ones, draws the change
+static void changed(LineEditor *ed, size_t pos, size_t removed, size_t inserted) {
+  if (ed->highlighter != NULL) {
+    long restyle = highlighter_edit(ed->highlighter, &ed->text, pos, removed, inserted);
+    if (restyle >= 0 && (size_t)restyle < pos) {
+      pos = (size_t)restyle;
+    }
+  }
+  redraw_from(ed, pos);
+}
+
+//start of the word before pos, words are separated by spaces like arguments
+static size_t word_left(LineEditor *ed, size_t pos) {
+  while (pos > 0 && gap_buffer_at(&ed->text, pos - 1) == ' ') {
+    pos--;
+  }
+  while (pos > 0 && gap_buffer_at(&ed->text, pos - 1) != ' ') {
+    pos--;
+  }
+  return pos;
+}
+
+//end of the word after pos
+static size_t word_right(LineEditor *ed, size_t pos) {
+  size_t length = gap_buffer_length(&ed->text);
+  while (pos < length && gap_buffer_at(&ed->text, pos) == ' ') {
+    pos++;
+  }
+  while (pos < length && gap_buffer_at(&ed->text, pos) != ' ') {
+    pos++;
+  }
+  return pos;
+}
+
+static void move_cursor(LineEditor *ed, size_t pos) {
+  gap_buffer_move_to(&ed->text, pos);
+  place(ed, gap_buffer_cursor(&ed->text));
+}
+
+//removes [from, to) into the yank buffer, the cursor ends up at from
+static void kill_text(LineEditor *ed, size_t from, size_t to) {
+  if (from >= to) {
+    return;
+  }
+
+  size_t len = to - from;
+  if (len > ed->yank_cap) {
+    char *yank = (char *)realloc(ed->yank, len);
+    if (yank == NULL) {
+      return;
+    }
+    ed->yank = yank;
+    ed->yank_cap = len;
+  }
+  gap_buffer_copy(&ed->text, from, to, ed->yank);
+  ed->yank_len = len;
+
+  gap_buffer_move_to(&ed->text, to);
+  gap_buffer_delete_before(&ed->text, len);
+  changed(ed, from, len, 0);
+}
+
+static void insert_text(LineEditor *ed, const char *text, size_t len) {
+  size_t pos = gap_buffer_cursor(&ed->text);
+  if (len == 0 || gap_buffer_insert(&ed->text, text, len) < 0) {
+    return;
+  }
+  changed(ed, pos, 0, len);
+}
+
+//replaces the whole line, the cursor goes to the end
+static void set_text(LineEditor *ed, const char *text, size_t len) {
+  size_t old_len = gap_buffer_length(&ed->text);
+  gap_buffer_clear(&ed->text);
+  if (len > 0 && gap_buffer_insert(&ed->text, text, len) < 0) {
+    len = 0;
+  }
+  changed(ed, 0, old_len, len);
+}
+
+//shows history entry pos, history_count() brings the typed line back
+static void show_history(LineEditor *ed, size_t pos) {
+  size_t count = history_count(ed->history);
+
+  //keep what was typed before leaving it
+  if (ed->history_pos == count) {
+    free(ed->draft);
+    ed->draft = gap_buffer_string(&ed->text);
+    ed->draft_len = ed->draft == NULL ? 0 : gap_buffer_length(&ed->text);
+  }
+  ed->history_pos = pos;
+
+  if (pos == count) {
+    set_text(ed, ed->draft, ed->draft_len);
+    return;
+  }
+  size_t len;
+  const char *entry = history_get(ed->history, pos, &len);
+  set_text(ed, entry, len);
+}
+
+//draws a search status over the line, the cursor goes to cursor_at
+static void draw_status(LineEditor *ed, const char *label, size_t label_len, const char *text, size_t text_len,
+                        size_t cursor_at) {
+  place(ed, 0);
+  addnstr(label, label_len);
+  addnstr(text, text_len);
+  for (size_t i = label_len + text_len; i < ed->drawn; i++) {
+    addch(' ');
+  }
+  ed->drawn = label_len + text_len;
+  place(ed, cursor_at);
+}
+
+//Ctrl-R, searches the history while the query is typed
+//returns the key that ended the search so the caller handles it with the
+//match in the line, or 0 when the search was cancelled
+static int reverse_search(LineEditor *ed) {
+  if (ed->search == NULL) {
+    ed->search = history_search_create(ed->history);
+    if (ed->search == NULL) {
+      return 0;
+    }
+  }
+
+  history_poll(ed->history);
+  size_t count = history_count(ed->history);
+  size_t typed_len = gap_buffer_length(&ed->text);
+  char *typed = gap_buffer_string(&ed->text);
+  char query[SEARCH_QUERY_MAX];
+  size_t query_len = 0;
+  long match = -1;
+  int failed = 0;
+
+  while (1) {
+    //shows the match with the cursor on the matched part
+    char label[SEARCH_QUERY_MAX + 32];
+    int label_len = snprintf(label, sizeof(label), "(%sreverse-i-search)`%.*s': ", failed ? "failed " : "",
+                             (int)query_len, query);
+    const char *entry = "";
+    size_t entry_len = 0, at = 0;
+    if (match >= 0) {
+      entry = history_get(ed->history, match, &entry_len);
+      at = str_search(entry, entry_len, query, query_len) - entry;
+    }
+    draw_status(ed, label, label_len, entry, entry_len, label_len + at);
+    show(ed);
+
+    int c = read_key(ed);
+    if (c == KEY_CTRL('r')) {
+      //next older match
+      if (query_len > 0) {
+        long older = history_search_find(ed->search, query, query_len, match >= 0 ? (size_t)match : count);
+        failed = older < 0;
+        match = older >= 0 ? older : match;
+      }
+    } else if (c == KEY_BACKSPACE || c == KEY_DEL || c == KEY_CTRL('h')) {
+      //a shorter query starts over from the newest entry
+      if (query_len > 0) {
+        query_len--;
+      }
+      match = query_len > 0 ? history_search_find(ed->search, query, query_len, count) : -1;
+      failed = query_len > 0 && match < 0;
+    } else if (c == KEY_CTRL('g')) {
+      //back to what was typed
+      set_text(ed, typed, typed == NULL ? 0 : typed_len);
+      free(typed);
+      return 0;
+    } else if (((c >= ' ' && c < KEY_DEL) || (c >= 0x80 && c <= 0xFF)) && query_len < SEARCH_QUERY_MAX) {
+      //a longer query can still match the entry shown, so search from it
+      query[query_len++] = (char)c;
+      long found = history_search_find(ed->search, query, query_len, match >= 0 ? (size_t)match + 1 : count);
+      failed = found < 0;
+      match = found >= 0 ? found : match;
+    } else {
+      //any other key takes the match into the line
+      if (match >= 0) {
+        entry = history_get(ed->history, match, &entry_len);
+        set_text(ed, entry, entry_len);
+      } else {
+        set_text(ed, typed, typed == NULL ? 0 : typed_len);
+      }
+      free(typed);
+      return c;
+    }
+  }
+}
+
+//removes the completion candidates from under the line
+static void clear_menu(LineEditor *ed) {
+  for (int i = 0; i < ed->menu_rows; i++) {
+    move(ed->menu_y + i, 0);
+    clrtoeol();
+  }
+  ed->menu_rows = 0;
+  place(ed, gap_buffer_cursor(&ed->text));
+}
+
+//lists candidates in columns under the line, down the first column first
+//only what fits in MENU_MAX_ROWS is drawn, the last row says how many
+//were left out
+static void show_menu(LineEditor *ed, const Completion *comp) {
+  size_t width = 0;
+  for (size_t i = 0; i < comp->shown_count; i++) {
+    size_t len = strlen(comp->shown[i]);
+    width = len > width ? len : width;
+  }
+  width += MENU_GAP;
+
+  size_t cols = (size_t)COLS > width ? (size_t)COLS / width : 1;
+  size_t rows = (comp->shown_count + cols - 1) / cols;
+  size_t left_out = 0;
+  if (rows > MENU_MAX_ROWS) {
+    rows = MENU_MAX_ROWS - 1;
+    left_out = comp->total - rows * cols;
+  } else if (comp->total > comp->shown_count) {
+    left_out = comp->total - comp->shown_count;
+  }
+
+  size_t end = (size_t)ed->start_y * COLS + ed->start_x + ed->drawn;
+  ed->menu_y = (int)(end / COLS) + 1;
+  for (size_t r = 0; r < rows && ed->menu_y + (int)r < LINES; r++) {
+    move(ed->menu_y + r, 0);
+    clrtoeol();
+    for (size_t col = 0; col < cols; col++) {
+      size_t i = col * rows + r;
+      if (i < comp->shown_count) {
+        mvaddnstr(ed->menu_y + r, col * width, comp->shown[i], COLS - col * width);
+      }
+    }
+    ed->menu_rows++;
+  }
+  if (left_out > 0 && ed->menu_y + ed->menu_rows < LINES) {
+    move(ed->menu_y + ed->menu_rows, 0);
+    clrtoeol();
+    printw("... and %zu more", left_out);
+    ed->menu_rows++;
+  }
+  place(ed, gap_buffer_cursor(&ed->text));
+}
+
+//Tab, completes the word before the cursor
+static void complete(LineEditor *ed) {
+  size_t cursor = gap_buffer_cursor(&ed->text);
+  size_t start = cursor;
+  while (start > 0 && gap_buffer_at(&ed->text, start - 1) != ' ') {
+    start--;
+  }
+  //the first word is the command
+  size_t before = start;
+  while (before > 0 && gap_buffer_at(&ed->text, before - 1) == ' ') {
+    before--;
+  }
+
+  char word[PATH_MAX];
+  if (cursor - start >= sizeof(word)) {
+    return;
+  }
+  gap_buffer_copy(&ed->text, start, cursor, word);
+
+  Completion comp;
+  completer_complete(ed->completer, word, cursor - start, before == 0, &comp);
+  if (comp.total == 0) {
+    beep();
+  } else if (comp.insert_len > 0) {
+    insert_text(ed, comp.insert, comp.insert_len);
+  } else {
+    show_menu(ed, &comp);
+  }
+}
+
+//draws the finder under the line: the query, then the best matches with
+//the selected one highlighted
+static void draw_finder(LineEditor *ed, FuzzyFinder *f, const char *query, size_t query_len, int selected) {
+  clear_menu(ed);
+  size_t end = (size_t)ed->start_y * COLS + ed->start_x + ed->drawn;
+  ed->menu_y = (int)(end / COLS) + 1;
+
+  if (ed->menu_y < LINES) {
+    mvprintw(ed->menu_y, 0, "> %.*s  %zu/%zu%s", (int)query_len, query, f->matched, fuzzy_finder_count(f),
+             fuzzy_finder_walking(f) ? " ..." : "");
+    ed->menu_rows++;
+  }
+  for (int i = 0; i < f->best_count && ed->menu_y + ed->menu_rows < LINES; i++) {
+    if (i == selected) {
+      attron(A_REVERSE);
+    }
+    mvaddnstr(ed->menu_y + ed->menu_rows, 2, fuzzy_finder_path(f, f->best[i].id), COLS - 2);
+    if (i == selected) {
+      attroff(A_REVERSE);
+    }
+    ed->menu_rows++;
+  }
+  //the cursor stays in the query
+  move(ed->menu_y, 2 + (int)query_len);
+}
+
+//Ctrl-T, fuzzy finds a file under the cwd and inserts its path
+//the walk goes on while the query is typed, the list follows it
+static void find_file(LineEditor *ed) {
+  FuzzyFinder *f = fuzzy_finder_create(ed->pool, ".");
+  if (f == NULL) {
+    beep();
+    return;
+  }
+
+  char query[FINDER_QUERY_MAX];
+  size_t query_len = 0;
+  int selected = 0;
+  const char *chosen = NULL;
+  int done = 0;
+
+  while (!done) {
+    fuzzy_finder_update(f, query, query_len);
+    if (selected >= f->best_count) {
+      selected = f->best_count > 0 ? f->best_count - 1 : 0;
+    }
+    draw_finder(ed, f, query, query_len, selected);
+    show(ed);
+
+    //wake up now and then while paths are still coming in
+    timeout(fuzzy_finder_walking(f) ? FINDER_TICK_MS : -1);
+    int c = read_key(ed);
+    switch (c) {
+      case ERR:
+        break;
+      case KEY_UP:
+      case KEY_CTRL('p'):
+        selected = selected > 0 ? selected - 1 : 0;
+        break;
+      case KEY_DOWN:
+      case KEY_CTRL('n'):
+        selected = selected + 1 < f->best_count ? selected + 1 : selected;
+        break;
+      case KEY_BACKSPACE:
+      case KEY_DEL:
+      case KEY_CTRL('h'):
+        if (query_len > 0) {
+          query_len--;
+        }
+        break;
+      case '\n':
+      case '\r':
+      case KEY_ENTER:
+      case '\t':
+        if (f->best_count > 0) {
+          chosen = fuzzy_finder_path(f, f->best[selected].id);
+        }
+        done = 1;
+        break;
+      case KEY_CTRL('g'):
+      case KEY_CTRL('c'):
+      case KEY_ESCAPE:
+        done = 1;
+        break;
+      default:
+        if (((c >= ' ' && c < KEY_DEL) || (c >= 0x80 && c <= 0xFF)) && query_len < FINDER_QUERY_MAX) {
+          query[query_len++] = (char)c;
+          selected = 0;
+        }
+        break;
+    }
+  }
+  timeout(-1);
+
+  clear_menu(ed);
+  if (chosen != NULL) {
+    insert_text(ed, chosen, strlen(chosen));
+    insert_text(ed, " ", 1);
+  }
+  fuzzy_finder_destroy(f);
+}
+
+//erases the suggestion after the line
+static void hide_ghost(LineEditor *ed) {
+  if (ed->ghost_len == 0) {
+    return;
+  }
+  ed->ghost_len = 0;
+  redraw_from(ed, gap_buffer_length(&ed->text));
+}
+
+static void draw_ghost(LineEditor *ed) {
+  size_t length = gap_buffer_length(&ed->text);
+  place(ed, length);
+  attron(A_DIM);
+  addnstr(ed->ghost, ed->ghost_len);
+  attroff(A_DIM);
+  //so the next redraw blanks it
+  if (length + ed->ghost_len > ed->drawn) {
+    ed->drawn = length + ed->ghost_len;
+  }
+  place(ed, gap_buffer_cursor(&ed->text));
+}
+
+//draws the suggestion if the answer to the last request is in
+static void show_ghost(LineEditor *ed) {
+  size_t len;
+  if (!suggester_answer(ed->suggester, ed->suggest_gen, ed->ghost, sizeof(ed->ghost), &len)) {
+    return;
+  }
+  ed->suggesting = 0;
+  ed->ghost_len = len;
+  if (len > 0) {
+    draw_ghost(ed);
+  }
+}
+
+//getch waits for a key only when no answer is still to come
+static void poll_answers(LineEditor *ed) {
+  int waiting = ed->suggesting || (ed->highlighter != NULL && ed->highlighter->pending);
+  timeout(waiting ? POLL_MS : -1);
+}
+
+//asks for a suggestion for the line, only when typing at its end
+//the answer is picked up by getch timing out before the next key
+static void request_suggestion(LineEditor *ed) {
+  size_t length = gap_buffer_length(&ed->text);
+  ed->suggest_gen++;
+  ed->suggesting = 0;
+  if (length == 0 || length > SUGGEST_MAX || gap_buffer_cursor(&ed->text) != length) {
+    return;
+  }
+
+  char line[SUGGEST_MAX];
+  gap_buffer_copy(&ed->text, 0, length, line);
+  suggester_request(ed->suggester, ed->suggest_gen, line, length);
+  ed->suggesting = 1;
+}
+
+//Alt-<key> arrives as ESC followed by the key
+static void handle_alt(LineEditor *ed, int c) {
+  size_t cursor = gap_buffer_cursor(&ed->text);
+
+  switch (c) {
+    case 'b':
+      move_cursor(ed, word_left(ed, cursor));
+      break;
+    case 'f':
+      move_cursor(ed, word_right(ed, cursor));
+      break;
+    case 'd':
+      kill_text(ed, cursor, word_right(ed, cursor));
+      break;
+  }
+}
+
+char *line_editor_read(LineEditor *ed, int y, const char *prompt) {
+  gap_buffer_clear(&ed->text);
+  ed->drawn = 0;
+  if (ed->highlighter != NULL) {
+    highlighter_reset(ed->highlighter);
+  }
+  if (ed->history != NULL) {
+    history_poll(ed->history);
+  }
+  ed->history_pos = ed->history == NULL ? 0 : history_count(ed->history);
+
+  mvprintw(y, 1, "%s", prompt);
+  getyx(stdscr, ed->start_y, ed->start_x);
+  refresh();
+
+  int done = 0;
+  int cancelled = 0;
+  int pending = 0; //key that ended a Ctrl-R search
+  while (!done) {
+    int c = pending != 0 ? pending : read_key(ed);
+    pending = 0;
+    if (c == ERR) {
+      //no key yet, the suggestion or a command or path check may have come in
+      if (ed->suggesting) {
+        show_ghost(ed);
+      }
+      if (ed->highlighter != NULL && highlighter_stale(ed->highlighter)) {
+        redraw_from(ed, 0);
+        if (ed->ghost_len > 0) {
+          draw_ghost(ed);
+        }
+      }
+      refresh();
+      poll_answers(ed);
+      continue;
+    }
+    timeout(-1);
+    ed->suggesting = 0;
+
+    if (ed->menu_rows > 0) {
+      clear_menu(ed);
+    }
+    size_t cursor = gap_buffer_cursor(&ed->text);
+    size_t length = gap_buffer_length(&ed->text);
+
+    //moving right off the end takes the suggestion
+    if (ed->ghost_len > 0 && cursor == length &&
+        (c == KEY_RIGHT || c == KEY_CTRL('f') || c == KEY_END || c == KEY_CTRL('e'))) {
+      size_t len = ed->ghost_len;
+      ed->ghost_len = 0;
+      insert_text(ed, ed->ghost, len);
+      show(ed);
+      request_suggestion(ed);
+      continue;
+    }
+    hide_ghost(ed);
+
+    switch (c) {
+      case '\n':
+      case '\r':
+      case KEY_ENTER:
+        done = 1;
+        break;
+
+      case KEY_LEFT:
+      case KEY_CTRL('b'):
+        if (cursor > 0) {
+          move_cursor(ed, cursor - 1);
+        }
+        break;
+      case KEY_RIGHT:
+      case KEY_CTRL('f'):
+        move_cursor(ed, cursor + 1);
+        break;
+      case KEY_HOME:
+      case KEY_CTRL('a'):
+        move_cursor(ed, 0);
+        break;
+      case KEY_END:
+      case KEY_CTRL('e'):
+        move_cursor(ed, length);
+        break;
+
+      case KEY_UP:
+      case KEY_CTRL('p'):
+        //commands other shells ran while this line was typed
+        if (ed->history != NULL && ed->history_pos == history_count(ed->history)) {
+          history_poll(ed->history);
+          ed->history_pos = history_count(ed->history);
+        }
+        if (ed->history != NULL && ed->history_pos > 0) {
+          show_history(ed, ed->history_pos - 1);
+        }
+        break;
+      case KEY_DOWN:
+      case KEY_CTRL('n'):
+        if (ed->history != NULL && ed->history_pos < history_count(ed->history)) {
+          show_history(ed, ed->history_pos + 1);
+        }
+        break;
+
+      case KEY_CTRL('r'):
+        if (ed->history != NULL) {
+          pending = reverse_search(ed);
+        }
+        break;
+
+      case KEY_BACKSPACE:
+      case KEY_DEL:
+      case KEY_CTRL('h'):
+        if (gap_buffer_delete_before(&ed->text, 1) > 0) {
+          changed(ed, cursor - 1, 1, 0);
+        }
+        break;
+      case KEY_CTRL('d'):
+        //end of input on an empty line, otherwise the same as Delete
+        if (length == 0) {
+          return NULL;
+        }
+        //fall through
+      case KEY_DC:
+        if (gap_buffer_delete_after(&ed->text, 1) > 0) {
+          changed(ed, cursor, 1, 0);
+        }
+        break;
+
+      case KEY_CTRL('k'):
+        kill_text(ed, cursor, length);
+        break;
+      case KEY_CTRL('u'):
+        kill_text(ed, 0, cursor);
+        break;
+      case KEY_CTRL('w'):
+        kill_text(ed, word_left(ed, cursor), cursor);
+        break;
+      case KEY_CTRL('y'):
+        insert_text(ed, ed->yank, ed->yank_len);
+        break;
+
+      case KEY_CTRL('c'):
+        //raw mode has no SIGINT, Ctrl-C just drops the line
+        move_cursor(ed, length);
+        addstr("^C");
+        cancelled = 1;
+        done = 1;
+        break;
+
+      case KEY_ESCAPE:
+        handle_alt(ed, read_key(ed));
+        break;
+
+      case '\t':
+        if (ed->completer != NULL) {
+          complete(ed);
+        }
+        break;
+      case KEY_CTRL('t'):
+        if (ed->pool != NULL) {
+          find_file(ed);
+        }
+        break;
+
+      case KEY_RESIZE:
+        redraw_from(ed, 0);
+        break;
+
+      default:
+        //printable ascii and utf-8 bytes, other control keys are ignored
+        if ((c >= ' ' && c < KEY_DEL) || (c >= 0x80 && c <= 0xFF)) {
+          char byte = (char)c;
+          insert_text(ed, &byte, 1);
+        }
+        break;
+    }
+    show(ed);
+    if (!done && ed->suggester != NULL) {
+      request_suggestion(ed);
+    }
+    poll_answers(ed);
+  }
+  timeout(-1);
+
+  size_t end = (size_t)ed->start_y * COLS + ed->start_x + ed->drawn + (cancelled ? 2 : 0);
+  ed->rows = (int)(end / COLS) - y + 1;
+  if (cancelled) {
+    gap_buffer_clear(&ed->text);
+  }
+
+  size_t length = gap_buffer_length(&ed->text);
+  if (length + 1 > ed->result_cap) {
+    char *result = (char *)realloc(ed->result, length + 1);
+    if (result == NULL) {
+      return NULL;
+    }
+    ed->result = result;
+    ed->result_cap = length + 1;
+  }
+  gap_buffer_copy(&ed->text, 0, length, ed->result);
+  ed->result[length] = '\0';
+  return ed->result;
+}
@@ -0,0 +1,78 @@
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include <stddef.h>
+#include "completion.h"
+#include "fuzzy_find.h"
+#include "gap_buffer.h"
+#include "highlight.h"
+#include "history.h"
+#include "history_search.h"
+#include "latency.h"
+#include "suggest.h"
+
+//raw mode line editor for the ncurses shell
+//the line lives in a gap buffer, after an edit only the text from the edit
+//position on is drawn again, so typing at the end of a long line costs the
+//same as on an empty one
+//keys: arrows, Home/End, Ctrl-A/E/B/F, Alt-B/F (word jumps), Backspace,
+//Delete, Ctrl-K/U/W and Alt-D (kill), Ctrl-Y (yank), Ctrl-C (cancel line),
+//Ctrl-D on an empty line (end of input), Up/Down and Ctrl-P/N (history),
+//Ctrl-R (search the history, again for older matches, Ctrl-G cancels),
+//Tab (complete a command or path, candidates are listed under the line),
+//Ctrl-T (fuzzy find a file under the cwd and insert its path)
+//while typing at the end of the line the newest history entry starting
+//with it is shown dimmed after the cursor, Right/End/Ctrl-F/Ctrl-E take it
+//with a highlighter the line is drawn in colors, an edit only styles again
+//from the word it touched
+//with a latency histogram every key is timed from getch returning it to
+//the refresh that put its effect on screen
+typedef struct {
+  GapBuffer text;
+  char *yank;      //last killed text
+  size_t yank_len;
+  size_t yank_cap;
+
+  int start_y;     //screen position of the first byte of the line
+  int start_x;
+  size_t drawn;    //bytes on screen after the last redraw
+  int rows;        //screen rows the last finished line took, prompt included
+
+  History *history;   //set by the caller, NULL for no history
+  size_t history_pos; //entry shown, history_count() for the line being typed
+  char *draft;        //the line being typed while browsing history
+  size_t draft_len;
+  HistorySearch *search; //built on the first Ctrl-R
+
+  Completer *completer; //set by the caller, NULL for no completion
+  ThreadPool *pool;     //set by the caller, NULL for no Ctrl-T
+  Highlighter *highlighter; //set by the caller, NULL for a plain line
+
+  Suggester *suggester; //set by the caller, NULL for no suggestions
+  uint64_t suggest_gen; //request the shown suggestion must answer
+  int suggesting;       //a request is out, getch polls for the answer
+  char ghost[SUGGEST_MAX]; //suggestion drawn after the line
+  size_t ghost_len;
+  int menu_y;           //rows of candidates drawn under the line
+  int menu_rows;
+
+  LatencyHistogram *latency; //set by the caller, NULL to not measure
+  uint64_t key_time;    //when the oldest key not yet on screen was read, 0 for none
+
+  char *result;         //the finished line handed back, reused for every line
+  size_t result_cap;
+} LineEditor;
+
+LineEditor *line_editor_create(void);
+void line_editor_destroy(LineEditor *ed);
+
+//sets up the color pairs the highlighter's styles are drawn with, on the
+//given background, after start_color
+void line_editor_colors(short background);
+
+//prints prompt at row y and lets the user edit a line
+//returns the line, owned by the editor until the next call, NULL on Ctrl-D
+//on an empty line or when out of memory
+char *line_editor_read(LineEditor *ed, int y, const char *prompt);
+
+#endif
@@ -8,7 +8,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <limits.h>
 #include <linux/limits.h>
+#include "alloc_count.h"
+#include "arena.h"
+#include "builtins/builtins.h"
+#include "line_editor.h"
 
 //Input line values
 typedef struct {
@@ -16,8 +23,27 @@ typedef struct {
   char * username;
   int line;
   char shell_scripts_path[PATH_MAX];
+  LineEditor *editor;
+  History *history;
+  Completer *completer;
+  ThreadPool *pool;
+  Jobs *jobs;
+  Suggester *suggester;
+  ExistCache *exists;
+  Highlighter *highlighter;
+  Arena arena;  //everything the command being run needs, reset after it
+  unsigned long heap_mark;  //alloc_count() when the command was read
+  LatencyHistogram latency; //keystroke to screen, for the latency builtin
+  const char **commands;    //shell_builtins and the native builtins, for completion
+  int command_count;
+  const char *redirect;     //where the command's output goes (> or >>), NULL for the screen
+  int redirect_append;
 } InputLine;
 
+//commands handled by the main loop itself, the rest are native builtins or
+//come from shell_cmds
+static const char *const shell_builtins[] = {"end", "cls", "latency"};
+
 // Function to safely concatenate paths
 size_t safe_path_join(char *dest, size_t dest_size, const char *base, const char *append) {
     size_t base_len = strlen(base);
@@ -105,70 +131,103 @@ void get_builtin_cmd_path(const char *cmd, char *full_path, const char *scripts_
 //Macros
 #define check_end(msg) (strcmp(msg, "end") == 0)
 #define check_clear(msg) (strcmp(msg, "cls") == 0)
-#define CMD_ARG_BUFSIZE 64;
-#define CMD_BUFSIZE 30; //not used yet
+#define check_latency(args) (args[0] != NULL && strcmp(args[0], "latency") == 0)
+#define COMMAND_ARENA_SIZE (16 * 1024)
 #define display(msg) mvprintw(input->line++,1,"%s",msg);
-#define TOK_DELIM " "
 
 //functions
 
 //input line function
-//retuens the line inputed by user
+//retuens the line inputed by user, copied into the command's arena
 char *write_command(InputLine *input) {
-  int bufsize = CMD_BUFSIZE; 
-  char *line = (char *)malloc(bufsize*sizeof(char)); //figure out dynamic alloction
+  char *line = line_editor_read(input->editor, input->line, input->username);
+  input->line += input->editor->rows;
   if (line == NULL) {
     return NULL;
-  };
-
-  mvprintw(input->line++,1,"%s",input->username);
-  getstr(line);
-  
-  return line;
+  }
+  input->heap_mark = alloc_count();
+  return arena_strndup(&input->arena, line, strlen(line));
 }
 
 //split line into arguments function
+//quotes are taken out of cmd in place and most arguments point into it, the
+//rest into the arena, so they last until the command is done
+//an unquoted > or >> and its target are taken out into input->redirect,
+//on a syntax error the first argument is NULL
 char **split_line(char *cmd,InputLine * input) {
-  int i = 0;
-  int bufsize = CMD_ARG_BUFSIZE;
-  char **tokens = (char **)malloc(bufsize * sizeof(char *));
-  char *token;
-
-  if (!tokens) {
+  LexWords words = {.arena = &input->arena};
+  if (lex_words(cmd, strlen(cmd), &words) < 0) {
     display("ERROR: alloction error in split_line: tokens");
     exit(EXIT_FAILURE);
   }
-  
-  token = strtok(cmd,TOK_DELIM);
-  while (token != NULL ) {
-    //handling comments
-    if (token[0] == '#')
-      break;
 
-    tokens[i++] = token;
+  input->redirect = NULL;
+  size_t kept = 0;
+  for (size_t i = 0; i < words.argc; i++) {
+    int is_redirect = words.kinds[i] == LEX_OPERATOR &&
+                      (strcmp(words.argv[i], ">") == 0 || strcmp(words.argv[i], ">>") == 0);
+    if (!is_redirect) {
+      words.argv[kept++] = words.argv[i];
+      continue;
+    }
+    if (i + 1 == words.argc || words.kinds[i + 1] != LEX_WORD) {
+      mvprintw(input->line++, 1, "syntax error near %s", words.argv[i]);
+      words.argv[0] = NULL;
+      return words.argv;
+    }
+    input->redirect_append = words.argv[i][1] == '>';
+    input->redirect = words.argv[++i];
+  }
+  words.argv[kept] = NULL;
+  return words.argv;
+}
 
-    if (i >= bufsize) {
-      bufsize++;
-      tokens = realloc(tokens, bufsize * sizeof(char *));
+//hands a builtin's line to the screen
+static void show_line(const char *line, size_t len, void *ctx) {
+  InputLine *input = (InputLine *)ctx;
+  mvaddnstr(input->line++, 1, line, len < INT_MAX ? (int)len : INT_MAX);
+}
 
-      if (!tokens) {
-        display("ERROR: alloction error in split_line: tokens");
-        exit(EXIT_FAILURE);
-      }
-    }
-    token = strtok(NULL, TOK_DELIM);
+//or to the file its output is redirected to
+static void write_line(const char *line, size_t len, void *ctx) {
+  int fd = *(int *)ctx;
+  if (write(fd, line, len) == (ssize_t)len) {
+    write(fd, "\n", 1);
   }
-  tokens[i] = NULL;
-  return (tokens);
 }
 
 //command argument execution
 void execute_args(char **cmd_args, InputLine *input) {
-    const char *builtin_cmds[] = {"ls", "cd", "mv", "pwd", "delete", "cat", "gcc", "touch"};
+    const char *builtin_cmds[] = {"cd", "pwd"};
     char exec_path[PATH_MAX];
     char **exec_args = NULL;
     int is_builtin = 0;
     const char *original_cmd = NULL;
+    const Builtin *native = builtin_find(cmd_args[0]);
+    int arg_count = 0;
+    while (cmd_args[arg_count] != NULL) arg_count++;
+
+    // Native commands that run in the shell need neither a child nor the
+    // pipe, unless their output is redirected and they can run in a child
+    if (native != NULL && native->in_shell != NULL && (input->redirect == NULL || native->main == NULL)) {
+        BuiltinShell shell = {show_line, input, input->pool, input->jobs};
+        int fd = -1;
+        if (input->redirect != NULL) {
+            int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (input->redirect_append ? O_APPEND : O_TRUNC);
+            fd = open(input->redirect, flags, 0644);
+            if (fd < 0) {
+                mvprintw(input->line++, 1, "cannot write %s: %s", input->redirect, strerror(errno));
+                return;
+            }
+            shell.show = write_line;
+            shell.ctx = &fd;
+        }
+        native->in_shell(arg_count, cmd_args, &shell);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
     
     // Initialize pipe and path
     int Pipe_PtoC[2];
@@ -199,8 +258,8 @@ void execute_args(char **cmd_args, InputLine *input) {
         }
         exec_args = cmd_args;
         exec_args[0] = exec_path;
-    } else {
-        // Handle built-in commands
+    } else if (native == NULL) {
+        // Handle built-in commands, native ones run in the child without an exec
         for (size_t i = 0; i < sizeof(builtin_cmds) / sizeof(builtin_cmds[0]); i++) {
             if (strcmp(cmd_args[0], builtin_cmds[i]) == 0) {
                 is_builtin = 1;
@@ -236,11 +295,8 @@ void execute_args(char **cmd_args, InputLine *input) {
                     }
                 }
                 
-                // Create new argument array
-                int arg_count = 0;
-                while (cmd_args[arg_count] != NULL) arg_count++;
-                
-                exec_args = malloc((arg_count + 1) * sizeof(char *));
+                // The arguments already live in the command's arena
+                exec_args = arena_alloc(&input->arena, (arg_count + 1) * sizeof(char *));
                 if (!exec_args) {
                     perror("malloc failed");
                     close(Pipe_PtoC[0]);
@@ -248,27 +304,9 @@ void execute_args(char **cmd_args, InputLine *input) {
                     return;
                 }
                 
-                exec_args[0] = strdup(exec_path);
-                if (!exec_args[0]) {
-                    free(exec_args);
-                    perror("strdup failed");
-                    close(Pipe_PtoC[0]);
-                    close(Pipe_PtoC[1]);
-                    return;
-                }
-                
+                exec_args[0] = exec_path;
                 for (int j = 1; j < arg_count; j++) {
-                    exec_args[j] = strdup(cmd_args[j]);
-                    if (!exec_args[j]) {
-                        for (int k = 0; k < j; k++) {
-                            free(exec_args[k]);
-                        }
-                        free(exec_args);
-                        perror("strdup failed");
-                        close(Pipe_PtoC[0]);
-                        close(Pipe_PtoC[1]);
-                        return;
-                    }
+                    exec_args[j] = cmd_args[j];
                 }
                 exec_args[arg_count] = NULL;
                 break;
@@ -287,12 +325,6 @@ void execute_args(char **cmd_args, InputLine *input) {
     pid_t pid = fork();
     if (pid == -1) {
         perror("fork failed");
-        if (is_builtin) {
-            for (int j = 0; exec_args[j] != NULL; j++) {
-                free(exec_args[j]);
-            }
-            free(exec_args);
-        }
         close(Pipe_PtoC[0]);
         close(Pipe_PtoC[1]);
         return;
@@ -303,6 +335,21 @@ void execute_args(char **cmd_args, InputLine *input) {
         dup2(Pipe_PtoC[1], STDOUT_FILENO);
         close(Pipe_PtoC[1]);
 
+        // Output into a file, an error still goes to the screen
+        if (input->redirect != NULL) {
+            int flags = O_WRONLY | O_CREAT | (input->redirect_append ? O_APPEND : O_TRUNC);
+            int fd = open(input->redirect, flags, 0644);
+            if (fd < 0) {
+                dprintf(STDOUT_FILENO, "cannot write %s: %s\n", input->redirect, strerror(errno));
+                _exit(EXIT_FAILURE);
+            }
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+
+        if (native != NULL) {
+            _exit(native->main(arg_count, cmd_args));
+        }
         execv(exec_path, exec_args);
         perror("execv failed");
         exit(EXIT_FAILURE);
@@ -331,10 +378,49 @@ void execute_args(char **cmd_args, InputLine *input) {
                 }
             }
         } else {
+            // Shown a line at a time as it streams in, a line cut by a
+            // read waits for the rest and a line ending in \r is drawn
+            // over by the next one, for progress lines
             char buffer[1024];
+            size_t kept = 0;
+            int overwrite = 0;
             ssize_t nbytes;
-            while ((nbytes = read(Pipe_PtoC[0], buffer, sizeof(buffer) - 1)) > 0) {
-                buffer[nbytes] = '\0';
+            while ((nbytes = read(Pipe_PtoC[0], buffer + kept, sizeof(buffer) - 1 - kept)) > 0) {
+                size_t end = kept + (size_t)nbytes;
+                size_t start = 0;
+                for (size_t i = 0; i < end; i++) {
+                    if (buffer[i] == '\r') {
+                        buffer[i] = '\0';
+                        mvprintw(input->line, 1, "%s", buffer + start);
+                        clrtoeol();
+                        overwrite = 1;
+                        start = i + 1;
+                    } else if (buffer[i] == '\n') {
+                        buffer[i] = '\0';
+                        // \r\n ends a line already drawn
+                        if (overwrite && start == i) {
+                            input->line++;
+                        } else {
+                            mvprintw(input->line, 1, "%s", buffer + start);
+                            clrtoeol();
+                            input->line++;
+                        }
+                        overwrite = 0;
+                        start = i + 1;
+                    }
+                }
+                // A line longer than the buffer is shown in pieces
+                if (start == 0 && end == sizeof(buffer) - 1) {
+                    buffer[end] = '\0';
+                    display(buffer);
+                    start = end;
+                }
+                kept = end - start;
+                memmove(buffer, buffer + start, kept);
+                refresh();
+            }
+            if (kept > 0) {
+                buffer[kept] = '\0';
                 display(buffer);
             }
         }
@@ -342,19 +428,50 @@ void execute_args(char **cmd_args, InputLine *input) {
         close(Pipe_PtoC[0]);
         int status;
         waitpid(pid, &status, 0);
-
-        // Clean up if using built-in command
-        if (is_builtin) {
-            for (int j = 0; exec_args[j] != NULL; j++) {
-                free(exec_args[j]);
-            }
-            free(exec_args);
-        }
     }
 }
+//latency builtin
+//prints how long keys took to reach the screen, "latency reset" starts
+//over and "latency save FILE" writes the histogram for HdrHistogram tools
+void show_latency(char **cmd_args, InputLine *input) {
+  LatencyHistogram *h = &input->latency;
+  if (cmd_args[1] != NULL && strcmp(cmd_args[1], "reset") == 0) {
+    latency_reset(h);
+    return;
+  }
+  if (cmd_args[1] != NULL && strcmp(cmd_args[1], "save") == 0) {
+    if (cmd_args[2] == NULL) {
+      display("usage: latency [reset | save FILE]");
+      return;
+    }
+    int fd = open(cmd_args[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || latency_export(h, fd) < 0) {
+      mvprintw(input->line++, 1, "latency: cannot write %s", cmd_args[2]);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  if (cmd_args[1] != NULL) {
+    display("usage: latency [reset | save FILE]");
+    return;
+  }
+
+  //microseconds, one decimal
+  mvprintw(input->line++, 1, "%llu keys  p50 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us",
+           (unsigned long long)h->total, latency_percentile(h, 0.5) / 1e3,
+           latency_percentile(h, 0.99) / 1e3, latency_percentile(h, 0.999) / 1e3, h->max / 1e3);
+}
+
 int main(int argc, char **argv) {
   //init screen
+  //raw mode, the line editor handles every key itself
   initscr();
+  raw();
+  noecho();
+  keypad(stdscr, TRUE);
+  set_escdelay(25);
   start_color();
   
   //intializing input line
@@ -391,6 +508,72 @@ int main(int argc, char **argv) {
   }
 
   input->line = 0;
+  if (arena_init(&input->arena, COMMAND_ARENA_SIZE) < 0) {
+      perror("malloc() error");
+      return 1;
+  }
+
+  input->editor = line_editor_create();
+  if (input->editor == NULL) {
+      perror("malloc() error");
+      return 1;
+  }
+
+  //history is optional, the shell works without it
+  input->history = history_open_default();
+  input->editor->history = input->history;
+
+  //suggestions come from a helper thread with its own view of the history
+  char history_path[PATH_MAX];
+  input->suggester = NULL;
+  if (input->history != NULL && history_default_path(history_path, sizeof(history_path)) == 0) {
+    input->suggester = suggester_create(history_path);
+  }
+  input->editor->suggester = input->suggester;
+
+  //the shell's own commands and the native ones are known by name, the
+  //scripts by their files
+  size_t shell_count = sizeof(shell_builtins) / sizeof(shell_builtins[0]);
+  input->command_count = (int)(shell_count + builtin_count);
+  input->commands = (const char **)malloc(input->command_count * sizeof(char *));
+  if (input->commands == NULL) {
+      perror("malloc() error");
+      return 1;
+  }
+  for (size_t i = 0; i < shell_count; i++) {
+    input->commands[i] = shell_builtins[i];
+  }
+  for (size_t i = 0; i < builtin_count; i++) {
+    input->commands[shell_count + i] = builtins[i].name;
+  }
+
+  //Tab completion over the builtins, shell_cmds and $PATH
+  input->completer = completer_create(input->shell_scripts_path, input->commands, input->command_count);
+  input->editor->completer = input->completer;
+
+  //one worker per core, shared by everything that runs in parallel
+  input->pool = thread_pool_create(0);
+  input->editor->pool = input->pool;
+
+  //commands like delete -r leave work running on the pool
+  input->jobs = input->pool != NULL ? jobs_create(input->pool) : NULL;
+
+  //the line is colored as it is typed, commands and paths are looked up
+  //on the pool
+  input->exists = NULL;
+  input->highlighter = NULL;
+  if (input->pool != NULL) {
+    input->exists = exist_cache_create(input->pool, input->shell_scripts_path, input->commands,
+                                       input->command_count);
+  }
+  if (input->exists != NULL) {
+    input->highlighter = highlighter_create(input->exists);
+  }
+  input->editor->highlighter = input->highlighter;
+
+  //every key is timed from being read to being on screen
+  latency_reset(&input->latency);
+  input->editor->latency = &input->latency;
 
   if(can_change_color()) {
     init_color(COLOR_BLUE,0,0,300);
@@ -398,6 +581,7 @@ int main(int argc, char **argv) {
 
   //define color parts
   init_pair(1, COLOR_WHITE, COLOR_BLUE);
+  line_editor_colors(COLOR_BLUE);
 
   //set up full screen with the color
   bkgd(COLOR_PAIR(1));
@@ -418,7 +602,6 @@ int main(int argc, char **argv) {
     
     //for end cmd
     if(check_end(cmd)){
-      free(cmd);
       break;
     }
     
@@ -430,22 +613,47 @@ int main(int argc, char **argv) {
     
     //command execution call
     else if(strcmp(cmd,"") != 0) {
+      if (input->history != NULL) {
+        history_add(input->history, cmd);
+      }
+
       //spliting the input line into command and its arguments
       char **cmd_args;
       //char *result;
 
       cmd_args = split_line(cmd,input);
-      execute_args(cmd_args,input);
+      if (check_latency(cmd_args)) {
+        show_latency(cmd_args, input);
+      }
+      //a line of blanks or only a comment
+      else if (cmd_args[0] != NULL) {
+        execute_args(cmd_args,input);
+      }
       //mvprintw(input->line++,1,"%s",msg);
     }
-    
-    free(cmd);
+
+#ifdef ALLOC_DEBUG
+    //a warm shell runs a command without the heap, only a command bigger
+    //than any before it may give the arena another block
+    assert(alloc_count() - input->heap_mark == input->arena.grown);
+#endif
+    arena_reset(&input->arena);
     attroff(COLOR_PAIR(1));
     refresh();
     //pause the screen output
     //getch();
   }
   
+  line_editor_destroy(input->editor);
+  arena_free(&input->arena);
+  history_close(input->history);
+  completer_destroy(input->completer);
+  highlighter_destroy(input->highlighter);
+  exist_cache_destroy(input->exists);
+  jobs_destroy(input->jobs);
+  thread_pool_destroy(input->pool);
+  suggester_destroy(input->suggester);
+  free(input->commands);
   free(input->username);
   free(input);
   endwin();
@@ -0,0 +1,340 @@
+#include "soft_render.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOFT_RENDER_X86 1
+#endif
+
+//blends count pixels of color into dst using 8-bit coverage
+typedef void (*BlendSpanFn)(Uint32 *dst, const Uint8 *coverage, int count, Uint32 color);
+
+static BlendSpanFn blend_span = NULL;
+static const char *blend_name = "scalar";
+
+static Uint32 pack_color(SDL_Color color) {
+  return (255u << 24) | ((Uint32)color.r << 16) | ((Uint32)color.g << 8) | color.b;
+}
+
+//out = (fg * a + dst * (255 - a)) / 255, rounded, for every channel
+//the (x + (x >> 8)) >> 8 trick is an exact division by 255 for x + 128
+static void blend_span_scalar(Uint32 *dst, const Uint8 *coverage, int count, Uint32 color) {
+  for (int i = 0; i < count; i++) {
+    Uint32 a = coverage[i];
+    if (a == 0) {
+      continue;
+    }
+    if (a == 255) {
+      dst[i] = color;
+      continue;
+    }
+
+    Uint32 d = dst[i];
+    Uint32 out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      Uint32 f = (color >> shift) & 0xFF;
+      Uint32 b = (d >> shift) & 0xFF;
+      Uint32 x = f * a + b * (255 - a) + 128;
+      out |= ((x + (x >> 8)) >> 8) << shift;
+    }
+    dst[i] = out;
+  }
+}
+
+#ifdef SOFT_RENDER_X86
+//same math as the scalar version on 16-bit lanes, nothing overflows because
+//f * a + d * (255 - a) + 128 is at most 65153
+__attribute__((target("sse2")))
+static inline __m128i blend_epi16_sse2(__m128i d, __m128i f, __m128i a) {
+  const __m128i c255 = _mm_set1_epi16(255);
+  const __m128i c128 = _mm_set1_epi16(128);
+  __m128i x = _mm_add_epi16(_mm_mullo_epi16(f, a), _mm_mullo_epi16(d, _mm_sub_epi16(c255, a)));
+  x = _mm_add_epi16(x, c128);
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+//4 pixels per iteration
+__attribute__((target("sse2")))
+static void blend_span_sse2(Uint32 *dst, const Uint8 *coverage, int count, Uint32 color) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i fg = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+  int i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    Uint32 a4;
+    memcpy(&a4, coverage + i, sizeof(a4));
+    if (a4 == 0) {
+      continue; //most of a glyph cell is empty
+    }
+
+    //spread every coverage byte over the 4 channels of its pixel
+    __m128i a = _mm_cvtsi32_si128((int)a4);
+    a = _mm_unpacklo_epi8(a, a);
+    a = _mm_unpacklo_epi16(a, a);
+
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    __m128i lo = blend_epi16_sse2(_mm_unpacklo_epi8(d, zero), fg, _mm_unpacklo_epi8(a, zero));
+    __m128i hi = blend_epi16_sse2(_mm_unpackhi_epi8(d, zero), fg, _mm_unpackhi_epi8(a, zero));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+  }
+
+  blend_span_scalar(dst + i, coverage + i, count - i, color);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend_epi16_avx2(__m256i d, __m256i f, __m256i a) {
+  const __m256i c255 = _mm256_set1_epi16(255);
+  const __m256i c128 = _mm256_set1_epi16(128);
+  __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(f, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a)));
+  x = _mm256_add_epi16(x, c128);
+  return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+//8 pixels per iteration, the unpacks work per 128-bit lane so the coverage
+//is laid out as pixels 0-3 in the low lane and 4-7 in the high lane
+__attribute__((target("avx2")))
+static void blend_span_avx2(Uint32 *dst, const Uint8 *coverage, int count, Uint32 color) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i fg = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), zero);
+  int i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    Uint64 a8;
+    memcpy(&a8, coverage + i, sizeof(a8));
+    if (a8 == 0) {
+      continue;
+    }
+
+    __m128i a = _mm_loadl_epi64((const __m128i *)(coverage + i));
+    a = _mm_unpacklo_epi8(a, a);
+    __m256i av = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(a, a)),
+                                         _mm_unpackhi_epi16(a, a), 1);
+
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    __m256i lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero), fg, _mm256_unpacklo_epi8(av, zero));
+    __m256i hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero), fg, _mm256_unpackhi_epi8(av, zero));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+  }
+
+  blend_span_sse2(dst + i, coverage + i, count - i, color);
+}
+#endif
+
+//picks the widest blend routine the cpu supports
+static void select_blend_span(void) {
+  if (blend_span != NULL) {
+    return;
+  }
+
+  blend_span = blend_span_scalar;
+  blend_name = "scalar";
+#ifdef SOFT_RENDER_X86
+  if (SDL_HasAVX2()) {
+    blend_span = blend_span_avx2;
+    blend_name = "avx2";
+  } else if (SDL_HasSSE2()) {
+    blend_span = blend_span_sse2;
+    blend_name = "sse2";
+  }
+#endif
+}
+
+const char *soft_render_blend_name(void) {
+  select_blend_span();
+  return blend_name;
+}
+
+SoftRenderer *soft_render_create(SDL_Renderer *renderer, int width, int height) {
+  select_blend_span();
+
+  SoftRenderer *sr = (SoftRenderer *)calloc(1, sizeof(SoftRenderer));
+  if (sr == NULL) {
+    return NULL;
+  }
+
+  sr->width = width;
+  sr->height = height;
+  sr->pixels = (Uint32 *)calloc((size_t)width * height, sizeof(Uint32));
+  sr->dirty_rows = (Uint8 *)calloc(height, 1);
+  if (sr->pixels == NULL || sr->dirty_rows == NULL) {
+    soft_render_destroy(sr);
+    return NULL;
+  }
+
+  if (renderer != NULL) {
+    sr->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                    SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (sr->texture == NULL) {
+      soft_render_destroy(sr);
+      return NULL;
+    }
+  }
+
+  //the texture starts with undefined contents, upload everything once
+  memset(sr->dirty_rows, 1, height);
+  return sr;
+}
+
+void soft_render_destroy(SoftRenderer *sr) {
+  if (sr == NULL) {
+    return;
+  }
+  if (sr->texture != NULL) {
+    SDL_DestroyTexture(sr->texture);
+  }
+  free(sr->pixels);
+  free(sr->dirty_rows);
+  free(sr);
+}
+
+//clips a span against the framebuffer, returns 0 when nothing is left
+static int clip_rect(SoftRenderer *sr, int *x, int *y, int *w, int *h) {
+  if (*x < 0) {
+    *w += *x;
+    *x = 0;
+  }
+  if (*y < 0) {
+    *h += *y;
+    *y = 0;
+  }
+  if (*x + *w > sr->width) {
+    *w = sr->width - *x;
+  }
+  if (*y + *h > sr->height) {
+    *h = sr->height - *y;
+  }
+  return *w > 0 && *h > 0;
+}
+
+void soft_render_fill(SoftRenderer *sr, int x, int y, int w, int h, SDL_Color color) {
+  if (!clip_rect(sr, &x, &y, &w, &h)) {
+    return;
+  }
+
+  Uint32 value = pack_color(color);
+  for (int row = y; row < y + h; row++) {
+    SDL_memset4(sr->pixels + (size_t)row * sr->width + x, value, w);
+    sr->dirty_rows[row] = 1;
+  }
+}
+
+int soft_render_draw_glyphs(SoftRenderer *sr, GlyphCache *cache, int x, int y,
+                            const Uint32 *codepoints, int count, SDL_Color color) {
+  Uint32 value = pack_color(color);
+
+  for (int i = 0; i < count; i++, x += cache->cell_w) {
+    int gx = x, gy = y, gw = cache->cell_w, gh = cache->cell_h;
+    if (!clip_rect(sr, &gx, &gy, &gw, &gh)) {
+      continue;
+    }
+
+    const Uint8 *mask = glyph_cache_get(cache, codepoints[i]);
+    if (mask == NULL) {
+      continue;
+    }
+
+    for (int row = gy; row < gy + gh; row++) {
+      const Uint8 *coverage = mask + (row - y) * cache->cell_w + (gx - x);
+      blend_span(sr->pixels + (size_t)row * sr->width + gx, coverage, gw, value);
+      sr->dirty_rows[row] = 1;
+    }
+  }
+
+  return x;
+}
+
+int soft_render_draw_text(SoftRenderer *sr, GlyphCache *cache, int x, int y,
+                          const char *text, SDL_Color color) {
+  Uint32 codepoints[256];
+  int count = 0;
+  Uint32 cp;
+  int len;
+
+  while ((len = utf8_decode(text, &cp)) > 0) {
+    text += len;
+    codepoints[count++] = cp;
+    if (count == 256) {
+      x = soft_render_draw_glyphs(sr, cache, x, y, codepoints, count, color);
+      count = 0;
+    }
+  }
+
+  return soft_render_draw_glyphs(sr, cache, x, y, codepoints, count, color);
+}
+
+int soft_render_draw_grid(SoftRenderer *sr, GlyphCache *cache, TermGrid *grid, int x, int y,
+                          SDL_Color fg, SDL_Color bg) {
+  int drawn = 0;
+  int width = grid->cols * cache->cell_w;
+  int height = grid->rows * cache->cell_h;
+
+  //scrolled output: move the rows that stay visible up in the framebuffer,
+  //the grid has already flagged only the newly exposed rows as dirty
+  int scrolled = grid->scrolled;
+  grid->scrolled = 0;
+  if (scrolled > 0) {
+    if (scrolled < grid->rows && x >= 0 && y >= 0 && x + width <= sr->width && y + height <= sr->height) {
+      int shift = scrolled * cache->cell_h;
+      for (int row = y; row < y + height - shift; row++) {
+        memcpy(sr->pixels + (size_t)row * sr->width + x,
+               sr->pixels + (size_t)(row + shift) * sr->width + x, width * sizeof(Uint32));
+        sr->dirty_rows[row] = 1;
+      }
+    } else {
+      memset(grid->dirty, 1, grid->rows);
+    }
+  }
+
+  for (int row = 0; row < grid->rows; row++) {
+    if (!grid->dirty[row]) {
+      continue;
+    }
+    grid->dirty[row] = 0;
+    drawn++;
+
+    int row_y = y + row * cache->cell_h;
+    soft_render_fill(sr, x, row_y, grid->cols * cache->cell_w, cache->cell_h, bg);
+
+    //trailing blanks are already covered by the fill
+    const Uint32 *cells = term_grid_row(grid, row);
+    int used = grid->cols;
+    while (used > 0 && cells[used - 1] == ' ') {
+      used--;
+    }
+    soft_render_draw_glyphs(sr, cache, x, row_y, cells, used, fg);
+  }
+
+  return drawn;
+}
+
+void soft_render_present(SoftRenderer *sr, SDL_Renderer *renderer) {
+  sr->uploaded_rows = 0;
+
+  //upload each run of dirty rows with a single SDL_UpdateTexture
+  int y = 0;
+  while (y < sr->height) {
+    if (!sr->dirty_rows[y]) {
+      y++;
+      continue;
+    }
+
+    int start = y;
+    while (y < sr->height && sr->dirty_rows[y]) {
+      sr->dirty_rows[y++] = 0;
+    }
+
+    if (sr->texture != NULL) {
+      SDL_Rect rect = {0, start, sr->width, y - start};
+      SDL_UpdateTexture(sr->texture, &rect, sr->pixels + (size_t)start * sr->width,
+                        sr->width * sizeof(Uint32));
+    }
+    sr->uploaded_rows += y - start;
+  }
+
+  if (renderer != NULL && sr->texture != NULL) {
+    SDL_RenderCopy(renderer, sr->texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef SOFT_RENDER_H
+#define SOFT_RENDER_H
+
+#include <SDL2/SDL.h>
+#include "glyph_cache.h"
+#include "term_grid.h"
+
+//software rendering backend
+//text is composited into a framebuffer in cpu memory and only the rows that
+//changed are uploaded to a streaming texture, which is much cheaper than one
+//SDL_RenderCopy per text texture when SDL itself renders in software
+typedef struct {
+  SDL_Texture *texture; //NULL when rendering headless
+  Uint32 *pixels;       //ARGB8888, width * height
+  int width;
+  int height;
+  Uint8 *dirty_rows;    //one flag per pixel row
+  int uploaded_rows;    //rows uploaded by the last present
+} SoftRenderer;
+
+//renderer may be NULL, the framebuffer is then never uploaded anywhere
+SoftRenderer *soft_render_create(SDL_Renderer *renderer, int width, int height);
+void soft_render_destroy(SoftRenderer *sr);
+
+//fills a rectangle with a solid color and marks its rows dirty
+void soft_render_fill(SoftRenderer *sr, int x, int y, int w, int h, SDL_Color color);
+
+//blends glyphs from the cache at x,y, one cell per codepoint
+//returns the x position after the last glyph
+int soft_render_draw_glyphs(SoftRenderer *sr, GlyphCache *cache, int x, int y,
+                            const Uint32 *codepoints, int count, SDL_Color color);
+int soft_render_draw_text(SoftRenderer *sr, GlyphCache *cache, int x, int y,
+                          const char *text, SDL_Color color);
+
+//redraws the dirty rows of a grid with its top left corner at x,y and
+//clears their dirty flags, returns the number of rows drawn
+int soft_render_draw_grid(SoftRenderer *sr, GlyphCache *cache, TermGrid *grid, int x, int y,
+                          SDL_Color fg, SDL_Color bg);
+
+//uploads the dirty rows, copies the texture to the renderer and presents it
+void soft_render_present(SoftRenderer *sr, SDL_Renderer *renderer);
+
+//name of the blend routine picked for this cpu, for diagnostics
+const char *soft_render_blend_name(void);
+
+#endif
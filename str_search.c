@@ -0,0 +1,284 @@
+#include "str_search.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+static const char *search_scalar(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+  const char *end = hay + hay_len - needle_len + 1;
+  for (const char *p = hay; p < end; p++) {
+    p = (const char *)memchr(p, needle[0], end - p);
+    if (p == NULL) {
+      return NULL;
+    }
+    if (memcmp(p, needle, needle_len) == 0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+#ifdef HAVE_X86
+__attribute__((target("sse2")))
+static const char *search_sse2(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+  size_t i = 0;
+
+  //blocks whose last-byte loads stay inside the haystack
+  for (; i + 16 + needle_len - 1 <= hay_len; i += 16) {
+    __m128i block_first = _mm_loadu_si128((const __m128i *)(hay + i));
+    __m128i block_last = _mm_loadu_si128((const __m128i *)(hay + i + needle_len - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                    _mm_cmpeq_epi8(block_last, last)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+        return hay + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return search_scalar(hay + i, hay_len - i, needle, needle_len);
+}
+
+__attribute__((target("avx2")))
+static const char *search_avx2(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+  size_t i = 0;
+
+  for (; i + 32 + needle_len - 1 <= hay_len; i += 32) {
+    __m256i block_first = _mm256_loadu_si256((const __m256i *)(hay + i));
+    __m256i block_last = _mm256_loadu_si256((const __m256i *)(hay + i + needle_len - 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                          _mm256_cmpeq_epi8(block_last, last)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+        return hay + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return search_sse2(hay + i, hay_len - i, needle, needle_len);
+}
+#endif
+
+typedef const char *(*SearchFunc)(const char *, size_t, const char *, size_t);
+
+static SearchFunc pick_search(const char **name) {
+#ifdef HAVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    *name = "avx2";
+    return search_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    *name = "sse2";
+    return search_sse2;
+  }
+#endif
+  *name = "scalar";
+  return search_scalar;
+}
+
+static SearchFunc search_func = NULL;
+static const char *search_name = NULL;
+
+const char *str_search(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+  if (needle_len == 0) {
+    return hay;
+  }
+  if (needle_len > hay_len) {
+    return NULL;
+  }
+  //one byte needles are what memchr is for
+  if (needle_len == 1) {
+    return (const char *)memchr(hay, needle[0], hay_len);
+  }
+
+  if (search_func == NULL) {
+    search_func = pick_search(&search_name);
+  }
+  return search_func(hay, hay_len, needle, needle_len);
+}
+
+const char *str_search_name(void) {
+  if (search_func == NULL) {
+    search_func = pick_search(&search_name);
+  }
+  return search_name;
+}
+
+//how common a byte is in text, source and logs, higher is more common
+static int byte_rank(unsigned char c) {
+  static const char letters[] = "etaoinsrhldcumfpgwybvkxjqz";
+  if (c >= 'a' && c <= 'z') {
+    return 250 - 4 * (int)(strchr(letters, c) - letters);
+  }
+  if (c >= 'A' && c <= 'Z') {
+    return 130 - 2 * (int)(strchr(letters, c - 'A' + 'a') - letters);
+  }
+  if (c >= '0' && c <= '9') {
+    return 190 - (c - '0');
+  }
+  if (c == ' ') {
+    return 255;
+  }
+  if (strchr("\n\t.,:;-_/=\"'()[]", c) != NULL && c != '\0') {
+    return 160;
+  }
+  if (c >= 0x20 && c < 0x7f) {
+    return 60;
+  }
+  return 10;
+}
+
+static unsigned char lower(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? (unsigned char)(c + 32) : c;
+}
+
+static unsigned char upper(unsigned char c) {
+  return c >= 'a' && c <= 'z' ? (unsigned char)(c - 32) : c;
+}
+
+static int matches_at(const StrFinder *f, const char *p) {
+  if (!f->icase) {
+    return memcmp(p, f->needle, f->len) == 0;
+  }
+  for (size_t i = 0; i < f->len; i++) {
+    if (lower((unsigned char)p[i]) != lower((unsigned char)f->needle[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static const char *finder_scalar(const StrFinder *f, const char *hay, size_t hay_len) {
+  unsigned char rare = (unsigned char)f->needle[f->rare1];
+  for (size_t i = 0; i + f->len <= hay_len; i++) {
+    unsigned char c = (unsigned char)hay[i + f->rare1];
+    if ((f->icase ? lower(c) == lower(rare) : c == rare) && matches_at(f, hay + i)) {
+      return hay + i;
+    }
+  }
+  return NULL;
+}
+
+#ifdef HAVE_X86
+__attribute__((target("sse2")))
+static const char *finder_sse2(const StrFinder *f, const char *hay, size_t hay_len) {
+  unsigned char c1 = (unsigned char)f->needle[f->rare1];
+  unsigned char c2 = (unsigned char)f->needle[f->rare2];
+  const __m128i lo1 = _mm_set1_epi8((char)(f->icase ? lower(c1) : c1));
+  const __m128i up1 = _mm_set1_epi8((char)(f->icase ? upper(c1) : c1));
+  const __m128i lo2 = _mm_set1_epi8((char)(f->icase ? lower(c2) : c2));
+  const __m128i up2 = _mm_set1_epi8((char)(f->icase ? upper(c2) : c2));
+  size_t i = 0;
+
+  for (; i + 16 + f->len - 1 <= hay_len; i += 16) {
+    __m128i block1 = _mm_loadu_si128((const __m128i *)(hay + i + f->rare1));
+    __m128i block2 = _mm_loadu_si128((const __m128i *)(hay + i + f->rare2));
+    __m128i eq1 = _mm_or_si128(_mm_cmpeq_epi8(block1, lo1), _mm_cmpeq_epi8(block1, up1));
+    __m128i eq2 = _mm_or_si128(_mm_cmpeq_epi8(block2, lo2), _mm_cmpeq_epi8(block2, up2));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(eq1, eq2));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (matches_at(f, hay + i + bit)) {
+        return hay + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return finder_scalar(f, hay + i, hay_len - i);
+}
+
+__attribute__((target("avx2")))
+static const char *finder_avx2(const StrFinder *f, const char *hay, size_t hay_len) {
+  unsigned char c1 = (unsigned char)f->needle[f->rare1];
+  unsigned char c2 = (unsigned char)f->needle[f->rare2];
+  const __m256i lo1 = _mm256_set1_epi8((char)(f->icase ? lower(c1) : c1));
+  const __m256i up1 = _mm256_set1_epi8((char)(f->icase ? upper(c1) : c1));
+  const __m256i lo2 = _mm256_set1_epi8((char)(f->icase ? lower(c2) : c2));
+  const __m256i up2 = _mm256_set1_epi8((char)(f->icase ? upper(c2) : c2));
+  size_t i = 0;
+
+  for (; i + 32 + f->len - 1 <= hay_len; i += 32) {
+    __m256i block1 = _mm256_loadu_si256((const __m256i *)(hay + i + f->rare1));
+    __m256i block2 = _mm256_loadu_si256((const __m256i *)(hay + i + f->rare2));
+    __m256i eq1 = _mm256_or_si256(_mm256_cmpeq_epi8(block1, lo1), _mm256_cmpeq_epi8(block1, up1));
+    __m256i eq2 = _mm256_or_si256(_mm256_cmpeq_epi8(block2, lo2), _mm256_cmpeq_epi8(block2, up2));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(eq1, eq2));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (matches_at(f, hay + i + bit)) {
+        return hay + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return finder_sse2(f, hay + i, hay_len - i);
+}
+#endif
+
+typedef const char *(*FinderFunc)(const StrFinder *, const char *, size_t);
+
+static FinderFunc finder_func = NULL;
+
+void str_finder_init(StrFinder *f, const char *needle, size_t len, int icase) {
+  //picked here, on the thread preparing the search, not by the threads
+  //running it
+  if (finder_func == NULL) {
+    if (search_func == NULL) {
+      search_func = pick_search(&search_name);
+    }
+    finder_func = finder_scalar;
+#ifdef HAVE_X86
+    finder_func = search_func == search_avx2 ? finder_avx2 : search_func == search_sse2 ? finder_sse2 : finder_scalar;
+#endif
+  }
+  f->needle = needle;
+  f->len = len;
+  f->icase = icase;
+  f->rare1 = 0;
+  f->rare2 = 0;
+  //the rarest byte, then the rarest other byte value, so both compares
+  //filter something
+  for (size_t i = 1; i < len; i++) {
+    if (byte_rank(lower((unsigned char)needle[i])) < byte_rank(lower((unsigned char)needle[f->rare1]))) {
+      f->rare1 = i;
+    }
+  }
+  int best = 1000;
+  for (size_t i = 0; i < len; i++) {
+    int rank = byte_rank(lower((unsigned char)needle[i]));
+    if (i != f->rare1 && needle[i] != needle[f->rare1] && rank < best) {
+      best = rank;
+      f->rare2 = i;
+    }
+  }
+  if (best == 1000) {
+    f->rare2 = len > 1 ? len - 1 : 0;
+  }
+}
+
+const char *str_finder_find(const StrFinder *f, const char *hay, size_t hay_len) {
+  if (f->len == 0) {
+    return hay;
+  }
+  if (f->len > hay_len) {
+    return NULL;
+  }
+  if (f->len == 1 && !f->icase) {
+    return (const char *)memchr(hay, f->needle[0], hay_len);
+  }
+  return finder_func(f, hay, hay_len);
+}
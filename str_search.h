@@ -0,0 +1,36 @@
+#ifndef STR_SEARCH_H
+#define STR_SEARCH_H
+
+#include <stddef.h>
+
+//substring search
+//compares the first and last byte of the needle against 16 or 32 positions
+//of the haystack at once and only runs memcmp where both match, which skips
+//almost every position of normal text
+//never reads outside hay[0, hay_len), so it is safe on mmap'd files
+//returns a pointer to the first match or NULL, an empty needle matches at hay
+const char *str_search(const char *hay, size_t hay_len, const char *needle, size_t needle_len);
+
+//name of the routine picked for this cpu, for benchmarks
+const char *str_search_name(void);
+
+//a needle prepared once for searching many haystacks (grep)
+//the two bytes of it that are rarest in text and logs are compared against
+//16 or 32 positions at once, so a needle starting with "e" or " " does not
+//stop at every word, and only positions where both match are checked in
+//full; icase matches ASCII letters in either case
+//the needle is not copied, it has to outlive the finder
+typedef struct {
+  const char *needle;
+  size_t len;
+  size_t rare1; //offsets of the two rarest bytes, the same for a one byte needle
+  size_t rare2;
+  int icase;
+} StrFinder;
+
+void str_finder_init(StrFinder *f, const char *needle, size_t len, int icase);
+
+//first match in hay[0, hay_len) or NULL, never reads outside it
+const char *str_finder_find(const StrFinder *f, const char *hay, size_t hay_len);
+
+#endif
@@ -0,0 +1,259 @@
+#include "suggest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NODES_INITIAL_SIZE 4096
+#define NO_ENTRY UINT32_MAX
+
+//radix tree, only touched by the helper thread
+
+static const char *label(Suggester *s, const PrefixNode *node) {
+  size_t len;
+  return history_get(s->history, node->entry, &len) + node->start;
+}
+
+static uint32_t new_node(Suggester *s, uint32_t entry, uint32_t start, uint32_t len, unsigned char first) {
+  if (s->node_count == s->node_cap) {
+    uint32_t cap = s->node_cap == 0 ? NODES_INITIAL_SIZE : s->node_cap * 2;
+    PrefixNode *nodes = (PrefixNode *)realloc(s->nodes, cap * sizeof(PrefixNode));
+    if (nodes == NULL) {
+      return 0;
+    }
+    s->nodes = nodes;
+    s->node_cap = cap;
+  }
+  s->nodes[s->node_count] = (PrefixNode){entry, start, len, entry, 0, 0, first};
+  return s->node_count++;
+}
+
+//the link that points at the child starting with byte, or at the child
+//it would go before
+static uint32_t *child_link(Suggester *s, uint32_t node, unsigned char byte) {
+  uint32_t *link = &s->nodes[node].child;
+  while (*link != 0 && s->nodes[*link].first < byte) {
+    link = &s->nodes[*link].sibling;
+  }
+  return link;
+}
+
+//entries go in oldest first, so each one is the newest on its path
+static int insert(Suggester *s, uint32_t entry, const char *text, size_t len) {
+  uint32_t node = 0;
+  size_t pos = 0;
+  s->nodes[0].newest = entry;
+
+  while (pos < len) {
+    unsigned char byte = (unsigned char)text[pos];
+    uint32_t *link = child_link(s, node, byte);
+    uint32_t child = *link;
+
+    if (child == 0 || s->nodes[child].first != byte) {
+      //nothing shares this byte, the rest of the entry is a new leaf
+      uint32_t leaf = new_node(s, entry, (uint32_t)pos, (uint32_t)(len - pos), byte);
+      if (leaf == 0) {
+        return -1;
+      }
+      //new_node may have moved the nodes
+      link = child_link(s, node, byte);
+      s->nodes[leaf].sibling = *link;
+      *link = leaf;
+      return 0;
+    }
+
+    const char *child_label = label(s, &s->nodes[child]);
+    uint32_t child_len = s->nodes[child].len;
+    uint32_t common = 1;
+    while (common < child_len && pos + common < len && child_label[common] == text[pos + common]) {
+      common++;
+    }
+
+    if (common < child_len) {
+      //the entry leaves the label part way, split it there
+      PrefixNode old = s->nodes[child];
+      uint32_t mid = new_node(s, old.entry, old.start, common, old.first);
+      if (mid == 0) {
+        return -1;
+      }
+      link = child_link(s, node, byte);
+      s->nodes[mid].sibling = old.sibling;
+      s->nodes[mid].child = child;
+      s->nodes[mid].newest = entry;
+      s->nodes[child].start += common;
+      s->nodes[child].len -= common;
+      s->nodes[child].first = (unsigned char)child_label[common];
+      s->nodes[child].sibling = 0;
+      *link = mid;
+      child = mid;
+    } else {
+      s->nodes[child].newest = entry;
+    }
+    node = child;
+    pos += common;
+  }
+  return 0;
+}
+
+//newest entry longer than prefix that starts with it
+static uint32_t lookup(Suggester *s, const char *prefix, size_t len) {
+  if (s->node_count == 0) {
+    return NO_ENTRY;
+  }
+  uint32_t node = 0;
+  size_t pos = 0;
+  while (pos < len) {
+    uint32_t child = *child_link(s, node, (unsigned char)prefix[pos]);
+    if (child == 0 || s->nodes[child].first != (unsigned char)prefix[pos]) {
+      return NO_ENTRY;
+    }
+    const char *child_label = label(s, &s->nodes[child]);
+    uint32_t child_len = s->nodes[child].len;
+    uint32_t i = 1;
+    while (i < child_len && pos + i < len) {
+      if (child_label[i] != prefix[pos + i]) {
+        return NO_ENTRY;
+      }
+      i++;
+    }
+    node = child;
+    pos += i;
+    if (i < child_len) {
+      //ends inside the label, everything below is longer
+      return s->nodes[node].newest;
+    }
+  }
+
+  //ends on a node, which may be an entry of exactly that text
+  uint32_t newest = NO_ENTRY;
+  for (uint32_t child = s->nodes[node].child; child != 0; child = s->nodes[child].sibling) {
+    if (newest == NO_ENTRY || s->nodes[child].newest > newest) {
+      newest = s->nodes[child].newest;
+    }
+  }
+  return newest;
+}
+
+//adds entries appended since the last call, by any shell
+static void catch_up(Suggester *s) {
+  if (s->node_count == 0) {
+    return;
+  }
+  history_poll(s->history);
+  size_t count = history_count(s->history);
+  for (; s->indexed < count; s->indexed++) {
+    size_t len;
+    const char *text = history_get(s->history, s->indexed, &len);
+    if (insert(s, (uint32_t)s->indexed, text, len) < 0) {
+      break;
+    }
+  }
+}
+
+static void *suggest_main(void *arg) {
+  Suggester *s = (Suggester *)arg;
+  //the root, without it nothing is indexed or looked up
+  s->history = history_open(s->history_path);
+  if (s->history != NULL) {
+    new_node(s, NO_ENTRY, 0, 0, 0);
+    catch_up(s);
+  }
+
+  char query[SUGGEST_MAX];
+  while (1) {
+    pthread_mutex_lock(&s->lock);
+    while (!s->stop && s->query_gen == s->answer_gen) {
+      pthread_cond_wait(&s->wake, &s->lock);
+    }
+    if (s->stop) {
+      pthread_mutex_unlock(&s->lock);
+      break;
+    }
+    //only the newest request, the ones before it are stale
+    uint64_t gen = s->query_gen;
+    size_t len = s->query_len;
+    memcpy(query, s->query, len);
+    pthread_mutex_unlock(&s->lock);
+
+    uint32_t entry = NO_ENTRY;
+    if (s->history != NULL) {
+      catch_up(s);
+      entry = lookup(s, query, len);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    //typed on while this was looked up, the next request has it
+    if (s->query_gen == gen) {
+      s->answer_len = 0;
+      if (entry != NO_ENTRY) {
+        size_t entry_len;
+        const char *text = history_get(s->history, entry, &entry_len);
+        s->answer_len = entry_len - len < SUGGEST_MAX ? entry_len - len : 0;
+        memcpy(s->answer, text + len, s->answer_len);
+      }
+      s->answer_gen = gen;
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  history_close(s->history);
+  return NULL;
+}
+
+Suggester *suggester_create(const char *history_path) {
+  Suggester *s = (Suggester *)calloc(1, sizeof(Suggester));
+  if (s == NULL) {
+    return NULL;
+  }
+  strncpy(s->history_path, history_path, sizeof(s->history_path) - 1);
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->wake, NULL);
+  if (pthread_create(&s->thread, NULL, suggest_main, s) != 0) {
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    free(s);
+    return NULL;
+  }
+  return s;
+}
+
+void suggester_destroy(Suggester *s) {
+  if (s == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&s->lock);
+  s->stop = 1;
+  pthread_cond_signal(&s->wake);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->thread, NULL);
+
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->wake);
+  free(s->nodes);
+  free(s);
+}
+
+void suggester_request(Suggester *s, uint64_t generation, const char *line, size_t len) {
+  if (len > SUGGEST_MAX) {
+    len = SUGGEST_MAX;
+  }
+  pthread_mutex_lock(&s->lock);
+  memcpy(s->query, line, len);
+  s->query_len = len;
+  s->query_gen = generation;
+  pthread_cond_signal(&s->wake);
+  pthread_mutex_unlock(&s->lock);
+}
+
+int suggester_answer(Suggester *s, uint64_t generation, char *out, size_t cap, size_t *len) {
+  //the helper holds the lock only to copy, never while looking up
+  if (pthread_mutex_trylock(&s->lock) != 0) {
+    return 0;
+  }
+  int ready = s->answer_gen == generation;
+  if (ready) {
+    *len = s->answer_len < cap ? s->answer_len : 0;
+    memcpy(out, s->answer, *len);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return ready;
+}
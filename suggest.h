@@ -0,0 +1,68 @@
+#ifndef SUGGEST_H
+#define SUGGEST_H
+
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "history.h"
+
+#define SUGGEST_MAX 4096  //longest line a suggestion is looked up for
+
+//radix tree node, the label is a slice of a history entry so the tree
+//stores no text of its own
+typedef struct {
+  uint32_t entry;   //entry the label is read from
+  uint32_t start;   //label is bytes [start, start + len) of it
+  uint32_t len;
+  uint32_t newest;  //newest entry at or below this node
+  uint32_t child;   //first child, 0 for none (node 0 is the root)
+  uint32_t sibling; //next child of the parent, in order of first byte
+  unsigned char first; //first byte of the label
+} PrefixNode;
+
+//newest history entry that starts with what has been typed, looked up on
+//a helper thread so typing never waits for it
+//the helper opens the history file itself and follows appends from every
+//shell with history_poll, its radix tree keeps in each node the newest
+//entry below it, so a lookup only walks the typed bytes
+//requests carry a generation, a request that was replaced before the
+//helper got to it is dropped and a stale answer is never handed out
+typedef struct {
+  char history_path[PATH_MAX];
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int stop;
+
+  //latest request, written by the editor
+  char query[SUGGEST_MAX];
+  size_t query_len;
+  uint64_t query_gen;
+
+  //answer to it, written by the helper
+  char answer[SUGGEST_MAX];
+  size_t answer_len;
+  uint64_t answer_gen;
+
+  //owned by the helper thread
+  History *history;
+  PrefixNode *nodes;
+  uint32_t node_count;
+  uint32_t node_cap;
+  size_t indexed;
+} Suggester;
+
+//starts the helper, NULL on error
+Suggester *suggester_create(const char *history_path);
+void suggester_destroy(Suggester *s);
+
+//asks for a suggestion for line, replacing any earlier request
+//generation must grow with every request
+void suggester_request(Suggester *s, uint64_t generation, const char *line, size_t len);
+
+//1 when the answer to request generation is in, the rest of the suggested
+//line goes to out (empty when nothing matched), 0 while it is not
+int suggester_answer(Suggester *s, uint64_t generation, char *out, size_t cap, size_t *len);
+
+#endif
@@ -0,0 +1,200 @@
+#include "term_grid.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TAB_WIDTH 8
+
+//escape sequence parser states
+#define ESC_NONE 0
+#define ESC_START 1 //seen ESC
+#define ESC_CSI 2   //inside ESC [ ... final byte
+#define ESC_OSC 3   //inside ESC ] ... BEL
+
+TermGrid *term_grid_create(int cols, int rows) {
+  TermGrid *grid = (TermGrid *)calloc(1, sizeof(TermGrid));
+  if (grid == NULL) {
+    return NULL;
+  }
+
+  grid->cols = cols;
+  grid->rows = rows;
+  grid->cells = (Uint32 *)malloc((size_t)cols * rows * sizeof(Uint32));
+  grid->dirty = (Uint8 *)malloc(rows);
+  if (grid->cells == NULL || grid->dirty == NULL) {
+    term_grid_destroy(grid);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < (size_t)cols * rows; i++) {
+    grid->cells[i] = ' ';
+  }
+  memset(grid->dirty, 1, rows);
+  return grid;
+}
+
+void term_grid_destroy(TermGrid *grid) {
+  if (grid == NULL) {
+    return;
+  }
+  free(grid->cells);
+  free(grid->dirty);
+  free(grid);
+}
+
+void term_grid_scroll(TermGrid *grid, int n) {
+  if (n <= 0) {
+    return;
+  }
+  if (n > grid->rows) {
+    n = grid->rows;
+  }
+
+  size_t keep = (size_t)(grid->rows - n) * grid->cols;
+  memmove(grid->cells, grid->cells + (size_t)n * grid->cols, keep * sizeof(Uint32));
+  for (size_t i = keep; i < (size_t)grid->rows * grid->cols; i++) {
+    grid->cells[i] = ' ';
+  }
+
+  //dirty flags move with their rows, renderers shift what they already drew
+  //by scrolled lines and only draw the new rows at the bottom
+  memmove(grid->dirty, grid->dirty + n, grid->rows - n);
+  memset(grid->dirty + grid->rows - n, 1, n);
+  grid->scrolled += n;
+}
+
+int term_grid_resize(TermGrid *grid, int cols, int rows) {
+  Uint32 *cells = (Uint32 *)malloc((size_t)cols * rows * sizeof(Uint32));
+  Uint8 *dirty = (Uint8 *)malloc(rows);
+  if (cells == NULL || dirty == NULL) {
+    free(cells);
+    free(dirty);
+    return -1;
+  }
+
+  for (size_t i = 0; i < (size_t)cols * rows; i++) {
+    cells[i] = ' ';
+  }
+
+  //drop lines from the top when the cursor would end up off the grid
+  int shift = grid->cursor_y - (rows - 1);
+  if (shift < 0) {
+    shift = 0;
+  }
+  int copy_rows = grid->rows - shift < rows ? grid->rows - shift : rows;
+  int copy_cols = grid->cols < cols ? grid->cols : cols;
+  for (int row = 0; row < copy_rows; row++) {
+    memcpy(cells + (size_t)row * cols, term_grid_row(grid, row + shift), copy_cols * sizeof(Uint32));
+  }
+
+  free(grid->cells);
+  free(grid->dirty);
+  grid->cells = cells;
+  grid->dirty = dirty;
+  grid->cols = cols;
+  grid->rows = rows;
+  grid->cursor_y -= shift;
+  if (grid->cursor_x > cols) {
+    grid->cursor_x = cols;
+  }
+
+  //the geometry changed, nothing drawn before can be reused
+  memset(grid->dirty, 1, rows);
+  grid->scrolled = 0;
+  return 0;
+}
+
+static void newline(TermGrid *grid) {
+  grid->cursor_x = 0;
+  if (grid->cursor_y + 1 < grid->rows) {
+    grid->cursor_y++;
+  } else {
+    term_grid_scroll(grid, 1);
+  }
+}
+
+static void put_codepoint(TermGrid *grid, Uint32 cp) {
+  switch (cp) {
+    case '\n':
+      newline(grid);
+      return;
+    case '\r':
+      grid->cursor_x = 0;
+      return;
+    case '\t':
+      grid->cursor_x = (grid->cursor_x / TAB_WIDTH + 1) * TAB_WIDTH;
+      if (grid->cursor_x >= grid->cols) {
+        grid->cursor_x = grid->cols - 1;
+      }
+      return;
+    case '\b':
+      if (grid->cursor_x > 0) {
+        grid->cursor_x--;
+      }
+      return;
+  }
+
+  //other control characters are not printable
+  if (cp < 0x20 || cp == 0x7F) {
+    return;
+  }
+
+  if (grid->cursor_x >= grid->cols) {
+    newline(grid);
+  }
+  term_grid_row(grid, grid->cursor_y)[grid->cursor_x++] = cp;
+  grid->dirty[grid->cursor_y] = 1;
+}
+
+void term_grid_feed(TermGrid *grid, const char *bytes, size_t len) {
+  const Uint8 *s = (const Uint8 *)bytes;
+
+  for (size_t i = 0; i < len; i++) {
+    Uint8 c = s[i];
+
+    //escape sequences only change attributes and modes, skip them
+    if (grid->esc_state != ESC_NONE) {
+      if (grid->esc_state == ESC_START) {
+        grid->esc_state = c == '[' ? ESC_CSI : c == ']' ? ESC_OSC : ESC_NONE;
+      } else if (grid->esc_state == ESC_CSI) {
+        if (c >= 0x40 && c <= 0x7E) {
+          grid->esc_state = ESC_NONE;
+        }
+      } else if (c == 0x07 || c == 0x1B) {
+        grid->esc_state = c == 0x1B ? ESC_START : ESC_NONE;
+      }
+      continue;
+    }
+
+    //continuation of a multibyte utf-8 sequence
+    if (grid->utf8_need > 0) {
+      if ((c & 0xC0) == 0x80) {
+        grid->utf8_cp = (grid->utf8_cp << 6) | (c & 0x3F);
+        if (--grid->utf8_need == 0) {
+          put_codepoint(grid, grid->utf8_cp);
+        }
+        continue;
+      }
+      //truncated sequence, show it and handle this byte normally
+      grid->utf8_need = 0;
+      put_codepoint(grid, 0xFFFD);
+    }
+
+    if (c == 0x1B) {
+      grid->esc_state = ESC_START;
+    } else if (c < 0x80) {
+      put_codepoint(grid, c);
+    } else if ((c & 0xE0) == 0xC0) {
+      grid->utf8_cp = c & 0x1F;
+      grid->utf8_need = 1;
+    } else if ((c & 0xF0) == 0xE0) {
+      grid->utf8_cp = c & 0x0F;
+      grid->utf8_need = 2;
+    } else if ((c & 0xF8) == 0xF0) {
+      grid->utf8_cp = c & 0x07;
+      grid->utf8_need = 3;
+    } else {
+      put_codepoint(grid, 0xFFFD);
+    }
+  }
+}
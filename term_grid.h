@@ -0,0 +1,43 @@
+#ifndef TERM_GRID_H
+#define TERM_GRID_H
+
+#include <SDL2/SDL.h>
+#include <stddef.h>
+
+//character grid the output is parsed into
+//each cell holds one codepoint, rows that changed since the last frame are
+//flagged in dirty so renderers only redraw those
+typedef struct {
+  int cols;
+  int rows;
+  Uint32 *cells; //rows * cols codepoints, ' ' when empty
+  Uint8 *dirty;  //one flag per row
+  int cursor_x;
+  int cursor_y;
+  int scrolled;  //lines scrolled since the last frame, reset by renderers
+
+  //parser state carried between feeds
+  Uint32 utf8_cp;
+  int utf8_need;
+  int esc_state;
+} TermGrid;
+
+TermGrid *term_grid_create(int cols, int rows);
+void term_grid_destroy(TermGrid *grid);
+
+//parses output bytes into the grid, sequences may be split across calls
+//handles utf-8, \n \r \t \b and skips escape sequences
+void term_grid_feed(TermGrid *grid, const char *bytes, size_t len);
+
+//moves everything up by n lines, the new lines at the bottom are blank
+void term_grid_scroll(TermGrid *grid, int n);
+
+//changes the size, keeping the text around the cursor
+//returns -1 when out of memory, the grid is unchanged then
+int term_grid_resize(TermGrid *grid, int cols, int rows);
+
+static inline Uint32 *term_grid_row(TermGrid *grid, int row) {
+  return grid->cells + (size_t)row * grid->cols;
+}
+
+#endif
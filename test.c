@@ -8,7 +8,19 @@
 #include <SDL2/SDL_video.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "font_chain.h"
+#include "glyph_cache.h"
+#include "headless.h"
+#include "soft_render.h"
+#include "grid_render.h"
+#include "latency.h"
+#include "font_zoom.h"
+#include "term_grid.h"
 
 //screen changes
 #define SCREEN_WIDTH 680
@@ -18,6 +30,7 @@
 //text changes
 #define TEXT_FONT "/usr/share/fonts/truetype/jetbrains-mono/JetBrainsMono-Regular.ttf"
 #define TEXT_SIZE 12
+#define ZOOM_STEP 2 //points per Ctrl+ / Ctrl-
 #define FONT_COLOR {255,255,255,255} //white
 
 //error macros
@@ -38,53 +51,200 @@ do { \
  } \
 } while(0);
 
-//current y position
-int text_y_pos = 20;
+//margin between the window border and the grid
+#define GRID_MARGIN 10
 
-//store rendered text textures 
-//basically stores all the texts 
-typedef struct {
-  SDL_Texture* texture;
-  SDL_Rect rect;
-} TextLine;
+//everything shown in the window lives in this grid, lines are fed into it
+//and the renderers only redraw the rows it flags as dirty
+TermGrid *term_grid = NULL;
 
-//creates a list for structs for texts
-//may change to a linked list here
-TextLine text_lines[100];
-int text_line_count = 0;
+//fonts load on a background thread, until the primary one is ready the
+//glyph cache draws from the built-in bitmap font
+FontChain *font_chain = NULL;
+GlyphCache *bitmap_cache = NULL;
+GlyphAtlas *bitmap_atlas = NULL;
+
+//font sizes for zooming, owns every cache once the real font is loaded
+FontZoom *font_zoom = NULL;
+
+//cache and atlas being drawn from, owned by font_zoom or the bitmap ones
+GlyphCache *glyph_cache = NULL;
+GlyphAtlas *glyph_atlas = NULL;
+
+//cell size on screen, while a zoom is being rasterized the old glyphs are
+//stretched to the new size so this differs from the cache
+int cell_w = 0;
+int cell_h = 0;
+
+//software backend, only set when SDL renders without a GPU or with --soft
+//glyphs are blended into a cpu framebuffer instead of one texture per line
+SoftRenderer *soft_renderer = NULL;
+
+//gpu backend, keeps the last frame in a render target so scrolling is one copy
+GridRenderer *grid_renderer = NULL;
+
+//keystroke to screen latency, keys read during a frame wait here for the
+//present that shows them
+#define KEY_STAMPS_MAX 64
+LatencyHistogram key_latency;
+uint64_t key_stamps[KEY_STAMPS_MAX];
+int key_stamp_count = 0;
 
 //text display function
-void create_text ( SDL_Renderer *renderer,char *text_value, TTF_Font *font, SDL_Color textColor) {
-  SDL_Surface *textSurface = TTF_RenderText_Solid(font, text_value, textColor);
-  ERROR_CHECK(textSurface,"Failed to create text surface  \n",TTF_ERROR_SHOW)
-
-  //create texture from surface
-  //Surfaces are convereted into textures 
-  //basically textures handle the images using the GPU which is faster
-  SDL_Texture *textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-  ERROR_CHECK(textTexture,"Failed to create text texture  \n",TTF_ERROR_SHOW)
-  
-  // Save the texture and position for later rendering
-  text_lines[text_line_count].texture = textTexture;
-  text_lines[text_line_count].rect = (SDL_Rect){10, text_y_pos, textSurface->w, textSurface->h};
-  text_y_pos += textSurface->h + 10; // Move down for the next line
-  text_line_count++;
-
-  SDL_FreeSurface(textSurface);
-} 
-
-//Render all the stored text lines 
-void render_all_text(SDL_Renderer *renderer) {
-  SDL_SetRenderDrawColor(renderer, BACKGROUND_COLOR);
-  SDL_RenderClear(renderer);
+void create_text ( SDL_Renderer *renderer,char *text_value, SDL_Color textColor) {
+  (void)renderer;
+  (void)textColor;
+  term_grid_feed(term_grid, text_value, strlen(text_value));
+  term_grid_feed(term_grid, "\n", 1);
+}
+
+//Render the rows of the grid that changed since the last frame
+void render_all_text(SDL_Renderer *renderer, SDL_Color textColor) {
+  SDL_Color background = {BACKGROUND_COLOR};
+
+  if (soft_renderer != NULL) {
+    //only the rows touched since the last frame get uploaded
+    soft_render_draw_grid(soft_renderer, glyph_cache, term_grid, GRID_MARGIN, GRID_MARGIN, textColor, background);
+    soft_render_present(soft_renderer, renderer);
+    return;
+  }
+
+  grid_render_frame(grid_renderer, renderer, term_grid, GRID_MARGIN, GRID_MARGIN, textColor, background);
+}
+
+//fits the grid to the window and recreates the backend for it
+//needed whenever the glyph cache or the output size changes
+void relayout_text(SDL_Renderer *renderer) {
+  int output_w, output_h;
+  SDL_GetRendererOutputSize(renderer, &output_w, &output_h);
+
+  int cols = (output_w - 2 * GRID_MARGIN) / cell_w;
+  int rows = (output_h - 2 * GRID_MARGIN) / cell_h;
+  ERROR_CHECK((term_grid_resize(term_grid, cols < 1 ? 1 : cols, rows < 1 ? 1 : rows) == 0),
+              "Failed to resize the grid \n",SDL2_ERROR)
+
+  if (soft_renderer != NULL) {
+    //the framebuffer has to match the new output size
+    soft_render_destroy(soft_renderer);
+    soft_renderer = soft_render_create(renderer, output_w, output_h);
+    ERROR_CHECK(soft_renderer,"Failed to create software renderer \n",SDL2_ERROR)
+
+    SDL_Color background = {BACKGROUND_COLOR};
+    soft_render_fill(soft_renderer, 0, 0, output_w, output_h, background);
+    return;
+  }
+
+  grid_render_destroy(grid_renderer);
+  grid_renderer = grid_render_create(renderer, glyph_atlas, cell_w, cell_h, term_grid->cols, term_grid->rows);
+  ERROR_CHECK(grid_renderer,"Failed to create grid renderer \n",SDL2_ERROR)
+}
 
-  for (int i = 0; i < text_line_count; i++) {
-    SDL_RenderCopy(renderer, text_lines[i].texture, NULL, &text_lines[i].rect);
+//switches to another glyph cache and lays the grid out for its cells
+void use_font(SDL_Renderer *renderer, GlyphCache *cache, GlyphAtlas *atlas) {
+  glyph_cache = cache;
+  glyph_atlas = atlas;
+  cell_w = cache->cell_w;
+  cell_h = cache->cell_h;
+  relayout_text(renderer);
+}
+
+//Ctrl+ / Ctrl- / Ctrl 0
+//sizes seen recently switch at once, new ones are rasterized on a worker
+//thread and meanwhile the old glyphs are drawn stretched
+void zoom_text(SDL_Renderer *renderer, int ptsize) {
+  if (font_zoom->current < 0) {
+    //still on the bitmap font, it only has one size
+    return;
+  }
+
+  ZoomEntry *entry = font_zoom_request(font_zoom, ptsize);
+  if (entry != NULL) {
+    use_font(renderer, entry->cache, entry->atlas);
+    return;
+  }
+
+  //the software backend cannot stretch glyphs, it keeps the old size
+  if (soft_renderer == NULL) {
+    cell_w = glyph_cache->cell_w * font_zoom->wanted / glyph_cache->ptsize;
+    cell_h = glyph_cache->cell_h * font_zoom->wanted / glyph_cache->ptsize;
+    relayout_text(renderer);
   }
-  SDL_RenderPresent(renderer);
+}
+
+//notes when a key was read, past KEY_STAMPS_MAX in one frame they go uncounted
+void stamp_key(void) {
+  if (key_stamp_count < KEY_STAMPS_MAX) {
+    key_stamps[key_stamp_count++] = latency_now();
+  }
+}
+
+//the frame is done, keys it presented are timed, keys that changed
+//nothing have no frame to wait for and are dropped
+void record_keys(bool presented) {
+  if (presented) {
+    uint64_t now = latency_now();
+    for (int i = 0; i < key_stamp_count; i++) {
+      latency_record(&key_latency, now - key_stamps[i]);
+    }
+  }
+  key_stamp_count = 0;
+}
+
+//reads whatever is waiting on stdin into the grid, so output can be piped
+//in (e.g. tail -f log | terrabine-sdl)
+//returns 1 when something was read, 0 when nothing or stdin is closed
+int read_stdin(bool *stdin_open) {
+  char buffer[4096];
+  int got = 0;
+
+  while (*stdin_open) {
+    ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (n > 0) {
+      term_grid_feed(term_grid, buffer, n);
+      got = 1;
+    } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      *stdin_open = false;
+    } else {
+      break;
+    }
+  }
+  return got;
+}
+
+//benchmark mode, no window and no video subsystem
+int run_headless(int argc, char *argv[]) {
+  if (SDL_Init(0) < 0 || TTF_Init() < 0) {
+    printf("Failed to initiatize SDL for headless mode \n");
+    SDL2_ERROR
+    return EXIT_FAILURE;
+  }
+
+  //benchmarks need the real font, so wait for it here
+  FontChain *chain = font_chain_create(TEXT_FONT, TEXT_SIZE);
+  ERROR_CHECK(chain,"Failed to create font chain \n",SDL2_ERROR)
+  ERROR_CHECK((font_chain_start(chain) == 0),"Failed to start font loader \n",SDL2_ERROR)
+  GlyphCache *cache = font_chain_wait_cache(chain);
+  if (cache == NULL) {
+    cache = glyph_cache_create_bitmap();
+  }
+  ERROR_CHECK(cache,"Failed to create glyph cache \n",SDL2_ERROR)
+
+  int status = headless_run(cache, argc, argv);
+
+  glyph_cache_destroy(cache);
+  font_chain_destroy(chain);
+  TTF_Quit();
+  SDL_Quit();
+  return status;
 }
 
 int main(int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0) {
+      return run_headless(argc, argv);
+    }
+  }
+
   //initiatize SDL
   if(SDL_Init(SDL_INIT_VIDEO) < 0) {
     printf("Failed to initiatize the SDL2 library \n");
@@ -119,9 +279,51 @@ int main(int argc, char *argv[]) {
   SDL_SetRenderDrawColor(renderer, BACKGROUND_COLOR); //black background
   SDL_RenderClear(renderer);
 
-  //load font
-  TTF_Font *font = TTF_OpenFont(TEXT_FONT, TEXT_SIZE);
-  ERROR_CHECK(font,"Failed to load font  \n",TTF_ERROR_SHOW)
+  //load fonts in the background, the first frames use the bitmap font
+  font_chain = font_chain_create(TEXT_FONT, TEXT_SIZE);
+  ERROR_CHECK(font_chain,"Failed to create font chain \n",SDL2_ERROR)
+  ERROR_CHECK((font_chain_start(font_chain) == 0),"Failed to start font loader \n",SDL2_ERROR)
+  bitmap_cache = glyph_cache_create_bitmap();
+  ERROR_CHECK(bitmap_cache,"Failed to create glyph cache \n",SDL2_ERROR)
+
+  //use the software backend when SDL has no GPU renderer (e.g. under
+  //SDL_VIDEODRIVER=dummy or offscreen) or when asked for with --soft
+  SDL_RendererInfo renderer_info;
+  bool use_soft = SDL_GetRendererInfo(renderer, &renderer_info) == 0 &&
+                  (renderer_info.flags & SDL_RENDERER_SOFTWARE);
+  const char *latency_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--soft") == 0) {
+      use_soft = true;
+    } else if (strcmp(argv[i], "--latency-out") == 0 && i + 1 < argc) {
+      latency_path = argv[++i];
+    }
+  }
+
+  //the grid is sized to the window by relayout_text
+  term_grid = term_grid_create(1, 1);
+  ERROR_CHECK(term_grid,"Failed to create grid \n",SDL2_ERROR)
+
+  if (use_soft) {
+    soft_renderer = soft_render_create(NULL, 1, 1);
+    ERROR_CHECK(soft_renderer,"Failed to create software renderer \n",SDL2_ERROR)
+  } else {
+    bitmap_atlas = glyph_atlas_create(renderer, bitmap_cache);
+    ERROR_CHECK(bitmap_atlas,"Failed to create glyph atlas \n",SDL2_ERROR)
+  }
+  font_zoom = font_zoom_create(font_chain, use_soft ? NULL : renderer);
+  ERROR_CHECK(font_zoom,"Failed to create font zoom \n",SDL2_ERROR)
+  use_font(renderer, bitmap_cache, bitmap_atlas);
+  if (use_soft) {
+    printf("Software renderer: %dx%d, %s blending \n", soft_renderer->width, soft_renderer->height,
+           soft_render_blend_name());
+  }
+
+  //output piped into the window is shown as it arrives
+  bool stdin_open = !isatty(STDIN_FILENO);
+  if (stdin_open) {
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+  }
 
   //creating a surface with rendered text
   //Surface is basically an image containing the rendered text 
@@ -129,40 +331,132 @@ int main(int argc, char *argv[]) {
   SDL_Color textColor = FONT_COLOR;
 
   //inital Text render
-  create_text(renderer, "Hello World, Welcome to TerraBine", font, textColor);
-  create_text(renderer, "Skibbidi@SigmaLaptop:~$ ", font, textColor);
-  render_all_text(renderer);
+  create_text(renderer, "Hello World, Welcome to TerraBine", textColor);
+  create_text(renderer, "Skibbidi@SigmaLaptop:~$ ", textColor);
+  render_all_text(renderer, textColor);
   
   bool keep_window_open = true;
   while(keep_window_open) {
+    bool redraw = false;
+
+    //swap in the real font once the loader has it, and redraw when a
+    //fallback font arrived for glyphs that were missing
+    GlyphCache *loaded_cache = font_chain_take_cache(font_chain);
+    if (loaded_cache != NULL) {
+      ZoomEntry *entry = font_zoom_adopt(font_zoom, loaded_cache);
+      if (entry != NULL) {
+        use_font(renderer, entry->cache, entry->atlas);
+        glyph_atlas_destroy(bitmap_atlas);
+        glyph_cache_destroy(bitmap_cache);
+        bitmap_atlas = NULL;
+        bitmap_cache = NULL;
+        redraw = true;
+      }
+    } else if (glyph_cache_refresh(glyph_cache)) {
+      relayout_text(renderer);
+      redraw = true;
+    }
+
+    //a zoomed size finished rasterizing on the worker
+    ZoomEntry *zoomed = font_zoom_poll(font_zoom);
+    if (zoomed != NULL) {
+      use_font(renderer, zoomed->cache, zoomed->atlas);
+      redraw = true;
+    }
+
+    if (read_stdin(&stdin_open)) {
+      redraw = true;
+    }
     
     //Gets all the events as a Queue
     SDL_Event e;
-    //takes a event one at a time exits if there are no processes
-    while(SDL_PollEvent(&e) > 0) {
+    //waits a frame for the first event so the loop does not spin, then
+    //takes the rest one at a time
+    int has_event = SDL_WaitEventTimeout(&e, 16);
+    while(has_event > 0) {
 
       switch(e.type) {
         case SDL_QUIT:
           keep_window_open = false;
           break;
+
+        //the render targets lost their contents, draw everything again
+        case SDL_RENDER_TARGETS_RESET:
+          if (grid_renderer != NULL) {
+            grid_render_invalidate(grid_renderer);
+          }
+          redraw = true;
+          break;
           
+        //zoom with Ctrl+ and Ctrl-, Ctrl 0 goes back to the default size
+        case SDL_KEYDOWN:
+          stamp_key();
+          if (e.key.keysym.mod & KMOD_CTRL) {
+            switch (e.key.keysym.sym) {
+              case SDLK_EQUALS:
+              case SDLK_PLUS:
+              case SDLK_KP_PLUS:
+                zoom_text(renderer, font_zoom->wanted + ZOOM_STEP);
+                redraw = true;
+                break;
+              case SDLK_MINUS:
+              case SDLK_KP_MINUS:
+                zoom_text(renderer, font_zoom->wanted - ZOOM_STEP);
+                redraw = true;
+                break;
+              case SDLK_0:
+              case SDLK_KP_0:
+                zoom_text(renderer, TEXT_SIZE);
+                redraw = true;
+                break;
+            }
+          }
+          break;
+
         //checks if the window is resized and then renders all the text
         case SDL_WINDOWEVENT:
           if (e.window.event == SDL_WINDOWEVENT_RESIZED) {
-            render_all_text(renderer); //Redraw all text on resize
+            relayout_text(renderer);
+            redraw = true; //Redraw all text on resize
+          } else if (e.window.event == SDL_WINDOWEVENT_EXPOSED) {
+            redraw = true;
           }
 
           break;
       }
+      has_event = SDL_PollEvent(&e);
     }
+
+    if (redraw) {
+      render_all_text(renderer, textColor);
+    }
+    record_keys(redraw);
   }
 
-  // Cleanup
-  //destroys all stored text
-  for (int i = 0; i < text_line_count; i++) {
-    SDL_DestroyTexture(text_lines[i].texture);
+  //keystroke to screen latency, --latency-out FILE saves it for HdrHistogram tools
+  if (key_latency.total > 0) {
+    printf("Key latency: %llu keys, p50 %.1f us, p99 %.1f us, p99.9 %.1f us \n",
+           (unsigned long long)key_latency.total, latency_percentile(&key_latency, 0.5) / 1e3,
+           latency_percentile(&key_latency, 0.99) / 1e3, latency_percentile(&key_latency, 0.999) / 1e3);
   }
-  TTF_CloseFont(font);
+  if (latency_path != NULL) {
+    int fd = open(latency_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || latency_export(&key_latency, fd) < 0) {
+      perror(latency_path);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  // Cleanup
+  grid_render_destroy(grid_renderer);
+  term_grid_destroy(term_grid);
+  soft_render_destroy(soft_renderer);
+  font_zoom_destroy(font_zoom);
+  glyph_atlas_destroy(bitmap_atlas);
+  glyph_cache_destroy(bitmap_cache);
+  font_chain_destroy(font_chain);
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
   TTF_Quit();
@@ -0,0 +1,254 @@
+#include "thread_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEQUE_INITIAL_SIZE 64
+
+//the deque of the worker running on this thread, -1 elsewhere
+static __thread int worker_index = -1;
+static __thread ThreadPool *worker_pool = NULL;
+
+static int deque_push(TaskDeque *d, Task task) {
+  pthread_mutex_lock(&d->lock);
+  if (d->count == d->cap) {
+    int cap = d->cap == 0 ? DEQUE_INITIAL_SIZE : d->cap * 2;
+    Task *tasks = (Task *)malloc(cap * sizeof(Task));
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&d->lock);
+      return -1;
+    }
+    //unwrap the ring into the new buffer
+    for (int i = 0; i < d->count; i++) {
+      tasks[i] = d->tasks[(d->top + i) % d->cap];
+    }
+    free(d->tasks);
+    d->tasks = tasks;
+    d->cap = cap;
+    d->top = 0;
+  }
+  d->tasks[(d->top + d->count) % d->cap] = task;
+  d->count++;
+  pthread_mutex_unlock(&d->lock);
+  return 0;
+}
+
+//newest task, the owner's end
+static int deque_pop(TaskDeque *d, Task *task) {
+  pthread_mutex_lock(&d->lock);
+  int found = d->count > 0;
+  if (found) {
+    d->count--;
+    *task = d->tasks[(d->top + d->count) % d->cap];
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+//oldest task, the thief's end
+static int deque_steal(TaskDeque *d, Task *task) {
+  if (pthread_mutex_trylock(&d->lock) != 0) {
+    return 0;
+  }
+  int found = d->count > 0;
+  if (found) {
+    *task = d->tasks[d->top];
+    d->top = (d->top + 1) % d->cap;
+    d->count--;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+//own deque first, then every other one starting after it
+static int take_task(ThreadPool *pool, int self, Task *task) {
+  int deques = pool->deque_count;
+  if (self >= 0 && deque_pop(&pool->deques[self], task)) {
+    atomic_fetch_sub(&pool->queued, 1);
+    return 1;
+  }
+  int start = self >= 0 ? self + 1 : 0;
+  for (int i = 0; i < deques; i++) {
+    int victim = (start + i) % deques;
+    if (victim != self && deque_steal(&pool->deques[victim], task)) {
+      atomic_fetch_sub(&pool->queued, 1);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//the count only drops under the group's lock, so a waiter that takes the
+//lock after seeing it reach zero knows no worker will touch the group again
+static void run_task(Task *task) {
+  task->func(task->arg);
+  TaskGroup *group = task->group;
+  if (group != NULL) {
+    pthread_mutex_lock(&group->lock);
+    if (atomic_fetch_sub(&group->pending, 1) == 1) {
+      pthread_cond_broadcast(&group->done);
+    }
+    pthread_mutex_unlock(&group->lock);
+  }
+}
+
+typedef struct {
+  ThreadPool *pool;
+  int index;
+} WorkerStart;
+
+static void *worker_main(void *arg) {
+  WorkerStart *start = (WorkerStart *)arg;
+  ThreadPool *pool = start->pool;
+  worker_index = start->index;
+  worker_pool = pool;
+  free(start);
+
+  while (1) {
+    Task task;
+    if (take_task(pool, worker_index, &task)) {
+      run_task(&task);
+      continue;
+    }
+
+    //nothing anywhere, sleep until a submit
+    pthread_mutex_lock(&pool->idle_lock);
+    while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stop)) {
+      pthread_cond_wait(&pool->work, &pool->idle_lock);
+    }
+    int stop = atomic_load(&pool->stop) && atomic_load(&pool->queued) == 0;
+    pthread_mutex_unlock(&pool->idle_lock);
+    if (stop) {
+      return NULL;
+    }
+  }
+}
+
+ThreadPool *thread_pool_create(int threads) {
+  if (threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int)cpus : 1;
+  }
+
+  ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->threads = (pthread_t *)calloc(threads, sizeof(pthread_t));
+  pool->deques = (TaskDeque *)calloc(threads + 1, sizeof(TaskDeque));
+  if (pool->threads == NULL || pool->deques == NULL) {
+    free(pool->threads);
+    free(pool->deques);
+    free(pool);
+    return NULL;
+  }
+  //fixed before any worker starts, the deques of workers that fail to
+  //start just stay empty
+  pool->deque_count = threads + 1;
+  for (int i = 0; i < pool->deque_count; i++) {
+    pthread_mutex_init(&pool->deques[i].lock, NULL);
+  }
+  pthread_mutex_init(&pool->idle_lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+
+  for (int i = 0; i < threads; i++) {
+    WorkerStart *start = (WorkerStart *)malloc(sizeof(WorkerStart));
+    if (start == NULL) {
+      break;
+    }
+    *start = (WorkerStart){pool, i};
+    if (pthread_create(&pool->threads[i], NULL, worker_main, start) != 0) {
+      free(start);
+      break;
+    }
+    pool->workers++;
+  }
+  if (pool->workers == 0) {
+    thread_pool_destroy(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+void thread_pool_destroy(ThreadPool *pool) {
+  if (pool == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pool->idle_lock);
+  atomic_store(&pool->stop, 1);
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->idle_lock);
+  for (int i = 0; i < pool->workers; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  //threads that failed to start leave deques nobody ran
+  Task task;
+  while (take_task(pool, -1, &task)) {
+    run_task(&task);
+  }
+  for (int i = 0; i < pool->deque_count; i++) {
+    pthread_mutex_destroy(&pool->deques[i].lock);
+    free(pool->deques[i].tasks);
+  }
+  pthread_mutex_destroy(&pool->idle_lock);
+  pthread_cond_destroy(&pool->work);
+  free(pool->deques);
+  free(pool->threads);
+  free(pool);
+}
+
+int thread_pool_submit(ThreadPool *pool, TaskGroup *group, TaskFunc func, void *arg) {
+  //the last deque takes submits from threads outside the pool
+  int index = worker_pool == pool ? worker_index : pool->deque_count - 1;
+
+  if (group != NULL) {
+    atomic_fetch_add(&group->pending, 1);
+  }
+  if (deque_push(&pool->deques[index], (Task){func, arg, group}) < 0) {
+    if (group != NULL) {
+      atomic_fetch_sub(&group->pending, 1);
+    }
+    return -1;
+  }
+  atomic_fetch_add(&pool->queued, 1);
+
+  pthread_mutex_lock(&pool->idle_lock);
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->idle_lock);
+  return 0;
+}
+
+void task_group_init(TaskGroup *group) {
+  atomic_init(&group->pending, 0);
+  pthread_mutex_init(&group->lock, NULL);
+  pthread_cond_init(&group->done, NULL);
+}
+
+void task_group_destroy(TaskGroup *group) {
+  pthread_mutex_destroy(&group->lock);
+  pthread_cond_destroy(&group->done);
+}
+
+void task_group_wait(ThreadPool *pool, TaskGroup *group) {
+  int self = worker_pool == pool ? worker_index : -1;
+  while (atomic_load(&group->pending) > 0) {
+    //help instead of sleeping while there is work
+    Task task;
+    if (take_task(pool, self, &task)) {
+      run_task(&task);
+      continue;
+    }
+
+    pthread_mutex_lock(&group->lock);
+    if (atomic_load(&group->pending) > 0) {
+      pthread_cond_wait(&group->done, &group->lock);
+    }
+    pthread_mutex_unlock(&group->lock);
+  }
+  //the last task to finish may still hold the lock it dropped the count
+  //under
+  pthread_mutex_lock(&group->lock);
+  pthread_mutex_unlock(&group->lock);
+}
@@ -0,0 +1,65 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef void (*TaskFunc)(void *arg);
+
+//tasks that can be waited on together
+typedef struct {
+  atomic_int pending;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+} TaskGroup;
+
+typedef struct {
+  TaskFunc func;
+  void *arg;
+  TaskGroup *group;
+} Task;
+
+//one worker's tasks, the worker takes the newest from the bottom and idle
+//workers steal the oldest from the top
+typedef struct {
+  pthread_mutex_t lock;
+  Task *tasks;  //ring buffer
+  int cap;
+  int top;
+  int count;
+} TaskDeque;
+
+//work stealing thread pool, one worker per core
+//a task submitted from a worker goes to that worker's own deque, so a
+//task that spawns more (a directory walk) keeps its work local until
+//someone runs out and steals it
+typedef struct {
+  pthread_t *threads;
+  TaskDeque *deques;  //one per worker and one more for other threads
+  int deque_count;
+  int workers;        //threads started, to join them
+  atomic_int next;    //deque for the next outside submit
+  atomic_int queued;  //tasks in all deques
+  atomic_int stop;
+  pthread_mutex_t idle_lock;
+  pthread_cond_t work;
+} ThreadPool;
+
+//threads 0 means one per online cpu, NULL on error
+ThreadPool *thread_pool_create(int threads);
+//runs every queued task, then stops the workers
+void thread_pool_destroy(ThreadPool *pool);
+
+//group may be NULL for a task nobody waits on, returns -1 when out of memory
+int thread_pool_submit(ThreadPool *pool, TaskGroup *group, TaskFunc func, void *arg);
+
+void task_group_init(TaskGroup *group);
+void task_group_destroy(TaskGroup *group);
+//runs queued tasks itself until every task of the group is done
+void task_group_wait(ThreadPool *pool, TaskGroup *group);
+
+static inline int task_group_done(TaskGroup *group) {
+  return atomic_load(&group->pending) == 0;
+}
+
+#endif
@@ -0,0 +1,268 @@
+#include "word_count.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+static int is_space(unsigned char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static int is_print(unsigned char c) {
+  return c > ' ' && c < 0x7f;
+}
+
+//the bytes the vector loops leave, carrying whether a word is open
+static void count_scalar(const char *text, size_t len, int in_word, WordCount *count) {
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)text[i];
+    count->lines += c == '\n';
+    if (is_space(c)) {
+      in_word = 0;
+    } else if (is_print(c)) {
+      count->words += !in_word;
+      in_word = 1;
+    }
+  }
+}
+
+//words starting in one 64 byte block: printable bytes that neither follow a
+//printable byte nor a run of other bytes that follows one; adding the seeds
+//to the other bytes' mask carries each seed to the end of its run
+static inline uint64_t block_words(uint64_t spaces, uint64_t printable, uint64_t *in_word) {
+  uint64_t other = ~(spaces | printable);
+  uint64_t seeds = printable << 1 | *in_word;
+  uint64_t sum = other + (seeds & other);
+  uint64_t after_word = (sum ^ other) | seeds;
+  *in_word = printable >> 63 | (other >> 63 & (uint64_t)(sum < other));
+  return printable & ~after_word;
+}
+
+#ifdef HAVE_X86
+__attribute__((target("sse2")))
+static size_t count_sse2(const char *text, size_t len, WordCount *count, int *in_word) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i below_tab = _mm_set1_epi8('\t' - 1);
+  const __m128i above_cr = _mm_set1_epi8('\r' + 1);
+  const __m128i delete = _mm_set1_epi8(0x7f);
+  uint64_t carry = (uint64_t)*in_word;
+  uint64_t lines = 0;
+  uint64_t words = 0;
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64) {
+    uint64_t newlines = 0;
+    uint64_t spaces = 0;
+    uint64_t printable = 0;
+    for (int part = 0; part < 4; part++) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(text + i + 16 * part));
+      //bytes from 0x80 up are negative, so the signed range compares
+      //leave them out as they should
+      __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(block, space),
+                                _mm_and_si128(_mm_cmpgt_epi8(block, below_tab), _mm_cmpgt_epi8(above_cr, block)));
+      __m128i print = _mm_and_si128(_mm_cmpgt_epi8(block, space), _mm_cmpgt_epi8(delete, block));
+      newlines |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)) << (16 * part);
+      spaces |= (uint64_t)(unsigned)_mm_movemask_epi8(ws) << (16 * part);
+      printable |= (uint64_t)(unsigned)_mm_movemask_epi8(print) << (16 * part);
+    }
+    lines += (uint64_t)__builtin_popcountll(newlines);
+    words += (uint64_t)__builtin_popcountll(block_words(spaces, printable, &carry));
+  }
+
+  count->lines += lines;
+  count->words += words;
+  *in_word = (int)carry;
+  return i;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t count_avx2(const char *text, size_t len, WordCount *count, int *in_word) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i below_tab = _mm256_set1_epi8('\t' - 1);
+  const __m256i above_cr = _mm256_set1_epi8('\r' + 1);
+  const __m256i delete = _mm256_set1_epi8(0x7f);
+  uint64_t carry = (uint64_t)*in_word;
+  uint64_t lines = 0;
+  uint64_t words = 0;
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64) {
+    uint64_t newlines = 0;
+    uint64_t spaces = 0;
+    uint64_t printable = 0;
+    for (int half = 0; half < 2; half++) {
+      __m256i block = _mm256_loadu_si256((const __m256i *)(text + i + 32 * half));
+      __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(block, space),
+                                   _mm256_and_si256(_mm256_cmpgt_epi8(block, below_tab), _mm256_cmpgt_epi8(above_cr, block)));
+      __m256i print = _mm256_and_si256(_mm256_cmpgt_epi8(block, space), _mm256_cmpgt_epi8(delete, block));
+      newlines |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)) << (32 * half);
+      spaces |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << (32 * half);
+      printable |= (uint64_t)(uint32_t)_mm256_movemask_epi8(print) << (32 * half);
+    }
+    lines += (uint64_t)_mm_popcnt_u64(newlines);
+    words += (uint64_t)_mm_popcnt_u64(block_words(spaces, printable, &carry));
+  }
+
+  count->lines += lines;
+  count->words += words;
+  *in_word = (int)carry;
+  return i;
+}
+
+//newlines alone: the compares are subtracted into byte counters, which are
+//summed into 64 bit ones with psadbw before they can wrap
+__attribute__((target("sse2")))
+static size_t lines_sse2(const char *text, size_t len, uint64_t *lines) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  __m128i total = _mm_setzero_si128();
+  size_t i = 0;
+  while (i + 16 <= len) {
+    __m128i counts = _mm_setzero_si128();
+    for (int round = 0; round < 255 && i + 16 <= len; round++, i += 16) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(text + i));
+      counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(block, newline));
+    }
+    total = _mm_add_epi64(total, _mm_sad_epu8(counts, _mm_setzero_si128()));
+  }
+  *lines += (uint64_t)_mm_cvtsi128_si64(total) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total));
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t lines_avx2(const char *text, size_t len, uint64_t *lines) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  __m256i total = _mm256_setzero_si256();
+  size_t i = 0;
+  while (i + 64 <= len) {
+    __m256i counts = _mm256_setzero_si256();
+    for (int round = 0; round < 127 && i + 64 <= len; round++, i += 64) {
+      __m256i low = _mm256_loadu_si256((const __m256i *)(text + i));
+      __m256i high = _mm256_loadu_si256((const __m256i *)(text + i + 32));
+      counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(low, newline));
+      counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(high, newline));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+  }
+  __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+  *lines += (uint64_t)_mm_cvtsi128_si64(half) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half));
+  return i;
+}
+#endif
+
+typedef size_t (*CountFunc)(const char *, size_t, WordCount *, int *);
+typedef size_t (*LinesFunc)(const char *, size_t, uint64_t *);
+
+static size_t count_none(const char *text, size_t len, WordCount *count, int *in_word) {
+  (void)text;
+  (void)len;
+  (void)count;
+  (void)in_word;
+  return 0;
+}
+
+static size_t lines_none(const char *text, size_t len, uint64_t *lines) {
+  (void)text;
+  (void)len;
+  (void)lines;
+  return 0;
+}
+
+static CountFunc count_func = NULL;
+static LinesFunc lines_func = NULL;
+static const char *count_name = NULL;
+
+static void pick_count(void) {
+#ifdef HAVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    count_name = "avx2";
+    lines_func = lines_avx2;
+    count_func = count_avx2;
+    return;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    count_name = "sse2";
+    lines_func = lines_sse2;
+    count_func = count_sse2;
+    return;
+  }
+#endif
+  count_name = "scalar";
+  lines_func = lines_none;
+  count_func = count_none;
+}
+
+void word_count(const char *text, size_t len, WordCount *count) {
+  if (count_func == NULL) {
+    pick_count();
+  }
+  memset(count, 0, sizeof(*count));
+  count->bytes = len;
+  count->ends_in_word = -1;
+  //the ends are looked up by hand, they are almost always the first and
+  //last byte
+  size_t first = 0;
+  while (first < len && !is_space((unsigned char)text[first]) && !is_print((unsigned char)text[first])) {
+    first++;
+  }
+  if (first == len) {
+    return;
+  }
+  count->starts_in_word = is_print((unsigned char)text[first]);
+  size_t last = len - 1;
+  while (!is_space((unsigned char)text[last]) && !is_print((unsigned char)text[last])) {
+    last--;
+  }
+  count->ends_in_word = is_print((unsigned char)text[last]);
+  int in_word = 0;
+  size_t done = count_func(text, len, count, &in_word);
+  count_scalar(text + done, len - done, in_word, count);
+}
+
+void word_count_add(WordCount *total, const WordCount *next) {
+  if (next->bytes == 0) {
+    return;
+  }
+  if (total->bytes == 0) {
+    *total = *next;
+    return;
+  }
+  if (total->ends_in_word == -1) {
+    total->starts_in_word = next->starts_in_word;
+  }
+  total->lines += next->lines;
+  total->words += next->words;
+  //the word next starts with was counted in total already
+  if (total->ends_in_word == 1 && next->starts_in_word) {
+    total->words--;
+  }
+  total->bytes += next->bytes;
+  if (next->ends_in_word != -1) {
+    total->ends_in_word = next->ends_in_word;
+  }
+}
+
+void word_count_lines(const char *text, size_t len, WordCount *count) {
+  if (count_func == NULL) {
+    pick_count();
+  }
+  memset(count, 0, sizeof(*count));
+  count->bytes = len;
+  count->ends_in_word = -1;
+  size_t done = lines_func(text, len, &count->lines);
+  for (; done < len; done++) {
+    count->lines += text[done] == '\n';
+  }
+}
+
+const char *word_count_name(void) {
+  if (count_func == NULL) {
+    pick_count();
+  }
+  return count_name;
+}
@@ -0,0 +1,35 @@
+#ifndef WORD_COUNT_H
+#define WORD_COUNT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//lines, words and bytes of a piece of text, words as coreutils wc counts
+//them in the C locale: a word starts at a printable byte after space, \t,
+//\n, \v, \f or \r, and the other bytes (controls, bytes from 0x80 up)
+//neither start nor end one
+//64 bytes at a time: compares give a newline, a space and a printable mask
+//with one bit per byte, the newline bits are popcounted and so are the
+//printable bytes whose last space-or-printable byte before was a space
+typedef struct {
+  uint64_t lines;
+  uint64_t words;
+  uint64_t bytes;
+  int starts_in_word; //the first byte that is a space or printable is printable
+  int ends_in_word;   //the last one is, -1 when there is none
+} WordCount;
+
+//counts text as if a space came before it
+void word_count(const char *text, size_t len, WordCount *count);
+
+//only lines and bytes, for when the words are not wanted
+void word_count_lines(const char *text, size_t len, WordCount *count);
+
+//adds next, the text right after what total counted, to total, a word cut
+//in two by the split is one word
+void word_count_add(WordCount *total, const WordCount *next);
+
+//name of the routine picked for this cpu, for benchmarks
+const char *word_count_name(void);
+
+#endif